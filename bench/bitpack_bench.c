@@ -0,0 +1,98 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+  Times every bit-packing implementation this build and CPU support on chunk section sized arrays.
+  Usage: bitpack_bench [rounds]
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <world/bitpack.h>
+
+#define COUNT 4096 // Blocks in a chunk section.
+#define DEFAULT_ROUNDS 20000
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+static uint64_t rng(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static const struct { enum bitpack_impl impl; const char *name; } impls[] =
+{
+  { BITPACK_IMPL_SCALAR, "scalar" },
+  { BITPACK_IMPL_SSE2, "sse2" },
+  { BITPACK_IMPL_AVX2, "avx2" }
+};
+#define IMPL_COUNT (sizeof(impls) / sizeof(impls[0]))
+
+static volatile uint64_t sink;
+
+int main(int argc, char **argv)
+{
+  unsigned int rounds = (argc > 1) ? (unsigned int) strtoul(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+  if(rounds == 0) rounds = 1;
+
+  static uint16_t values[COUNT];
+  static uint64_t out[COUNT * BITPACK_MAX_BITS / 64];
+
+  printf("ns per section (%u values)\n%4s", COUNT, "bits");
+  for(size_t n = 0; n < IMPL_COUNT; n++) printf(" %10s", impls[n].name);
+  printf("\n");
+
+  for(unsigned int bits = BITPACK_MIN_BITS; bits <= BITPACK_MAX_BITS; bits++)
+  {
+    for(size_t i = 0; i < COUNT; i++) values[i] = (uint16_t) (rng() & ((1U << bits) - 1));
+    printf("%4u", bits);
+    for(size_t n = 0; n < IMPL_COUNT; n++)
+    {
+      if(!bitpack_force_impl(impls[n].impl)) { printf(" %10s", "-"); continue; }
+      for(unsigned int r = 0; r < rounds / 10 + 1; r++) bitpack_pack_be(out, values, COUNT, bits); // Warm up.
+
+      uint64_t t = now_ns();
+      for(unsigned int r = 0; r < rounds; r++)
+      {
+        bitpack_pack_be(out, values, COUNT, bits);
+        sink += out[0];
+      }
+      printf(" %10.1f", (double) (now_ns() - t) / rounds);
+    }
+    printf("\n");
+  }
+  bitpack_force_impl(BITPACK_IMPL_AUTO);
+  return EXIT_SUCCESS;
+}
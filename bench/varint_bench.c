@@ -0,0 +1,166 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+  Times VarInt coding over a palette-sized buffer, comparing the current codec to the byte-at-a-time implementation it replaced.
+  Usage: varint_bench [rounds]
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <mcpr/codec.h>
+
+#define COUNT 4096
+#define DEFAULT_ROUNDS 2000
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+static uint64_t rng(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Kept out of line, as the codec's own functions are called across translation units.
+__attribute__((noinline)) static size_t old_encode_varint(void *output, int32_t value)
+{
+  unsigned char *out = output;
+  size_t i = 0;
+  do
+  {
+    uint8_t tmp = (uint8_t) (value & 0x0000007F);
+    value = ((uint32_t) value) >> 7;
+    if(value != 0) tmp |= 0x80;
+    out[i++] = (unsigned char) tmp;
+  } while(value != 0);
+  return i;
+}
+
+__attribute__((noinline)) static ssize_t old_decode_varint(int32_t *out, const void *in, size_t max_len)
+{
+  size_t i = 0;
+  uint32_t result = 0;
+  uint8_t tmp = 0;
+  do
+  {
+    if(i >= MCPR_VARINT_SIZE_MAX || i >= max_len) return -1;
+    tmp = ((const uint8_t *) in)[i];
+    result |= ((uint32_t) (tmp & 0x7F)) << (7 * i);
+    i++;
+  } while(tmp & 0x80);
+  *out = (int32_t) result;
+  return i;
+}
+
+static volatile int64_t sink;
+
+static void report(const char *name, uint64_t ns, unsigned int rounds)
+{
+  printf("  %-28s %8.2f ns/value\n", name, (double) ns / ((double) rounds * COUNT));
+}
+
+static void run(const char *label, const int32_t *values, unsigned int rounds)
+{
+  static unsigned char buf[COUNT * 5];
+  static int32_t decoded[COUNT];
+  size_t size = mcpr_encode_varints(buf, values, COUNT);
+  for(unsigned int r = 0; r < rounds / 10 + 1; r++) sink += mcpr_decode_varints(decoded, COUNT, buf, size); // Warm up.
+  printf("%s (%.2f bytes/value)\n", label, (double) size / COUNT);
+
+  uint64_t t = now_ns();
+  for(unsigned int r = 0; r < rounds; r++)
+  {
+    unsigned char *out = buf;
+    for(size_t i = 0; i < COUNT; i++) out += old_encode_varint(out, values[i]);
+    sink += out[-1];
+  }
+  report("encode, previous", now_ns() - t, rounds);
+
+  t = now_ns();
+  for(unsigned int r = 0; r < rounds; r++)
+  {
+    unsigned char *out = buf;
+    for(size_t i = 0; i < COUNT; i++) out += mcpr_encode_varint(out, values[i]);
+    sink += out[-1];
+  }
+  report("mcpr_encode_varint", now_ns() - t, rounds);
+
+  t = now_ns();
+  for(unsigned int r = 0; r < rounds; r++) sink += mcpr_encode_varints(buf, values, COUNT);
+  report("mcpr_encode_varints", now_ns() - t, rounds);
+
+  t = now_ns();
+  for(unsigned int r = 0; r < rounds; r++)
+  {
+    size_t read = 0;
+    for(size_t i = 0; i < COUNT; i++) read += old_decode_varint(decoded + i, buf + read, size - read);
+    sink += decoded[COUNT - 1];
+  }
+  report("decode, previous", now_ns() - t, rounds);
+
+  t = now_ns();
+  for(unsigned int r = 0; r < rounds; r++)
+  {
+    size_t read = 0;
+    for(size_t i = 0; i < COUNT; i++) read += mcpr_decode_varint(decoded + i, buf + read, size - read);
+    sink += decoded[COUNT - 1];
+  }
+  report("mcpr_decode_varint", now_ns() - t, rounds);
+
+  t = now_ns();
+  for(unsigned int r = 0; r < rounds; r++)
+  {
+    sink += mcpr_decode_varints(decoded, COUNT, buf, size);
+    sink += decoded[COUNT - 1];
+  }
+  report("mcpr_decode_varints", now_ns() - t, rounds);
+  if(memcmp(decoded, values, sizeof(decoded)) != 0) { fprintf(stderr, "Decoded values differ!\n"); exit(EXIT_FAILURE); }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int rounds = (argc > 1) ? (unsigned int) strtoul(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+  if(rounds == 0) rounds = 1;
+
+  static int32_t values[COUNT];
+  for(size_t i = 0; i < COUNT; i++) values[i] = (int32_t) (rng() % 256); // Block states of a typical section palette.
+  run("Block states below 256", values, rounds);
+
+  for(size_t i = 0; i < COUNT; i++) values[i] = (int32_t) (rng() % 65536);
+  run("Block states below 65536", values, rounds);
+
+  for(size_t i = 0; i < COUNT; i++) values[i] = (int32_t) rng();
+  run("Any 32-bit value", values, rounds);
+  return EXIT_SUCCESS;
+}
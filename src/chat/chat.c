@@ -27,6 +27,7 @@
 
 #include <server.h>
 #include <mcpr/packet.h>
+#include <mcpr/connection.h>
 
 #include <network/player.h>
 #include <network/connection.h>
@@ -76,7 +77,7 @@ bool chat_send(struct connection *conn, struct chat_entry entry)
   pkt.data.play.clientbound.chat_message.json_data = entry.msg;
   pkt.data.play.clientbound.chat_message.position = entry.position;
 
-  if(fwrite(&pkt, sizeof(pkt), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &pkt))
   {
     return false;
   }
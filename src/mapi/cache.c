@@ -0,0 +1,296 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+
+  cache.c - Size bounded TTL cache for Mojang API lookups, internal to mapi.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include <ninuuid/ninuuid.h>
+
+#include "cache.h"
+#include "mapi.h"
+
+// Two fixed size tables, so that a flood of made up names can't make them grow.
+// An entry is looked for in PROBE_LENGTH slots after its hash, when none of them match the least recently used one is replaced.
+// Negative entries remember that a lookup had no result, so that asking for an unknown name again doesn't go to Mojang either.
+
+#define PROBE_LENGTH 8
+#define NAME_CACHE_CAPACITY 4096 // Must be a power of two.
+#define PROFILE_CACHE_CAPACITY 1024 // Must be a power of two.
+#define NAME_KEY_MAX 16 // Longest valid Minecraft username, longer names aren't cached.
+
+#define DEFAULT_TTL 600
+#define DEFAULT_NEGATIVE_TTL 60
+
+struct name_entry
+{
+  char key[NAME_KEY_MAX + 1]; // Lowercase, as usernames are case insensitive.
+  bool used;
+  bool negative;
+  struct ninuuid uuid;
+  uint64_t expires_at;
+  uint64_t used_at;
+};
+
+struct profile_entry
+{
+  struct ninuuid key;
+  bool used;
+  struct mapi_minecraft_has_joined_response *profile; // NULL for negative entries.
+  uint64_t expires_at;
+  uint64_t used_at;
+};
+
+static struct name_entry name_entries[NAME_CACHE_CAPACITY];
+static struct profile_entry profile_entries[PROFILE_CACHE_CAPACITY];
+static struct mapi_cache_stats stats;
+static uint64_t ttl_ns = (uint64_t) DEFAULT_TTL * 1000000000;
+static uint64_t negative_ttl_ns = (uint64_t) DEFAULT_NEGATIVE_TTL * 1000000000;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static size_t hash_bytes(const void *data, size_t len)
+{
+  const unsigned char *bytes = data;
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  for(size_t i = 0; i < len; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return (size_t) hash;
+}
+
+// Returns false if the name is too long to be cached.
+static bool make_name_key(char key[NAME_KEY_MAX + 1], const char *player_name)
+{
+  size_t len = strlen(player_name);
+  if(len > NAME_KEY_MAX) return false;
+  for(size_t i = 0; i < len; i++) key[i] = (char) tolower((unsigned char) player_name[i]);
+  memset(key + len, 0, NAME_KEY_MAX + 1 - len);
+  return true;
+}
+
+static struct name_entry *find_name(const char key[NAME_KEY_MAX + 1])
+{
+  size_t start = hash_bytes(key, NAME_KEY_MAX);
+  for(size_t i = 0; i < PROBE_LENGTH; i++)
+  {
+    struct name_entry *entry = &(name_entries[(start + i) & (NAME_CACHE_CAPACITY - 1)]);
+    if(entry->used && memcmp(entry->key, key, NAME_KEY_MAX) == 0) return entry;
+  }
+  return NULL;
+}
+
+static struct profile_entry *find_profile(const struct ninuuid *key)
+{
+  size_t start = hash_bytes(key->bytes, 16);
+  for(size_t i = 0; i < PROBE_LENGTH; i++)
+  {
+    struct profile_entry *entry = &(profile_entries[(start + i) & (PROFILE_CACHE_CAPACITY - 1)]);
+    if(entry->used && memcmp(entry->key.bytes, key->bytes, 16) == 0) return entry;
+  }
+  return NULL;
+}
+
+enum mapi_cache_result mapi_cache_get_uuid(const char *player_name, struct ninuuid *out)
+{
+  char key[NAME_KEY_MAX + 1];
+  if(!make_name_key(key, player_name)) return MAPI_CACHE_MISS;
+  uint64_t now = now_ns();
+
+  pthread_mutex_lock(&lock);
+  enum mapi_cache_result result = MAPI_CACHE_MISS;
+  struct name_entry *entry = find_name(key);
+  if(entry != NULL && entry->expires_at <= now)
+  {
+    entry->used = false;
+    entry = NULL;
+  }
+  if(entry == NULL)
+  {
+    stats.names.misses++;
+  }
+  else if(entry->negative)
+  {
+    stats.names.negative_hits++;
+    entry->used_at = now;
+    result = MAPI_CACHE_NEGATIVE_HIT;
+  }
+  else
+  {
+    stats.names.hits++;
+    entry->used_at = now;
+    *out = entry->uuid;
+    result = MAPI_CACHE_HIT;
+  }
+  pthread_mutex_unlock(&lock);
+  return result;
+}
+
+void mapi_cache_put_uuid(const char *player_name, const struct ninuuid *uuid)
+{
+  char key[NAME_KEY_MAX + 1];
+  if(!make_name_key(key, player_name)) return;
+  uint64_t now = now_ns();
+  uint64_t ttl = (uuid != NULL) ? ttl_ns : negative_ttl_ns;
+  if(ttl == 0) return;
+
+  pthread_mutex_lock(&lock);
+  struct name_entry *entry = find_name(key);
+  if(entry == NULL)
+  {
+    size_t start = hash_bytes(key, NAME_KEY_MAX);
+    for(size_t i = 0; i < PROBE_LENGTH; i++)
+    {
+      struct name_entry *candidate = &(name_entries[(start + i) & (NAME_CACHE_CAPACITY - 1)]);
+      if(!candidate->used || candidate->expires_at <= now) { entry = candidate; break; }
+      if(entry == NULL || candidate->used_at < entry->used_at) entry = candidate;
+    }
+    if(entry->used && entry->expires_at > now) stats.names.evictions++;
+    memcpy(entry->key, key, NAME_KEY_MAX + 1);
+    entry->used = true;
+  }
+  entry->negative = uuid == NULL;
+  if(uuid != NULL) entry->uuid = *uuid;
+  entry->expires_at = now + ttl;
+  entry->used_at = now;
+  pthread_mutex_unlock(&lock);
+}
+
+enum mapi_cache_result mapi_cache_get_profile(const struct ninuuid *uuid, struct mapi_minecraft_has_joined_response **out)
+{
+  uint64_t now = now_ns();
+
+  pthread_mutex_lock(&lock);
+  enum mapi_cache_result result = MAPI_CACHE_MISS;
+  struct profile_entry *entry = find_profile(uuid);
+  if(entry != NULL && entry->expires_at <= now)
+  {
+    mapi_minecraft_has_joined_response_destroy(entry->profile);
+    entry->profile = NULL;
+    entry->used = false;
+    entry = NULL;
+  }
+  if(entry == NULL)
+  {
+    stats.profiles.misses++;
+  }
+  else if(entry->profile == NULL)
+  {
+    stats.profiles.negative_hits++;
+    entry->used_at = now;
+    result = MAPI_CACHE_NEGATIVE_HIT;
+  }
+  else
+  {
+    // If the copy can't be made the profile is simply fetched again.
+    *out = mapi_minecraft_has_joined_response_copy(entry->profile);
+    if(*out != NULL)
+    {
+      stats.profiles.hits++;
+      entry->used_at = now;
+      result = MAPI_CACHE_HIT;
+    }
+    else stats.profiles.misses++;
+  }
+  pthread_mutex_unlock(&lock);
+  return result;
+}
+
+void mapi_cache_put_profile(const struct ninuuid *uuid, const struct mapi_minecraft_has_joined_response *profile)
+{
+  uint64_t now = now_ns();
+  uint64_t ttl = (profile != NULL) ? ttl_ns : negative_ttl_ns;
+  if(ttl == 0) return;
+
+  // Copied outside of the lock, an entry which can't be copied is just not cached.
+  struct mapi_minecraft_has_joined_response *copy = NULL;
+  if(profile != NULL)
+  {
+    copy = mapi_minecraft_has_joined_response_copy(profile);
+    if(copy == NULL) return;
+  }
+
+  pthread_mutex_lock(&lock);
+  struct profile_entry *entry = find_profile(uuid);
+  if(entry == NULL)
+  {
+    size_t start = hash_bytes(uuid->bytes, 16);
+    for(size_t i = 0; i < PROBE_LENGTH; i++)
+    {
+      struct profile_entry *candidate = &(profile_entries[(start + i) & (PROFILE_CACHE_CAPACITY - 1)]);
+      if(!candidate->used || candidate->expires_at <= now) { entry = candidate; break; }
+      if(entry == NULL || candidate->used_at < entry->used_at) entry = candidate;
+    }
+    if(entry->used && entry->expires_at > now) stats.profiles.evictions++;
+    entry->key = *uuid;
+    entry->used = true;
+  }
+  struct mapi_minecraft_has_joined_response *old = entry->profile;
+  entry->profile = copy;
+  entry->expires_at = now + ttl;
+  entry->used_at = now;
+  pthread_mutex_unlock(&lock);
+
+  if(old != NULL) mapi_minecraft_has_joined_response_destroy(old);
+}
+
+void mapi_get_cache_stats(struct mapi_cache_stats *out)
+{
+  pthread_mutex_lock(&lock);
+  *out = stats;
+  pthread_mutex_unlock(&lock);
+}
+
+void mapi_set_cache_ttl(unsigned int ttl, unsigned int negative_ttl)
+{
+  ttl_ns = (uint64_t) ttl * 1000000000;
+  negative_ttl_ns = (uint64_t) negative_ttl * 1000000000;
+}
+
+void mapi_cache_clear(void)
+{
+  pthread_mutex_lock(&lock);
+  memset(name_entries, 0, sizeof(name_entries));
+  for(size_t i = 0; i < PROFILE_CACHE_CAPACITY; i++)
+  {
+    if(profile_entries[i].profile != NULL) mapi_minecraft_has_joined_response_destroy(profile_entries[i].profile);
+  }
+  memset(profile_entries, 0, sizeof(profile_entries));
+  pthread_mutex_unlock(&lock);
+}
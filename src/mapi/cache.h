@@ -0,0 +1,49 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+
+  cache.h - Size bounded TTL cache for Mojang API lookups, internal to mapi.
+*/
+#ifndef MAPI_CACHE_H
+#define MAPI_CACHE_H
+
+#include <stdbool.h>
+
+#include <ninuuid/ninuuid.h>
+
+#include "mapi.h"
+
+enum mapi_cache_result
+{
+  MAPI_CACHE_MISS,
+  MAPI_CACHE_HIT,
+  MAPI_CACHE_NEGATIVE_HIT, // The lookup is known to have no result.
+};
+
+enum mapi_cache_result mapi_cache_get_uuid(const char *player_name, struct ninuuid *out);
+void mapi_cache_put_uuid(const char *player_name, const struct ninuuid *uuid); // uuid NULL caches that there is no such player.
+
+// Upon a hit, out is set to a copy which should be destroyed by the caller.
+enum mapi_cache_result mapi_cache_get_profile(const struct ninuuid *uuid, struct mapi_minecraft_has_joined_response **out);
+void mapi_cache_put_profile(const struct ninuuid *uuid, const struct mapi_minecraft_has_joined_response *profile); // Copies profile, NULL caches that there is no such profile.
+
+#endif
@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/fcntl.h>
 
 #include <ninerr/ninerr.h>
@@ -40,6 +41,7 @@
 #include <c11threads.h>
 
 #include "mapi.h"
+#include "cache.h"
 #include "util.h"
 
 #ifndef __FILENAME__
@@ -213,7 +215,17 @@ enum mapi_http_method {
   MAPI_HTTP_PUT,
   MAPI_HTTP_DELETE,
 };
+
+// Every thread has a CURL handle per endpoint, see endpoint_handle().
+enum mapi_endpoint
+{
+  MAPI_ENDPOINT_AUTHSERVER,
+  MAPI_ENDPOINT_SESSIONSERVER,
+  MAPI_ENDPOINT_API,
+  MAPI_ENDPOINT_COUNT,
+};
 IGNORE("-Wreturn-type")
+
 const char *mapi_http_method_to_string(enum mapi_http_method method)
 {
   switch(method)
@@ -233,7 +245,7 @@ static size_t mapi_curl_write_callback(void *contents, size_t size, size_t nmemb
 struct mapi_auth_response *json_to_auth_response(json_t *json);
 struct mapi_refresh_response *json_to_refresh_response(json_t *json);
 static int make_authserver_request(json_t **response, const char *endpoint, const char *payload);
-static int mapi_make_api_request(json_t **output, const char *url, enum mapi_http_method http_method, char **headers, size_t header_count, const char *payload);
+static int mapi_make_api_request(json_t **output, enum mapi_endpoint endpoint, const char *url, enum mapi_http_method http_method, char **headers, size_t header_count, const char *payload);
 static struct mapi_err_authserver_err *mapi_err_authserver_err_from_json(json_t *json, int http_code);
 static void mapi_err_authserver_err_free(struct ninerr *err);
 static struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined_response_from_json(json_t *json);
@@ -451,22 +463,39 @@ bool mapi_generate_client_token(char *restrict buf, size_t token_len)
 
 bool mapi_username_to_uuid(struct ninuuid *output, const char *restrict player_name)
 {
+  switch(mapi_cache_get_uuid(player_name, output))
+  {
+    case MAPI_CACHE_HIT: return true;
+    case MAPI_CACHE_NEGATIVE_HIT: ninerr_set_err(ninerr_new("No player found.")); return false;
+    case MAPI_CACHE_MISS: break;
+  }
+
   const char *fmt = "https://api.mojang.com/users/profiles/minecraft/%s";
   char url[strlen(fmt) + strlen(player_name) + 1];
   sprintf(&url[0], fmt, player_name);
   json_t *response;
-  int status = mapi_make_api_request(&response, url, MAPI_HTTP_GET, NULL, 0, NULL);
+  int status = mapi_make_api_request(&response, MAPI_ENDPOINT_API, url, MAPI_HTTP_GET, NULL, 0, NULL);
   if(status < 0) { return false; }
-  if(status == 204) { ninerr_set_err(ninerr_new("No player found.", false)); return false; } // No player found.
+  if(status == 204 || status == 404) // No player found.
+  {
+    json_decref(response);
+    mapi_cache_put_uuid(player_name, NULL);
+    ninerr_set_err(ninerr_new("No player found."));
+    return false;
+  }
+  if(status != 200 || response == NULL) { json_decref(response); ninerr_set_err(ninerr_new("Mojang API responded with HTTP status %i", status)); return false; }
 
+  bool success = false;
   json_t *compressed_uuid_json = json_object_get(response, "id");
-  if(compressed_uuid_json == NULL) { ninerr_set_err(NULL); return false; }
-  const char *compressed_uuid = json_string_value(compressed_uuid_json);
-  if(compressed_uuid == NULL) { ninerr_set_err(NULL); return false; } // Not a string.
-  if(strlen(compressed_uuid) != 32) { ninerr_set_err(NULL); return false; } // UUID is malformed, it is not 32 characters long.
+  const char *compressed_uuid = json_string_value(compressed_uuid_json); // NULL if not present or not a string.
+  if(compressed_uuid == NULL) ninerr_set_err(NULL);
+  else if(strlen(compressed_uuid) != 32) ninerr_set_err(NULL); // UUID is malformed, it is not 32 characters long.
+  else if(!ninuuid_from_string(output, compressed_uuid)) ninerr_set_err(NULL);
+  else success = true;
+  json_decref(response);
 
-  if(!ninuuid_from_string(output, compressed_uuid)) { ninerr_set_err(NULL); return false; }
-  return true;
+  if(success) mapi_cache_put_uuid(player_name, output);
+  return success;
 }
 
 struct mapi_err_authserver_err *mapi_err_authserver_err_new(const char *error, const char *friendly_error_message, const char *cause_message, int http_code)
@@ -523,27 +552,425 @@ struct mapi_err_authserver_err *mapi_err_authserver_err_new(const char *error, c
   return err;
 }
 
+/*
+  Connection reuse.
+
+  Every thread gets its own easy handle per endpoint, created on first use and kept until the thread exits,
+  so that the connection to that endpoint stays open between requests without threads contending for the handle.
+  All handles, including those of asynchronous requests, share one DNS cache, TLS session cache and connection cache.
+*/
+
+struct mapi_thread_handles
+{
+  CURL *handles[MAPI_ENDPOINT_COUNT];
+};
+
+static CURLSH *share = NULL;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+static pthread_key_t thread_handles_key;
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *arg)
+{
+  (void) handle; (void) access; (void) arg;
+  pthread_mutex_lock(&(share_locks[data]));
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *arg)
+{
+  (void) handle; (void) arg;
+  pthread_mutex_unlock(&(share_locks[data]));
+}
+
+static void thread_handles_destroy(void *arg)
+{
+  struct mapi_thread_handles *thread_handles = arg;
+  for(int i = 0; i < MAPI_ENDPOINT_COUNT; i++)
+  {
+    if(thread_handles->handles[i] != NULL) curl_easy_cleanup(thread_handles->handles[i]);
+  }
+  free(thread_handles);
+}
+
+bool mapi_init(void)
+{
+  if(pthread_key_create(&thread_handles_key, thread_handles_destroy) != 0) { ninerr_set_err(ninerr_new("Could not create thread key for CURL handles.")); return false; }
+  for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_init(&(share_locks[i]), NULL);
+
+  share = curl_share_init();
+  if(share == NULL)
+  {
+    for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_destroy(&(share_locks[i]));
+    pthread_key_delete(thread_handles_key);
+    ninerr_set_err(ninerr_new("Could not initialize CURL share handle."));
+    return false;
+  }
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  return true;
+}
+
+void mapi_cleanup(void)
+{
+  if(share == NULL) return;
+  struct mapi_thread_handles *thread_handles = pthread_getspecific(thread_handles_key);
+  if(thread_handles != NULL)
+  {
+    thread_handles_destroy(thread_handles);
+    pthread_setspecific(thread_handles_key, NULL);
+  }
+  pthread_key_delete(thread_handles_key);
+
+  CURLSHcode code = curl_share_cleanup(share);
+  if(code != CURLSHE_OK) DEBUG_PRINT("curl_share_cleanup failed (%s)", curl_share_strerror(code)); // Some thread which made requests is still alive.
+  share = NULL;
+  for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_destroy(&(share_locks[i]));
+}
+
+// Options every request starts out with, as curl_easy_reset() clears them.
+static void setup_handle(CURL *curl)
+{
+  curl_easy_setopt(curl, CURLOPT_SHARE, share);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "MAPI/1.0");
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+}
+
+// Returns the calling thread's handle for endpoint, ready for a new request, or NULL upon error, in which case ninerr will be set.
+static CURL *endpoint_handle(enum mapi_endpoint endpoint)
+{
+  if(share == NULL) { ninerr_set_err(ninerr_new("mapi_init() has not been called.")); return NULL; }
+
+  struct mapi_thread_handles *thread_handles = pthread_getspecific(thread_handles_key);
+  if(thread_handles == NULL)
+  {
+    thread_handles = calloc(1, sizeof(struct mapi_thread_handles));
+    if(thread_handles == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
+    if(pthread_setspecific(thread_handles_key, thread_handles) != 0)
+    {
+      free(thread_handles);
+      ninerr_set_err(ninerr_new("Could not store CURL handles for this thread."));
+      return NULL;
+    }
+  }
+
+  CURL *curl = thread_handles->handles[endpoint];
+  if(curl == NULL)
+  {
+    curl = curl_easy_init();
+    if(curl == NULL) { ninerr_set_err(ninerr_new("Could not initialize CURL.")); return NULL; }
+    thread_handles->handles[endpoint] = curl;
+  }
+  else
+  {
+    curl_easy_reset(curl); // Keeps the open connection and caches, only the options are cleared.
+  }
+  setup_handle(curl);
+  return curl;
+}
+
+
+#define DEFAULT_SESSION_SERVER "https://sessionserver.mojang.com"
+static char *session_server = NULL; // NULL means DEFAULT_SESSION_SERVER.
+
+bool mapi_set_session_server(const char *base_url)
+{
+  char *copy = NULL;
+  if(base_url != NULL)
+  {
+    copy = strdup(base_url);
+    if(copy == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  }
+  free(session_server);
+  session_server = copy;
+  return true;
+}
+
+// Returns a malloc'd URL for the hasJoined endpoint, or NULL upon error.
+static char *has_joined_url(const char *username, const char *server_id_hash)
+{
+  const char *base = (session_server != NULL) ? session_server : DEFAULT_SESSION_SERVER;
+  char *escaped_username = curl_easy_escape(NULL, username, 0);
+  if(escaped_username == NULL) { ninerr_set_err(ninerr_new("Could not escape username.")); return NULL; }
+
+  const char *fmt = "%s/session/minecraft/hasJoined?username=%s&serverId=%s";
+  int len = snprintf(NULL, 0, fmt, base, escaped_username, server_id_hash);
+  char *url = (len < 0) ? NULL : malloc((size_t) len + 1);
+  if(url == NULL) { ninerr_set_err(ninerr_from_errno()); curl_free(escaped_username); return NULL; }
+  sprintf(url, fmt, base, escaped_username, server_id_hash);
+  curl_free(escaped_username);
+  return url;
+}
+
+// Fills both caches, a player who just joined is likely to be looked up again soon.
+static void cache_joined_profile(const struct mapi_minecraft_has_joined_response *response)
+{
+  mapi_cache_put_uuid(response->player_name, &(response->id));
+  mapi_cache_put_profile(&(response->id), response);
+}
+
 struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined(const char *username, const char *server_id_hash, const char *ip)
 {
   DEBUG_PRINT("in mapi_minecraft_has_joined(username = %s, server_id_hash = %s, ip = %s)", username, server_id_hash, ip);
 
-  //const char *fmt = "https://sessionserver.mojang.com/session/minecraft/hasJoined?username=%s&serverId=%s&ip=%s";
-  const char *fmt = "https://sessionserver.mojang.com/session/minecraft/hasJoined?username=%s&serverId=%s";
-  // CURL *curl = curl_easy_init();
-  // if(curl == NULL) { ninerr_set_err(ninerr_new("Could not initialize CURL object.")); return NULL; }
+  char *url = has_joined_url(username, server_id_hash);
+  if(url == NULL) return NULL;
+  json_t *response;
+  int status = mapi_make_api_request(&response, MAPI_ENDPOINT_SESSIONSERVER, url, MAPI_HTTP_GET, NULL, 0, NULL);
+  free(url);
+  if(status < 0) { return NULL; }
+  if(response == NULL) { ninerr_set_err(ninerr_new("Player has not joined with this server id.")); return NULL; }
+
+  struct mapi_minecraft_has_joined_response *result = mapi_minecraft_has_joined_response_from_json(response);
+  json_decref(response);
+  if(result != NULL) cache_joined_profile(result);
+  return result;
+}
+
+void mapi_minecraft_has_joined_response_destroy(struct mapi_minecraft_has_joined_response *response)
+{
+  free(response); // The strings live in the same allocation.
+}
+
+struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined_response_copy(const struct mapi_minecraft_has_joined_response *response)
+{
+  size_t value_len = strlen(response->properties.skin_blob_base64);
+  size_t signature_len = strlen(response->properties.signature);
+  size_t name_len = strlen(response->player_name);
+  struct mapi_minecraft_has_joined_response *copy = malloc(sizeof(struct mapi_minecraft_has_joined_response) + value_len+1 + signature_len+1 + name_len+1);
+  if(copy == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
+
+  char *value_buf = (char *) copy + sizeof(struct mapi_minecraft_has_joined_response);
+  char *signature_buf = value_buf + value_len + 1;
+  char *name_buf = signature_buf + signature_len + 1;
+  memcpy(value_buf, response->properties.skin_blob_base64, value_len + 1);
+  memcpy(signature_buf, response->properties.signature, signature_len + 1);
+  memcpy(name_buf, response->player_name, name_len + 1);
+
+  copy->id = response->id;
+  copy->player_name = name_buf;
+  copy->properties.signature = signature_buf;
+  copy->properties.skin_blob_base64 = value_buf;
+  return copy;
+}
 
+struct mapi_minecraft_has_joined_response *mapi_uuid_to_profile(const struct ninuuid *uuid)
+{
+  struct mapi_minecraft_has_joined_response *result = NULL;
+  switch(mapi_cache_get_profile(uuid, &result))
+  {
+    case MAPI_CACHE_HIT: return result;
+    case MAPI_CACHE_NEGATIVE_HIT: ninerr_set_err(ninerr_new("No player found.")); return NULL;
+    case MAPI_CACHE_MISS: break;
+  }
 
-  // TODO: escape username
-  //char *escaped_username = curl_easy_escape(username, );
-  // curl_easy_cleanup(curl);
+  char compressed_uuid[NINUUID_STRING_SIZE_COMPRESSED + 1];
+  for(int i = 0; i < 16; i++) sprintf(&compressed_uuid[i * 2], "%02x", uuid->bytes[i]);
+
+  const char *base = (session_server != NULL) ? session_server : DEFAULT_SESSION_SERVER;
+  const char *fmt = "%s/session/minecraft/profile/%s?unsigned=false";
+  char url[strlen(fmt) + strlen(base) + NINUUID_STRING_SIZE_COMPRESSED + 1];
+  sprintf(&url[0], fmt, base, compressed_uuid);
 
-  char url[strlen(server_id_hash) + 84 + strlen(username) + strlen(ip) + 1];
-  sprintf(url, fmt, username, server_id_hash, ip);
   json_t *response;
-  int status = mapi_make_api_request(&response, url, MAPI_HTTP_GET, NULL, 0, NULL);
-  if(status < 0) { return false; }
+  int status = mapi_make_api_request(&response, MAPI_ENDPOINT_SESSIONSERVER, url, MAPI_HTTP_GET, NULL, 0, NULL);
+  if(status < 0) { return NULL; }
+  if(status == 204 || status == 404) // No player found.
+  {
+    json_decref(response);
+    mapi_cache_put_profile(uuid, NULL);
+    ninerr_set_err(ninerr_new("No player found."));
+    return NULL;
+  }
+  if(status != 200 || response == NULL) { json_decref(response); ninerr_set_err(ninerr_new("Session server responded with HTTP status %i", status)); return NULL; }
+
+  result = mapi_minecraft_has_joined_response_from_json(response);
+  json_decref(response);
+  if(result != NULL) mapi_cache_put_profile(uuid, result);
+  return result;
+}
 
-  return mapi_minecraft_has_joined_response_from_json(response);
+struct mapi_request
+{
+  CURL *curl;
+  char *url;
+  struct mapi_curl_buffer buf;
+  mapi_has_joined_callback callback;
+  void *arg;
+  struct mapi_request *prev;
+  struct mapi_request *next;
+};
+
+#define IDLE_ASYNC_HANDLES_MAX 8
+
+static CURLM *multi = NULL;
+static struct mapi_request *requests_in_flight = NULL;
+static size_t requests_in_flight_count = 0;
+static CURL *idle_async_handles[IDLE_ASYNC_HANDLES_MAX]; // Handles of finished requests, kept for their open connections.
+static size_t idle_async_handle_count = 0;
+
+bool mapi_async_init(void)
+{
+  multi = curl_multi_init();
+  if(multi == NULL) { ninerr_set_err(ninerr_new("Could not initialize CURL multi handle.")); return false; }
+  return true;
+}
+
+static void request_free(struct mapi_request *request)
+{
+  if(request->curl != NULL)
+  {
+    if(idle_async_handle_count < IDLE_ASYNC_HANDLES_MAX) idle_async_handles[idle_async_handle_count++] = request->curl;
+    else curl_easy_cleanup(request->curl);
+  }
+  free(request->url);
+  free(request->buf.content);
+  free(request);
+}
+
+static void request_unlink(struct mapi_request *request)
+{
+  curl_multi_remove_handle(multi, request->curl);
+  if(request->prev != NULL) request->prev->next = request->next; else requests_in_flight = request->next;
+  if(request->next != NULL) request->next->prev = request->prev;
+  requests_in_flight_count--;
+}
+
+void mapi_async_cleanup(void)
+{
+  if(multi == NULL) return;
+  while(requests_in_flight != NULL)
+  {
+    struct mapi_request *request = requests_in_flight;
+    request_unlink(request);
+    request_free(request);
+  }
+  while(idle_async_handle_count > 0) curl_easy_cleanup(idle_async_handles[--idle_async_handle_count]);
+  curl_multi_cleanup(multi);
+  multi = NULL;
+}
+
+struct mapi_request *mapi_minecraft_has_joined_async(const char *username, const char *server_id_hash, const char *ip, mapi_has_joined_callback callback, void *arg)
+{
+  DEBUG_PRINT("in mapi_minecraft_has_joined_async(username = %s, server_id_hash = %s, ip = %s)", username, server_id_hash, ip);
+
+  struct mapi_request *request = malloc(sizeof(struct mapi_request));
+  if(request == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
+  request->url = NULL;
+  request->buf.content = NULL;
+  request->buf.size = 0;
+  request->callback = callback;
+  request->arg = arg;
+
+  if(idle_async_handle_count > 0)
+  {
+    request->curl = idle_async_handles[--idle_async_handle_count];
+    curl_easy_reset(request->curl);
+  }
+  else
+  {
+    request->curl = curl_easy_init();
+    if(request->curl == NULL) { ninerr_set_err(ninerr_new("Could not initialize CURL.")); free(request); return NULL; }
+  }
+  setup_handle(request->curl);
+  request->url = has_joined_url(username, server_id_hash);
+  if(request->url == NULL) { request_free(request); return NULL; }
+
+  curl_easy_setopt(request->curl, CURLOPT_URL, request->url);
+  curl_easy_setopt(request->curl, CURLOPT_WRITEFUNCTION, mapi_curl_write_callback);
+  curl_easy_setopt(request->curl, CURLOPT_WRITEDATA, &(request->buf));
+  curl_easy_setopt(request->curl, CURLOPT_PRIVATE, request);
+
+  CURLMcode code = curl_multi_add_handle(multi, request->curl);
+  if(code != CURLM_OK)
+  {
+    ninerr_set_err(ninerr_new("Could not add request to CURL multi handle. (%s)", curl_multi_strerror(code)));
+    request_free(request);
+    return NULL;
+  }
+  request->prev = NULL;
+  request->next = requests_in_flight;
+  if(requests_in_flight != NULL) requests_in_flight->prev = request;
+  requests_in_flight = request;
+  requests_in_flight_count++;
+  return request;
+}
+
+void mapi_request_cancel(struct mapi_request *request)
+{
+  request_unlink(request);
+  request_free(request);
+}
+
+static void finish_has_joined(struct mapi_request *request, CURLcode result)
+{
+  if(result != CURLE_OK)
+  {
+    ninerr_set_err(ninerr_new("Could not reach session server (%s)", curl_easy_strerror(result)));
+    request->callback(MAPI_HAS_JOINED_RESULT_ERROR, NULL, request->arg);
+    return;
+  }
+
+  long http_code = 0;
+  curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &http_code);
+  DEBUG_PRINT("Returned HTTP code is %ld", http_code);
+  if(http_code == 204) // The session server's way of saying that the player didn't join using this server id.
+  {
+    request->callback(MAPI_HAS_JOINED_RESULT_FAILED, NULL, request->arg);
+    return;
+  }
+  if(http_code != 200)
+  {
+    ninerr_set_err(ninerr_new("Session server responded with HTTP status %ld", http_code));
+    request->callback(MAPI_HAS_JOINED_RESULT_ERROR, NULL, request->arg);
+    return;
+  }
+
+  json_error_t json_error;
+  json_t *json = json_loadb(request->buf.content, request->buf.size, 0, &json_error);
+  if(json == NULL)
+  {
+    ninerr_set_err(ninerr_new("Error loading JSON. (text: %s, source: %s, line: %d, column: %d, position: %d)", json_error.text, json_error.source, json_error.line, json_error.column, json_error.position));
+    request->callback(MAPI_HAS_JOINED_RESULT_ERROR, NULL, request->arg);
+    return;
+  }
+  struct mapi_minecraft_has_joined_response *response = mapi_minecraft_has_joined_response_from_json(json);
+  json_decref(json);
+  if(response == NULL)
+  {
+    if(ninerr == NULL) ninerr_set_err(ninerr_new("Invalid response from session server."));
+    request->callback(MAPI_HAS_JOINED_RESULT_ERROR, NULL, request->arg);
+    return;
+  }
+  cache_joined_profile(response);
+  request->callback(MAPI_HAS_JOINED_RESULT_SUCCESS, response, request->arg);
+}
+
+size_t mapi_async_perform(void)
+{
+  if(requests_in_flight == NULL) return 0;
+
+  int running;
+  CURLMcode code = curl_multi_perform(multi, &running);
+  if(code != CURLM_OK) DEBUG_PRINT("curl_multi_perform failed (%s)", curl_multi_strerror(code));
+
+  CURLMsg *msg;
+  int msgs_left;
+  while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL)
+  {
+    if(msg->msg != CURLMSG_DONE) continue;
+    struct mapi_request *request;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &request);
+    CURLcode result = msg->data.result;
+
+    // Unlinked before the callback runs, the callback is free to start or cancel other requests.
+    request_unlink(request);
+    finish_has_joined(request, result);
+    request_free(request);
+  }
+  return requests_in_flight_count;
 }
 // Big whitespace to divide actual functions from private helper functions.
 
@@ -602,12 +1029,11 @@ static int make_authserver_request(json_t **response, const char *endpoint, cons
   curl_buf.size = 0;
 
 
-  CURL *curl = curl_easy_init();
+  CURL *curl = endpoint_handle(MAPI_ENDPOINT_AUTHSERVER);
   CURLcode res;
   if(curl == NULL)
   {
     free(curl_buf.content);
-    ninerr_set_err(ninerr_new("Failed to initialize CURL.", false));
     return -1;
   }
 
@@ -618,7 +1044,6 @@ static int make_authserver_request(json_t **response, const char *endpoint, cons
 
   curl_easy_setopt(curl, CURLOPT_URL, url);
   curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-  curl_easy_setopt(curl, CURLOPT_USERAGENT, "MAPI/1.0");
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, mapi_curl_write_callback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &curl_buf);
 
@@ -638,7 +1063,7 @@ static int make_authserver_request(json_t **response, const char *endpoint, cons
       default: ninerr_set_err(NULL); break;
     }
 
-    curl_easy_cleanup(curl);
+    curl_slist_free_all(chunk);
     return -1;
   }
 
@@ -652,7 +1077,7 @@ static int make_authserver_request(json_t **response, const char *endpoint, cons
     {
       free(curl_buf.content);
       ninerr_set_err(NULL);
-      curl_easy_cleanup(curl);
+      curl_slist_free_all(chunk);
       return -1;
     }
 
@@ -660,33 +1085,32 @@ static int make_authserver_request(json_t **response, const char *endpoint, cons
     ninerr_set_err(&(err->super));
     json_decref(error_response);
     free(curl_buf.content);
-    curl_easy_cleanup(curl);
+    curl_slist_free_all(chunk);
     return -1;
   }
 
   json_error_t json_error;
   *response = json_loadb(curl_buf.content, curl_buf.size, 0, &json_error);
-  if(response == NULL)
+  if(*response == NULL)
   {
     free(curl_buf.content);
     ninerr_set_err(NULL);
-    curl_easy_cleanup(curl);
+    curl_slist_free_all(chunk);
     return -1;
   }
 
-  curl_easy_cleanup(curl);
+  curl_slist_free_all(chunk);
   free(curl_buf.content);
   return 0;
 }
 
-static int mapi_make_api_request(json_t **output, const char *url, enum mapi_http_method http_method, char **headers, size_t header_count, const char *payload) {
+static int mapi_make_api_request(json_t **output, enum mapi_endpoint endpoint, const char *url, enum mapi_http_method http_method, char **headers, size_t header_count, const char *payload) {
   DEBUG_PRINT("in mapi_make_api_request(), arguments: url: %s, http_method: %s, header_count: %zu, payload: %s", url, mapi_http_method_to_string(http_method), header_count, payload);
 
-  CURL *curl = curl_easy_init();
-  if(curl == NULL) { ninerr_set_err(ninerr_new("Could not initialize CURL.")); return -1; }
+  CURL *curl = endpoint_handle(endpoint);
+  if(curl == NULL) { return -1; }
 
   curl_easy_setopt(curl, CURLOPT_URL, url);
-  curl_easy_setopt(curl, CURLOPT_USERAGENT, "MAPI/1.0");
 
   struct curl_slist *chunk = NULL;
   if(headers != NULL) {
@@ -708,6 +1132,7 @@ static int mapi_make_api_request(json_t **output, const char *url, enum mapi_htt
   curl_buf.content = malloc(1);
   if(curl_buf.content == NULL) {
     ninerr_set_err(ninerr_from_errno());
+    curl_slist_free_all(chunk);
     return -1;
   }
   curl_buf.size = 0;
@@ -736,6 +1161,7 @@ static int mapi_make_api_request(json_t **output, const char *url, enum mapi_htt
   if(res != CURLE_OK)
   {
     ninerr_set_err(ninerr_new("Could not curl_easy_perform (%s)", curl_easy_strerror(res)));
+    curl_slist_free_all(chunk);
     free(curl_buf.content);
     return -1;
   }
@@ -753,15 +1179,19 @@ static int mapi_make_api_request(json_t **output, const char *url, enum mapi_htt
     tmp[curl_buf.size] = '\0';
     DEBUG_PRINT("Content of curl buf(len = %zu): %s\n", curl_buf.size, tmp);
   #endif
-  *output = json_loadb(curl_buf.content, curl_buf.size, 0, &json_error);
-  if(*output == NULL)
+  if(curl_buf.size == 0) // Such as 204 No Content, which some endpoints use for "not found".
+  {
+    *output = NULL;
+  }
+  else if((*output = json_loadb(curl_buf.content, curl_buf.size, 0, &json_error)) == NULL)
   {
+    curl_slist_free_all(chunk);
     free(curl_buf.content);
     ninerr_set_err(ninerr_new("Error loading JSON. (text: %s, source: %s, line: %d, column: %d, position: %d)", json_error.text, json_error.source, json_error.line, json_error.column, json_error.position));
     return -1;
   }
 
-  curl_easy_cleanup(curl);
+  curl_slist_free_all(chunk);
   free(curl_buf.content);
   if(http_code > INT_MAX) { ninerr_set_err(ninerr_arithmetic_new()); return -1; }
   return (int) http_code;
@@ -1464,8 +1894,8 @@ static struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined_resp
   if(resp == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
 
   char *value_buf = (char *) resp + sizeof(struct mapi_minecraft_has_joined_response);
-  char *signature_buf = (char *) value_buf + value_len;
-  char *name_buf = (char *) signature_buf + signature_len;
+  char *signature_buf = (char *) value_buf + value_len + 1;
+  char *name_buf = (char *) signature_buf + signature_len + 1;
 
   memcpy(value_buf, value, value_len + 1);
   memcpy(signature_buf, signature, signature_len + 1);
@@ -1476,7 +1906,7 @@ static struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined_resp
   resp->properties.skin_blob_base64 = value_buf;
 
   DEBUG_PRINT("id: %s", id);
-  if(!ninuuid_from_string(&(resp->id), id)) { ninerr_set_err(ninerr_new("ninuuid_from_string() failed")); return NULL; }
+  if(!ninuuid_from_string(&(resp->id), id)) { ninerr_set_err(ninerr_new("ninuuid_from_string() failed")); free(resp); return NULL; }
 
   return resp;
 }
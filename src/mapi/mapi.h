@@ -29,6 +29,7 @@
 #define MCPR_MOJANG_API_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <ninuuid/ninuuid.h>
@@ -99,6 +100,7 @@ struct mapi_minecraft_has_joined_response
   } properties;
 };
 void mapi_minecraft_has_joined_response_destroy(struct mapi_minecraft_has_joined_response *response);
+struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined_response_copy(const struct mapi_minecraft_has_joined_response *response); // Returns NULL upon error, will set ninerr.
 
 enum mapi_agent
 {
@@ -186,6 +188,7 @@ bool mapi_generate_client_token(char *restrict buf, size_t token_len);
 
 /**
  * Get the UUID associated with a player name at this point in time.
+ * Answers, including that no such player exists, are cached. See mapi_set_cache_ttl().
  *
  * @note This function does I/O, be aware that this could take some time.
  *
@@ -195,6 +198,44 @@ bool mapi_generate_client_token(char *restrict buf, size_t token_len);
  */
 bool mapi_username_to_uuid(struct ninuuid *out, const char *restrict player_name);
 
+/**
+ * Get the name and skin properties of a player by UUID.
+ * Answers, including that no such player exists, are cached. See mapi_set_cache_ttl().
+ *
+ * Endpoint: /session/minecraft/profile/<uuid> on the session server.
+ * @see http://wiki.vg/Mojang_API#UUID_-.3E_Profile_.2B_Skin.2FCape
+ * @note This function does I/O, be aware that this could take some time.
+ *
+ * @returns The profile, which should be destroyed using mapi_minecraft_has_joined_response_destroy(), or NULL upon error. If an error occurs, ninerr will be set.
+ */
+struct mapi_minecraft_has_joined_response *mapi_uuid_to_profile(const struct ninuuid *uuid);
+
+
+/*
+  Lookup cache.
+
+  Name to UUID and UUID to profile lookups are kept in memory for a while, in tables of a fixed size.
+  Successful hasJoined responses fill both of them, hasJoined itself is never answered from the cache as it is what authenticates a player.
+*/
+
+struct mapi_cache_stats
+{
+  struct
+  {
+    uint64_t hits;
+    uint64_t negative_hits; // Lookups answered with "no such player" from the cache.
+    uint64_t misses;
+    uint64_t evictions;     // Entries dropped before they expired to make room for others.
+  } names, profiles;
+};
+
+void mapi_get_cache_stats(struct mapi_cache_stats *out);
+
+// TTLs in seconds, 0 disables caching of that kind. Defaults are 600 and 60. Not thread safe, meant to be called before any requests are made.
+void mapi_set_cache_ttl(unsigned int ttl, unsigned int negative_ttl);
+
+void mapi_cache_clear(void); // Forgets all entries, but not the stats.
+
 
 struct mapi_err_authserver_err
 {
@@ -207,6 +248,61 @@ struct mapi_err_authserver_err
 struct mapi_err_authserver_err *mapi_err_authserver_err_new(const char *error, const char *friendly_error_message, const char *cause_message, int http_code);
 
 
+/**
+ * Sets up the handles shared by all requests, so that connections, DNS lookups and TLS sessions are reused between them.
+ * Should be called once after curl_global_init() and before any requests are made, from any thread.
+ *
+ * @returns false upon error, will set ninerr.
+ */
+bool mapi_init(void);
+
+// Threads which made requests should have exited by now, the calling thread's handles are cleaned up as well.
+void mapi_cleanup(void);
+
+/**
+ * Sets the base URL of the session server, such as "http://localhost:8080", NULL restores the default (Mojang's).
+ * Not thread safe, meant to be called before any requests are made.
+ *
+ * @returns false upon error, will set ninerr.
+ */
+bool mapi_set_session_server(const char *base_url);
+
 struct mapi_minecraft_has_joined_response *mapi_minecraft_has_joined(const char *username, const char *server_id_hash, const char *ip);
 
+
+/*
+  Asynchronous requests.
+
+  Requests are started right away but only make progress within mapi_async_perform(), which never blocks.
+  All of these functions, and the callbacks, run on the thread which calls mapi_async_perform().
+*/
+
+enum mapi_has_joined_result
+{
+  MAPI_HAS_JOINED_RESULT_SUCCESS,
+  MAPI_HAS_JOINED_RESULT_ERROR,   // ninerr will be set.
+  MAPI_HAS_JOINED_RESULT_FAILED,  // The player did not join with this server id, so the client is not who it claims to be.
+};
+
+// response is only non-NULL upon success, and should be destroyed by the callback.
+typedef void (*mapi_has_joined_callback)(enum mapi_has_joined_result result, struct mapi_minecraft_has_joined_response *response, void *arg);
+
+struct mapi_request;
+
+bool mapi_async_init(void);
+void mapi_async_cleanup(void); // Cancels all requests in flight.
+
+// Makes progress on all requests in flight, calling the callbacks of those which are done. Returns the amount still in flight.
+size_t mapi_async_perform(void);
+
+/**
+ * Asynchronous mapi_minecraft_has_joined().
+ *
+ * @returns A handle which stays valid until the callback has been called, or NULL upon error, in which case ninerr will be set.
+ */
+struct mapi_request *mapi_minecraft_has_joined_async(const char *username, const char *server_id_hash, const char *ip, mapi_has_joined_callback callback, void *arg);
+
+// Cancels a request which is still in flight, its callback won't be called.
+void mapi_request_cancel(struct mapi_request *request);
+
 #endif
@@ -95,7 +95,7 @@ ssize_t mcpr_encode_float(void *out, float f)
 {
   uint32_t netfloat;
   memcpy(&netfloat, &f, 4);
-  netfloat = hton64(netfloat);
+  netfloat = hton32(netfloat);
   memcpy(out, &netfloat, 4);
   return 4;
 }
@@ -135,6 +135,28 @@ ssize_t mcpr_encode_string(void *out, const char *utf8Str)
   return bytes_written;
 }
 
+ssize_t mcpr_encode_string_view(void *out, struct mcpr_string_view view)
+{
+  if(view.len > INT32_MAX) { ninerr_set_err(ninerr_arithmetic_new()); return -1; }
+  size_t bytes_written = mcpr_encode_varint(out, (int32_t) view.len);
+  memcpy(((char *) out) + bytes_written, view.str, view.len);
+  return bytes_written + view.len;
+}
+
+bool mcpr_string_view_equals(struct mcpr_string_view view, const char *str)
+{
+  return strlen(str) == view.len && memcmp(view.str, str, view.len) == 0;
+}
+
+char *mcpr_string_view_dup(struct mcpr_string_view view)
+{
+  char *str = malloc(view.len + 1);
+  if(str == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
+  memcpy(str, view.str, view.len);
+  str[view.len] = '\0';
+  return str;
+}
+
 ssize_t mcpr_encode_chat(void *out, const char *chat)
 {
   return mcpr_encode_string(out, chat);
@@ -143,61 +165,73 @@ ssize_t mcpr_encode_chat(void *out, const char *chat)
 size_t mcpr_encode_varint(void *output, int32_t value)
 {
   unsigned char *out = output;
+  uint32_t v = (uint32_t) value;
+
+  if(likely(v < 0x80)) { out[0] = (unsigned char) v; return 1; } // Packet ids, lengths and most palette entries.
 
   size_t i = 0;
-  do
+  while(v >= 0x80)
   {
-    uint8_t tmp = (uint8_t) (value & 0x0000007F);
-    value = ((uint32_t) value)>>7;
-    if(value != 0)
-    {
-      tmp |= 0x80;
-    }
-
-    out[i] = (unsigned char) tmp;
-
-    i++;
-  } while(value != 0);
-
+    out[i++] = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+  out[i++] = (unsigned char) v;
   return i;
 }
 
+// Every 7 significant bits take a byte, zero still takes one.
 size_t mcpr_varint_bounds(int32_t value)
 {
-  size_t i = 0;
-  do
-  {
-    uint8_t tmp = (uint8_t) (value & 0x0000007F);
-    value = ((uint32_t) value)>>7;
-    if(value != 0)
-    {
-      tmp |= 0x80;
-    }
+  #ifdef __GNUC__
+    unsigned int bits = 32 - (unsigned int) __builtin_clz((uint32_t) value | 1);
+    return (bits + 6) / 7;
+  #else
+    uint32_t v = (uint32_t) value;
+    size_t i = 1;
+    while(v >= 0x80) { v >>= 7; i++; }
+    return i;
+  #endif
+}
 
-    i++;
-  } while(value != 0);
+size_t mcpr_varlong_bounds(int64_t value)
+{
+  #ifdef __GNUC__
+    unsigned int bits = 64 - (unsigned int) __builtin_clzll((uint64_t) value | 1);
+    return (bits + 6) / 7;
+  #else
+    uint64_t v = (uint64_t) value;
+    size_t i = 1;
+    while(v >= 0x80) { v >>= 7; i++; }
+    return i;
+  #endif
+}
 
-  return i;
+size_t mcpr_varints_bounds(const int32_t *values, size_t count)
+{
+  size_t size = 0;
+  for(size_t i = 0; i < count; i++) size += mcpr_varint_bounds(values[i]);
+  return size;
 }
 
-size_t mcpr_encode_varlong(void *output, int64_t value) {
+size_t mcpr_encode_varints(void *output, const int32_t *values, size_t count)
+{
+  unsigned char *out = output;
+  for(size_t i = 0; i < count; i++) out += mcpr_encode_varint(out, values[i]);
+  return out - (unsigned char *) output;
+}
+
+size_t mcpr_encode_varlong(void *output, int64_t value)
+{
   unsigned char *out = output;
+  uint64_t v = (uint64_t) value;
 
   size_t i = 0;
-  do
+  while(v >= 0x80)
   {
-    uint8_t tmp = (uint8_t) (value & 0x0000007F);
-    value = ((uint64_t) value)>>7;
-    if(value != 0)
-    {
-      tmp |= 0x80;
-    }
-
-    out[i] = (unsigned char) tmp;
-
-    i++;
-  } while(value != 0);
-
+    out[i++] = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+  out[i++] = (unsigned char) v;
   return i;
 }
 
@@ -265,13 +299,19 @@ void mcpr_decode_long(int64_t *out, const void *in)
 
 ssize_t mcpr_decode_float(float *out, const void *in)
 {
-  memcpy(out, in, sizeof(float));
+  uint32_t netfloat;
+  memcpy(&netfloat, in, sizeof(netfloat));
+  netfloat = ntoh32(netfloat);
+  memcpy(out, &netfloat, sizeof(float));
   return sizeof(float);
 }
 
 ssize_t mcpr_decode_double(double *out, const void *in)
 {
-  memcpy(out, in, sizeof(double));
+  uint64_t netdouble;
+  memcpy(&netdouble, in, sizeof(netdouble));
+  netdouble = ntoh64(netdouble);
+  memcpy(out, &netdouble, sizeof(double));
   return sizeof(double);
 }
 
@@ -294,70 +334,115 @@ ssize_t mcpr_decode_string(char **out, const void *in, size_t maxlen)
   return final_bytes_read;
 }
 
+ssize_t mcpr_decode_string_view(struct mcpr_string_view *out, const void *in, size_t maxlen)
+{
+  int32_t len;
+  ssize_t bytes_read = mcpr_decode_varint(&len, in, maxlen);
+  if(bytes_read < 0) { return -1; }
+  if(len < 0) { ninerr_set_err(ninerr_new("Invalid string length in mcpr_decode_string_view().")); return -1; }
+  if((size_t) len > maxlen - bytes_read) { ninerr_set_err(ninerr_new("Max decoding length exceeded.")); return -1; }
+
+  out->str = ((const char *) in) + bytes_read;
+  out->len = len;
+  return bytes_read + len;
+}
+
 ssize_t mcpr_decode_chat(char **out, const void *in, size_t maxsize)
 {
   return mcpr_decode_string(out, in, maxsize);
 }
 
-ssize_t mcpr_decode_varint(int32_t *out, const void *in, size_t max_len)
+// One byte of a VarInt or VarLong, returns from the calling function once the last byte has been read.
+#define DECODE_VAR_BYTE(type, i) \
+  byte = in[i]; \
+  result |= (type) (byte & 0x7F) << (7 * (i)); \
+  if(!(byte & 0x80)) { *out = result; return (i) + 1; }
+
+// Only called when all 5 bytes a VarInt can take are readable, so none of the bytes need a bounds check.
+static inline ssize_t decode_varint_unchecked(int32_t *out, const unsigned char *in)
+{
+  uint32_t result = 0;
+  uint8_t byte;
+  DECODE_VAR_BYTE(uint32_t, 0)
+  DECODE_VAR_BYTE(uint32_t, 1)
+  DECODE_VAR_BYTE(uint32_t, 2)
+  DECODE_VAR_BYTE(uint32_t, 3)
+  DECODE_VAR_BYTE(uint32_t, 4)
+  ninerr_set_err(ninerr_new("Varint size exceeded 5 bytes."));
+  return -1;
+}
+
+static inline ssize_t decode_varlong_unchecked(int64_t *out, const unsigned char *in)
+{
+  uint64_t result = 0;
+  uint8_t byte;
+  DECODE_VAR_BYTE(uint64_t, 0)
+  DECODE_VAR_BYTE(uint64_t, 1)
+  DECODE_VAR_BYTE(uint64_t, 2)
+  DECODE_VAR_BYTE(uint64_t, 3)
+  DECODE_VAR_BYTE(uint64_t, 4)
+  DECODE_VAR_BYTE(uint64_t, 5)
+  DECODE_VAR_BYTE(uint64_t, 6)
+  DECODE_VAR_BYTE(uint64_t, 7)
+  DECODE_VAR_BYTE(uint64_t, 8)
+  DECODE_VAR_BYTE(uint64_t, 9)
+  ninerr_set_err(ninerr_new("Varlong size exceeded 10 bytes."));
+  return -1;
+}
+
+ssize_t mcpr_decode_varint(int32_t *out, const void *input, size_t max_len)
+{
+  const unsigned char *in = input;
+  if(likely(max_len >= MCPR_VARINT_SIZE_MAX)) return decode_varint_unchecked(out, in);
+
+  // Near the end of the buffer, every byte has to be checked before it is read.
+  uint32_t result = 0;
+  for(size_t i = 0; i < max_len; i++)
+  {
+    uint8_t byte = in[i];
+    result |= (uint32_t) (byte & 0x7F) << (7 * i);
+    if(!(byte & 0x80)) { *out = (int32_t) result; return i + 1; }
+  }
+  ninerr_set_err(ninerr_new("Exceeded given max length whilst decoding varint."));
+  return -1;
+}
+
+ssize_t mcpr_decode_varlong(int64_t *out, const void *input, size_t max_len)
 {
-  size_t i = 0;
-  int32_t result = 0;
-  uint8_t tmp = 0;
+  const unsigned char *in = input;
+  if(likely(max_len >= MCPR_VARLONG_SIZE_MAX)) return decode_varlong_unchecked(out, in);
 
-  do
+  uint64_t result = 0;
+  for(size_t i = 0; i < max_len; i++)
   {
-    tmp = *((uint8_t *) (in + i));
-    //memcpy(&tmp, in + i, 1);
-
-    uint8_t value = (tmp & 0x7F); // 0x7F == 0b01111111
-    result |= (value << (7 * i));
-
-    i++;
-    if (i > MCPR_VARINT_SIZE_MAX) // VarInt is longer than 5 bytes!
-    {
-      ninerr_set_err(ninerr_new("Varint size exceeded 5 bytes."));
-      return -1;
-    }
-    else if (i > max_len) // Max length exceeded whilst decoding VarInt
-    {
-      ninerr_set_err(ninerr_new("Exceeded given max length whilst decoding varint."));
-      return -1;
-    }
-  } while ((tmp & 0x80) != 0); // 0x80 == 0b10000000
-
-  *out = result;
-  return i;
+    uint8_t byte = in[i];
+    result |= (uint64_t) (byte & 0x7F) << (7 * i);
+    if(!(byte & 0x80)) { *out = (int64_t) result; return i + 1; }
+  }
+  ninerr_set_err(ninerr_new("Exceeded given max length whilst decoding varlong."));
+  return -1;
 }
 
-ssize_t mcpr_decode_varlong(int64_t *out, const void *in, size_t max_len)
+ssize_t mcpr_decode_varints(int32_t *out, size_t count, const void *input, size_t max_len)
 {
+  const unsigned char *in = input;
   size_t i = 0;
-  int64_t result = 0;
-  uint8_t tmp;
+  size_t read = 0;
 
-  do
+  // As long as the next VarInt can't run past the end, skip the bounds checks.
+  for(; i < count && max_len - read >= MCPR_VARINT_SIZE_MAX; i++)
   {
-    memcpy(&tmp, in + i, 1);
-
-    uint8_t value = (tmp & 0x7F); // 0x7F == 0b01111111
-    result |= (value << (7 * i));
-
-    i++;
-    if (i > MCPR_VARLONG_SIZE_MAX) // VarInt is longer than 10 bytes!
-    {
-      ninerr_set_err(ninerr_new("Varlong size exceeded 10 bytes."));
-      return -1;
-    }
-    else if (i > max_len) // Max length exceeded whilst decoding VarInt
-    {
-      ninerr_set_err(ninerr_new("Exceeded given max length whilst decoding varlong."));
-      return -1;
-    }
-  } while ((tmp & 0x80) != 0); // 0x80 == 0b10000000
-
-  *out = result;
-  return i;
+    ssize_t n = decode_varint_unchecked(out + i, in + read);
+    if(n < 0) return -1;
+    read += (size_t) n;
+  }
+  for(; i < count; i++)
+  {
+    ssize_t n = mcpr_decode_varint(out + i, in + read, max_len - read);
+    if(n < 0) return -1;
+    read += (size_t) n;
+  }
+  return read;
 }
 
 void mcpr_decode_position(struct mcpr_position *out, const void *in)
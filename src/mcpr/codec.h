@@ -56,6 +56,30 @@ static const size_t MCPR_VARLONG_SIZE_MAX = 10;
 
 
 size_t mcpr_varint_bounds(int32_t value);
+size_t mcpr_varlong_bounds(int64_t value);
+
+/*
+ * Exact amount of bytes mcpr_encode_varints() writes for these values.
+ */
+size_t mcpr_varints_bounds(const int32_t *values, size_t count);
+
+/*
+ * A borrowed, non-NUL-terminated string pointing into a decode buffer.
+ * Only valid for as long as the buffer it was decoded from.
+ */
+struct mcpr_string_view
+{
+  const char *str;
+  size_t len;
+};
+
+bool mcpr_string_view_equals(struct mcpr_string_view view, const char *str);
+
+/*
+ * Copies a view into a newly malloc'd NUL-terminated string.
+ * Returns NULL and sets ninerr upon error.
+ */
+char *mcpr_string_view_dup(struct mcpr_string_view view);
 
 
 // Encoding/decoding functions return the amount of bytes written for encode, and amount of
@@ -82,6 +106,11 @@ ssize_t mcpr_encode_double  (void *out, double d);     // writes 8 bytes
  */
 ssize_t mcpr_encode_string  (void *out, const char *utf8Str);
 
+/*
+  Same as mcpr_encode_string, make sure the out buffer is (view.len + 5) bytes.
+ */
+ssize_t mcpr_encode_string_view (void *out, struct mcpr_string_view view);
+
 /**
  *  Encode chat.
  *
@@ -100,6 +129,14 @@ ssize_t mcpr_encode_chat  (void *out, const char *in);
 
 size_t mcpr_encode_varint      (void *out, int32_t i);
 size_t mcpr_encode_varlong     (void *out, int64_t i);
+
+/*
+ * Encodes count VarInts back to back, as used for palettes and entity lists.
+ * Make sure out is at least mcpr_varints_bounds(values, count) bytes.
+ *
+ *   @returns the amount of bytes written.
+ */
+size_t mcpr_encode_varints     (void *out, const int32_t *values, size_t count);
 void mcpr_encode_position    (void *out, const struct mcpr_position *in);
 void mcpr_encode_angle       (void *out, uint8_t angle); // Angles start at 0 all the way to 255.
 void mcpr_encode_uuid      (void *out, const struct ninuuid *in);
@@ -205,6 +242,15 @@ ssize_t mcpr_decode_double      (double *out, const void *in);
  */
 ssize_t mcpr_decode_string      (char **out, const void *in, size_t maxlen);
 
+/**
+ * Like mcpr_decode_string, but does not copy; out will point into in.
+ *
+ * @param [out] out View into the input buffer, valid for as long as in is.
+ * @param [in] in Input buffer. Should be at least maxlen bytes long.
+ * @returns The amount of bytes read, or < 0 upon error.
+ */
+ssize_t mcpr_decode_string_view (struct mcpr_string_view *out, const void *in, size_t maxlen);
+
 /**
  * Will decode chat from in.
  *
@@ -231,6 +277,12 @@ ssize_t mcpr_decode_varint      (int32_t *out, const void *in, size_t maxlen);
  * @returns The amount of bytes read, or < 0 upon error.
  */
 ssize_t mcpr_decode_varlong     (int64_t *out, const void *in, size_t maxlen);
+
+/*
+ * Decodes count VarInts laid out back to back into out. Will read no further than maxlen.
+ * @returns The amount of bytes read, or < 0 upon error.
+ */
+ssize_t mcpr_decode_varints     (int32_t *out, size_t count, const void *in, size_t maxlen);
 //int mcpr_decode_chunk_section   (const void *in);
 
 /*
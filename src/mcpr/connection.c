@@ -35,7 +35,13 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <openssl/evp.h>
+#include <zlib.h>
+#include <pthread.h>
+#include <psnip/atomic/atomic.h>
 #include <ninio/ninio.h>
 #include <ninerr/ninerr.h>
 #include <mcpr/mcpr.h>
@@ -47,25 +53,45 @@
 
 #include "internal.h"
 
-#define BLOCK_SIZE EVP_CIPHER_block_size(EVP_aes_128_cfb8())
 #define PKTSTREAM_IOBUF_SIZE (sizeof(struct mcpr_packet))
+#define RECEIVING_BUF_INITIAL_SIZE 16384
+#define RECEIVING_BUF_MIN_SPACE 4096 // Minimum amount of free space to pass to recv()
+#define MAX_PACKET_DATA_LENGTH 2097152 // Largest allowed uncompressed packet.
+#define RECEIVING_BUF_MAX_SIZE (2097151 + 3 + RECEIVING_BUF_MIN_SPACE) // Largest possible packet plus its length prefix
+#define SENDING_BUF_INITIAL_SIZE 4096
+#define FRAME_HEADER_SIZE_MAX (MCPR_VARINT_SIZE_MAX * 2) // Packet length and data length.
+#define OUTGOING_QUEUE_LOW_WATERMARK (256 * 1024) // A congested connection is no longer congested once its queue drains below this.
+#define OUTGOING_QUEUE_HIGH_WATERMARK (1024 * 1024) // A connection is congested once this much is queued.
+#define OUTGOING_QUEUE_MAX_SIZE (8 * 1024 * 1024) // The connection is closed if it would need to queue more than this.
 
 typedef void mcpr_connection;
 
-// TODO COMPRESSION!!!
 struct conn
 {
-  bool is_closed;
+  psnip_atomic_int32 is_closed; // Can be set by both the reading and the writing side.
   FILE *iostream;
+  int fd; // File descriptor of iostream, received data is read directly from it.
   FILE *pktstream;
   enum mcpr_state state;
   bool use_compression;
   unsigned long compression_threshold; // Not guaranteed to be initialized if use_compression is set to false.
+  int compression_level;
+  bool zstreams_initialized;
+  z_stream deflate_stream; // Both streams are reused for every packet, only valid if zstreams_initialized is true.
+  z_stream inflate_stream;
+  struct ninio_buffer compression_buf; // Scratch space for compressing a single packet.
+  struct ninio_buffer decompression_buf; // Scratch space for decompressing a single packet.
   bool use_encryption;
   EVP_CIPHER_CTX *ctx_encrypt;
   EVP_CIPHER_CTX *ctx_decrypt;
   unsigned int reference_count;
-  struct ninio_buffer receiving_buf;
+  struct ninio_buffer receiving_buf; // Everything in here is already decrypted.
+  size_t receiving_buf_offset; // Amount of bytes at the start of receiving_buf which are already consumed.
+  struct ninio_buffer sending_buf; // Outgoing packets are encoded, framed and encrypted in place in here.
+  struct ninio_buffer outgoing_buf; // Encrypted bytes which couldn't be written yet because the socket was full.
+  size_t outgoing_offset; // Amount of bytes at the start of outgoing_buf which are already written.
+  pthread_mutex_t send_lock; // Guards everything used for writing, so that the queue can be flushed from another thread than the one sending.
+  bool congested; // Set once the outgoing queue passes the high watermark, cleared once it drains below the low watermark.
   char *pktstream_iobuf; // malloc'd length: PKTSTREAM_IOBUF_SIZE
   bool (*packet_handler)(const struct mcpr_packet *pkt, mcpr_connection *conn);
 
@@ -78,7 +104,6 @@ struct conn
 static ssize_t mcpr_connection_stream_write(void *cookie, const char *buf, size_t size);
 static ssize_t mcpr_connection_stream_read(void *cookie, char *buf, size_t size);
 static int mcpr_connection_stream_close(void *cookie);
-static bool mcpr_connection_write_packet(mcpr_connection *conn, const struct mcpr_packet *pkt);
 
 enum mcpr_state mcpr_connection_get_state(mcpr_connection *conn)
 {
@@ -93,21 +118,38 @@ FILE *mcpr_connection_get_stream(mcpr_connection *conn)
 void mcpr_connection_close(mcpr_connection *tmpconn, const char *reason)
 {
   struct conn *conn = (struct conn *) tmpconn;
-  if(!conn->is_closed)
+  if(!psnip_atomic_int32_load(&(conn->is_closed)))
   {
     if(conn->state == MCPR_STATE_LOGIN || conn->state == MCPR_STATE_PLAY)
     {
       struct mcpr_packet pkt;
-      pkt.id = MCPR_PKT_PL_CB_DISCONNECT;
-      pkt.state = (conn->state == MCPR_STATE_PLAY) ? MCPR_STATE_PLAY : MCPR_STATE_LOGIN;
+      pkt.state = conn->state;
       IGNORE("-Wdiscarded-qualifiers")
-      pkt.data.play.clientbound.disconnect.reason = (reason != NULL) ? reason : "{\"text\":\"Disconnected by server.\"}";
+      if(conn->state == MCPR_STATE_PLAY)
+      {
+        pkt.id = MCPR_PKT_PL_CB_DISCONNECT;
+        pkt.data.play.clientbound.disconnect.reason = (reason != NULL) ? reason : "{\"text\":\"Disconnected by server.\"}";
+      }
+      else
+      {
+        pkt.id = MCPR_PKT_LG_CB_DISCONNECT;
+        pkt.data.login.clientbound.disconnect.reason = (reason != NULL) ? reason : "{\"text\":\"Disconnected by server.\"}";
+      }
       END_IGNORE()
-      mcpr_connection_write_packet(conn, &pkt);
-      fclose(conn->pktstream);
+      mcpr_connection_send_packet(conn, &pkt);
+      mcpr_connection_flush(conn); // Last chance to get the disconnect message out.
     }
 
-    conn->is_closed = true;
+    psnip_atomic_int32_store(&(conn->is_closed), 1);
+  }
+
+  // Released in every state, and also if the connection was already closed by the reading or writing side.
+  // Closing the packet stream calls back into this function, which has to find the stream gone already.
+  if(conn->pktstream != NULL)
+  {
+    FILE *pktstream = conn->pktstream;
+    conn->pktstream = NULL;
+    fclose(pktstream);
   }
 }
 
@@ -118,30 +160,50 @@ mcpr_connection *mcpr_connection_new(FILE *iostream)
   if(conn == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
 
   conn->iostream = iostream;
+  conn->fd = fileno(iostream);
+  if(conn->fd == -1) { ninerr_set_err(ninerr_from_errno()); free(conn); return NULL; }
   conn->state = MCPR_STATE_HANDSHAKE;
   conn->use_compression = false;
+  conn->compression_level = Z_DEFAULT_COMPRESSION;
+  conn->zstreams_initialized = false;
+  conn->compression_buf.content = NULL;
+  conn->compression_buf.max_size = 0;
+  conn->decompression_buf.content = NULL;
+  conn->decompression_buf.max_size = 0;
   conn->use_encryption = false;
   conn->reference_count = 1;
 
   conn->ctx_encrypt = NULL;
   conn->ctx_decrypt = NULL;
 
-  conn->receiving_buf.content = malloc(256 * BLOCK_SIZE);
+  conn->receiving_buf.content = malloc(RECEIVING_BUF_INITIAL_SIZE);
   if(conn->receiving_buf.content == NULL) { ninerr_set_err(ninerr_from_errno()); free(conn); return NULL; }
-  conn->receiving_buf.max_size = 256 * BLOCK_SIZE;
+  conn->receiving_buf.max_size = RECEIVING_BUF_INITIAL_SIZE;
   conn->receiving_buf.size = 0;
+  conn->receiving_buf_offset = 0;
+
+  conn->sending_buf.content = malloc(SENDING_BUF_INITIAL_SIZE);
+  if(conn->sending_buf.content == NULL) { ninerr_set_err(ninerr_from_errno()); free(conn->receiving_buf.content); free(conn); return NULL; }
+  conn->sending_buf.max_size = SENDING_BUF_INITIAL_SIZE;
+  conn->sending_buf.size = 0;
+  conn->outgoing_buf.content = NULL;
+  conn->outgoing_buf.max_size = 0;
+  conn->outgoing_buf.size = 0;
+  conn->outgoing_offset = 0;
+  conn->congested = false;
 
   conn->pktstream_iobuf = malloc(PKTSTREAM_IOBUF_SIZE);
   if(conn->pktstream_iobuf == NULL)
   {
     ninerr_set_err(ninerr_from_errno());
     free(conn->receiving_buf.content);
+    free(conn->sending_buf.content);
     free(conn);
     return NULL;
   }
 
   conn->packet_handler = NULL;
-  conn->is_closed = false;
+  psnip_atomic_int32_store(&(conn->is_closed), 0);
 
   cookie_io_functions_t functions = {
     .read = mcpr_connection_stream_read,
@@ -150,18 +212,38 @@ mcpr_connection *mcpr_connection_new(FILE *iostream)
     .close = mcpr_connection_stream_close,
   };
   FILE *pktstream = fopencookie(conn, "r+", functions);
-  if(pktstream == NULL) { ninerr_set_err(NULL); free(conn); return NULL; }
+  if(pktstream == NULL)
+  {
+    ninerr_set_err(NULL);
+    free(conn->receiving_buf.content);
+    free(conn->sending_buf.content);
+    free(conn->pktstream_iobuf);
+    free(conn);
+    return NULL;
+  }
   if(setvbuf(pktstream, conn->pktstream_iobuf, _IOFBF, PKTSTREAM_IOBUF_SIZE) != 0)
   {
     ninerr_set_err(ninerr_from_errno());
     fclose(pktstream);
     free(conn->receiving_buf.content);
+    free(conn->sending_buf.content);
     free(conn->pktstream_iobuf);
     free(conn);
     return NULL;
   }
   conn->pktstream = pktstream;
 
+  if(pthread_mutex_init(&(conn->send_lock), NULL) != 0)
+  {
+    ninerr_set_err(ninerr_new("Could not initialize send lock."));
+    fclose(pktstream);
+    free(conn->receiving_buf.content);
+    free(conn->sending_buf.content);
+    free(conn->pktstream_iobuf);
+    free(conn);
+    return NULL;
+  }
+
   return conn;
 }
 
@@ -171,178 +253,484 @@ void mcpr_connection_free(mcpr_connection *tmpconn)
   mcpr_connection_close(conn, NULL);
   EVP_CIPHER_CTX_free(conn->ctx_encrypt);
   EVP_CIPHER_CTX_free(conn->ctx_decrypt);
+  if(conn->zstreams_initialized)
+  {
+    deflateEnd(&(conn->deflate_stream));
+    inflateEnd(&(conn->inflate_stream));
+  }
+  free(conn->compression_buf.content);
+  free(conn->decompression_buf.content);
   free(conn->receiving_buf.content);
+  free(conn->sending_buf.content);
+  free(conn->outgoing_buf.content);
   free(conn->pktstream_iobuf);
+  pthread_mutex_destroy(&(conn->send_lock));
   free(conn);
 }
 
-void mcpr_connection_set_use_encryption(mcpr_connection *conn, bool value)
+static bool ensure_buffer_size(struct ninio_buffer *buf, size_t size)
 {
-  ((struct conn *) conn)->use_encryption = value;
+  if(buf->max_size >= size) return true;
+  void *tmp = realloc(buf->content, size);
+  if(tmp == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  buf->content = tmp;
+  buf->max_size = size;
+  return true;
 }
 
-// TODO BLOCK_SIZE is apparentely only 1, horribly inefficient
+// Decompresses the packet data in a compressed frame into out, returns the size of the packet data or -1 on error.
+static ssize_t decompress_frame(struct conn *conn, struct ninio_buffer *out, const void *in, size_t in_size, int32_t data_length)
+{
+  if(data_length <= 0 || data_length > MAX_PACKET_DATA_LENGTH) { ninerr_set_err(ninerr_new("Invalid data length in compressed packet.")); return -1; }
+  if(!ensure_buffer_size(out, (size_t) data_length)) return -1;
+
+  z_stream *strm = &(conn->inflate_stream);
+  if(inflateReset(strm) != Z_OK) { ninerr_set_err(ninerr_new("inflateReset failed.")); return -1; }
+  IGNORE("-Wcast-qual")
+  strm->next_in = (Bytef *) in;
+  END_IGNORE()
+  strm->avail_in = (uInt) in_size;
+  strm->next_out = (Bytef *) out->content;
+  strm->avail_out = (uInt) data_length;
+  int result = inflate(strm, Z_FINISH);
+  if(result != Z_STREAM_END || strm->total_out != (uLong) data_length)
+  {
+    ninerr_set_err(ninerr_new("Could not decompress packet. (zlib error %i)", result));
+    return -1;
+  }
+  out->size = (size_t) data_length;
+  return data_length;
+}
+
+void mcpr_connection_set_use_encryption(mcpr_connection *tmpconn, bool value)
+{
+  struct conn *conn = (struct conn *) tmpconn;
+  if(value && !conn->use_encryption)
+  {
+    // Anything which was received after the packet which enabled encryption is still encrypted.
+    size_t pending = conn->receiving_buf.size - conn->receiving_buf_offset;
+    if(pending > 0)
+    {
+      void *start = conn->receiving_buf.content + conn->receiving_buf_offset;
+      if(mcpr_crypto_decrypt_inplace(start, conn->ctx_decrypt, pending) == -1)
+      {
+        DEBUG_PRINT("Could not decrypt already received data. Closing.");
+        psnip_atomic_int32_store(&(conn->is_closed), 1);
+      }
+    }
+  }
+  conn->use_encryption = value;
+}
+
+// Reads everything the socket has available straight into the receiving buffer, decrypting it in place.
 static bool update_receiving_buffer(mcpr_connection *tmpconn)
 {
   struct conn *conn = (struct conn *) tmpconn;
+  struct ninio_buffer *buf = &(conn->receiving_buf);
 
-  again:
-    // Ensure the buffer is large enough.
-    if(conn->receiving_buf.max_size < conn->receiving_buf.size + BLOCK_SIZE)
+  while(true)
+  {
+    // Move the unconsumed bytes to the front only once the buffer runs out of space.
+    if(conn->receiving_buf_offset > 0 && (conn->receiving_buf_offset == buf->size || buf->max_size - buf->size < RECEIVING_BUF_MIN_SPACE))
     {
-      void *tmp = realloc(conn->receiving_buf.content, conn->receiving_buf.max_size + BLOCK_SIZE * 256);
-      if(tmp == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
-      conn->receiving_buf.max_size += BLOCK_SIZE * 256;
-      conn->receiving_buf.content = tmp;
+      memmove(buf->content, buf->content + conn->receiving_buf_offset, buf->size - conn->receiving_buf_offset);
+      buf->size -= conn->receiving_buf_offset;
+      conn->receiving_buf_offset = 0;
     }
 
-    // Read a single block.
-
-    if(conn->use_encryption)
+    if(buf->max_size - buf->size < RECEIVING_BUF_MIN_SPACE)
     {
-      void *tmpbuf = malloc(BLOCK_SIZE);
-      if(tmpbuf == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
-      size_t result = fread(tmpbuf, BLOCK_SIZE, 1, conn->iostream);
-      if(result == 0)
-      {
-        if(ferror(conn->iostream) && (errno == EBADF || errno == ECONNRESET || errno == ENOTCONN))
-        {
-          clearerr(conn->iostream);
-          mcpr_connection_close(tmpconn, NULL);
-          free(tmpbuf);
-          return false;
-        }
-        else
-        {
-          free(tmpbuf);
-          return true;
-        }
-      }
+      if(buf->max_size >= RECEIVING_BUF_MAX_SIZE) return true; // Full, the pending packet has to be consumed first.
+      size_t new_size = buf->max_size * 2;
+      if(new_size > RECEIVING_BUF_MAX_SIZE) new_size = RECEIVING_BUF_MAX_SIZE;
+      void *tmp = realloc(buf->content, new_size);
+      if(tmp == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+      buf->content = tmp;
+      buf->max_size = new_size;
+    }
 
-      ssize_t decrypt_result = mcpr_crypto_decrypt(conn->receiving_buf.content + conn->receiving_buf.size,
-          tmpbuf, conn->ctx_decrypt, BLOCK_SIZE);
-      if(decrypt_result == -1) { free(tmpbuf); return false; }
-      conn->receiving_buf.size += decrypt_result;
-      goto again;
+    size_t space = buf->max_size - buf->size;
+    ssize_t result = recv(conn->fd, buf->content + buf->size, space, 0);
+    if(result == -1)
+    {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      ninerr_set_err(ninerr_from_errno());
+      DEBUG_PRINT("Got error: (errno: %i, %s) upon attempting to read from connection. Closing.", errno, strerror(errno));
+      psnip_atomic_int32_store(&(conn->is_closed), 1);
+      return false;
+    }
+    else if(result == 0)
+    {
+      DEBUG_PRINT("Connection closed by peer.");
+      psnip_atomic_int32_store(&(conn->is_closed), 1);
+      return false;
     }
-    else
+
+    if(conn->use_encryption)
     {
-      size_t result = fread(conn->receiving_buf.content + conn->receiving_buf.size, 1, 256, conn->iostream);
-      if(result == 0)
+      void *start = buf->content + buf->size;
+      if(mcpr_crypto_decrypt_inplace(start, conn->ctx_decrypt, (size_t) result) == -1)
       {
-        if(ferror(conn->iostream) &&
-            errno != EAGAIN &&
-            errno != EWOULDBLOCK)
-        {
-          ninerr_set_err(ninerr_from_errno());
-          DEBUG_PRINT("Got error: (errno: %i, %s) upon attempting to read from connection. Closing.", errno, strerror(errno));
-          clearerr(conn->iostream);
-          mcpr_connection_close(tmpconn, NULL);
-        }
+        DEBUG_PRINT("Could not decrypt received data. Closing.");
+        psnip_atomic_int32_store(&(conn->is_closed), 1);
         return false;
       }
-      conn->receiving_buf.size += result * 256;
-      if(result > 0) goto again;
     }
+    buf->size += (size_t) result;
 
-    return true;
+    // A short read means the socket has been drained.
+    if((size_t) result < space) return true;
+  }
 }
 
-static bool mcpr_connection_read_packet(mcpr_connection *tmpconn, struct mcpr_packet *out)
+bool mcpr_connection_read_packet(mcpr_connection *tmpconn, struct mcpr_packet *out, struct ninio_buffer *storage)
 {
-  update_receiving_buffer(tmpconn);
   struct conn *conn = (struct conn *) tmpconn;
-  DEBUG_PRINT("recvbuf.size = %zu, recvbuf.max_size %zu", conn->receiving_buf.size, conn->receiving_buf.max_size);
-  if(conn->receiving_buf.size <= 0) { return false; }
+  if(psnip_atomic_int32_load(&(conn->is_closed))) return false;
+
+  // Only touch the socket once everything which was buffered has been consumed.
   int32_t pktlen;
-  ssize_t result = mcpr_decode_varint(&pktlen, conn->receiving_buf.content, conn->receiving_buf.size);
-  if(result == -1) return false;
-  if(pktlen <= 0) { DEBUG_PRINT("received invalid packet length."); ninerr_set_err(ninerr_new("Received invalid packet length")); return false; }
-  if((conn->receiving_buf.size - result) >= (uint32_t) pktlen)
+  size_t available = conn->receiving_buf.size - conn->receiving_buf_offset;
+  ssize_t result = (available > 0) ? mcpr_decode_varint(&pktlen, conn->receiving_buf.content + conn->receiving_buf_offset, available) : -1;
+  if(result == -1 || available - result < (uint32_t) pktlen)
   {
-    ssize_t bytes_read = mcpr_decode_packet(out, conn->receiving_buf.content + result, conn->state, (size_t) pktlen);
+    update_receiving_buffer(tmpconn);
+    available = conn->receiving_buf.size - conn->receiving_buf_offset;
+    if(available == 0) return false;
+    result = mcpr_decode_varint(&pktlen, conn->receiving_buf.content + conn->receiving_buf_offset, available);
+    if(result == -1)
+    {
+      if(available >= MCPR_VARINT_SIZE_MAX) psnip_atomic_int32_store(&(conn->is_closed), 1); // Not just incomplete, but invalid.
+      return false;
+    }
+  }
+  DEBUG_PRINT("recvbuf.size = %zu, recvbuf.max_size %zu", conn->receiving_buf.size, conn->receiving_buf.max_size);
+
+  if(pktlen <= 0 || pktlen > RECEIVING_BUF_MAX_SIZE - RECEIVING_BUF_MIN_SPACE) { DEBUG_PRINT("received invalid packet length."); ninerr_set_err(ninerr_new("Received invalid packet length")); psnip_atomic_int32_store(&(conn->is_closed), 1); return false; }
+  if((available - result) >= (uint32_t) pktlen)
+  {
+    void *start = conn->receiving_buf.content + conn->receiving_buf_offset;
+    void *data = start + result;
+    size_t data_size = (size_t) pktlen;
+    if(conn->use_compression)
+    {
+      int32_t data_length;
+      ssize_t data_length_size = mcpr_decode_varint(&data_length, data, data_size);
+      if(data_length_size == -1) { DEBUG_PRINT("error. closing connection."); mcpr_connection_close(tmpconn, NULL); return false; }
+      data += data_length_size;
+      data_size -= data_length_size;
+
+      if(data_length != 0) // Zero means that this packet is not compressed.
+      {
+        // Inflated straight into the caller's storage, so there's nothing left to copy.
+        struct ninio_buffer *target = (storage != NULL) ? storage : &(conn->decompression_buf);
+        ssize_t decompressed_size = decompress_frame(conn, target, data, data_size, data_length);
+        if(decompressed_size == -1) { DEBUG_PRINT("Could not decompress packet. closing connection."); mcpr_connection_close(tmpconn, NULL); return false; }
+        data = target->content;
+        data_size = (size_t) decompressed_size;
+        storage = NULL;
+      }
+    }
+    if(storage != NULL)
+    {
+      if(!ensure_buffer_size(storage, data_size)) { mcpr_connection_close(tmpconn, NULL); return false; }
+      memcpy(storage->content, data, data_size);
+      storage->size = data_size;
+      data = storage->content;
+    }
+    ssize_t bytes_read = mcpr_decode_packet(out, data, conn->state, data_size);
     if(bytes_read == -1) { DEBUG_PRINT("error. closing connection."); mcpr_connection_close(tmpconn, NULL); return false; }
-    memmove(conn->receiving_buf.content, conn->receiving_buf.content + bytes_read + result, conn->receiving_buf.size - bytes_read - result);
-    conn->receiving_buf.size -= bytes_read + result;
+    conn->receiving_buf_offset += result + pktlen; // Skip the whole frame, even if the decoder didn't use all of it.
     return true;
   }
   else { return false; }
 }
 
-static bool mcpr_connection_write(mcpr_connection *tmpconn, const void *in, size_t bytes)
+static void update_congestion(struct conn *conn)
 {
-  DEBUG_PRINT("Writing %zu bytes to mcpr_connection at address %p", bytes, (void *) tmpconn)
-  struct conn *conn = (struct conn *) tmpconn;
+  size_t queued = conn->outgoing_buf.size - conn->outgoing_offset;
+  if(queued >= OUTGOING_QUEUE_HIGH_WATERMARK) conn->congested = true;
+  else if(queued <= OUTGOING_QUEUE_LOW_WATERMARK) conn->congested = false;
+}
 
-  if(conn->use_encryption)
+// Appends whatever is left in iov to the outgoing queue, closes the connection if that would exceed the queue limit.
+static bool queue_outgoing(struct conn *conn, const struct iovec *iov, int iovcnt)
+{
+  struct ninio_buffer *buf = &(conn->outgoing_buf);
+  size_t total = 0;
+  for(int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+
+  size_t queued = buf->size - conn->outgoing_offset;
+  if(queued + total > OUTGOING_QUEUE_MAX_SIZE)
   {
-    DEBUG_PRINT("Writing those bytes encrypted.");
-    void *encrypted_data = malloc(bytes + BLOCK_SIZE - 1);
-    if(encrypted_data == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+    ninerr_set_err(ninerr_new("Outgoing queue limit exceeded."));
+    DEBUG_PRINT("Outgoing queue limit exceeded. Closing.");
+    psnip_atomic_int32_store(&(conn->is_closed), 1);
+    return false;
+  }
+
+  if(buf->max_size - buf->size < total)
+  {
+    memmove(buf->content, buf->content + conn->outgoing_offset, queued);
+    buf->size = queued;
+    conn->outgoing_offset = 0;
+
+    size_t new_size = (buf->max_size > 0) ? buf->max_size : SENDING_BUF_INITIAL_SIZE;
+    while(new_size < queued + total) new_size *= 2;
+    if(!ensure_buffer_size(buf, new_size)) { psnip_atomic_int32_store(&(conn->is_closed), 1); return false; }
+  }
 
-    ssize_t encrypted_data_length = mcpr_crypto_encrypt(encrypted_data, in, conn->ctx_encrypt, bytes);
-    if(encrypted_data_length == -1) { free(encrypted_data); return false; }
+  for(int i = 0; i < iovcnt; i++)
+  {
+    memcpy(buf->content + buf->size, iov[i].iov_base, iov[i].iov_len);
+    buf->size += iov[i].iov_len;
+  }
+  update_congestion(conn);
+  return true;
+}
 
-    if(conn->use_compression) // TODO compression treshold
+// Writes as much of iov to the socket as it takes without blocking, the rest is queued until the socket is writable again.
+// A frame is never partially dropped, if that can't be guaranteed the connection is marked as closed.
+static bool write_iovecs(struct conn *conn, struct iovec *iov, int iovcnt)
+{
+  // Anything which is already queued has to go out first.
+  if(conn->outgoing_buf.size > conn->outgoing_offset) return queue_outgoing(conn, iov, iovcnt);
+
+  while(iovcnt > 0)
+  {
+    ssize_t result = writev(conn->fd, iov, iovcnt);
+    if(result == -1)
+    {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+      ninerr_set_err(ninerr_from_errno());
+      DEBUG_PRINT("Got error: (errno: %i, %s) upon attempting to write to connection. Closing.", errno, strerror(errno));
+      psnip_atomic_int32_store(&(conn->is_closed), 1);
+      return false;
+    }
+
+    size_t written = (size_t) result;
+    while(iovcnt > 0 && written >= iov->iov_len)
     {
-      DEBUG_PRINT("Writing those bytes compressed.");
-      void *compressed_data = malloc(mcpr_compress_bounds(encrypted_data_length));
-      if(compressed_data == NULL) { free(encrypted_data); ninerr_set_err(ninerr_from_errno()); return false; }
-      ssize_t compression_result = mcpr_compress(compressed_data, encrypted_data, encrypted_data_length);
-      if(compression_result == -1) { free(encrypted_data); free(compressed_data); return false; }
-
-      size_t write_result = fwrite(compressed_data, compression_result, 1, conn->iostream);
-      free(encrypted_data);
-      free(compressed_data);
-      return write_result == 1; // TODO better error handling maybe
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
     }
-    else
+    if(iovcnt > 0)
     {
-      DEBUG_PRINT("Writing those bytes uncompressed.");
-      size_t write_result = fwrite(encrypted_data, encrypted_data_length, 1, conn->iostream);
-      free(encrypted_data);
-      return write_result == 1; // TODO better error handling maybe
+      iov->iov_base = (uint8_t *) iov->iov_base + written;
+      iov->iov_len -= written;
     }
   }
-  else
+
+  return (iovcnt > 0) ? queue_outgoing(conn, iov, iovcnt) : true;
+}
+
+static bool flush(struct conn *conn)
+{
+  struct ninio_buffer *buf = &(conn->outgoing_buf);
+
+  while(conn->outgoing_offset < buf->size)
   {
-    DEBUG_PRINT("Writing those bytes unencrypted.");
-    if(conn->use_compression)
+    ssize_t result = write(conn->fd, buf->content + conn->outgoing_offset, buf->size - conn->outgoing_offset);
+    if(result == -1)
     {
-      DEBUG_PRINT("Writing those bytes compressed.");
-      void *compressed_data = malloc(mcpr_compress_bounds(bytes));
-      if(compressed_data == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
-
-      ssize_t compression_result = mcpr_compress(compressed_data, in, bytes);
-      if(compression_result == -1) { free(compressed_data); return false; }
-      size_t write_result = fwrite(compressed_data, compression_result, 1, conn->iostream) == compression_result;
-      free(compressed_data);
-      return write_result == 1; // TODO better error handling maybe
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+      ninerr_set_err(ninerr_from_errno());
+      DEBUG_PRINT("Got error: (errno: %i, %s) upon attempting to write to connection. Closing.", errno, strerror(errno));
+      psnip_atomic_int32_store(&(conn->is_closed), 1);
+      return false;
     }
-    else
+    conn->outgoing_offset += (size_t) result;
+  }
+
+  if(conn->outgoing_offset == buf->size)
+  {
+    buf->size = 0;
+    conn->outgoing_offset = 0;
+  }
+  update_congestion(conn);
+  return true;
+}
+
+bool mcpr_connection_flush(mcpr_connection *tmpconn)
+{
+  struct conn *conn = (struct conn *) tmpconn;
+  pthread_mutex_lock(&(conn->send_lock));
+  bool result = flush(conn);
+  pthread_mutex_unlock(&(conn->send_lock));
+  return result;
+}
+
+size_t mcpr_connection_get_outgoing_queue_size(mcpr_connection *tmpconn)
+{
+  struct conn *conn = (struct conn *) tmpconn;
+  pthread_mutex_lock(&(conn->send_lock));
+  size_t size = conn->outgoing_buf.size - conn->outgoing_offset;
+  pthread_mutex_unlock(&(conn->send_lock));
+  return size;
+}
+
+bool mcpr_connection_is_congested(mcpr_connection *tmpconn)
+{
+  struct conn *conn = (struct conn *) tmpconn;
+  pthread_mutex_lock(&(conn->send_lock));
+  bool congested = conn->congested;
+  pthread_mutex_unlock(&(conn->send_lock));
+  return congested;
+}
+
+// Encrypts a complete frame in place if needed and writes it to the socket.
+static bool send_frame(struct conn *conn, void *frame, size_t len)
+{
+  if(conn->use_encryption && mcpr_crypto_encrypt_inplace(frame, conn->ctx_encrypt, len) == -1) { psnip_atomic_int32_store(&(conn->is_closed), 1); return false; }
+  struct iovec iov = { .iov_base = frame, .iov_len = len };
+  return write_iovecs(conn, &iov, 1);
+}
+
+// Writes value as a varint such that it ends right before end, returns the amount of bytes written.
+static size_t prepend_varint(void *end, int32_t value)
+{
+  size_t len = mcpr_varint_bounds(value);
+  return mcpr_encode_varint(end - len, value);
+}
+
+// Compresses the packet data at in into compression_buf, leaving room for the frame header in front of it.
+// Returns the compressed size, or -1 on error.
+static ssize_t compress_frame(struct conn *conn, const void *in, size_t len)
+{
+  z_stream *strm = &(conn->deflate_stream);
+  if(deflateReset(strm) != Z_OK) { ninerr_set_err(ninerr_new("deflateReset failed.")); return -1; }
+  size_t bound = deflateBound(strm, len);
+  if(!ensure_buffer_size(&(conn->compression_buf), MCPR_VARINT_SIZE_MAX * 2 + bound)) return -1;
+
+  IGNORE("-Wcast-qual")
+  strm->next_in = (Bytef *) in;
+  END_IGNORE()
+  strm->avail_in = (uInt) len;
+  strm->next_out = (Bytef *) conn->compression_buf.content + MCPR_VARINT_SIZE_MAX * 2;
+  strm->avail_out = (uInt) bound;
+  int result = deflate(strm, Z_FINISH);
+  if(result != Z_STREAM_END) { ninerr_set_err(ninerr_new("Could not compress packet. (zlib error %i)", result)); return -1; }
+  return (ssize_t) strm->total_out;
+}
+
+static bool send_packet(struct conn *conn, const struct mcpr_packet *pkt)
+{
+  DEBUG_PRINT("Writing packet (type: %i, state: %s) to mcpr_connection at address %p\n", (int) pkt->id, mcpr_state_to_string(pkt->state), (void *) conn);
+
+  size_t bounds = mcpr_encode_packet_bounds(pkt);
+  if(bounds == 0) return false;
+  // Leave room for both the packet length and the data length in front of the packet, so that the frame can be built in place.
+  if(!ensure_buffer_size(&(conn->sending_buf), FRAME_HEADER_SIZE_MAX + bounds)) return false;
+  void *data = conn->sending_buf.content + FRAME_HEADER_SIZE_MAX;
+  size_t pktlen = mcpr_encode_packet(data, pkt);
+  if(pktlen == 0) return false;
+  if(pktlen > MAX_PACKET_DATA_LENGTH) { ninerr_set_err(ninerr_arithmetic_new()); return false; }
+
+  void *frame;
+  size_t frame_len;
+  if(conn->use_compression && pktlen >= conn->compression_threshold)
+  {
+    ssize_t compressed_len = compress_frame(conn, data, pktlen);
+    if(compressed_len == -1) return false;
+    void *compressed = conn->compression_buf.content + FRAME_HEADER_SIZE_MAX;
+    size_t data_length_len = prepend_varint(compressed, (int32_t) pktlen);
+    size_t total = data_length_len + (size_t) compressed_len;
+    if(total > INT32_MAX) { ninerr_set_err(ninerr_arithmetic_new()); return false; }
+    size_t length_len = prepend_varint(compressed - data_length_len, (int32_t) total);
+    frame = compressed - data_length_len - length_len;
+    frame_len = length_len + total;
+  }
+  else if(conn->use_compression)
+  {
+    // Below the threshold, a data length of zero marks the packet as uncompressed.
+    size_t data_length_len = prepend_varint(data, 0);
+    size_t length_len = prepend_varint(data - data_length_len, (int32_t) (pktlen + data_length_len));
+    frame = data - data_length_len - length_len;
+    frame_len = length_len + data_length_len + pktlen;
+  }
+  else
+  {
+    size_t length_len = prepend_varint(data, (int32_t) pktlen);
+    frame = data - length_len;
+    frame_len = length_len + pktlen;
+  }
+
+  DEBUG_PRINT("Writing packet, total size: %zu, size before prefixed length: %zu\n", frame_len, pktlen);
+  return send_frame(conn, frame, frame_len);
+}
+
+bool mcpr_connection_send_packet(mcpr_connection *tmpconn, const struct mcpr_packet *pkt)
+{
+  struct conn *conn = (struct conn *) tmpconn;
+  pthread_mutex_lock(&(conn->send_lock));
+  bool result = send_packet(conn, pkt);
+  pthread_mutex_unlock(&(conn->send_lock));
+  return result;
+}
+
+static bool write_encoded_packet(struct conn *conn, const void *data, size_t len, const void *compressed, size_t compressed_len)
+{
+  if(len > MAX_PACKET_DATA_LENGTH) { ninerr_set_err(ninerr_arithmetic_new()); return false; }
+
+  uint8_t header[FRAME_HEADER_SIZE_MAX];
+  size_t header_len;
+  if(conn->use_compression && len >= conn->compression_threshold)
+  {
+    if(compressed == NULL)
     {
-      DEBUG_PRINT("Writing those bytes uncompressed.");
-      return fwrite(in, bytes, 1, conn->iostream) == 1;
+      ssize_t result = compress_frame(conn, data, len);
+      if(result == -1) return false;
+      compressed = conn->compression_buf.content + FRAME_HEADER_SIZE_MAX;
+      compressed_len = (size_t) result;
     }
+    size_t data_length_len = mcpr_varint_bounds((int32_t) len);
+    if(data_length_len + compressed_len > INT32_MAX) { ninerr_set_err(ninerr_arithmetic_new()); return false; }
+    header_len = mcpr_encode_varint(header, (int32_t) (data_length_len + compressed_len));
+    header_len += mcpr_encode_varint(header + header_len, (int32_t) len);
+    data = compressed;
+    len = compressed_len;
+  }
+  else if(conn->use_compression)
+  {
+    header_len = mcpr_encode_varint(header, (int32_t) (len + 1));
+    header_len += mcpr_encode_varint(header + header_len, 0);
+  }
+  else
+  {
+    header_len = mcpr_encode_varint(header, (int32_t) len);
   }
+
+  if(conn->use_encryption)
+  {
+    // The data may be shared with other connections, so it is encrypted into the sending buffer instead.
+    if(!ensure_buffer_size(&(conn->sending_buf), header_len + len)) return false;
+    memcpy(conn->sending_buf.content, header, header_len);
+    if(mcpr_crypto_encrypt_inplace(conn->sending_buf.content, conn->ctx_encrypt, header_len) == -1
+      || mcpr_crypto_encrypt(conn->sending_buf.content + header_len, data, conn->ctx_encrypt, len) == -1) { psnip_atomic_int32_store(&(conn->is_closed), 1); return false; }
+    struct iovec iov = { .iov_base = conn->sending_buf.content, .iov_len = header_len + len };
+    return write_iovecs(conn, &iov, 1);
+  }
+
+  IGNORE("-Wcast-qual")
+  struct iovec iov[2] = {
+    { .iov_base = header, .iov_len = header_len },
+    { .iov_base = (void *) data, .iov_len = len },
+  };
+  END_IGNORE()
+  return write_iovecs(conn, iov, 2);
 }
 
-static bool mcpr_connection_write_packet(mcpr_connection *tmpconn, const struct mcpr_packet *pkt)
+bool mcpr_connection_write_encoded_packet(mcpr_connection *tmpconn, const void *data, size_t len, const void *compressed, size_t compressed_len)
 {
-  DEBUG_PRINT("Writing packet (numerical ID: 0x%02x, state: %s) to mcpr_connection at address %p\n", mcpr_packet_type_to_byte(pkt->id), mcpr_state_to_string(pkt->state), tmpconn);
-  size_t required_size = MCPR_VARINT_SIZE_MAX + mcpr_encode_packet_bounds(pkt);
-  void *buf = malloc(required_size);
-  if(buf == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
-  size_t pktlen = mcpr_encode_packet(buf + MCPR_VARINT_SIZE_MAX, pkt);
-  if(pktlen == 0) { free(buf); return false; }
-  if(pktlen > INT32_MAX) { free(buf); ninerr_set_err(ninerr_arithmetic_new()); return false; }
-
-  size_t skip = MCPR_VARINT_SIZE_MAX - mcpr_varint_bounds((int32_t) pktlen);
-  size_t bytes_written_1 = mcpr_encode_varint(buf + skip, (int32_t) pktlen);
-  DEBUG_PRINT("Writing packet, total size: %zu, size before prefixed length: %zu\n", (size_t) (pktlen + bytes_written_1), pktlen);
-  if(!mcpr_connection_write(tmpconn, buf + skip, pktlen + bytes_written_1)) { free(buf); return false; }
-  free(buf);
-  return true;
+  struct conn *conn = (struct conn *) tmpconn;
+  pthread_mutex_lock(&(conn->send_lock));
+  bool result = write_encoded_packet(conn, data, len, compressed, compressed_len);
+  pthread_mutex_unlock(&(conn->send_lock));
+  return result;
 }
 
 void mcpr_connection_set_crypto(mcpr_connection *tmpconn, EVP_CIPHER_CTX *ctx_encrypt, EVP_CIPHER_CTX *ctx_decrypt)
@@ -358,28 +746,63 @@ void mcpr_connection_set_state(mcpr_connection *conn, enum mcpr_state state)
 }
 
 
-void mcpr_connection_set_compression(mcpr_connection *tmpconn, bool compression)
+bool mcpr_connection_set_compression(mcpr_connection *tmpconn, bool compression, unsigned long threshold)
 {
   struct conn *conn = (struct conn *) tmpconn;
+  if(compression && !conn->zstreams_initialized)
+  {
+    conn->deflate_stream.zalloc = Z_NULL;
+    conn->deflate_stream.zfree = Z_NULL;
+    conn->deflate_stream.opaque = Z_NULL;
+    if(deflateInit(&(conn->deflate_stream), conn->compression_level) != Z_OK) { ninerr_set_err(ninerr_new("deflateInit failed.")); return false; }
+
+    conn->inflate_stream.zalloc = Z_NULL;
+    conn->inflate_stream.zfree = Z_NULL;
+    conn->inflate_stream.opaque = Z_NULL;
+    conn->inflate_stream.next_in = Z_NULL;
+    conn->inflate_stream.avail_in = 0;
+    if(inflateInit(&(conn->inflate_stream)) != Z_OK)
+    {
+      deflateEnd(&(conn->deflate_stream));
+      ninerr_set_err(ninerr_new("inflateInit failed."));
+      return false;
+    }
+    conn->zstreams_initialized = true;
+  }
   conn->use_compression = compression;
+  conn->compression_threshold = threshold;
+  return true;
+}
+
+bool mcpr_connection_set_compression_level(mcpr_connection *tmpconn, int level)
+{
+  struct conn *conn = (struct conn *) tmpconn;
+  if(level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) { ninerr_set_err(ninerr_new("Invalid compression level %i.", level)); return false; }
+  if(conn->zstreams_initialized && deflateParams(&(conn->deflate_stream), level, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    ninerr_set_err(ninerr_new("deflateParams failed."));
+    return false;
+  }
+  conn->compression_level = level;
+  return true;
 }
 
 bool mcpr_connection_is_closed(mcpr_connection *conn)
 {
-  return ((struct conn *) conn)->is_closed;
+  return psnip_atomic_int32_load(&(((struct conn *) conn)->is_closed));
 }
 
 static ssize_t mcpr_connection_stream_write(void *cookie, const char *buf, size_t size)
 {
   assert(size >= sizeof(struct mcpr_packet));
-  return mcpr_connection_write_packet(cookie, (struct mcpr_packet *) buf);
+  return mcpr_connection_send_packet(cookie, (struct mcpr_packet *) buf) ? (ssize_t) size : -1;
 }
 
 static ssize_t mcpr_connection_stream_read(void *cookie, char *buf, size_t size)
 {
   assert(size == sizeof(struct mcpr_packet));
 
-  if(mcpr_connection_read_packet(cookie, (struct mcpr_packet *) buf))
+  if(mcpr_connection_read_packet(cookie, (struct mcpr_packet *) buf, NULL))
   {
     DEBUG_PRINT("returning sizeof(mcpr_packet)");
     return sizeof(struct mcpr_packet);
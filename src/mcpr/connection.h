@@ -28,6 +28,7 @@
 #include <openssl/evp.h>
 #include <mcpr/mcpr.h>
 #include <mcpr/packet.h>
+#include <ninio/ninio.h>
 
 typedef void mcpr_connection;
 
@@ -38,10 +39,34 @@ void mcpr_connection_set_packet_handler   (mcpr_connection *conn, bool (*on_pack
 bool mcpr_connection_is_closed            (mcpr_connection *conn);
 void mcpr_connection_set_crypto           (mcpr_connection *conn, EVP_CIPHER_CTX *ctx_encrypt, EVP_CIPHER_CTX *ctx_decrypt);
 void mcpr_connection_set_use_encryption   (mcpr_connection *conn, bool value);
-void mcpr_connection_set_compression      (mcpr_connection *conn, bool compression);
+bool mcpr_connection_set_compression      (mcpr_connection *conn, bool compression, unsigned long threshold); // Packets of at least threshold bytes are compressed.
+bool mcpr_connection_set_compression_level(mcpr_connection *conn, int level); // zlib compression level, from -1 (default) to 9.
 enum mcpr_state mcpr_connection_get_state (mcpr_connection *conn);
 void mcpr_connection_set_state            (mcpr_connection *conn, enum mcpr_state state);
 void mcpr_connection_close                (mcpr_connection *conn, const char *reason);
+void mcpr_connection_free                 (mcpr_connection *conn); // Closes the connection if that didn't happen yet. Doesn't close the underlying stream.
 FILE *mcpr_connection_get_stream          (mcpr_connection *conn);
 
+// Decodes the next packet from what the socket has available, without blocking.
+// Returns false if there is no complete packet available yet, or if the connection got closed (see mcpr_connection_is_closed()).
+// Strings and byte arrays in out point into storage, which is grown as needed and has to outlive out. If storage is NULL
+// they point into the connection's own buffers instead, and are only valid until the next read.
+// Reading is not thread safe, but may happen concurrently with writing.
+bool mcpr_connection_read_packet          (mcpr_connection *conn, struct mcpr_packet *out, struct ninio_buffer *storage);
+
+// Writes are never blocking, whatever the socket can't take right away is queued on the connection.
+// The queue is written out with mcpr_connection_flush() once the socket becomes writable again.
+// Once more is queued than the connection's limit allows, the connection is closed.
+bool mcpr_connection_flush                (mcpr_connection *conn);
+size_t mcpr_connection_get_outgoing_queue_size(mcpr_connection *conn); // In bytes.
+bool mcpr_connection_is_congested         (mcpr_connection *conn); // True if callers should hold off sending more than necessary.
+
+// Encodes, frames and encrypts pkt in a buffer owned by the connection and writes it straight to the socket.
+bool mcpr_connection_send_packet          (mcpr_connection *conn, const struct mcpr_packet *pkt);
+
+// Writes a packet which has already been encoded with mcpr_encode_packet(), without copying it.
+// compressed may optionally point to the zlib compressed form of data, which is used instead of compressing data again
+// if this packet ends up being compressed. compressed may be NULL.
+bool mcpr_connection_write_encoded_packet (mcpr_connection *conn, const void *data, size_t len, const void *compressed, size_t compressed_len);
+
 #endif
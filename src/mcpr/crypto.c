@@ -59,6 +59,28 @@ ssize_t mcpr_crypto_decrypt(void *out, const void *data, EVP_CIPHER_CTX *ctx_dec
   return writtenlen;
 }
 
+ssize_t mcpr_crypto_encrypt_inplace(void *buf, EVP_CIPHER_CTX *ctx_encrypt, size_t len) {
+  if(len > INT_MAX) { ninerr_set_err(ninerr_arithmetic_new()); return -1; }
+
+  int writtenlen;
+  if(EVP_EncryptUpdate(ctx_encrypt, (unsigned char *) buf, &writtenlen, (unsigned char *) buf, (int) len) == 0) {
+    ninerr_set_err(ninerr_new("EVP_EncryptUpdate failed.", false));
+    return -1;
+  }
+  return writtenlen;
+}
+
+ssize_t mcpr_crypto_decrypt_inplace(void *buf, EVP_CIPHER_CTX *ctx_decrypt, size_t len) {
+  if(len > INT_MAX) { ninerr_set_err(ninerr_arithmetic_new()); return -1; }
+
+  int writtenlen;
+  if(EVP_DecryptUpdate(ctx_decrypt, (unsigned char *) buf, &writtenlen, (unsigned char *) buf, (int) len) == 0) {
+    ninerr_set_err(ninerr_new("EVP_DecryptUpdate failed.", false));
+    return -1;
+  }
+  return writtenlen;
+}
+
 void mcpr_crypto_stringify_sha1(char *out, const void *hash)
 {
   DEBUG_PRINT("in mcpr_crypto_stringify_sha1(out = %p, hash = %p)", (void *) out, (void *) hash);
@@ -53,6 +53,24 @@ ssize_t mcpr_crypto_encrypt(void *restrict out, const void *restrict in, EVP_CIP
  */
 ssize_t mcpr_crypto_decrypt(void *restrict out, const void *restrict in, EVP_CIPHER_CTX *ctx_decrypt, size_t len);
 
+/**
+ * Encrypt data in place, only valid for ciphers with a block size of 1 such as AES/CFB8.
+ *
+ * @param [in, out] buf Buffer of at least len in size, may not be NULL.
+ *
+ * @returns The amount of bytes encrypted, or a negative integer upon error.
+ */
+ssize_t mcpr_crypto_encrypt_inplace(void *buf, EVP_CIPHER_CTX *ctx_encrypt, size_t len);
+
+/**
+ * Decrypt data in place, only valid for ciphers with a block size of 1 such as AES/CFB8.
+ *
+ * @param [in, out] buf Buffer of at least len in size, may not be NULL.
+ *
+ * @returns The amount of bytes decrypted, or a negative integer upon error.
+ */
+ssize_t mcpr_crypto_decrypt_inplace(void *buf, EVP_CIPHER_CTX *ctx_decrypt, size_t len);
+
 
 ssize_t mcpr_crypto_generate_auth_hash(void *out, char *server_id, void *shared_secret, size_t shared_secret_len, void *server_pubkey, size_t server_pubkey_len);
 
@@ -36,6 +36,7 @@
 #include <mcpr/mcpr.h>
 #include <mcpr/codec.h>
 #include <mcpr/packet.h>
+#include <mcpr/packetschema.h>
 #include "util.h"
 
 #include <ninuuid/ninuuid.h>
@@ -74,7 +75,6 @@ static char *server_list_response_to_json(const struct mcpr_packet *pkt)
 
   if(player_sample != NULL)
   {
-    size_t online_players_size = online_players_size;
     const char *player_sample_fmt = "{\"name\":\"%s\",\"id\":\"%s\"}";
 
     size_t buf_size = 256;
@@ -170,1017 +170,947 @@ static char *server_list_response_to_json(const struct mcpr_packet *pkt)
   }
 }
 
-IGNORE("-Wswitch")
-size_t mcpr_encode_packet_bounds(const struct mcpr_packet *pkt)
+// Everything below is driven by the schema in packetschema.h, only the CUSTOM packets are written out by hand.
+
+static ssize_t length_exceeded(void)
 {
-  switch(pkt->state)
-  {
-    case MCPR_STATE_HANDSHAKE:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_HS_SB_HANDSHAKE:
-          return 12 + strlen(pkt->data.handshake.serverbound.handshake.server_address);
-      }
-    }
+  ninerr_set_err(ninerr_new("Max packet length exceeded."));
+  return -1;
+}
 
-    case MCPR_STATE_STATUS:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_ST_CB_PONG: return MCPR_VARINT_SIZE_MAX + MCPR_LONG_SIZE;
+// Returns size if left has room for a field of size bytes, -1 otherwise.
+static inline ssize_t take(size_t left, size_t size)
+{
+  return (left >= size) ? (ssize_t) size : length_exceeded();
+}
 
-        case MCPR_PKT_ST_CB_RESPONSE:
-        {
-          char *response = server_list_response_to_json(pkt);
-          if(response == NULL) { return 0; }
-          size_t len = strlen(response);
+static inline size_t string_size(const char *str)
+{
+  size_t len = strlen(str);
+  return mcpr_varint_bounds((int32_t) len) + len;
+}
 
-          return MCPR_VARINT_SIZE_MAX + MCPR_VARINT_SIZE_MAX + len;
-        }
-      }
-    }
+// Unlike mcpr_encode_string() this doesn't make a temporary copy of str.
+static inline size_t encode_string(void *out, const char *str)
+{
+  size_t len = strlen(str);
+  size_t written = mcpr_encode_varint(out, (int32_t) len);
+  memcpy(((unsigned char *) out) + written, str, len);
+  return written + len;
+}
 
-    case MCPR_STATE_LOGIN:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_LG_CB_DISCONNECT: return 10 + strlen(pkt->data.login.clientbound.disconnect.reason);
+static inline size_t encode_bytes(void *out, const void *data, int32_t length)
+{
+  size_t written = mcpr_encode_varint(out, length);
+  memcpy(((unsigned char *) out) + written, data, (size_t) length);
+  return written + (size_t) length;
+}
 
-        case MCPR_PKT_LG_CB_ENCRYPTION_REQUEST:
-          return 20 +
-            strlen(pkt->data.login.clientbound.encryption_request.server_id) +
-            pkt->data.login.clientbound.encryption_request.public_key_length +
-            pkt->data.login.clientbound.encryption_request.verify_token_length;
+static ssize_t decode_bytes(const void **data, int32_t *length, const void *in, size_t maxlen)
+{
+  ssize_t read = mcpr_decode_varint(length, in, maxlen);
+  if(read < 0) return -1;
+  if(*length < 0 || (size_t) *length > maxlen - (size_t) read) return length_exceeded();
+  *data = ((const unsigned char *) in) + read;
+  return read + *length;
+}
 
-        case MCPR_PKT_LG_CB_LOGIN_SUCCESS:
-          return 51 + strlen(pkt->data.login.clientbound.login_success.username);
+static ssize_t decode_enum(int32_t *out, int32_t count, const void *in, size_t maxlen)
+{
+  ssize_t read = mcpr_decode_varint(out, in, maxlen);
+  if(read < 0) return -1;
+  if(*out < 0 || *out >= count) { ninerr_set_err(ninerr_new("Invalid enum value %ld, expected 0 to %ld.", (long) *out, (long) count - 1)); return -1; }
+  return read;
+}
 
-        case MCPR_PKT_LG_CB_SET_COMPRESSION:
-          return 10;
+static ssize_t decode_byte_enum(int32_t *out, int32_t count, const void *in, size_t maxlen)
+{
+  if(take(maxlen, MCPR_BYTE_SIZE) < 0) return -1;
+  int8_t value;
+  mcpr_decode_byte(&value, in);
+  if(value < 0 || value >= count) { ninerr_set_err(ninerr_new("Invalid enum value %i, expected 0 to %ld.", (int) value, (long) count - 1)); return -1; }
+  *out = value;
+  return MCPR_BYTE_SIZE;
+}
 
-        case MCPR_PKT_LG_SB_LOGIN_START:
-          return 10 + strlen(pkt->data.login.serverbound.login_start.name);
+static size_t strings_size(char * const *strings, int32_t count)
+{
+  size_t size = 0;
+  for(int32_t i = 0; i < count; i++) size += string_size(strings[i]);
+  return size;
+}
 
-        case MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE:
-          return 15 + pkt->data.login.serverbound.encryption_response.shared_secret_length +
-            pkt->data.login.serverbound.encryption_response.verify_token_length;
-      }
-    }
+static size_t encode_strings(void *out, char * const *strings, int32_t count)
+{
+  unsigned char *ptr = out;
+  for(int32_t i = 0; i < count; i++) ptr += encode_string(ptr, strings[i]);
+  return ptr - (unsigned char *) out;
+}
 
-    case MCPR_STATE_PLAY:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_PL_CB_CHAT_MESSAGE:
-          return strlen(pkt->data.play.clientbound.chat_message.json_data +
-              MCPR_VARINT_SIZE_MAX +
-              MCPR_BYTE_SIZE);
-
-        case MCPR_PKT_PL_CB_DISCONNECT:
-          return 10 +
-            strlen(pkt->data.play.clientbound.disconnect.reason);
-
-        case MCPR_PKT_PL_CB_KEEP_ALIVE:
-          return 10;
-
-        case MCPR_PKT_PL_CB_JOIN_GAME:
-          return 33;
-
-        case MCPR_PKT_PL_CB_PLUGIN_MESSAGE:
-          return 10 +
-            strlen(pkt->data.play.clientbound.plugin_message.channel) +
-             pkt->data.play.clientbound.plugin_message.data_length;
-
-        case MCPR_PKT_PL_CB_SPAWN_POSITION:
-          return MCPR_VARINT_SIZE_MAX +
-            MCPR_POSITION_SIZE;
-
-        case MCPR_PKT_PL_CB_PLAYER_ABILITIES:
-          return MCPR_VARINT_SIZE_MAX +
-            MCPR_BYTE_SIZE +
-            MCPR_FLOAT_SIZE +
-            MCPR_FLOAT_SIZE;
-
-        case MCPR_PKT_PL_CB_PLAYER_POSITION_AND_LOOK:
-          return MCPR_VARINT_SIZE_MAX +
-            MCPR_DOUBLE_SIZE * 3 +
-            MCPR_FLOAT_SIZE * 2 +
-            MCPR_BYTE_SIZE +
-            MCPR_VARINT_SIZE_MAX;
-
-        case MCPR_PKT_PL_SB_KEEP_ALIVE:
-          return 10;
-
-        case MCPR_PKT_PL_SB_PLUGIN_MESSAGE:
-          return 10 +
-            strlen(pkt->data.play.serverbound.plugin_message.channel) +
-            pkt->data.play.serverbound.plugin_message.data_length;
-
-        case MCPR_PKT_PL_CB_CHUNK_DATA:
-        {
-          size_t raw_block_entities_size = 0;
-          struct buffer *raw_block_entities = NULL;
-          if(pkt->data.play.clientbound.chunk_data.block_entities != NULL)
-          {
-            struct buffer tmp = nbt_dump_binary(pkt->data.play.clientbound.chunk_data.block_entities);
-            raw_block_entities = &tmp;
-            raw_block_entities_size = tmp.len;
-          }
-
-          int32_t data_size = 0;
-          if(pkt->data.play.clientbound.chunk_data.ground_up_continuous) data_size += 256;
-          for(size_t i = 0; i < pkt->data.play.clientbound.chunk_data.size; i++) // TODO what if integer overflow occurs here.
-          {
-            struct mcpr_chunk_section *section = pkt->data.play.clientbound.chunk_data.chunk_sections + i;
-            data_size += MCPR_UBYTE_SIZE;
-            data_size += mcpr_varint_bounds(section->palette_length);
-            data_size += section->palette_length * MCPR_VARINT_SIZE_MAX;
-            data_size += mcpr_varint_bounds(section->block_array_length);
-            data_size += section->block_array_length * 8;
-            data_size += 2048; // block light, half a byte per block in 16x16x16 chunk section.
-            if(section->sky_light != NULL) data_size += 2048;// sky light, half a byte per block in 16x16x16 chunk section.
-          }
-
-          return MCPR_INT_SIZE +
-            MCPR_INT_SIZE +
-            MCPR_BOOL_SIZE +
-            MCPR_VARINT_SIZE_MAX +
-            MCPR_VARINT_SIZE_MAX +
-            data_size +
-            MCPR_VARINT_SIZE_MAX +
-            raw_block_entities_size;
-        }
-      }
-    }
-  }
+// lib/nbt predates TAG_Long_Array.
+#define NBT_TAG_LONG_ARRAY 12
+// Deeper nesting is rejected, same limit as the vanilla server.
+#define NBT_MAX_DEPTH 512
 
-  fprintf(stderr, "Packet bounds checking for packet with enum id (not packet id) %i is not implemented yet! (state: %s)\n", pkt->id, mcpr_state_to_string(pkt->state));
-  abort();
-}
-END_IGNORE()
+static ssize_t nbt_named_tag_size(const unsigned char *in, size_t maxlen, unsigned int depth);
 
-size_t mcpr_encode_packet(void *out, const struct mcpr_packet *pkt)
+// Size of the payload of a tag of the given type, or -1 if it's invalid or doesn't fit in maxlen.
+static ssize_t nbt_payload_size(uint8_t type, const unsigned char *in, size_t maxlen, unsigned int depth)
 {
-  DEBUG_PRINT("In mcpr_encode_packet, numerical packet ID: 0x%02x, state: %s\n", mcpr_packet_type_to_byte(pkt->id), mcpr_state_to_string(pkt->state));
-  IGNORE("-Wswitch")
+  if(depth > NBT_MAX_DEPTH) { ninerr_set_err(ninerr_new("NBT is nested too deeply.")); return -1; }
 
-  switch(pkt->state)
+  size_t element_size;
+  switch(type)
   {
-    case MCPR_STATE_HANDSHAKE:
+    case TAG_BYTE:    return take(maxlen, 1);
+    case TAG_SHORT:   return take(maxlen, 2);
+    case TAG_INT:     return take(maxlen, 4);
+    case TAG_LONG:    return take(maxlen, 8);
+    case TAG_FLOAT:   return take(maxlen, 4);
+    case TAG_DOUBLE:  return take(maxlen, 8);
+
+    case TAG_STRING:
     {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_HS_SB_HANDSHAKE:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_HS_SB_HANDSHAKE));
-          bufpointer += mcpr_encode_varint(bufpointer, MCPR_PROTOCOL_VERSION);
-          ssize_t bytes_written_3 = mcpr_encode_string(bufpointer, pkt->data.handshake.serverbound.handshake.server_address);
-          if(bytes_written_3 < 0) { return 0; }
-          bufpointer += bytes_written_3;
-          mcpr_encode_ushort(bufpointer, pkt->data.handshake.serverbound.handshake.server_port); bufpointer += MCPR_USHORT_SIZE;
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.handshake.serverbound.handshake.next_state);
-          return bufpointer - out;
-        }
-      }
+      if(take(maxlen, MCPR_USHORT_SIZE) < 0) return -1;
+      uint16_t length;
+      mcpr_decode_ushort(&length, in);
+      return take(maxlen, MCPR_USHORT_SIZE + (size_t) length);
     }
 
-    case MCPR_STATE_STATUS:
+    case TAG_BYTE_ARRAY:      element_size = 1; goto array;
+    case TAG_INT_ARRAY:       element_size = 4; goto array;
+    case NBT_TAG_LONG_ARRAY:  element_size = 8; goto array;
+    array:
     {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_ST_CB_PONG:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_ST_CB_PONG));
-          mcpr_encode_long(bufpointer, pkt->data.status.clientbound.pong.payload); bufpointer += MCPR_LONG_SIZE;
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_ST_CB_RESPONSE:
-        {
-          char *response = server_list_response_to_json(pkt);
-          if(response == NULL) { return 0; }
-          DEBUG_PRINT("Response: %s\n", response);
-          size_t len = strlen(response);
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_ST_CB_RESPONSE));
-          bufpointer += mcpr_encode_varint(bufpointer, len);
-          memcpy(bufpointer, response, len); bufpointer += len;
-          free(response);
-
-          return bufpointer - out;
-        }
-      }
+      if(take(maxlen, MCPR_INT_SIZE) < 0) return -1;
+      int32_t length;
+      mcpr_decode_int(&length, in);
+      if(length < 0 || (size_t) length > (maxlen - MCPR_INT_SIZE) / element_size) return length_exceeded();
+      return MCPR_INT_SIZE + (size_t) length * element_size;
     }
 
-    case MCPR_STATE_LOGIN:
+    case TAG_LIST:
     {
-      switch(pkt->id)
+      if(take(maxlen, 1 + MCPR_INT_SIZE) < 0) return -1;
+      uint8_t element_type = in[0];
+      int32_t length;
+      mcpr_decode_int(&length, in + 1);
+      size_t offset = 1 + MCPR_INT_SIZE;
+      for(int32_t i = 0; i < length; i++)
       {
-        case MCPR_PKT_LG_CB_DISCONNECT:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_LG_CB_DISCONNECT));
-          ssize_t bytes_written_2 = mcpr_encode_chat(bufpointer, pkt->data.login.clientbound.disconnect.reason);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_LG_CB_ENCRYPTION_REQUEST:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_LG_CB_ENCRYPTION_REQUEST));
-          ssize_t bytes_written_2 = mcpr_encode_string(bufpointer, pkt->data.login.clientbound.encryption_request.server_id);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.login.clientbound.encryption_request.public_key_length);
-          memcpy(bufpointer, pkt->data.login.clientbound.encryption_request.public_key, pkt->data.login.clientbound.encryption_request.public_key_length);
-          bufpointer += pkt->data.login.clientbound.encryption_request.public_key_length;
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.login.clientbound.encryption_request.verify_token_length);
-          memcpy(bufpointer, pkt->data.login.clientbound.encryption_request.verify_token, pkt->data.login.clientbound.encryption_request.verify_token_length);
-          bufpointer += pkt->data.login.clientbound.encryption_request.verify_token_length;
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_LG_CB_LOGIN_SUCCESS:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_LG_CB_LOGIN_SUCCESS));
-
-          char uuid_string[37];
-          ninuuid_to_string(&(pkt->data.login.clientbound.login_success.uuid), uuid_string, LOWERCASE, false);
-          ssize_t bytes_written_2 = mcpr_encode_string(bufpointer, uuid_string);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-
-          ssize_t bytes_written_3 = mcpr_encode_string(bufpointer, pkt->data.login.clientbound.login_success.username);
-          if(bytes_written_3 < 0) { return 0; }
-          bufpointer += bytes_written_3;
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_LG_CB_SET_COMPRESSION:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_LG_CB_SET_COMPRESSION));
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.login.clientbound.set_compression.threshold);
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_LG_SB_LOGIN_START:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_LG_SB_LOGIN_START));
-          ssize_t bytes_written_2 = mcpr_encode_string(bufpointer ,pkt->data.login.serverbound.login_start.name);
-          if(bytes_written_2 < 0) { return 0; }
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE:
-        {
-          int32_t shared_secret_length = pkt->data.login.serverbound.encryption_response.shared_secret_length;
-          int32_t verify_token_length = pkt->data.login.serverbound.encryption_response.verify_token_length;
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE));
-          bufpointer += mcpr_encode_varint(bufpointer, shared_secret_length);
-          memcpy(bufpointer, pkt->data.login.serverbound.encryption_response.shared_secret, shared_secret_length); bufpointer += shared_secret_length;
-          bufpointer += mcpr_encode_varint(bufpointer, verify_token_length);
-          memcpy(bufpointer, pkt->data.login.serverbound.encryption_response.verify_token, verify_token_length); bufpointer += verify_token_length;
-          return bufpointer - out;
-        }
+        ssize_t n = nbt_payload_size(element_type, in + offset, maxlen - offset, depth + 1);
+        if(n < 0) return -1;
+        offset += (size_t) n;
       }
+      return offset;
     }
 
-    case MCPR_STATE_PLAY:
+    case TAG_COMPOUND:
     {
-      switch(pkt->id)
+      size_t offset = 0;
+      while(true)
       {
-        case MCPR_PKT_PL_CB_CHAT_MESSAGE:
-        {
-          const char *json_data = pkt->data.play.clientbound.chat_message.json_data;
-          enum mcpr_chat_position position = pkt->data.play.clientbound.chat_message.position;
-          void *bufpointer = out;
-          ssize_t bytes_written_2 = mcpr_encode_chat(bufpointer, json_data);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-          uint8_t position_byte;
-          switch(position)
-          {
-            case MCPR_CHAT_POSITION_CHAT: { position_byte = 0; break; }
-            case MCPR_CHAT_POSITION_SYSTEM: { position_byte = 1; break; }
-            case MCPR_CHAT_POSITION_HOTBAR: { position_byte = 2; break; }
-          }
-          mcpr_encode_byte(bufpointer, position_byte);
-          bufpointer += MCPR_BYTE_SIZE;
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_DISCONNECT:
-        {
-          const char *reason = pkt->data.play.clientbound.disconnect.reason; // It's JSON chat, not a normal string
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_DISCONNECT));
-          ssize_t bytes_written_2 = mcpr_encode_string(bufpointer, reason);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_KEEP_ALIVE:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_KEEP_ALIVE));
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.play.clientbound.keep_alive.keep_alive_id);
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_JOIN_GAME:
-        {
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_JOIN_GAME));
-          mcpr_encode_int(bufpointer, pkt->data.play.clientbound.join_game.entity_id); bufpointer += MCPR_INT_SIZE;
-
-          uint8_t gamemode;
-          switch(pkt->data.play.clientbound.join_game.gamemode)
-          {
-            case MCPR_GAMEMODE_SURVIVAL:  gamemode = 0x00; break;
-            case MCPR_GAMEMODE_CREATIVE:  gamemode = 0x01; break;
-            case MCPR_GAMEMODE_ADVENTURE:   gamemode = 0x02; break;
-            case MCPR_GAMEMODE_SPECTATOR:   gamemode = 0x03; break;
-            default: abort(); return 0; // Won't be reached, but else the compiler will complain.
-          }
-          if(pkt->data.play.clientbound.join_game.hardcore) gamemode = gamemode | 0x08;
-          mcpr_encode_ubyte(bufpointer, gamemode); bufpointer += MCPR_UBYTE_SIZE;
-
-          int32_t dimension;
-          switch(pkt->data.play.clientbound.join_game.dimension)
-          {
-            case MCPR_DIMENSION_NETHER:   dimension = -1; break;
-            case MCPR_DIMENSION_OVERWORLD:  dimension = 0;  break;
-            case MCPR_DIMENSION_END:    dimension = 1;  break;
-            default: abort(); return 0; // Won't be reached, but else the compiler will complain.
-          }
-          mcpr_encode_int(bufpointer, dimension); bufpointer += MCPR_INT_SIZE;
-
-          uint8_t difficulty;
-          switch(pkt->data.play.clientbound.join_game.difficulty)
-          {
-            case MCPR_DIFFICULTY_PEACEFUL:  difficulty = 0; break;
-            case MCPR_DIFFICULTY_EASY:    difficulty = 1; break;
-            case MCPR_DIFFICULTY_NORMAL:  difficulty = 2; break;
-            case MCPR_DIFFICULTY_HARD:    difficulty = 3; break;
-            default: abort(); return 0; // Won't be reached, but else the compiler will complain.
-          }
-          mcpr_encode_ubyte(bufpointer, difficulty); bufpointer += MCPR_UBYTE_SIZE;
-          mcpr_encode_ubyte(bufpointer, pkt->data.play.clientbound.join_game.max_players); bufpointer += MCPR_UBYTE_SIZE;
-
-          char *level_type;
-          switch(pkt->data.play.clientbound.join_game.level_type)
-          {
-            case MCPR_LEVEL_DEFAULT:    level_type = "default";   break;
-            case MCPR_LEVEL_FLAT:       level_type = "flat";    break;
-            case MCPR_LEVEL_LARGE_BIOMES:   level_type = "largeBiomes"; break;
-            case MCPR_LEVEL_AMPLIFIED:    level_type = "amplified";   break;
-            case MCPR_LEVEL_DEFAULT_1_1:  level_type = "default_1_1"; break;
-            default: abort(); return 0; // Won't be reached, but else the compiler will complain.
-          }
-          ssize_t bytes_written_7 = mcpr_encode_string(bufpointer, level_type);
-          if(bytes_written_7 < 0) { return 0; }
-          bufpointer += bytes_written_7;
-
-          mcpr_encode_bool(bufpointer, pkt->data.play.clientbound.join_game.reduced_debug_info); bufpointer += MCPR_BOOL_SIZE;
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_PLUGIN_MESSAGE:
-        {
-          size_t channel_len = strlen(pkt->data.play.clientbound.plugin_message.channel);
-          if(channel_len > 20) { DEBUG_PRINT("Error for clientbound plugin message packet! Channel string length is greater than 20."); abort(); }
-
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_PLUGIN_MESSAGE));
-
-          ssize_t bytes_written_2 = mcpr_encode_string(bufpointer, pkt->data.play.clientbound.plugin_message.channel);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-
-          memcpy(bufpointer, pkt->data.play.clientbound.plugin_message.data, pkt->data.play.clientbound.plugin_message.data_length);
-          bufpointer += pkt->data.play.clientbound.plugin_message.data_length;
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_SPAWN_POSITION:
-        {
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_SPAWN_POSITION));
-          mcpr_encode_position(bufpointer, &(pkt->data.play.clientbound.spawn_position.location)); bufpointer += MCPR_POSITION_SIZE;
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_PLAYER_ABILITIES:
-        {
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_PLAYER_ABILITIES));
-
-          uint8_t flags = 0;
-          if(pkt->data.play.clientbound.player_abilities.invulnerable)  flags |= 0x01;
-          if(pkt->data.play.clientbound.player_abilities.is_flying)     flags |= 0x02;
-          if(pkt->data.play.clientbound.player_abilities.allow_flying)  flags |= 0x04;
-          if(pkt->data.play.clientbound.player_abilities.creative_mode)   flags |= 0x08;
-          mcpr_encode_byte(bufpointer, flags); bufpointer += MCPR_BYTE_SIZE;
-
-          ssize_t bytes_written_3 = mcpr_encode_float(bufpointer, pkt->data.play.clientbound.player_abilities.flying_speed);
-          if(bytes_written_3 < 0) { return 0; }
-          bufpointer += bytes_written_3;
-
-          ssize_t bytes_written_4 = mcpr_encode_float(bufpointer, pkt->data.play.clientbound.player_abilities.field_of_view_modifier);
-          if(bytes_written_4 < 0) { return 0; }
-          bufpointer += bytes_written_4;
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_PLAYER_POSITION_AND_LOOK:
-        {
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_PLAYER_POSITION_AND_LOOK));
-
-          ssize_t bytes_written_2 = mcpr_encode_double(bufpointer, pkt->data.play.clientbound.player_position_and_look.x);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-
-          ssize_t bytes_written_3 = mcpr_encode_double(bufpointer, pkt->data.play.clientbound.player_position_and_look.y);
-          if(bytes_written_3 < 0) { return 0; }
-          bufpointer += bytes_written_3;
-
-          ssize_t bytes_written_4 = mcpr_encode_double(bufpointer, pkt->data.play.clientbound.player_position_and_look.z);
-          if(bytes_written_4 < 0) { return 0; }
-          bufpointer += bytes_written_4;
-
-          ssize_t bytes_written_5 = mcpr_encode_float(bufpointer, pkt->data.play.clientbound.player_position_and_look.yaw);
-          if(bytes_written_5 < 0) { return 0; }
-          bufpointer += bytes_written_5;
-
-          ssize_t bytes_written_6 = mcpr_encode_float(bufpointer, pkt->data.play.clientbound.player_position_and_look.pitch);
-          if(bytes_written_6 < 0) { return 0; }
-          bufpointer += bytes_written_6;
-
-          int8_t flags = 0;
-          if(pkt->data.play.clientbound.player_position_and_look.x_is_relative)     flags |= 0x01;
-          if(pkt->data.play.clientbound.player_position_and_look.y_is_relative)     flags |= 0x02;
-          if(pkt->data.play.clientbound.player_position_and_look.z_is_relative)     flags |= 0x04;
-          if(pkt->data.play.clientbound.player_position_and_look.pitch_is_relative)   flags |= 0x08;
-          if(pkt->data.play.clientbound.player_position_and_look.yaw_is_relative)   flags |= 0x10;
-          mcpr_encode_byte(bufpointer, flags);
-          bufpointer += MCPR_BYTE_SIZE;
-
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.play.clientbound.player_position_and_look.teleport_id);
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_SB_KEEP_ALIVE:
-        {
-          void *bufpointer = out;
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_SB_KEEP_ALIVE));
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.play.serverbound.keep_alive.keep_alive_id);
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_SB_PLUGIN_MESSAGE:
-        {
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_SB_PLUGIN_MESSAGE));
-
-          ssize_t bytes_written_2 = mcpr_encode_string(bufpointer, pkt->data.play.serverbound.plugin_message.channel);
-          if(bytes_written_2 < 0) { return 0; }
-          bufpointer += bytes_written_2;
-
-          memcpy(bufpointer, pkt->data.play.serverbound.plugin_message.data, pkt->data.play.serverbound.plugin_message.data_length);
-          bufpointer += pkt->data.play.serverbound.plugin_message.data_length;
-
-          return bufpointer - out;
-        }
-
-        case MCPR_PKT_PL_CB_CHUNK_DATA:
-        {
-          size_t raw_block_entities_size = 0;
-          struct buffer *raw_block_entities = NULL;
-          if(pkt->data.play.clientbound.chunk_data.block_entities != NULL)
-          {
-            struct buffer tmp = nbt_dump_binary(pkt->data.play.clientbound.chunk_data.block_entities);
-            raw_block_entities = &tmp;
-            raw_block_entities_size = tmp.len;
-          }
-
-          int32_t data_size = 0;
-          if(pkt->data.play.clientbound.chunk_data.ground_up_continuous) data_size += 256;
-          for(size_t i = 0; i < pkt->data.play.clientbound.chunk_data.size; i++) // TODO what if integer overflow occurs here.
-          {
-            struct mcpr_chunk_section *section = pkt->data.play.clientbound.chunk_data.chunk_sections + i;
-            data_size += MCPR_UBYTE_SIZE;
-            data_size += mcpr_varint_bounds(section->palette_length);
-            data_size += section->palette_length * MCPR_VARINT_SIZE_MAX;
-            data_size += mcpr_varint_bounds(section->block_array_length);
-            data_size += section->block_array_length * 8;
-            data_size += 2048; // block light, half a byte per block in 16x16x16 chunk section.
-            if(section->sky_light != NULL) data_size += 2048;// sky light, half a byte per block in 16x16x16 chunk section.
-          }
-
-          void *bufpointer = out;
-
-          bufpointer += mcpr_encode_varint(bufpointer, mcpr_packet_type_to_byte(MCPR_PKT_PL_CB_CHUNK_DATA));
-          mcpr_encode_int(bufpointer, pkt->data.play.clientbound.chunk_data.chunk_x); bufpointer += MCPR_INT_SIZE;
-          mcpr_encode_int(bufpointer, pkt->data.play.clientbound.chunk_data.chunk_z); bufpointer += MCPR_INT_SIZE;
-          mcpr_encode_bool(bufpointer, pkt->data.play.clientbound.chunk_data.ground_up_continuous); bufpointer += MCPR_BOOL_SIZE;
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.play.clientbound.chunk_data.primary_bit_mask);
-          bufpointer += mcpr_encode_varint(bufpointer, data_size);
-
-          for(size_t i = 0; i < pkt->data.play.clientbound.chunk_data.size; i++)
-          {
-            struct mcpr_chunk_section *section = pkt->data.play.clientbound.chunk_data.chunk_sections + i;
-
-            mcpr_encode_ubyte(bufpointer, section->bits_per_block); bufpointer += MCPR_UBYTE_SIZE;
-            bufpointer += mcpr_encode_varint(bufpointer, section->palette_length);
-
-            if(section->palette_length > 0)
-            {
-              if((uint32_t) section->palette_length > SIZE_MAX)
-                { ninerr_set_err(ninerr_new("palette length of mcpr_chunk_section does not fit within size_t type.")); return 0; }
-              for(size_t j = 0; j < (size_t) section->palette_length; j++)
-              {
-                bufpointer += mcpr_encode_varint(bufpointer, section->palette[j]);
-              }
-            }
-            bufpointer += mcpr_encode_varint(bufpointer, section->block_array_length);
-            memcpy(bufpointer, section->blocks, section->block_array_length * 8); bufpointer += section->block_array_length * 8;
-            memcpy(bufpointer, section->block_light, 2048); bufpointer += 2048;
-            if(section->sky_light != NULL)
-            {
-              memcpy(bufpointer, section->sky_light, 2048); bufpointer += 2048;
-            }
-          }
-
-          if(pkt->data.play.clientbound.chunk_data.ground_up_continuous)
-          {
-            memcpy(bufpointer, pkt->data.play.clientbound.chunk_data.biomes, 256); bufpointer += 256;
-          }
-          bufpointer += mcpr_encode_varint(bufpointer, pkt->data.play.clientbound.chunk_data.block_entity_count);
-          if(pkt->data.play.clientbound.chunk_data.block_entity_count > 0)
-          {
-            memcpy(bufpointer, raw_block_entities->data, raw_block_entities->len); bufpointer += raw_block_entities->len;
-          }
-
-          if(raw_block_entities != NULL) buffer_free(raw_block_entities);
-          return bufpointer - out;
-        }
+        if(take(maxlen - offset, 1) < 0) return -1;
+        if(in[offset] == 0) return offset + 1; // TAG_End
+        ssize_t n = nbt_named_tag_size(in + offset, maxlen - offset, depth + 1);
+        if(n < 0) return -1;
+        offset += (size_t) n;
       }
     }
+
+    default:
+      ninerr_set_err(ninerr_new("Invalid NBT tag type %u.", (unsigned int) type));
+      return -1;
   }
-  END_IGNORE()
+}
 
-  // Shouldn't be reached anyway
+// Size of a tag with its type byte and name.
+static ssize_t nbt_named_tag_size(const unsigned char *in, size_t maxlen, unsigned int depth)
+{
+  if(take(maxlen, 1 + MCPR_USHORT_SIZE) < 0) return -1;
+  uint16_t name_length;
+  mcpr_decode_ushort(&name_length, in + 1);
+  size_t header_size = 1 + MCPR_USHORT_SIZE + (size_t) name_length;
+  if(take(maxlen, header_size) < 0) return -1;
+
+  ssize_t payload_size = nbt_payload_size(in[0], in + header_size, maxlen - header_size, depth);
+  if(payload_size < 0) return -1;
+  return header_size + payload_size;
+}
 
-  fprintf(stderr, "Packet encoding for packet with id %i is not implemented yet! (state: %s)\n", pkt->id, mcpr_state_to_string(pkt->state));
-  abort();
+static size_t slot_size(const struct mcpr_slot *slot)
+{
+  if(slot->item_id < 0) return MCPR_SHORT_SIZE;
+  return MCPR_SHORT_SIZE + MCPR_BYTE_SIZE + MCPR_SHORT_SIZE + ((slot->nbt_length == 0) ? 1 : slot->nbt_length);
 }
 
-ssize_t mcpr_decode_packet(struct mcpr_packet *out, const void *in, enum mcpr_state state, size_t maxlen)
+static size_t encode_slot(void *out, const struct mcpr_slot *slot)
 {
-  DEBUG_PRINT("in mcpr_decode_packet(state=%s, maxlen=%zu)", mcpr_state_to_string(state), maxlen);
+  unsigned char *ptr = out;
+  if(slot->item_id < 0)
+  {
+    mcpr_encode_short(ptr, -1);
+    return MCPR_SHORT_SIZE;
+  }
 
-  const void *ptr = in;
-  size_t len_left = maxlen;
-  int32_t packet_id;
-  ssize_t bytes_read_1 = mcpr_decode_varint(&packet_id, ptr, len_left);
-  if(bytes_read_1 < 0) return -1;
-  len_left -= bytes_read_1;
-  ptr += bytes_read_1;
-  DEBUG_PRINT("Decoding packet with id %ld", packet_id);
+  mcpr_encode_short(ptr, slot->item_id); ptr += MCPR_SHORT_SIZE;
+  mcpr_encode_byte(ptr, slot->count); ptr += MCPR_BYTE_SIZE;
+  mcpr_encode_short(ptr, slot->damage); ptr += MCPR_SHORT_SIZE;
+  if(slot->nbt_length == 0)
+  {
+    *ptr = 0; ptr++; // TAG_End, no NBT.
+  }
+  else
+  {
+    memcpy(ptr, slot->nbt, slot->nbt_length); ptr += slot->nbt_length;
+  }
+  return ptr - (unsigned char *) out;
+}
 
-  struct mcpr_packet *pkt = out;
-  if(!mcpr_get_packet_type(&(pkt->id), packet_id, state)) { ninerr_set_err(ninerr_new("Invalid packet id %ld", (long) packet_id)); return -1; }
+static ssize_t decode_slot(struct mcpr_slot *out, const unsigned char *in, size_t maxlen)
+{
+  if(take(maxlen, MCPR_SHORT_SIZE) < 0) return -1;
+  mcpr_decode_short(&(out->item_id), in);
+  out->count = 0;
+  out->damage = 0;
+  out->nbt_length = 0;
+  out->nbt = NULL;
+  if(out->item_id < 0) return MCPR_SHORT_SIZE;
+
+  size_t offset = MCPR_SHORT_SIZE;
+  if(take(maxlen - offset, MCPR_BYTE_SIZE + MCPR_SHORT_SIZE + 1) < 0) return -1;
+  mcpr_decode_byte(&(out->count), in + offset); offset += MCPR_BYTE_SIZE;
+  mcpr_decode_short(&(out->damage), in + offset); offset += MCPR_SHORT_SIZE;
+
+  if(in[offset] == 0) return offset + 1; // TAG_End, no NBT.
+  if(in[offset] != TAG_COMPOUND) { ninerr_set_err(ninerr_new("Item NBT is a tag of type %u instead of a compound.", (unsigned int) in[offset])); return -1; }
+  ssize_t nbt_length = nbt_named_tag_size(in + offset, maxlen - offset, 0);
+  if(nbt_length < 0) return -1;
+  out->nbt = in + offset;
+  out->nbt_length = (size_t) nbt_length;
+  return offset + (size_t) nbt_length;
+}
 
-  IGNORE("-Wswitch")
-  switch(state)
+static size_t slots_size(const struct mcpr_slot *slots, int16_t count)
+{
+  size_t size = 0;
+  for(int16_t i = 0; i < count; i++) size += slot_size(slots + i);
+  return size;
+}
+
+static size_t encode_slots(void *out, const struct mcpr_slot *slots, int16_t count)
+{
+  unsigned char *ptr = out;
+  for(int16_t i = 0; i < count; i++) ptr += encode_slot(ptr, slots + i);
+  return ptr - (unsigned char *) out;
+}
+
+static size_t encode_uuid_string(void *out, const struct ninuuid *uuid)
+{
+  char uuid_string[NINUUID_STRING_SIZE + 1];
+  ninuuid_to_string(uuid, uuid_string, LOWERCASE, false);
+  return encode_string(out, uuid_string);
+}
+
+/*
+ * Field kinds. Every kind has a SIZE_, ENCODE_ and DECODE_ macro taking the field's lvalue(s) and the kind's extra arguments.
+ * SIZE_ evaluates to the exact encoded size. ENCODE_ writes at ptr and evaluates to the amount of bytes written.
+ * DECODE_ reads from ptr, no further than left bytes, and sets n to the amount of bytes read, or -1 upon error.
+ * Kinds without a DECODE_ only occur in clientbound packets.
+ */
+#define SIZE_BOOL(v)      MCPR_BOOL_SIZE
+#define ENCODE_BOOL(v)    (mcpr_encode_bool(ptr, (v)), MCPR_BOOL_SIZE)
+#define DECODE_BOOL(v)    n = take(left, MCPR_BOOL_SIZE); if(n > 0) mcpr_decode_bool(&(v), ptr)
+
+#define SIZE_BYTE(v)      MCPR_BYTE_SIZE
+#define ENCODE_BYTE(v)    (mcpr_encode_byte(ptr, (v)), MCPR_BYTE_SIZE)
+#define DECODE_BYTE(v)    n = take(left, MCPR_BYTE_SIZE); if(n > 0) mcpr_decode_byte(&(v), ptr)
+
+#define SIZE_UBYTE(v)     MCPR_UBYTE_SIZE
+#define ENCODE_UBYTE(v)   (mcpr_encode_ubyte(ptr, (v)), MCPR_UBYTE_SIZE)
+#define DECODE_UBYTE(v)   n = take(left, MCPR_UBYTE_SIZE); if(n > 0) mcpr_decode_ubyte(&(v), ptr)
+
+#define SIZE_SHORT(v)     MCPR_SHORT_SIZE
+#define ENCODE_SHORT(v)   (mcpr_encode_short(ptr, (v)), MCPR_SHORT_SIZE)
+#define DECODE_SHORT(v)   n = take(left, MCPR_SHORT_SIZE); if(n > 0) mcpr_decode_short(&(v), ptr)
+
+#define SIZE_USHORT(v)    MCPR_USHORT_SIZE
+#define ENCODE_USHORT(v)  (mcpr_encode_ushort(ptr, (v)), MCPR_USHORT_SIZE)
+#define DECODE_USHORT(v)  n = take(left, MCPR_USHORT_SIZE); if(n > 0) mcpr_decode_ushort(&(v), ptr)
+
+#define SIZE_INT(v)       MCPR_INT_SIZE
+#define ENCODE_INT(v)     (mcpr_encode_int(ptr, (v)), MCPR_INT_SIZE)
+#define DECODE_INT(v)     n = take(left, MCPR_INT_SIZE); if(n > 0) mcpr_decode_int(&(v), ptr)
+
+#define SIZE_LONG(v)      MCPR_LONG_SIZE
+#define ENCODE_LONG(v)    (mcpr_encode_long(ptr, (v)), MCPR_LONG_SIZE)
+#define DECODE_LONG(v)    n = take(left, MCPR_LONG_SIZE); if(n > 0) mcpr_decode_long(&(v), ptr)
+
+#define SIZE_FLOAT(v)     MCPR_FLOAT_SIZE
+#define ENCODE_FLOAT(v)   (mcpr_encode_float(ptr, (v)), MCPR_FLOAT_SIZE)
+#define DECODE_FLOAT(v)   n = take(left, MCPR_FLOAT_SIZE); if(n > 0) mcpr_decode_float(&(v), ptr)
+
+#define SIZE_DOUBLE(v)    MCPR_DOUBLE_SIZE
+#define ENCODE_DOUBLE(v)  (mcpr_encode_double(ptr, (v)), MCPR_DOUBLE_SIZE)
+#define DECODE_DOUBLE(v)  n = take(left, MCPR_DOUBLE_SIZE); if(n > 0) mcpr_decode_double(&(v), ptr)
+
+#define SIZE_UUID(v)      MCPR_UUID_SIZE
+#define ENCODE_UUID(v)    (mcpr_encode_uuid(ptr, &(v)), MCPR_UUID_SIZE)
+#define DECODE_UUID(v)    n = take(left, MCPR_UUID_SIZE); if(n > 0) mcpr_decode_uuid(&(v), ptr)
+
+#define SIZE_POSITION(v)    MCPR_POSITION_SIZE
+#define ENCODE_POSITION(v)  (mcpr_encode_position(ptr, &(v)), MCPR_POSITION_SIZE)
+#define DECODE_POSITION(v)  n = take(left, MCPR_POSITION_SIZE); if(n > 0) mcpr_decode_position(&(v), ptr)
+
+#define SIZE_VARINT(v)    mcpr_varint_bounds(v)
+#define ENCODE_VARINT(v)  mcpr_encode_varint(ptr, (v))
+#define DECODE_VARINT(v)  n = mcpr_decode_varint(&(v), ptr, left)
+
+// An enum of which the values are 0 to count - 1, just like on the wire.
+#define SIZE_VARINT_ENUM(v, count)    mcpr_varint_bounds((int32_t) (v))
+#define ENCODE_VARINT_ENUM(v, count)  mcpr_encode_varint(ptr, (int32_t) (v))
+#define DECODE_VARINT_ENUM(v, count)  { int32_t value; n = decode_enum(&value, (count), ptr, left); (v) = value; }
+
+#define SIZE_BYTE_ENUM(v, count)    MCPR_BYTE_SIZE
+#define ENCODE_BYTE_ENUM(v, count)  (mcpr_encode_byte(ptr, (int8_t) (v)), MCPR_BYTE_SIZE)
+#define DECODE_BYTE_ENUM(v, count)  { int32_t value; n = decode_byte_enum(&value, (count), ptr, left); (v) = value; }
+
+// VarInts without a length in front, count is another field.
+#define SIZE_VARINTS(values, count)   mcpr_varints_bounds((values), (size_t) (count))
+#define ENCODE_VARINTS(values, count) mcpr_encode_varints(ptr, (values), (size_t) (count))
+
+#define SIZE_STRING(v)    string_size(v)
+#define ENCODE_STRING(v)  encode_string(ptr, (v))
+
+// Strings without a length in front, count is another field.
+#define SIZE_STRINGS(strings, count)    strings_size((strings), (count))
+#define ENCODE_STRINGS(strings, count)  encode_strings(ptr, (strings), (count))
+
+#define SIZE_STRING_VIEW(v)   (mcpr_varint_bounds((int32_t) (v).len) + (v).len)
+#define ENCODE_STRING_VIEW(v) ((size_t) mcpr_encode_string_view(ptr, (v)))
+#define DECODE_STRING_VIEW(v) n = mcpr_decode_string_view(&(v), ptr, left)
+
+#define SIZE_UUID_STRING(v)   (1 + NINUUID_STRING_SIZE)
+#define ENCODE_UUID_STRING(v) encode_uuid_string(ptr, &(v))
+
+// A VarInt length, followed by that many bytes.
+#define SIZE_BYTES(data, length)    (mcpr_varint_bounds(length) + (size_t) (length))
+#define ENCODE_BYTES(data, length)  encode_bytes(ptr, (data), (length))
+#define DECODE_BYTES(data, length)  { int32_t length_value; n = decode_bytes(&(data), &length_value, ptr, left); (length) = length_value; }
+
+// An item stack, see struct mcpr_slot.
+#define SIZE_SLOT(v)    slot_size(&(v))
+#define ENCODE_SLOT(v)  encode_slot(ptr, &(v))
+#define DECODE_SLOT(v)  n = decode_slot(&(v), ptr, left)
+
+// Slots without a length in front, count is another field.
+#define SIZE_SLOTS(slots, count)    slots_size((slots), (count))
+#define ENCODE_SLOTS(slots, count)  encode_slots(ptr, (slots), (count))
+
+// Everything up to the end of the packet.
+#define SIZE_REMAINING_BYTES(data, length)   (length)
+#define ENCODE_REMAINING_BYTES(data, length) (memcpy(ptr, (data), (length)), (length))
+#define DECODE_REMAINING_BYTES(data, length) { (data) = ptr; (length) = left; n = (ssize_t) left; }
+
+// The handshake's next state, 1 for status and 2 for login.
+#define SIZE_NEXT_STATE(v)    ((size_t) 1)
+#define ENCODE_NEXT_STATE(v)  mcpr_encode_varint(ptr, ((v) == MCPR_STATE_STATUS) ? 1 : 2)
+#define DECODE_NEXT_STATE(v) \
+  { \
+    int32_t next_state; \
+    n = mcpr_decode_varint(&next_state, ptr, left); \
+    if(n >= 0 && next_state != 1 && next_state != 2) { ninerr_set_err(ninerr_new("Received invalid next state %i in handshake packet.", next_state)); n = -1; } \
+    (v) = (next_state == 1) ? MCPR_STATE_STATUS : MCPR_STATE_LOGIN; \
+  }
+
+// A field of another kind that is only there if cond is true, cond may refer to the fields before it.
+#define SIZE_OPTIONAL(cond, kind, ...)    ((cond) ? SIZE_##kind(__VA_ARGS__) : 0)
+#define ENCODE_OPTIONAL(cond, kind, ...)  ((cond) ? ENCODE_##kind(__VA_ARGS__) : 0)
+#define DECODE_OPTIONAL(cond, kind, ...)  if(cond) { DECODE_##kind(__VA_ARGS__); } else { n = 0; }
+
+#define FIELD_SIZE(kind, ...)   size += SIZE_##kind(__VA_ARGS__);
+#define FIELD_ENCODE(kind, ...) ptr += ENCODE_##kind(__VA_ARGS__);
+#define FIELD_DECODE(kind, ...) { ssize_t n; DECODE_##kind(__VA_ARGS__); if(n < 0) return -1; ptr += n; left -= (size_t) n; }
+
+#define GENERATE_ENCODER(DIR, dir, name, path) \
+  static size_t dir##_size_##name(const struct mcpr_packet *pkt) \
+  { \
+    (void) pkt; \
+    size_t size = 0; \
+    MCPR_##DIR##_FIELDS_##name(FIELD_SIZE, pkt->data.path) \
+    return size; \
+  } \
+  static ssize_t dir##_encode_##name(void *out, const struct mcpr_packet *pkt) \
+  { \
+    (void) pkt; \
+    unsigned char *ptr = out; \
+    MCPR_##DIR##_FIELDS_##name(FIELD_ENCODE, pkt->data.path) \
+    return ptr - (unsigned char *) out; \
+  }
+
+#define GENERATE_DECODER(DIR, dir, name, path) \
+  static ssize_t dir##_decode_##name(struct mcpr_packet *pkt, const void *in, size_t maxlen) \
+  { \
+    (void) pkt; \
+    const unsigned char *ptr = in; \
+    size_t left = maxlen; \
+    MCPR_##DIR##_FIELDS_##name(FIELD_DECODE, pkt->data.path) \
+    (void) left; \
+    return ptr - (const unsigned char *) in; \
+  }
+
+#define GENERATE_SB_FIELDS(name, path) GENERATE_ENCODER(SB, sb, name, path) GENERATE_DECODER(SB, sb, name, path)
+#define GENERATE_SB_CUSTOM(name, path)
+#define GENERATE_SB_NONE(name, path)
+#define GENERATE_CB_FIELDS(name, path) GENERATE_ENCODER(CB, cb, name, path)
+#define GENERATE_CB_CUSTOM(name, path)
+#define GENERATE_CB_NONE(name, path)
+
+#define X(type, state, id, name, path, layout) GENERATE_SB_##layout(name, path)
+MCPR_SERVERBOUND_PACKETS(X)
+#undef X
+#define X(type, state, id, name, path, layout) GENERATE_CB_##layout(name, path)
+MCPR_CLIENTBOUND_PACKETS(X)
+#undef X
+
+
+// The CUSTOM packets.
+
+static size_t cb_size_st_response(const struct mcpr_packet *pkt)
+{
+  char *response = server_list_response_to_json(pkt);
+  if(response == NULL) { return 0; }
+  size_t len = strlen(response);
+  free(response);
+
+  return mcpr_varint_bounds((int32_t) len) + len;
+}
+
+static ssize_t cb_encode_st_response(void *out, const struct mcpr_packet *pkt)
+{
+  char *response = server_list_response_to_json(pkt);
+  if(response == NULL) { return -1; }
+  DEBUG_PRINT("Response: %s\n", response);
+  size_t written = encode_string(out, response);
+  free(response);
+  return written;
+}
+
+// Returns NULL for invalid values.
+static const char *level_type_name(enum mcpr_level level_type)
+{
+  switch(level_type)
   {
-    case MCPR_STATE_HANDSHAKE:
-    {
-      ssize_t bytes_read_2 = mcpr_decode_varint(&(pkt->data.handshake.serverbound.handshake.protocol_version), ptr, len_left);
-      if(bytes_read_2 < 0) { free(pkt); return -1; }
-      len_left -= bytes_read_2;
-      ptr += bytes_read_2;
-
-      // Dont forget to free server_address
-      ssize_t bytes_read_3 = mcpr_decode_string(&(pkt->data.handshake.serverbound.handshake.server_address), ptr, len_left);
-      if(bytes_read_3 < 0) { free(pkt); return -1; }
-      len_left -= bytes_read_3;
-      ptr += bytes_read_3;
-
-      if(len_left < MCPR_USHORT_SIZE) { free(pkt->data.handshake.serverbound.handshake.server_address); free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return false; }
-      mcpr_decode_ushort(&(pkt->data.handshake.serverbound.handshake.server_port), ptr);
-      len_left -= MCPR_USHORT_SIZE;
-      ptr += MCPR_USHORT_SIZE;
-
-      int32_t next_state;
-      ssize_t bytes_read_5 = mcpr_decode_varint(&next_state, ptr, len_left);
-      if(bytes_read_5 < 0) { free(pkt->data.handshake.serverbound.handshake.server_address); free(pkt); return -1;  }
-      if(next_state != 1 && next_state != 2) { free(pkt->data.handshake.serverbound.handshake.server_address); free(pkt); ninerr_set_err(ninerr_new("Received invalid next state %i in handshake packet.", next_state)); return false; }
-      pkt->data.handshake.serverbound.handshake.next_state = (next_state == 1) ? MCPR_STATE_STATUS : MCPR_STATE_LOGIN;
-      ptr += bytes_read_5;
-
-      return ptr - in;
-    }
+    case MCPR_LEVEL_DEFAULT:        return "default";
+    case MCPR_LEVEL_FLAT:           return "flat";
+    case MCPR_LEVEL_LARGE_BIOMES:   return "largeBiomes";
+    case MCPR_LEVEL_AMPLIFIED:      return "amplified";
+    case MCPR_LEVEL_DEFAULT_1_1:    return "default_1_1";
+    default:                        return NULL;
+  }
+}
 
-    case MCPR_STATE_LOGIN:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_LG_SB_LOGIN_START:
-        {
-          ssize_t bytes_read_2 = mcpr_decode_string(&(pkt->data.login.serverbound.login_start.name), ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          return bytes_read_2 + bytes_read_1;
-        }
-
-        case MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE:
-        {
-          int32_t shared_secret_length;
-          ssize_t bytes_read_2 = mcpr_decode_varint(&shared_secret_length, ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          if(shared_secret_length < 0) { ninerr_set_err(ninerr_new("Read invalid shared secret length (" PRId32 ").", shared_secret_length)); free(pkt); return -1; }
-          IGNORE("-Wtype-limits")
-          if((uint32_t) shared_secret_length > SIZE_MAX) { ninerr_set_err(ninerr_arithmetic_new()); free(pkt); return -1; }
-          END_IGNORE()
-          pkt->data.login.serverbound.encryption_response.shared_secret_length = shared_secret_length;
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          pkt->data.login.serverbound.encryption_response.shared_secret = malloc(shared_secret_length);
-          if(pkt->data.login.serverbound.encryption_response.shared_secret == NULL) { ninerr_set_err(ninerr_from_errno()); free(pkt); return -1; }
-          memcpy(pkt->data.login.serverbound.encryption_response.shared_secret, ptr, shared_secret_length);
-          ptr += shared_secret_length;
-          len_left -= shared_secret_length;
-
-          int32_t verify_token_length;
-          ssize_t bytes_read_3 = mcpr_decode_varint(&verify_token_length, ptr, len_left);
-          if(bytes_read_3 < 0) { free(pkt); return -1; }
-          if(verify_token_length < 0) { ninerr_set_err(ninerr_new("Read invalid verify token length (" PRId32 ").", shared_secret_length)); free(pkt); return -1; }
-          IGNORE("-Wtype-limits")
-          if((uint32_t) verify_token_length > SIZE_MAX) { ninerr_set_err(ninerr_arithmetic_new()); free(pkt); return -1; }
-          END_IGNORE()
-          pkt->data.login.serverbound.encryption_response.verify_token_length = verify_token_length;
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          pkt->data.login.serverbound.encryption_response.verify_token = malloc(verify_token_length);
-          if(pkt->data.login.serverbound.encryption_response.verify_token == NULL) { ninerr_set_err(ninerr_from_errno()); free(pkt); return -1; }
-          memcpy(pkt->data.login.serverbound.encryption_response.verify_token, ptr, verify_token_length);
-          ptr += verify_token_length;
-          len_left -= verify_token_length;
-
-          return ptr - in;
-        }
-      }
-    }
+static size_t level_type_size(enum mcpr_level level_type)
+{
+  const char *name = level_type_name(level_type);
+  return (name == NULL) ? 0 : string_size(name);
+}
 
-    case MCPR_STATE_STATUS:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_ST_SB_PING:
-        {
-          if(len_left < MCPR_LONG_SIZE) { ninerr_set_err(ninerr_new("Max packet length exceeded.")); free(pkt); return -1; }
-          mcpr_decode_long(&(pkt->data.status.serverbound.ping.payload), ptr);
-          return MCPR_LONG_SIZE + bytes_read_1;
-        }
-
-        case MCPR_PKT_ST_SB_REQUEST:
-        {
-          return bytes_read_1;
-        }
-      }
-    }
+// The enums join game and respawn share, checked before anything is written so that a failed encode doesn't overrun the bounds.
+struct world_info
+{
+  int32_t dimension;
+  uint8_t gamemode;
+  uint8_t difficulty;
+  const char *level_type;
+};
+
+static bool encode_world_info(struct world_info *out, enum mcpr_dimension dimension, enum mcpr_gamemode gamemode,
+  enum mcpr_difficulty difficulty, enum mcpr_level level_type)
+{
+  switch(dimension)
+  {
+    case MCPR_DIMENSION_NETHER:     out->dimension = -1; break;
+    case MCPR_DIMENSION_OVERWORLD:  out->dimension = 0;  break;
+    case MCPR_DIMENSION_END:        out->dimension = 1;  break;
+    default: ninerr_set_err(ninerr_new("Invalid dimension %i.", (int) dimension)); return false;
+  }
 
-    case MCPR_STATE_PLAY:
-    {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_PL_SB_CHAT_MESSAGE:
-        {
-          ssize_t bytes_read_2 = mcpr_decode_string(&(pkt->data.play.serverbound.chat_message.message), ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_CLIENT_SETTINGS:
-        {
-          ssize_t bytes_read_2 = mcpr_decode_string(&(pkt->data.play.serverbound.client_settings.locale), ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          if(len_left < 1) { ninerr_set_err(ninerr_new("Max decoding length exceeded.")); free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1; }
-          mcpr_decode_byte(&(pkt->data.play.serverbound.client_settings.view_distance), ptr);
-          ptr += MCPR_BYTE_SIZE;
-          len_left -= MCPR_BYTE_SIZE;
-
-          int32_t chat_mode_int;
-          ssize_t bytes_read_4 = mcpr_decode_varint(&chat_mode_int, ptr, len_left);
-          if(bytes_read_4 < 0) { free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1; }
-          switch(chat_mode_int)
-          {
-            case 0: pkt->data.play.serverbound.client_settings.chat_mode = MCPR_CHAT_MODE_ENABLED; break;
-            case 1: pkt->data.play.serverbound.client_settings.chat_mode = MCPR_CHAT_MODE_COMMANDS_ONLY; break;
-            case 2: pkt->data.play.serverbound.client_settings.chat_mode = MCPR_CHAT_MODE_HIDDEN; break;
-            default: ninerr_set_err(ninerr_new("Invalid value %ld for chat mode in client settings packet.",
-              (long) chat_mode_int)); free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1;
-          }
-          ptr += bytes_read_4;
-          len_left -= bytes_read_4;
-
-          if(len_left < MCPR_BOOL_SIZE)
-            { ninerr_set_err(ninerr_new("Max packet length exceeded.")); free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1; }
-          mcpr_decode_bool(&(pkt->data.play.serverbound.client_settings.chat_colors), ptr);
-          ptr += MCPR_BOOL_SIZE;
-          len_left -= MCPR_BOOL_SIZE;
-
-          if(len_left < 1) { ninerr_set_err(ninerr_new("Max packet length exceeded."));
-           free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1; }
-          uint8_t displayed_skin_parts;
-          mcpr_decode_ubyte(&displayed_skin_parts, ptr);
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.cape_enabled = displayed_skin_parts & 0x01;
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.jacket_enabled = displayed_skin_parts & 0x02;
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.left_sleeve_enabled = displayed_skin_parts & 0x04;
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.right_sleeve_enabled = displayed_skin_parts & 0x08;
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.left_pants_enabled = displayed_skin_parts & 0x10;
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.right_pants_enabled = displayed_skin_parts & 0x20;
-          pkt->data.play.serverbound.client_settings.displayed_skin_parts.hat_enabled = displayed_skin_parts & 0x40;
-          ptr += MCPR_UBYTE_SIZE;
-          len_left -= MCPR_UBYTE_SIZE;
-
-          int32_t main_hand;
-          ssize_t bytes_read_7 = mcpr_decode_varint(&main_hand, ptr, len_left);
-          if(bytes_read_7 < 0) { free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1; }
-          switch(main_hand)
-          {
-            case 0: pkt->data.play.serverbound.client_settings.main_hand = MCPR_HAND_LEFT; break;
-            case 1: pkt->data.play.serverbound.client_settings.main_hand = MCPR_HAND_RIGHT; break;
-            default: ninerr_set_err(ninerr_new("Invalid value %ld for main hand in client settings packet. Expected either 0 for left hand or 1 for right hand.",
-                  (long) main_hand)); free(pkt); free(pkt->data.play.serverbound.client_settings.locale); return -1;
-          }
-          ptr += bytes_read_7;
-          len_left -= bytes_read_7;
-
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_PLUGIN_MESSAGE:
-        {
-          ssize_t bytes_read_2 = mcpr_decode_string(&(pkt->data.play.serverbound.plugin_message.channel), ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          pkt->data.play.serverbound.plugin_message.data = malloc(len_left);
-          if(pkt->data.play.serverbound.plugin_message.data == NULL)
-            { free(pkt->data.play.serverbound.plugin_message.channel); free(pkt); ninerr_set_err(ninerr_from_errno()); return -1; }
-          memcpy(pkt->data.play.serverbound.plugin_message.data, ptr, len_left);
-          ptr += len_left;
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_KEEP_ALIVE:
-        {
-          ssize_t bytes_read_2 = mcpr_decode_varint(&(pkt->data.play.serverbound.keep_alive.keep_alive_id), ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_PLAYER_POSITION:
-        {
-          if(len_left < MCPR_DOUBLE_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_2 = mcpr_decode_double(&(pkt->data.play.serverbound.player_position.x), ptr);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          if(len_left < MCPR_DOUBLE_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_3 = mcpr_decode_double(&(pkt->data.play.serverbound.player_position.feet_y), ptr);
-          if(bytes_read_3 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_3;
-          len_left -= bytes_read_3;
-
-          if(len_left < MCPR_DOUBLE_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_4 = mcpr_decode_double(&(pkt->data.play.serverbound.player_position.z), ptr);
-          if(bytes_read_4 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_4;
-          len_left -= bytes_read_4;
-
-          if(len_left < MCPR_BOOL_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          mcpr_decode_bool(&(pkt->data.play.serverbound.player_position_and_look.on_ground), ptr);
-          ptr += MCPR_BOOL_SIZE;
-
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_PLAYER_POSITION_AND_LOOK:
-        {
-          if(len_left < MCPR_DOUBLE_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_2 = mcpr_decode_double(&(pkt->data.play.serverbound.player_position_and_look.x), ptr);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          if(len_left < MCPR_DOUBLE_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_3 = mcpr_decode_double(&(pkt->data.play.serverbound.player_position_and_look.feet_y), ptr);
-          if(bytes_read_3 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_3;
-          len_left -= bytes_read_3;
-
-          if(len_left < MCPR_DOUBLE_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_4 = mcpr_decode_double(&(pkt->data.play.serverbound.player_position_and_look.z), ptr);
-          if(bytes_read_4 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_4;
-          len_left -= bytes_read_4;
-
-          if(len_left < MCPR_FLOAT_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_5 = mcpr_decode_float(&(pkt->data.play.serverbound.player_position_and_look.yaw), ptr);
-          if(bytes_read_5 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_5;
-          len_left -= bytes_read_5;
-
-          if(len_left < MCPR_FLOAT_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_6 = mcpr_decode_float(&(pkt->data.play.serverbound.player_position_and_look.pitch), ptr);
-          if(bytes_read_6 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_6;
-          len_left -= bytes_read_6;
-
-          if(len_left < MCPR_BOOL_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          mcpr_decode_bool(&(pkt->data.play.serverbound.player_position_and_look.on_ground), ptr);
-          ptr += MCPR_BOOL_SIZE;
-
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_TELEPORT_CONFIRM:
-        {
-          ssize_t bytes_read_2 = mcpr_decode_varint(&(pkt->data.play.serverbound.teleport_confirm.teleport_id), ptr, len_left);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_PLAYER_LOOK:
-        {
-          if(len_left < MCPR_FLOAT_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_2 = mcpr_decode_float(&(pkt->data.play.serverbound.player_look.yaw), ptr);
-          if(bytes_read_2 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_2;
-          len_left -= bytes_read_2;
-
-          if(len_left < MCPR_FLOAT_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          ssize_t bytes_read_3 = mcpr_decode_float(&(pkt->data.play.serverbound.player_look.pitch), ptr);
-          if(bytes_read_3 < 0) { free(pkt); return -1; }
-          ptr += bytes_read_3;
-          len_left -= bytes_read_3;
-
-          if(len_left < MCPR_BOOL_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          mcpr_decode_bool(&(pkt->data.play.serverbound.player_look.on_ground), ptr);
-          ptr += MCPR_BOOL_SIZE;
-
-          return ptr - in;
-        }
-
-        case MCPR_PKT_PL_SB_HELD_ITEM_CHANGE:
-        {
-          if(len_left < MCPR_SHORT_SIZE) { free(pkt); ninerr_set_err(ninerr_new("Max packet length exceeded.")); return -1; }
-          mcpr_decode_short(&(pkt->data.play.serverbound.held_item_change.slot), ptr);
-          ptr += MCPR_SHORT_SIZE;
-          len_left -= MCPR_SHORT_SIZE;
-          return ptr - in;
-        }
-      }
-    }
+  if(gamemode < MCPR_GAMEMODE_SURVIVAL || gamemode > MCPR_GAMEMODE_SPECTATOR) { ninerr_set_err(ninerr_new("Invalid gamemode %i.", (int) gamemode)); return false; }
+  out->gamemode = (uint8_t) gamemode;
+
+  if(difficulty < MCPR_DIFFICULTY_PEACEFUL || difficulty > MCPR_DIFFICULTY_HARD) { ninerr_set_err(ninerr_new("Invalid difficulty %i.", (int) difficulty)); return false; }
+  out->difficulty = (uint8_t) difficulty;
+
+  out->level_type = level_type_name(level_type);
+  if(out->level_type == NULL) { ninerr_set_err(ninerr_new("Invalid level type %i.", (int) level_type)); return false; }
+  return true;
+}
+
+static size_t cb_size_pl_join_game(const struct mcpr_packet *pkt)
+{
+  return MCPR_INT_SIZE + MCPR_UBYTE_SIZE + MCPR_INT_SIZE + MCPR_UBYTE_SIZE + MCPR_UBYTE_SIZE +
+    level_type_size(pkt->data.play.clientbound.join_game.level_type) + MCPR_BOOL_SIZE;
+}
+
+static ssize_t cb_encode_pl_join_game(void *out, const struct mcpr_packet *pkt)
+{
+  struct world_info info;
+  if(!encode_world_info(&info, pkt->data.play.clientbound.join_game.dimension, pkt->data.play.clientbound.join_game.gamemode,
+    pkt->data.play.clientbound.join_game.difficulty, pkt->data.play.clientbound.join_game.level_type)) return -1;
+
+  unsigned char *ptr = out;
+  mcpr_encode_int(ptr, pkt->data.play.clientbound.join_game.entity_id); ptr += MCPR_INT_SIZE;
+  uint8_t gamemode = info.gamemode;
+  if(pkt->data.play.clientbound.join_game.hardcore) gamemode = gamemode | 0x08;
+  mcpr_encode_ubyte(ptr, gamemode); ptr += MCPR_UBYTE_SIZE;
+  mcpr_encode_int(ptr, info.dimension); ptr += MCPR_INT_SIZE;
+  mcpr_encode_ubyte(ptr, info.difficulty); ptr += MCPR_UBYTE_SIZE;
+  mcpr_encode_ubyte(ptr, pkt->data.play.clientbound.join_game.max_players); ptr += MCPR_UBYTE_SIZE;
+  ptr += encode_string(ptr, info.level_type);
+  mcpr_encode_bool(ptr, pkt->data.play.clientbound.join_game.reduced_debug_info); ptr += MCPR_BOOL_SIZE;
+
+  return ptr - (unsigned char *) out;
+}
+
+static size_t cb_size_pl_respawn(const struct mcpr_packet *pkt)
+{
+  return MCPR_INT_SIZE + MCPR_UBYTE_SIZE + MCPR_UBYTE_SIZE + level_type_size(pkt->data.play.clientbound.respawn.level_type);
+}
+
+static ssize_t cb_encode_pl_respawn(void *out, const struct mcpr_packet *pkt)
+{
+  struct world_info info;
+  if(!encode_world_info(&info, pkt->data.play.clientbound.respawn.dimension, pkt->data.play.clientbound.respawn.gamemode,
+    pkt->data.play.clientbound.respawn.difficulty, pkt->data.play.clientbound.respawn.level_type)) return -1;
+
+  unsigned char *ptr = out;
+  mcpr_encode_int(ptr, info.dimension); ptr += MCPR_INT_SIZE;
+  mcpr_encode_ubyte(ptr, info.difficulty); ptr += MCPR_UBYTE_SIZE;
+  mcpr_encode_ubyte(ptr, info.gamemode); ptr += MCPR_UBYTE_SIZE;
+  ptr += encode_string(ptr, info.level_type);
+
+  return ptr - (unsigned char *) out;
+}
+
+// The wire skips 9, the elder guardian appearance is 10.
+static size_t cb_size_pl_change_game_state(const struct mcpr_packet *pkt)
+{
+  return MCPR_UBYTE_SIZE + MCPR_FLOAT_SIZE;
+}
+
+static ssize_t cb_encode_pl_change_game_state(void *out, const struct mcpr_packet *pkt)
+{
+  enum mcpr_game_state_effect reason = pkt->data.play.clientbound.change_game_state.reason;
+  if(reason < MCPR_GAME_STATE_EFFECT_INVALID_BED || reason > MCPR_GAME_STATE_EFFECT_ELDER_GUARDIAN_APPEARANCE)
+    { ninerr_set_err(ninerr_new("Invalid game state change reason %i.", (int) reason)); return -1; }
+
+  unsigned char *ptr = out;
+  mcpr_encode_ubyte(ptr, (reason == MCPR_GAME_STATE_EFFECT_ELDER_GUARDIAN_APPEARANCE) ? 10 : (uint8_t) reason); ptr += MCPR_UBYTE_SIZE;
+  ptr += mcpr_encode_float(ptr, pkt->data.play.clientbound.change_game_state.value);
+  return ptr - (unsigned char *) out;
+}
+
+// Returns NULL for invalid values.
+static const char *advancement_tab_name(enum mcpr_select_advancement_tab_id id)
+{
+  switch(id)
+  {
+    case MCPR_SELECT_ADVANCEMENT_TAB_ID_STORY_ROOT:     return "minecraft:story/root";
+    case MCPR_SELECT_ADVANCEMENT_TAB_ID_NETHER_ROOT:    return "minecraft:nether/root";
+    case MCPR_SELECT_ADVANCEMENT_TAB_ID_END_ROOT:       return "minecraft:end/root";
+    case MCPR_SELECT_ADVANCEMENT_TAB_ID_ADVENTURE_ROOT: return "minecraft:adventure/root";
+    case MCPR_SELECT_ADVANCEMENT_TAB_ID_HUSBANDRY_ROOT: return "minecraft:husbandry/root";
+    default:                                            return NULL;
   }
-  END_IGNORE()
+}
 
-  // Shouldn't be reached anyway
-  DEBUG_PRINT("Decoding for packet is not implemented yet! (state: %s)", mcpr_state_to_string(state));
-  return -1;
+static size_t cb_size_pl_select_advancement_tab(const struct mcpr_packet *pkt)
+{
+  const char *name = advancement_tab_name(pkt->data.play.clientbound.select_advancement_tab.identifier);
+  return MCPR_BOOL_SIZE + ((pkt->data.play.clientbound.select_advancement_tab.has_id && name != NULL) ? string_size(name) : 0);
 }
 
-// Last updated for 1.12.1 protocol
-bool mcpr_get_packet_type(enum mcpr_packet_type *out, uint8_t id, enum mcpr_state state)
+static ssize_t cb_encode_pl_select_advancement_tab(void *out, const struct mcpr_packet *pkt)
 {
-  // only serverbound packets for now
-  switch(state)
+  unsigned char *ptr = out;
+  bool has_id = pkt->data.play.clientbound.select_advancement_tab.has_id;
+  const char *name = NULL;
+  if(has_id)
   {
-    case MCPR_STATE_HANDSHAKE: *out = 0x00; return true;
+    name = advancement_tab_name(pkt->data.play.clientbound.select_advancement_tab.identifier);
+    if(name == NULL) { ninerr_set_err(ninerr_new("Invalid advancement tab %i.", (int) pkt->data.play.clientbound.select_advancement_tab.identifier)); return -1; }
+  }
 
-    case MCPR_STATE_LOGIN:
-    {
-      switch(id)
-      {
-        case 0x00: *out = MCPR_PKT_LG_SB_LOGIN_START;       return true;
-        case 0x01: *out = MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE;   return true;
-        default: return false;
-      }
-    }
+  mcpr_encode_bool(ptr, has_id); ptr += MCPR_BOOL_SIZE;
+  if(has_id) ptr += encode_string(ptr, name);
+  return ptr - (unsigned char *) out;
+}
 
-    case MCPR_STATE_STATUS:
-    {
-      switch(id)
-      {
-        case 0x00: *out = MCPR_PKT_ST_SB_REQUEST;   return true;
-        case 0x01: *out = MCPR_PKT_ST_SB_PING;    return true;
-        default: return false;
-      }
-    }
+static size_t cb_size_pl_player_abilities(const struct mcpr_packet *pkt)
+{
+  return MCPR_BYTE_SIZE + MCPR_FLOAT_SIZE + MCPR_FLOAT_SIZE;
+}
+
+static ssize_t cb_encode_pl_player_abilities(void *out, const struct mcpr_packet *pkt)
+{
+  unsigned char *ptr = out;
+
+  uint8_t flags = 0;
+  if(pkt->data.play.clientbound.player_abilities.invulnerable)  flags |= 0x01;
+  if(pkt->data.play.clientbound.player_abilities.is_flying)     flags |= 0x02;
+  if(pkt->data.play.clientbound.player_abilities.allow_flying)  flags |= 0x04;
+  if(pkt->data.play.clientbound.player_abilities.creative_mode)   flags |= 0x08;
+  mcpr_encode_byte(ptr, flags); ptr += MCPR_BYTE_SIZE;
+  ptr += mcpr_encode_float(ptr, pkt->data.play.clientbound.player_abilities.flying_speed);
+  ptr += mcpr_encode_float(ptr, pkt->data.play.clientbound.player_abilities.field_of_view_modifier);
+
+  return ptr - (unsigned char *) out;
+}
+
+static size_t cb_size_pl_player_position_and_look(const struct mcpr_packet *pkt)
+{
+  return MCPR_DOUBLE_SIZE * 3 + MCPR_FLOAT_SIZE * 2 + MCPR_BYTE_SIZE +
+    mcpr_varint_bounds(pkt->data.play.clientbound.player_position_and_look.teleport_id);
+}
+
+static ssize_t cb_encode_pl_player_position_and_look(void *out, const struct mcpr_packet *pkt)
+{
+  unsigned char *ptr = out;
+
+  ptr += mcpr_encode_double(ptr, pkt->data.play.clientbound.player_position_and_look.x);
+  ptr += mcpr_encode_double(ptr, pkt->data.play.clientbound.player_position_and_look.y);
+  ptr += mcpr_encode_double(ptr, pkt->data.play.clientbound.player_position_and_look.z);
+  ptr += mcpr_encode_float(ptr, pkt->data.play.clientbound.player_position_and_look.yaw);
+  ptr += mcpr_encode_float(ptr, pkt->data.play.clientbound.player_position_and_look.pitch);
+
+  int8_t flags = 0;
+  if(pkt->data.play.clientbound.player_position_and_look.x_is_relative)     flags |= 0x01;
+  if(pkt->data.play.clientbound.player_position_and_look.y_is_relative)     flags |= 0x02;
+  if(pkt->data.play.clientbound.player_position_and_look.z_is_relative)     flags |= 0x04;
+  if(pkt->data.play.clientbound.player_position_and_look.pitch_is_relative)   flags |= 0x08;
+  if(pkt->data.play.clientbound.player_position_and_look.yaw_is_relative)   flags |= 0x10;
+  mcpr_encode_byte(ptr, flags); ptr += MCPR_BYTE_SIZE;
+
+  ptr += mcpr_encode_varint(ptr, pkt->data.play.clientbound.player_position_and_look.teleport_id);
+
+  return ptr - (unsigned char *) out;
+}
+
+// Size of the chunk sections and biomes, which are sent as a single byte array.
+static int32_t chunk_data_size(const struct mcpr_packet *pkt)
+{
+  int32_t data_size = 0;
+  if(pkt->data.play.clientbound.chunk_data.ground_up_continuous) data_size += 256;
+  for(size_t i = 0; i < pkt->data.play.clientbound.chunk_data.size; i++) // TODO what if integer overflow occurs here.
+  {
+    struct mcpr_chunk_section *section = pkt->data.play.clientbound.chunk_data.chunk_sections + i;
+    data_size += MCPR_UBYTE_SIZE;
+    data_size += mcpr_varint_bounds(section->palette_length);
+    data_size += mcpr_varints_bounds(section->palette, (size_t) section->palette_length);
+    data_size += mcpr_varint_bounds(section->block_array_length);
+    data_size += section->block_array_length * 8;
+    data_size += 2048; // block light, half a byte per block in 16x16x16 chunk section.
+    if(section->sky_light != NULL) data_size += 2048;// sky light, half a byte per block in 16x16x16 chunk section.
+  }
+  return data_size;
+}
+
+static size_t cb_size_pl_chunk_data(const struct mcpr_packet *pkt)
+{
+  size_t raw_block_entities_size = 0;
+  if(pkt->data.play.clientbound.chunk_data.block_entities != NULL)
+  {
+    struct buffer raw_block_entities = nbt_dump_binary(pkt->data.play.clientbound.chunk_data.block_entities);
+    raw_block_entities_size = raw_block_entities.len;
+    buffer_free(&raw_block_entities);
+  }
 
-    case MCPR_STATE_PLAY:
+  int32_t data_size = chunk_data_size(pkt);
+  return MCPR_INT_SIZE +
+    MCPR_INT_SIZE +
+    MCPR_BOOL_SIZE +
+    mcpr_varint_bounds(pkt->data.play.clientbound.chunk_data.primary_bit_mask) +
+    mcpr_varint_bounds(data_size) +
+    data_size +
+    mcpr_varint_bounds(pkt->data.play.clientbound.chunk_data.block_entity_count) +
+    raw_block_entities_size;
+}
+
+static ssize_t cb_encode_pl_chunk_data(void *out, const struct mcpr_packet *pkt)
+{
+  unsigned char *ptr = out;
+
+  mcpr_encode_int(ptr, pkt->data.play.clientbound.chunk_data.chunk_x); ptr += MCPR_INT_SIZE;
+  mcpr_encode_int(ptr, pkt->data.play.clientbound.chunk_data.chunk_z); ptr += MCPR_INT_SIZE;
+  mcpr_encode_bool(ptr, pkt->data.play.clientbound.chunk_data.ground_up_continuous); ptr += MCPR_BOOL_SIZE;
+  ptr += mcpr_encode_varint(ptr, pkt->data.play.clientbound.chunk_data.primary_bit_mask);
+  ptr += mcpr_encode_varint(ptr, chunk_data_size(pkt));
+
+  for(size_t i = 0; i < pkt->data.play.clientbound.chunk_data.size; i++)
+  {
+    struct mcpr_chunk_section *section = pkt->data.play.clientbound.chunk_data.chunk_sections + i;
+
+    mcpr_encode_ubyte(ptr, section->bits_per_block); ptr += MCPR_UBYTE_SIZE;
+    ptr += mcpr_encode_varint(ptr, section->palette_length);
+
+    ptr += mcpr_encode_varints(ptr, section->palette, (size_t) section->palette_length);
+    ptr += mcpr_encode_varint(ptr, section->block_array_length);
+    memcpy(ptr, section->blocks, section->block_array_length * 8); ptr += section->block_array_length * 8;
+    memcpy(ptr, section->block_light, 2048); ptr += 2048;
+    if(section->sky_light != NULL)
     {
-      switch(id)
-      {
-        case 0x00: *out = MCPR_PKT_PL_SB_TELEPORT_CONFIRM;          return true;
-        case 0x01: *out = MCPR_PKT_PL_SB_TAB_COMPLETE;              return true;
-        case 0x02: *out = MCPR_PKT_PL_SB_CHAT_MESSAGE;              return true;
-        case 0x03: *out = MCPR_PKT_PL_SB_CLIENT_STATUS;             return true;
-        case 0x04: *out = MCPR_PKT_PL_SB_CLIENT_SETTINGS;           return true;
-        case 0x05: *out = MCPR_PKT_PL_SB_CONFIRM_TRANSACTION;       return true;
-        case 0x06: *out = MCPR_PKT_PL_SB_ENCHANT_ITEM;              return true;
-        case 0x07: *out = MCPR_PKT_PL_SB_CLICK_WINDOW;              return true;
-        case 0x08: *out = MCPR_PKT_PL_SB_CLOSE_WINDOW;              return true;
-        case 0x09: *out = MCPR_PKT_PL_SB_PLUGIN_MESSAGE;            return true;
-        case 0x0A: *out = MCPR_PKT_PL_SB_USE_ENTITY;                return true;
-        case 0x0B: *out = MCPR_PKT_PL_SB_KEEP_ALIVE;                return true;
-        case 0x0C: *out = MCPR_PKT_PL_SB_PLAYER;                    return true;
-        case 0x0D: *out = MCPR_PKT_PL_SB_PLAYER_POSITION;           return true;
-        case 0x0E: *out = MCPR_PKT_PL_SB_PLAYER_POSITION_AND_LOOK;  return true;
-        case 0x0F: *out = MCPR_PKT_PL_SB_PLAYER_LOOK;               return true;
-        case 0x10: *out = MCPR_PKT_PL_SB_VEHICLE_MOVE;              return true;
-        case 0x11: *out = MCPR_PKT_PL_SB_STEER_BOAT;                return true;
-        case 0x12: *out = MCPR_PKT_PL_SB_CRAFT_RECIPE_REQUEST;      return true;
-        case 0x13: *out = MCPR_PKT_PL_SB_PLAYER_ABILITIES;          return true;
-        case 0x14: *out = MCPR_PKT_PL_SB_PLAYER_DIGGING;            return true;
-        case 0x15: *out = MCPR_PKT_PL_SB_ENTITY_ACTION;             return true;
-        case 0x16: *out = MCPR_PKT_PL_SB_STEER_VEHICLE;             return true;
-        case 0x17: *out = MCPR_PKT_PL_SB_CRAFTING_BOOK_DATA;        return true;
-        case 0x18: *out = MCPR_PKT_PL_SB_RESOURCE_PACK_STATUS;      return true;
-        case 0x19: *out = MCPR_PKT_PL_SB_ADVANCEMENT_TAB;           return true;
-        case 0x1A: *out = MCPR_PKT_PL_SB_HELD_ITEM_CHANGE;          return true;
-        case 0x1B: *out = MCPR_PKT_PL_SB_CREATIVE_INVENTORY_ACTION; return true;
-        case 0x1C: *out = MCPR_PKT_PL_SB_UPDATE_SIGN;               return true;
-        case 0x1D: *out = MCPR_PKT_PL_SB_ANIMATION;                 return true;
-        case 0x1E: *out = MCPR_PKT_PL_SB_SPECTATE;                  return true;
-        case 0x1F: *out = MCPR_PKT_PL_SB_PLAYER_BLOCK_PLACEMENT;    return true;
-        case 0X20: *out = MCPR_PKT_PL_SB_USE_ITEM;                  return true;
-        default: return false;
-      }
+      memcpy(ptr, section->sky_light, 2048); ptr += 2048;
     }
   }
-  return false; // Won't even be reached, but else the compiler will complain.
+
+  if(pkt->data.play.clientbound.chunk_data.ground_up_continuous)
+  {
+    memcpy(ptr, pkt->data.play.clientbound.chunk_data.biomes, 256); ptr += 256;
+  }
+  ptr += mcpr_encode_varint(ptr, pkt->data.play.clientbound.chunk_data.block_entity_count);
+  if(pkt->data.play.clientbound.chunk_data.block_entities != NULL)
+  {
+    struct buffer raw_block_entities = nbt_dump_binary(pkt->data.play.clientbound.chunk_data.block_entities);
+    memcpy(ptr, raw_block_entities.data, raw_block_entities.len); ptr += raw_block_entities.len;
+    buffer_free(&raw_block_entities);
+  }
+
+  return ptr - (unsigned char *) out;
 }
 
-// Last update was for 1.12.1
-uint8_t mcpr_packet_type_to_byte(enum mcpr_packet_type id)
+// The main hand is 0 for left and 1 for right on the wire, the other way around from enum mcpr_side_based_hand.
+static size_t sb_size_pl_client_settings(const struct mcpr_packet *pkt)
 {
-  switch(id)
+  return SIZE_STRING_VIEW(pkt->data.play.serverbound.client_settings.locale) + MCPR_BYTE_SIZE +
+    SIZE_VARINT_ENUM(pkt->data.play.serverbound.client_settings.chat_mode, 3) + MCPR_BOOL_SIZE + MCPR_UBYTE_SIZE +
+    1; // The main hand, 0 or 1.
+}
+
+static ssize_t sb_encode_pl_client_settings(void *out, const struct mcpr_packet *pkt)
+{
+  unsigned char *ptr = out;
+  ptr += ENCODE_STRING_VIEW(pkt->data.play.serverbound.client_settings.locale);
+  ptr += ENCODE_BYTE(pkt->data.play.serverbound.client_settings.view_distance);
+  ptr += ENCODE_VARINT_ENUM(pkt->data.play.serverbound.client_settings.chat_mode, 3);
+  ptr += ENCODE_BOOL(pkt->data.play.serverbound.client_settings.chat_colors);
+
+  uint8_t displayed_skin_parts = 0;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.cape_enabled)          displayed_skin_parts |= 0x01;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.jacket_enabled)        displayed_skin_parts |= 0x02;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.left_sleeve_enabled)   displayed_skin_parts |= 0x04;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.right_sleeve_enabled)  displayed_skin_parts |= 0x08;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.left_pants_enabled)    displayed_skin_parts |= 0x10;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.right_pants_enabled)   displayed_skin_parts |= 0x20;
+  if(pkt->data.play.serverbound.client_settings.displayed_skin_parts.hat_enabled)           displayed_skin_parts |= 0x40;
+  ptr += ENCODE_UBYTE(displayed_skin_parts);
+
+  ptr += mcpr_encode_varint(ptr, (pkt->data.play.serverbound.client_settings.main_hand == MCPR_HAND_LEFT) ? 0 : 1);
+  return ptr - (unsigned char *) out;
+}
+
+static ssize_t sb_decode_pl_client_settings(struct mcpr_packet *pkt, const void *in, size_t maxlen)
+{
+  const unsigned char *ptr = in;
+  size_t left = maxlen;
+
+  FIELD_DECODE(STRING_VIEW, pkt->data.play.serverbound.client_settings.locale)
+  FIELD_DECODE(BYTE, pkt->data.play.serverbound.client_settings.view_distance)
+  FIELD_DECODE(VARINT_ENUM, pkt->data.play.serverbound.client_settings.chat_mode, 3)
+  FIELD_DECODE(BOOL, pkt->data.play.serverbound.client_settings.chat_colors)
+
+  uint8_t displayed_skin_parts;
+  FIELD_DECODE(UBYTE, displayed_skin_parts)
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.cape_enabled = displayed_skin_parts & 0x01;
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.jacket_enabled = displayed_skin_parts & 0x02;
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.left_sleeve_enabled = displayed_skin_parts & 0x04;
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.right_sleeve_enabled = displayed_skin_parts & 0x08;
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.left_pants_enabled = displayed_skin_parts & 0x10;
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.right_pants_enabled = displayed_skin_parts & 0x20;
+  pkt->data.play.serverbound.client_settings.displayed_skin_parts.hat_enabled = displayed_skin_parts & 0x40;
+
+  int32_t main_hand;
+  FIELD_DECODE(VARINT_ENUM, main_hand, 2)
+  pkt->data.play.serverbound.client_settings.main_hand = (main_hand == 0) ? MCPR_HAND_LEFT : MCPR_HAND_RIGHT;
+
+  return ptr - (const unsigned char *) in;
+}
+
+// Same flags as the clientbound player abilities.
+static size_t sb_size_pl_player_abilities(const struct mcpr_packet *pkt)
+{
+  return MCPR_BYTE_SIZE + MCPR_FLOAT_SIZE + MCPR_FLOAT_SIZE;
+}
+
+static ssize_t sb_encode_pl_player_abilities(void *out, const struct mcpr_packet *pkt)
+{
+  unsigned char *ptr = out;
+
+  int8_t flags = 0;
+  if(pkt->data.play.serverbound.player_abilities.invulnerable)  flags |= 0x01;
+  if(pkt->data.play.serverbound.player_abilities.is_flying)     flags |= 0x02;
+  if(pkt->data.play.serverbound.player_abilities.can_fly)       flags |= 0x04;
+  if(pkt->data.play.serverbound.player_abilities.is_creative)   flags |= 0x08;
+  ptr += ENCODE_BYTE(flags);
+  ptr += ENCODE_FLOAT(pkt->data.play.serverbound.player_abilities.flying_speed);
+  ptr += ENCODE_FLOAT(pkt->data.play.serverbound.player_abilities.field_of_view_modifier);
+
+  return ptr - (unsigned char *) out;
+}
+
+static ssize_t sb_decode_pl_player_abilities(struct mcpr_packet *pkt, const void *in, size_t maxlen)
+{
+  const unsigned char *ptr = in;
+  size_t left = maxlen;
+
+  int8_t flags;
+  FIELD_DECODE(BYTE, flags)
+  pkt->data.play.serverbound.player_abilities.invulnerable = flags & 0x01;
+  pkt->data.play.serverbound.player_abilities.is_flying = flags & 0x02;
+  pkt->data.play.serverbound.player_abilities.can_fly = flags & 0x04;
+  pkt->data.play.serverbound.player_abilities.is_creative = flags & 0x08;
+  FIELD_DECODE(FLOAT, pkt->data.play.serverbound.player_abilities.flying_speed)
+  FIELD_DECODE(FLOAT, pkt->data.play.serverbound.player_abilities.field_of_view_modifier)
+
+  return ptr - (const unsigned char *) in;
+}
+
+static size_t sb_size_pl_steer_vehicle(const struct mcpr_packet *pkt)
+{
+  return MCPR_FLOAT_SIZE + MCPR_FLOAT_SIZE + MCPR_UBYTE_SIZE;
+}
+
+static ssize_t sb_encode_pl_steer_vehicle(void *out, const struct mcpr_packet *pkt)
+{
+  unsigned char *ptr = out;
+  ptr += ENCODE_FLOAT(pkt->data.play.serverbound.steer_vehicle.sideways);
+  ptr += ENCODE_FLOAT(pkt->data.play.serverbound.steer_vehicle.forward);
+
+  uint8_t flags = 0;
+  if(pkt->data.play.serverbound.steer_vehicle.jump)     flags |= 0x01;
+  if(pkt->data.play.serverbound.steer_vehicle.unmount)  flags |= 0x02;
+  ptr += ENCODE_UBYTE(flags);
+
+  return ptr - (unsigned char *) out;
+}
+
+static ssize_t sb_decode_pl_steer_vehicle(struct mcpr_packet *pkt, const void *in, size_t maxlen)
+{
+  const unsigned char *ptr = in;
+  size_t left = maxlen;
+
+  FIELD_DECODE(FLOAT, pkt->data.play.serverbound.steer_vehicle.sideways)
+  FIELD_DECODE(FLOAT, pkt->data.play.serverbound.steer_vehicle.forward)
+  uint8_t flags;
+  FIELD_DECODE(UBYTE, flags)
+  pkt->data.play.serverbound.steer_vehicle.jump = flags & 0x01;
+  pkt->data.play.serverbound.steer_vehicle.unmount = flags & 0x02;
+
+  return ptr - (const unsigned char *) in;
+}
+
+
+struct packet_codec
+{
+  bool known;
+  enum mcpr_state state;
+  uint8_t id;
+  size_t (*size)(const struct mcpr_packet *pkt); // Size without the packet id, NULL if the packet can't be encoded.
+  ssize_t (*encode)(void *out, const struct mcpr_packet *pkt); // Encodes everything after the packet id.
+  ssize_t (*decode)(struct mcpr_packet *out, const void *in, size_t maxlen); // NULL if the packet can't be decoded.
+};
+
+#define CODEC_SB_FIELDS(name) sb_size_##name, sb_encode_##name, sb_decode_##name
+#define CODEC_SB_CUSTOM(name) sb_size_##name, sb_encode_##name, sb_decode_##name
+#define CODEC_SB_NONE(name)   NULL, NULL, NULL
+#define CODEC_CB_FIELDS(name) cb_size_##name, cb_encode_##name, NULL
+#define CODEC_CB_CUSTOM(name) cb_size_##name, cb_encode_##name, NULL
+#define CODEC_CB_NONE(name)   NULL, NULL, NULL
+
+static const struct packet_codec codecs[MCPR_PACKET_TYPE_COUNT] =
+{
+  #define X(type, state, id, name, path, layout) [type] = { true, state, id, CODEC_SB_##layout(name) },
+  MCPR_SERVERBOUND_PACKETS(X)
+  #undef X
+  #define X(type, state, id, name, path, layout) [type] = { true, state, id, CODEC_CB_##layout(name) },
+  MCPR_CLIENTBOUND_PACKETS(X)
+  #undef X
+};
+
+// Serverbound packet types by state and id, offset by one so that zero means there is no such packet.
+static const uint8_t serverbound_types[MCPR_STATE_PLAY + 1][UINT8_MAX + 1] =
+{
+  #define X(type, state, id, name, path, layout) [state][id] = (type) + 1,
+  MCPR_SERVERBOUND_PACKETS(X)
+  #undef X
+};
+
+// Returns NULL and sets ninerr if pkt can't be encoded.
+static const struct packet_codec *encoder(const struct mcpr_packet *pkt)
+{
+  if((unsigned int) pkt->id >= MCPR_PACKET_TYPE_COUNT || codecs[pkt->id].encode == NULL)
+  {
+    ninerr_set_err(ninerr_new("Encoding packets of type %i is not implemented. (state: %s)", (int) pkt->id, mcpr_state_to_string(pkt->state)));
+    return NULL;
+  }
+  return &(codecs[pkt->id]);
+}
+
+size_t mcpr_encode_packet_bounds(const struct mcpr_packet *pkt)
+{
+  const struct packet_codec *codec = encoder(pkt);
+  if(codec == NULL) return 0;
+  return mcpr_varint_bounds(codec->id) + codec->size(pkt);
+}
+
+size_t mcpr_encode_packet(void *out, const struct mcpr_packet *pkt)
+{
+  const struct packet_codec *codec = encoder(pkt);
+  if(codec == NULL) return 0;
+  DEBUG_PRINT("In mcpr_encode_packet, numerical packet ID: 0x%02x, state: %s\n", codec->id, mcpr_state_to_string(codec->state));
+
+  size_t id_size = mcpr_encode_varint(out, codec->id);
+  ssize_t body_size = codec->encode(((unsigned char *) out) + id_size, pkt);
+  if(body_size < 0) return 0;
+  return id_size + (size_t) body_size;
+}
+
+ssize_t mcpr_decode_packet(struct mcpr_packet *out, const void *in, enum mcpr_state state, size_t maxlen)
+{
+  DEBUG_PRINT("in mcpr_decode_packet(state=%s, maxlen=%zu)", mcpr_state_to_string(state), maxlen);
+
+  int32_t packet_id;
+  ssize_t bytes_read_1 = mcpr_decode_varint(&packet_id, in, maxlen);
+  if(bytes_read_1 < 0) return -1;
+  DEBUG_PRINT("Decoding packet with id %ld", packet_id);
+
+  if(packet_id < 0 || packet_id > UINT8_MAX || !mcpr_get_packet_type(&(out->id), (uint8_t) packet_id, state))
+    { ninerr_set_err(ninerr_new("Invalid packet id %ld", (long) packet_id)); return -1; }
+  out->state = state;
+
+  const struct packet_codec *codec = &(codecs[out->id]);
+  if(codec->decode == NULL)
   {
-    case MCPR_PKT_ST_CB_RESPONSE:                 return 0x00;
-    case MCPR_PKT_ST_CB_PONG:                     return 0x01;
-
-    case MCPR_PKT_LG_CB_DISCONNECT:               return 0x00;
-    case MCPR_PKT_LG_CB_ENCRYPTION_REQUEST:       return 0x01;
-    case MCPR_PKT_LG_CB_LOGIN_SUCCESS:            return 0x02;
-    case MCPR_PKT_LG_CB_SET_COMPRESSION:          return 0x03;
-
-    case MCPR_PKT_PL_CB_DISCONNECT:               return 0x1A;
-    case MCPR_PKT_PL_CB_KEEP_ALIVE:               return 0x1F;
-    case MCPR_PKT_PL_CB_JOIN_GAME:                return 0x23;
-    case MCPR_PKT_PL_CB_PLUGIN_MESSAGE:           return 0x18;
-    case MCPR_PKT_PL_CB_SPAWN_POSITION:           return 0x46;
-    case MCPR_PKT_PL_CB_CHUNK_DATA:               return 0x20;
-    case MCPR_PKT_PL_CB_PLAYER_ABILITIES:         return 0x2C;
-    case MCPR_PKT_PL_CB_PLAYER_POSITION_AND_LOOK: return 0x2F;
-    case MCPR_PKT_PL_CB_CHAT_MESSAGE:             return 0x0F;
-    default: DEBUG_PRINT("Unimplemented packet id given in mcpr_packet_type_to_byte().. Aborting at mcpr.c:%i", __LINE__); abort();
+    ninerr_set_err(ninerr_new("Decoding for packet with id 0x%02x is not implemented yet. (state: %s)", (unsigned int) packet_id, mcpr_state_to_string(state)));
+    return -1;
   }
-  return 0; // Won't even be reached, but else the compiler will complain
+  ssize_t bytes_read_2 = codec->decode(out, ((const unsigned char *) in) + bytes_read_1, maxlen - (size_t) bytes_read_1);
+  if(bytes_read_2 < 0) return -1;
+  return bytes_read_1 + bytes_read_2;
+}
+
+bool mcpr_get_packet_type(enum mcpr_packet_type *out, uint8_t id, enum mcpr_state state)
+{
+  if(state < MCPR_STATE_HANDSHAKE || state > MCPR_STATE_PLAY) return false;
+  uint8_t type = serverbound_types[state][id];
+  if(type == 0) return false;
+  *out = (enum mcpr_packet_type) (type - 1);
+  return true;
+}
+
+bool mcpr_packet_type_to_byte(uint8_t *out, enum mcpr_packet_type type)
+{
+  if((unsigned int) type >= MCPR_PACKET_TYPE_COUNT || !codecs[type].known) { ninerr_set_err(ninerr_new("Invalid packet type %i.", (int) type)); return false; }
+  *out = codecs[type].id;
+  return true;
 }
@@ -33,6 +33,7 @@
 #include <nbt/nbt.h>
 
 #include "mcpr/mcpr.h"
+#include "mcpr/codec.h"
 #include "warnings.h"
 
 IGNORE("-Wpedantic")
@@ -134,6 +135,10 @@ enum mcpr_packet_type
   MCPR_PKT_PL_CB_ENTITY_TELEPORT,
   MCPR_PKT_PL_CB_ENTITY_PROPERTIES,
   MCPR_PKT_PL_CB_ENTITY_EFFECT,
+  MCPR_PKT_PL_CB_CRAFT_RECIPE_RESPONSE,
+  MCPR_PKT_PL_CB_UNLOCK_RECIPES,
+  MCPR_PKT_PL_CB_SELECT_ADVANCEMENT_TAB,
+  MCPR_PKT_PL_CB_ADVANCEMENTS,
 
   MCPR_PKT_PL_SB_TELEPORT_CONFIRM,
   MCPR_PKT_PL_SB_TAB_COMPLETE,
@@ -165,15 +170,15 @@ enum mcpr_packet_type
   MCPR_PKT_PL_SB_SPECTATE,
   MCPR_PKT_PL_SB_PLAYER_BLOCK_PLACEMENT,
   MCPR_PKT_PL_SB_USE_ITEM,
-  MCPR_PKT_PL_SB_UNLOCK_RECIPES,
-  MCPR_PKT_PL_SB_ADVANCEMENT_PROGRESS,
-  MCPR_PKT_PL_SB_ADVANCEMENTS,
   MCPR_PKT_PL_SB_CRAFT_RECIPE_REQUEST,
   MCPR_PKT_PL_SB_CRAFTING_BOOK_DATA,
   MCPR_PKT_PL_SB_ADVANCEMENT_TAB,
 };
+#define MCPR_PACKET_TYPE_COUNT (MCPR_PKT_PL_SB_ADVANCEMENT_TAB + 1)
 bool mcpr_get_packet_type(enum mcpr_packet_type *out, uint8_t id, enum mcpr_state state);
-uint8_t mcpr_packet_type_to_byte(enum mcpr_packet_type id);
+
+// Returns false and sets ninerr if type isn't a packet type.
+bool mcpr_packet_type_to_byte(uint8_t *out, enum mcpr_packet_type type);
 
 enum mcpr_painting
 {
@@ -207,11 +212,12 @@ enum mcpr_painting
 
 enum mcpr_equipment_slot
 {
-  MCPR_EQUIP_MENT_SLOT_HEAD,
-  MCPR_EQUIP_MENT_SLOT_CHEST,
-  MCPR_EQUIP_MENT_SLOT_LEGS,
-  MCPR_EQUIP_MENT_SLOT_FEET,
+  MCPR_EQUIP_MENT_SLOT_MAINHAND,
   MCPR_EQUIP_MENT_SLOT_OFFHAND,
+  MCPR_EQUIP_MENT_SLOT_FEET,
+  MCPR_EQUIP_MENT_SLOT_LEGS,
+  MCPR_EQUIP_MENT_SLOT_CHEST,
+  MCPR_EQUIP_MENT_SLOT_HEAD,
 };
 
 enum mcpr_select_advancement_tab_id
@@ -415,8 +421,8 @@ enum mcpr_game_state_effect
 enum mcpr_use_entity_type
 {
   MCPR_USE_ENTITY_TYPE_INTERACT,
-  MCPR_USE_ENTITY_TYPE_INTERACT_AT,
-  MCPR_USE_ENTITY_TYPE_ATTACK
+  MCPR_USE_ENTITY_TYPE_ATTACK,
+  MCPR_USE_ENTITY_TYPE_INTERACT_AT
 };
 
 enum mcpr_entity_property
@@ -506,13 +512,12 @@ enum mcpr_window
 
 enum mcpr_block_face
 {
-  MCPR_BLOCK_FACE_TOP,
   MCPR_BLOCK_FACE_BOTTOM,
+  MCPR_BLOCK_FACE_TOP,
   MCPR_BLOCK_FACE_NORTH,
   MCPR_BLOCK_FACE_SOUTH,
   MCPR_BLOCK_FACE_WEST,
-  MCPR_BLOCK_FACE_EAST,
-  MCPR_BLOCK_FACE_SPECIAL
+  MCPR_BLOCK_FACE_EAST
 };
 
 enum mcpr_side_based_hand
@@ -534,6 +539,18 @@ enum mcpr_chat_mode
   MCPR_CHAT_MODE_HIDDEN
 };
 
+enum mcpr_crafting_book_data_type
+{
+  MCPR_CRAFTING_BOOK_DATA_TYPE_DISPLAYED_RECIPE,
+  MCPR_CRAFTING_BOOK_DATA_TYPE_CRAFTING_BOOK_STATUS
+};
+
+enum mcpr_advancement_tab_action
+{
+  MCPR_ADVANCEMENT_TAB_ACTION_OPENED_TAB,
+  MCPR_ADVANCEMENT_TAB_ACTION_CLOSED_SCREEN
+};
+
 enum mcpr_client_status_action
 {
   MCPR_CLIENT_STATUS_ACTION_PERFORM_RESPAWN,
@@ -650,8 +667,8 @@ enum mcpr_title_action
 
 enum mcpr_update_score_action
 {
-  MCPR_UPDATE_SCORE_ACTION_REMOVE,
-  MCPR_UPDATE_SCORE_ACTION_UPDATE
+  MCPR_UPDATE_SCORE_ACTION_UPDATE,
+  MCPR_UPDATE_SCORE_ACTION_REMOVE
 };
 
 enum mcpr_teams_action
@@ -1609,6 +1626,18 @@ struct mcpr_entity_metadata
   size_t entry_count;
 };
 
+/*
+ * An item stack. A decoded slot's NBT points into the decode buffer, like a string view.
+ */
+struct mcpr_slot
+{
+  int16_t item_id; // Negative for an empty slot, in which case the other fields aren't sent.
+  int8_t count;
+  int16_t damage;
+  size_t nbt_length; // 0 if the item has no NBT.
+  const void *nbt; // A named compound tag in binary form, including its type byte.
+};
+
 struct mcpr_packet
 {
   enum mcpr_packet_type id;
@@ -1622,7 +1651,7 @@ struct mcpr_packet
         struct
         {
           int32_t protocol_version;
-          char *server_address;
+          struct mcpr_string_view server_address;
           uint16_t server_port;
           enum mcpr_state next_state;
         } handshake;
@@ -1635,15 +1664,15 @@ struct mcpr_packet
       {
         struct
         {
-          char *name;
+          struct mcpr_string_view name;
         } login_start;
 
         struct
         {
           int32_t shared_secret_length;
-          void *shared_secret;
+          const void *shared_secret;
           int32_t verify_token_length;
-          void *verify_token;
+          const void *verify_token;
         } encryption_response;
       } serverbound;
 
@@ -1724,7 +1753,7 @@ struct mcpr_packet
 
         struct
         {
-          char *text;
+          struct mcpr_string_view text;
           bool assume_command;
           bool has_position;
           struct mcpr_position looked_at_block; // Optional, only if has_position is true.
@@ -1732,7 +1761,7 @@ struct mcpr_packet
 
         struct
         {
-          char *message;
+          struct mcpr_string_view message;
         } chat_message;
 
         struct
@@ -1742,7 +1771,7 @@ struct mcpr_packet
 
         struct
         {
-          char *locale;
+          struct mcpr_string_view locale;
           int8_t view_distance;
           enum mcpr_chat_mode chat_mode;
           bool chat_colors;
@@ -1779,7 +1808,7 @@ struct mcpr_packet
           int8_t button;
           int16_t action_number;
           int32_t mode;
-          void * clicked_item;
+          struct mcpr_slot clicked_item;
         } click_window;
 
         struct
@@ -1789,9 +1818,9 @@ struct mcpr_packet
 
         struct
         {
-          char *channel;
+          struct mcpr_string_view channel;
           size_t data_length;
-          void *data;
+          const void *data;
         } plugin_message;
 
         struct
@@ -1799,7 +1828,7 @@ struct mcpr_packet
           int32_t target;
           enum mcpr_use_entity_type type;
           float target_x, target_y, target_z; // Optional, only if type is MCPR_USE_ENTITY_TYPE_INTERACT_AT
-          enum mcpr_hand hand; // Optional, only if type is MCPR_USE_ENTITY_TYPE_INTERACT_AT
+          enum mcpr_hand hand; // Optional, only if type isn't MCPR_USE_ENTITY_TYPE_ATTACK
         } use_entity;
 
         struct
@@ -1886,13 +1915,13 @@ struct mcpr_packet
         struct
         {
           int16_t slot;
-          void * clicked_item;
+          struct mcpr_slot clicked_item;
         } creative_inventory_action;
 
         struct
         {
           struct mcpr_position sign_location;
-          char *line_1, line_2, line_3, line_4;
+          struct mcpr_string_view line_1, line_2, line_3, line_4;
         } update_sign;
 
         struct
@@ -1917,6 +1946,27 @@ struct mcpr_packet
         {
           enum mcpr_hand hand;
         } use_item;
+
+        struct
+        {
+          int8_t window_id;
+          int32_t recipe_id;
+          bool make_all;
+        } craft_recipe_request;
+
+        struct
+        {
+          enum mcpr_crafting_book_data_type type;
+          int32_t displayed_recipe_id; // Optional, only if type is MCPR_CRAFTING_BOOK_DATA_TYPE_DISPLAYED_RECIPE
+          bool crafting_book_open; // Optional, only if type is MCPR_CRAFTING_BOOK_DATA_TYPE_CRAFTING_BOOK_STATUS
+          bool crafting_filter; // Optional, only if type is MCPR_CRAFTING_BOOK_DATA_TYPE_CRAFTING_BOOK_STATUS
+        } crafting_book_data;
+
+        struct
+        {
+          enum mcpr_advancement_tab_action action;
+          struct mcpr_string_view tab_id; // Optional, only if action is MCPR_ADVANCEMENT_TAB_ACTION_OPENED_TAB
+        } advancement_tab;
       } serverbound;
 
       union // play - clientbound
@@ -2119,7 +2169,7 @@ struct mcpr_packet
         {
           uint8_t window_id;
           int16_t count;
-          void * *slots;
+          struct mcpr_slot *slots;
         } window_items;
 
         struct
@@ -2133,7 +2183,7 @@ struct mcpr_packet
         {
           uint8_t window_id;
           int16_t slot;
-          void * slot_data;
+          struct mcpr_slot slot_data;
         } set_slot;
 
         struct
@@ -2468,7 +2518,7 @@ struct mcpr_packet
         {
           int32_t entity_id;
           enum mcpr_equipment_slot slot;
-          void *slot_data;
+          struct mcpr_slot slot_data;
         } entity_equipment;
 
         struct
@@ -2616,7 +2666,7 @@ struct mcpr_packet
         {
           int32_t entity_id;
           double x, y, z;
-          int8_t angle, yaw;
+          int8_t yaw, pitch;
           bool on_ground;
         } entity_teleport;
 
@@ -2655,6 +2705,12 @@ struct mcpr_packet
           enum mcpr_select_advancement_tab_id identifier; // optional, only if has_id is true
         } select_advancement_tab;
 
+        struct
+        {
+          int8_t window_id;
+          int32_t recipe_id;
+        } craft_recipe_response;
+
         // struct
         // {
         //   bool reset;
@@ -2671,8 +2727,15 @@ struct mcpr_packet
 };
 END_IGNORE()
 
+/*
+ * Decoded packets do not own any memory; strings and byte arrays are views into in,
+ * and are only valid for as long as in is. Copy anything that must outlive it.
+ */
 ssize_t mcpr_decode_packet(struct mcpr_packet *out, const void *in, enum mcpr_state state, size_t maxlen);
-void mcpr_free_decoded_packet(struct mcpr_packet *pkt);
+
+/*
+ * Both return 0 and set ninerr if pkt can't be encoded, for example because the schema has no layout for it.
+ */
 size_t mcpr_encode_packet(void *out, const struct mcpr_packet *pkt);
 size_t mcpr_encode_packet_bounds(const struct mcpr_packet *pkt);
 
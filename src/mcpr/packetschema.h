@@ -0,0 +1,600 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+
+
+  packetschema.h - The layout of every packet, declared once.
+*/
+
+#ifndef MCPR_PACKETSCHEMA_H
+#define MCPR_PACKETSCHEMA_H
+
+/*
+ * Every packet is listed as X(type, state, id, name, path, layout), where path is the packet's member of
+ * struct mcpr_packet's data union, and layout is one of
+ *
+ *   FIELDS  The packet is the fields in MCPR_<direction>_FIELDS_<name>, in order. Their size, encoder and
+ *           decoder are generated in packet.c.
+ *   CUSTOM  The codec is written by hand in packet.c, for packets which don't map one to one on their struct.
+ *   NONE    Only the id is known, it can't be encoded or decoded yet.
+ *
+ * Fields are listed as F(kind, lvalue, ...), see packet.c for the kinds.
+ * Serverbound packets are dispatched to handle_<name>(), see network/packethandlers/packethandlers.h.
+ */
+
+// Last updated for 1.12.2
+#define MCPR_SERVERBOUND_PACKETS(X) \
+  X(MCPR_PKT_HS_SB_HANDSHAKE,                     MCPR_STATE_HANDSHAKE, 0x00, hs_handshake,                     handshake.serverbound.handshake,                FIELDS) \
+  \
+  X(MCPR_PKT_ST_SB_REQUEST,                       MCPR_STATE_STATUS,    0x00, st_request,                       status.serverbound.request,                     FIELDS) \
+  X(MCPR_PKT_ST_SB_PING,                          MCPR_STATE_STATUS,    0x01, st_ping,                          status.serverbound.ping,                        FIELDS) \
+  \
+  X(MCPR_PKT_LG_SB_LOGIN_START,                   MCPR_STATE_LOGIN,     0x00, lg_login_start,                   login.serverbound.login_start,                  FIELDS) \
+  X(MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE,           MCPR_STATE_LOGIN,     0x01, lg_encryption_response,           login.serverbound.encryption_response,          FIELDS) \
+  \
+  X(MCPR_PKT_PL_SB_TELEPORT_CONFIRM,              MCPR_STATE_PLAY,      0x00, pl_teleport_confirm,              play.serverbound.teleport_confirm,              FIELDS) \
+  X(MCPR_PKT_PL_SB_TAB_COMPLETE,                  MCPR_STATE_PLAY,      0x01, pl_tab_complete,                  play.serverbound.tab_complete,                  FIELDS) \
+  X(MCPR_PKT_PL_SB_CHAT_MESSAGE,                  MCPR_STATE_PLAY,      0x02, pl_chat_message,                  play.serverbound.chat_message,                  FIELDS) \
+  X(MCPR_PKT_PL_SB_CLIENT_STATUS,                 MCPR_STATE_PLAY,      0x03, pl_client_status,                 play.serverbound.client_status,                 FIELDS) \
+  X(MCPR_PKT_PL_SB_CLIENT_SETTINGS,               MCPR_STATE_PLAY,      0x04, pl_client_settings,               play.serverbound.client_settings,               CUSTOM) \
+  X(MCPR_PKT_PL_SB_CONFIRM_TRANSACTION,           MCPR_STATE_PLAY,      0x05, pl_confirm_transaction,           play.serverbound.confirm_transaction,           FIELDS) \
+  X(MCPR_PKT_PL_SB_ENCHANT_ITEM,                  MCPR_STATE_PLAY,      0x06, pl_enchant_item,                  play.serverbound.enchant_item,                  FIELDS) \
+  X(MCPR_PKT_PL_SB_CLICK_WINDOW,                  MCPR_STATE_PLAY,      0x07, pl_click_window,                  play.serverbound.click_window,                  FIELDS) \
+  X(MCPR_PKT_PL_SB_CLOSE_WINDOW,                  MCPR_STATE_PLAY,      0x08, pl_close_window,                  play.serverbound.close_window,                  FIELDS) \
+  X(MCPR_PKT_PL_SB_PLUGIN_MESSAGE,                MCPR_STATE_PLAY,      0x09, pl_plugin_message,                play.serverbound.plugin_message,                FIELDS) \
+  X(MCPR_PKT_PL_SB_USE_ENTITY,                    MCPR_STATE_PLAY,      0x0A, pl_use_entity,                    play.serverbound.use_entity,                    FIELDS) \
+  X(MCPR_PKT_PL_SB_KEEP_ALIVE,                    MCPR_STATE_PLAY,      0x0B, pl_keep_alive,                    play.serverbound.keep_alive,                    FIELDS) \
+  X(MCPR_PKT_PL_SB_PLAYER,                        MCPR_STATE_PLAY,      0x0C, pl_player,                        play.serverbound.player,                        FIELDS) \
+  X(MCPR_PKT_PL_SB_PLAYER_POSITION,               MCPR_STATE_PLAY,      0x0D, pl_player_position,               play.serverbound.player_position,               FIELDS) \
+  X(MCPR_PKT_PL_SB_PLAYER_POSITION_AND_LOOK,      MCPR_STATE_PLAY,      0x0E, pl_player_position_and_look,      play.serverbound.player_position_and_look,      FIELDS) \
+  X(MCPR_PKT_PL_SB_PLAYER_LOOK,                   MCPR_STATE_PLAY,      0x0F, pl_player_look,                   play.serverbound.player_look,                   FIELDS) \
+  X(MCPR_PKT_PL_SB_VEHICLE_MOVE,                  MCPR_STATE_PLAY,      0x10, pl_vehicle_move,                  play.serverbound.vehicle_move,                  FIELDS) \
+  X(MCPR_PKT_PL_SB_STEER_BOAT,                    MCPR_STATE_PLAY,      0x11, pl_steer_boat,                    play.serverbound.steer_boat,                    FIELDS) \
+  X(MCPR_PKT_PL_SB_CRAFT_RECIPE_REQUEST,          MCPR_STATE_PLAY,      0x12, pl_craft_recipe_request,          play.serverbound.craft_recipe_request,          FIELDS) \
+  X(MCPR_PKT_PL_SB_PLAYER_ABILITIES,              MCPR_STATE_PLAY,      0x13, pl_player_abilities,              play.serverbound.player_abilities,              CUSTOM) \
+  X(MCPR_PKT_PL_SB_PLAYER_DIGGING,                MCPR_STATE_PLAY,      0x14, pl_player_digging,                play.serverbound.player_digging,                FIELDS) \
+  X(MCPR_PKT_PL_SB_ENTITY_ACTION,                 MCPR_STATE_PLAY,      0x15, pl_entity_action,                 play.serverbound.entity_action,                 FIELDS) \
+  X(MCPR_PKT_PL_SB_STEER_VEHICLE,                 MCPR_STATE_PLAY,      0x16, pl_steer_vehicle,                 play.serverbound.steer_vehicle,                 CUSTOM) \
+  X(MCPR_PKT_PL_SB_CRAFTING_BOOK_DATA,            MCPR_STATE_PLAY,      0x17, pl_crafting_book_data,            play.serverbound.crafting_book_data,            FIELDS) \
+  X(MCPR_PKT_PL_SB_RESOURCE_PACK_STATUS,          MCPR_STATE_PLAY,      0x18, pl_resource_pack_status,          play.serverbound.resource_pack_status,          FIELDS) \
+  X(MCPR_PKT_PL_SB_ADVANCEMENT_TAB,               MCPR_STATE_PLAY,      0x19, pl_advancement_tab,               play.serverbound.advancement_tab,               FIELDS) \
+  X(MCPR_PKT_PL_SB_HELD_ITEM_CHANGE,              MCPR_STATE_PLAY,      0x1A, pl_held_item_change,              play.serverbound.held_item_change,              FIELDS) \
+  X(MCPR_PKT_PL_SB_CREATIVE_INVENTORY_ACTION,     MCPR_STATE_PLAY,      0x1B, pl_creative_inventory_action,     play.serverbound.creative_inventory_action,     FIELDS) \
+  X(MCPR_PKT_PL_SB_UPDATE_SIGN,                   MCPR_STATE_PLAY,      0x1C, pl_update_sign,                   play.serverbound.update_sign,                   FIELDS) \
+  X(MCPR_PKT_PL_SB_ANIMATION,                     MCPR_STATE_PLAY,      0x1D, pl_animation,                     play.serverbound.animation,                     FIELDS) \
+  X(MCPR_PKT_PL_SB_SPECTATE,                      MCPR_STATE_PLAY,      0x1E, pl_spectate,                      play.serverbound.spectate,                      FIELDS) \
+  X(MCPR_PKT_PL_SB_PLAYER_BLOCK_PLACEMENT,        MCPR_STATE_PLAY,      0x1F, pl_player_block_placement,        play.serverbound.player_block_placement,        FIELDS) \
+  X(MCPR_PKT_PL_SB_USE_ITEM,                      MCPR_STATE_PLAY,      0x20, pl_use_item,                      play.serverbound.use_item,                      FIELDS)
+
+// Last updated for 1.12.2
+#define MCPR_CLIENTBOUND_PACKETS(X) \
+  X(MCPR_PKT_ST_CB_RESPONSE,                      MCPR_STATE_STATUS,    0x00, st_response,                      status.clientbound.response,                    CUSTOM) \
+  X(MCPR_PKT_ST_CB_PONG,                          MCPR_STATE_STATUS,    0x01, st_pong,                          status.clientbound.pong,                        FIELDS) \
+  \
+  X(MCPR_PKT_LG_CB_DISCONNECT,                    MCPR_STATE_LOGIN,     0x00, lg_disconnect,                    login.clientbound.disconnect,                   FIELDS) \
+  X(MCPR_PKT_LG_CB_ENCRYPTION_REQUEST,            MCPR_STATE_LOGIN,     0x01, lg_encryption_request,            login.clientbound.encryption_request,           FIELDS) \
+  X(MCPR_PKT_LG_CB_LOGIN_SUCCESS,                 MCPR_STATE_LOGIN,     0x02, lg_login_success,                 login.clientbound.login_success,                FIELDS) \
+  X(MCPR_PKT_LG_CB_SET_COMPRESSION,               MCPR_STATE_LOGIN,     0x03, lg_set_compression,               login.clientbound.set_compression,              FIELDS) \
+  \
+  X(MCPR_PKT_PL_CB_SPAWN_OBJECT,                  MCPR_STATE_PLAY,      0x00, pl_spawn_object,                  play.clientbound.spawn_object,                  NONE)   \
+  X(MCPR_PKT_PL_CB_SPAWN_EXPERIENCE_ORB,          MCPR_STATE_PLAY,      0x01, pl_spawn_experience_orb,          play.clientbound.spawn_experience_orb,          FIELDS) \
+  X(MCPR_PKT_PL_CB_SPAWN_GLOBAL_ENTITY,           MCPR_STATE_PLAY,      0x02, pl_spawn_global_entity,           play.clientbound.spawn_global_entity,           FIELDS) \
+  X(MCPR_PKT_PL_CB_SPAWN_MOB,                     MCPR_STATE_PLAY,      0x03, pl_spawn_mob,                     play.clientbound.spawn_mob,                     NONE)   \
+  X(MCPR_PKT_PL_CB_SPAWN_PAINTING,                MCPR_STATE_PLAY,      0x04, pl_spawn_painting,                play.clientbound.spawn_painting,                NONE)   \
+  X(MCPR_PKT_PL_CB_SPAWN_PLAYER,                  MCPR_STATE_PLAY,      0x05, pl_spawn_player,                  play.clientbound.spawn_player,                  NONE)   \
+  X(MCPR_PKT_PL_CB_ANIMATION,                     MCPR_STATE_PLAY,      0x06, pl_animation,                     play.clientbound.animation,                     FIELDS) \
+  X(MCPR_PKT_PL_CB_STATISTICS,                    MCPR_STATE_PLAY,      0x07, pl_statistics,                    play.clientbound.statistics,                    NONE)   \
+  X(MCPR_PKT_PL_CB_BLOCK_BREAK_ANIMATION,         MCPR_STATE_PLAY,      0x08, pl_block_break_animation,         play.clientbound.block_break_animation,         FIELDS) \
+  X(MCPR_PKT_PL_CB_UPDATE_BLOCK_ENTITY,           MCPR_STATE_PLAY,      0x09, pl_update_block_entity,           play.clientbound.update_block_entity,           NONE)   \
+  X(MCPR_PKT_PL_CB_BLOCK_ACTION,                  MCPR_STATE_PLAY,      0x0A, pl_block_action,                  play.clientbound.block_action,                  NONE)   \
+  X(MCPR_PKT_PL_CB_BLOCK_CHANGE,                  MCPR_STATE_PLAY,      0x0B, pl_block_change,                  play.clientbound.block_change,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_BOSS_BAR,                      MCPR_STATE_PLAY,      0x0C, pl_boss_bar,                      play.clientbound.boss_bar,                      NONE)   \
+  X(MCPR_PKT_PL_CB_SERVER_DIFFICULTY,             MCPR_STATE_PLAY,      0x0D, pl_server_difficulty,             play.clientbound.server_difficulty,             FIELDS) \
+  X(MCPR_PKT_PL_CB_TAB_COMPLETE,                  MCPR_STATE_PLAY,      0x0E, pl_tab_complete,                  play.clientbound.tab_complete,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_CHAT_MESSAGE,                  MCPR_STATE_PLAY,      0x0F, pl_chat_message,                  play.clientbound.chat_message,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_MULTI_BLOCK_CHANGE,            MCPR_STATE_PLAY,      0x10, pl_multi_block_change,            play.clientbound.multi_block_change,            NONE)   \
+  X(MCPR_PKT_PL_CB_CONFIRM_TRANSACTION,           MCPR_STATE_PLAY,      0x11, pl_confirm_transaction,           play.clientbound.confirm_transaction,           FIELDS) \
+  X(MCPR_PKT_PL_CB_CLOSE_WINDOW,                  MCPR_STATE_PLAY,      0x12, pl_close_window,                  play.clientbound.close_window,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_OPEN_WINDOW,                   MCPR_STATE_PLAY,      0x13, pl_open_window,                   play.clientbound.open_window,                   NONE)   \
+  X(MCPR_PKT_PL_CB_WINDOW_ITEMS,                  MCPR_STATE_PLAY,      0x14, pl_window_items,                  play.clientbound.window_items,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_WINDOW_PROPERTY,               MCPR_STATE_PLAY,      0x15, pl_window_property,               play.clientbound.window_property,               NONE)   \
+  X(MCPR_PKT_PL_CB_SET_SLOT,                      MCPR_STATE_PLAY,      0x16, pl_set_slot,                      play.clientbound.set_slot,                      FIELDS) \
+  X(MCPR_PKT_PL_CB_SET_COOLDOWN,                  MCPR_STATE_PLAY,      0x17, pl_set_cooldown,                  play.clientbound.set_cooldown,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_PLUGIN_MESSAGE,                MCPR_STATE_PLAY,      0x18, pl_plugin_message,                play.clientbound.plugin_message,                FIELDS) \
+  X(MCPR_PKT_PL_CB_NAMED_SOUND_EFFECT,            MCPR_STATE_PLAY,      0x19, pl_named_sound_effect,            play.clientbound.named_sound_effect,            FIELDS) \
+  X(MCPR_PKT_PL_CB_DISCONNECT,                    MCPR_STATE_PLAY,      0x1A, pl_disconnect,                    play.clientbound.disconnect,                    FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_STATUS,                 MCPR_STATE_PLAY,      0x1B, pl_entity_status,                 play.clientbound.entity_status,                 FIELDS) \
+  X(MCPR_PKT_PL_CB_EXPLOSION,                     MCPR_STATE_PLAY,      0x1C, pl_explosion,                     play.clientbound.explosion,                     NONE)   \
+  X(MCPR_PKT_PL_CB_UNLOAD_CHUNK,                  MCPR_STATE_PLAY,      0x1D, pl_unload_chunk,                  play.clientbound.unload_chunk,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_CHANGE_GAME_STATE,             MCPR_STATE_PLAY,      0x1E, pl_change_game_state,             play.clientbound.change_game_state,             CUSTOM) \
+  X(MCPR_PKT_PL_CB_KEEP_ALIVE,                    MCPR_STATE_PLAY,      0x1F, pl_keep_alive,                    play.clientbound.keep_alive,                    FIELDS) \
+  X(MCPR_PKT_PL_CB_CHUNK_DATA,                    MCPR_STATE_PLAY,      0x20, pl_chunk_data,                    play.clientbound.chunk_data,                    CUSTOM) \
+  X(MCPR_PKT_PL_CB_EFFECT,                        MCPR_STATE_PLAY,      0x21, pl_effect,                        play.clientbound.effect,                        NONE)   \
+  X(MCPR_PKT_PL_CB_PARTICLE,                      MCPR_STATE_PLAY,      0x22, pl_particle,                      play.clientbound.particle,                      NONE)   \
+  X(MCPR_PKT_PL_CB_JOIN_GAME,                     MCPR_STATE_PLAY,      0x23, pl_join_game,                     play.clientbound.join_game,                     CUSTOM) \
+  X(MCPR_PKT_PL_CB_MAP,                           MCPR_STATE_PLAY,      0x24, pl_map,                           play.clientbound.map,                           NONE)   \
+  X(MCPR_PKT_PL_CB_ENTITY,                        MCPR_STATE_PLAY,      0x25, pl_entity,                        play.clientbound.entity,                        FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_RELATIVE_MOVE,          MCPR_STATE_PLAY,      0x26, pl_entity_relative_move,          play.clientbound.entity_relative_move,          FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_LOOK_AND_RELATIVE_MOVE, MCPR_STATE_PLAY,      0x27, pl_entity_look_and_relative_move, play.clientbound.entity_look_and_relative_move, FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_LOOK,                   MCPR_STATE_PLAY,      0x28, pl_entity_look,                   play.clientbound.entity_look,                   FIELDS) \
+  X(MCPR_PKT_PL_CB_VEHICLE_MOVE,                  MCPR_STATE_PLAY,      0x29, pl_vehicle_move,                  play.clientbound.vehicle_move,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_OPEN_SIGN_EDITOR,              MCPR_STATE_PLAY,      0x2A, pl_open_sign_editor,              play.clientbound.open_sign_editor,              FIELDS) \
+  X(MCPR_PKT_PL_CB_CRAFT_RECIPE_RESPONSE,         MCPR_STATE_PLAY,      0x2B, pl_craft_recipe_response,         play.clientbound.craft_recipe_response,         FIELDS) \
+  X(MCPR_PKT_PL_CB_PLAYER_ABILITIES,              MCPR_STATE_PLAY,      0x2C, pl_player_abilities,              play.clientbound.player_abilities,              CUSTOM) \
+  X(MCPR_PKT_PL_CB_COMBAT_EVENT,                  MCPR_STATE_PLAY,      0x2D, pl_combat_event,                  play.clientbound.combat_event,                  NONE)   \
+  X(MCPR_PKT_PL_CB_PLAYER_LIST_ITEM,              MCPR_STATE_PLAY,      0x2E, pl_player_list_item,              play.clientbound.player_list_item,              NONE)   \
+  X(MCPR_PKT_PL_CB_PLAYER_POSITION_AND_LOOK,      MCPR_STATE_PLAY,      0x2F, pl_player_position_and_look,      play.clientbound.player_position_and_look,      CUSTOM) \
+  X(MCPR_PKT_PL_CB_USE_BED,                       MCPR_STATE_PLAY,      0x30, pl_use_bed,                       play.clientbound.use_bed,                       FIELDS) \
+  X(MCPR_PKT_PL_CB_UNLOCK_RECIPES,                MCPR_STATE_PLAY,      0x31, pl_unlock_recipes,                play.clientbound.unlock_recipes,                FIELDS) \
+  X(MCPR_PKT_PL_CB_DESTROY_ENTITIES,              MCPR_STATE_PLAY,      0x32, pl_destroy_entities,              play.clientbound.destroy_entities,              FIELDS) \
+  X(MCPR_PKT_PL_CB_REMOVE_ENTITY_EFFECT,          MCPR_STATE_PLAY,      0x33, pl_remove_entity_effect,          play.clientbound.remove_entity_effect,          NONE)   \
+  X(MCPR_PKT_PL_CB_RESOURCE_PACK_SEND,            MCPR_STATE_PLAY,      0x34, pl_resource_pack_send,            play.clientbound.resource_pack_send,            FIELDS) \
+  X(MCPR_PKT_PL_CB_RESPAWN,                       MCPR_STATE_PLAY,      0x35, pl_respawn,                       play.clientbound.respawn,                       CUSTOM) \
+  X(MCPR_PKT_PL_CB_ENTITY_HEAD_LOOK,              MCPR_STATE_PLAY,      0x36, pl_entity_head_look,              play.clientbound.entity_head_look,              FIELDS) \
+  X(MCPR_PKT_PL_CB_SELECT_ADVANCEMENT_TAB,        MCPR_STATE_PLAY,      0x37, pl_select_advancement_tab,        play.clientbound.select_advancement_tab,        CUSTOM) \
+  X(MCPR_PKT_PL_CB_WORLD_BORDER,                  MCPR_STATE_PLAY,      0x38, pl_world_border,                  play.clientbound.world_border,                  NONE)   \
+  X(MCPR_PKT_PL_CB_CAMERA,                        MCPR_STATE_PLAY,      0x39, pl_camera,                        play.clientbound.camera,                        FIELDS) \
+  X(MCPR_PKT_PL_CB_HELD_ITEM_CHANGE,              MCPR_STATE_PLAY,      0x3A, pl_held_item_change,              play.clientbound.held_item_change,              FIELDS) \
+  X(MCPR_PKT_PL_CB_DISPLAY_SCOREBOARD,            MCPR_STATE_PLAY,      0x3B, pl_display_scoreboard,            play.clientbound.display_scoreboard,            FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_METADATA,               MCPR_STATE_PLAY,      0x3C, pl_entity_metadata,               play.clientbound.entity_metadata,               NONE)   \
+  X(MCPR_PKT_PL_CB_ATTACH_ENTITY,                 MCPR_STATE_PLAY,      0x3D, pl_attach_entity,                 play.clientbound.attach_entity,                 FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_VELOCITY,               MCPR_STATE_PLAY,      0x3E, pl_entity_velocity,               play.clientbound.entity_velocity,               FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_EQUIPMENT,              MCPR_STATE_PLAY,      0x3F, pl_entity_equipment,              play.clientbound.entity_equipment,              FIELDS) \
+  X(MCPR_PKT_PL_CB_SET_EXPERIENCE,                MCPR_STATE_PLAY,      0x40, pl_set_experience,                play.clientbound.set_experience,                FIELDS) \
+  X(MCPR_PKT_PL_CB_UPDATE_HEALTH,                 MCPR_STATE_PLAY,      0x41, pl_update_health,                 play.clientbound.update_health,                 FIELDS) \
+  X(MCPR_PKT_PL_CB_SCOREBOARD_OBJECTIVE,          MCPR_STATE_PLAY,      0x42, pl_scoreboard_objective,          play.clientbound.scoreboard_objective,          FIELDS) \
+  X(MCPR_PKT_PL_CB_SET_PASSENGERS,                MCPR_STATE_PLAY,      0x43, pl_set_passengers,                play.clientbound.set_passengers,                FIELDS) \
+  X(MCPR_PKT_PL_CB_TEAMS,                         MCPR_STATE_PLAY,      0x44, pl_teams,                         play.clientbound.teams,                         NONE)   \
+  X(MCPR_PKT_PL_CB_UPDATE_SCORE,                  MCPR_STATE_PLAY,      0x45, pl_update_score,                  play.clientbound.update_score,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_SPAWN_POSITION,                MCPR_STATE_PLAY,      0x46, pl_spawn_position,                play.clientbound.spawn_position,                FIELDS) \
+  X(MCPR_PKT_PL_CB_TIME_UPDATE,                   MCPR_STATE_PLAY,      0x47, pl_time_update,                   play.clientbound.time_update,                   FIELDS) \
+  X(MCPR_PKT_PL_CB_TITLE,                         MCPR_STATE_PLAY,      0x48, pl_title,                         play.clientbound.title,                         FIELDS) \
+  X(MCPR_PKT_PL_CB_SOUND_EFFECT,                  MCPR_STATE_PLAY,      0x49, pl_sound_effect,                  play.clientbound.sound_effect,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_PLAYER_LIST_HEADER_AND_FOOTER, MCPR_STATE_PLAY,      0x4A, pl_player_list_header_and_footer, play.clientbound.player_list_header_and_footer, NONE)   \
+  X(MCPR_PKT_PL_CB_COLLECT_ITEM,                  MCPR_STATE_PLAY,      0x4B, pl_collect_item,                  play.clientbound.collect_item,                  FIELDS) \
+  X(MCPR_PKT_PL_CB_ENTITY_TELEPORT,               MCPR_STATE_PLAY,      0x4C, pl_entity_teleport,               play.clientbound.entity_teleport,               FIELDS) \
+  X(MCPR_PKT_PL_CB_ADVANCEMENTS,                  MCPR_STATE_PLAY,      0x4D, pl_advancements,                  play.clientbound.advancements,                  NONE)   \
+  X(MCPR_PKT_PL_CB_ENTITY_PROPERTIES,             MCPR_STATE_PLAY,      0x4E, pl_entity_properties,             play.clientbound.entity_properties,             NONE)   \
+  X(MCPR_PKT_PL_CB_ENTITY_EFFECT,                 MCPR_STATE_PLAY,      0x4F, pl_entity_effect,                 play.clientbound.entity_effect,                 NONE)
+
+
+#define MCPR_SB_FIELDS_hs_handshake(F, p) \
+  F(VARINT, p.protocol_version) \
+  F(STRING_VIEW, p.server_address) \
+  F(USHORT, p.server_port) \
+  F(NEXT_STATE, p.next_state)
+
+#define MCPR_SB_FIELDS_st_request(F, p)
+
+#define MCPR_SB_FIELDS_st_ping(F, p) \
+  F(LONG, p.payload)
+
+#define MCPR_SB_FIELDS_lg_login_start(F, p) \
+  F(STRING_VIEW, p.name)
+
+#define MCPR_SB_FIELDS_lg_encryption_response(F, p) \
+  F(BYTES, p.shared_secret, p.shared_secret_length) \
+  F(BYTES, p.verify_token, p.verify_token_length)
+
+#define MCPR_SB_FIELDS_pl_teleport_confirm(F, p) \
+  F(VARINT, p.teleport_id)
+
+#define MCPR_SB_FIELDS_pl_tab_complete(F, p) \
+  F(STRING_VIEW, p.text) \
+  F(BOOL, p.assume_command) \
+  F(BOOL, p.has_position) \
+  F(OPTIONAL, p.has_position, POSITION, p.looked_at_block)
+
+#define MCPR_SB_FIELDS_pl_chat_message(F, p) \
+  F(STRING_VIEW, p.message)
+
+#define MCPR_SB_FIELDS_pl_client_status(F, p) \
+  F(VARINT_ENUM, p.action, 3)
+
+#define MCPR_SB_FIELDS_pl_confirm_transaction(F, p) \
+  F(BYTE, p.window_id) \
+  F(SHORT, p.action_number) \
+  F(BOOL, p.accepted)
+
+#define MCPR_SB_FIELDS_pl_enchant_item(F, p) \
+  F(BYTE, p.window_id) \
+  F(BYTE, p.enchantment)
+
+#define MCPR_SB_FIELDS_pl_click_window(F, p) \
+  F(UBYTE, p.window_id) \
+  F(SHORT, p.slot) \
+  F(BYTE, p.button) \
+  F(SHORT, p.action_number) \
+  F(VARINT_ENUM, p.mode, 7) \
+  F(SLOT, p.clicked_item)
+
+#define MCPR_SB_FIELDS_pl_close_window(F, p) \
+  F(UBYTE, p.window_id)
+
+#define MCPR_SB_FIELDS_pl_plugin_message(F, p) \
+  F(STRING_VIEW, p.channel) \
+  F(REMAINING_BYTES, p.data, p.data_length)
+
+#define MCPR_SB_FIELDS_pl_use_entity(F, p) \
+  F(VARINT, p.target) \
+  F(VARINT_ENUM, p.type, 3) \
+  F(OPTIONAL, p.type == MCPR_USE_ENTITY_TYPE_INTERACT_AT, FLOAT, p.target_x) \
+  F(OPTIONAL, p.type == MCPR_USE_ENTITY_TYPE_INTERACT_AT, FLOAT, p.target_y) \
+  F(OPTIONAL, p.type == MCPR_USE_ENTITY_TYPE_INTERACT_AT, FLOAT, p.target_z) \
+  F(OPTIONAL, p.type != MCPR_USE_ENTITY_TYPE_ATTACK, VARINT_ENUM, p.hand, 2)
+
+#define MCPR_SB_FIELDS_pl_keep_alive(F, p) \
+  F(VARINT, p.keep_alive_id)
+
+#define MCPR_SB_FIELDS_pl_player(F, p) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_SB_FIELDS_pl_player_position(F, p) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.feet_y) \
+  F(DOUBLE, p.z) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_SB_FIELDS_pl_player_position_and_look(F, p) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.feet_y) \
+  F(DOUBLE, p.z) \
+  F(FLOAT, p.yaw) \
+  F(FLOAT, p.pitch) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_SB_FIELDS_pl_player_look(F, p) \
+  F(FLOAT, p.yaw) \
+  F(FLOAT, p.pitch) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_SB_FIELDS_pl_vehicle_move(F, p) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.y) \
+  F(DOUBLE, p.z) \
+  F(FLOAT, p.yaw) \
+  F(FLOAT, p.pitch)
+
+#define MCPR_SB_FIELDS_pl_steer_boat(F, p) \
+  F(BOOL, p.right_paddle_turning) \
+  F(BOOL, p.left_paddle_turning)
+
+#define MCPR_SB_FIELDS_pl_craft_recipe_request(F, p) \
+  F(BYTE, p.window_id) \
+  F(VARINT, p.recipe_id) \
+  F(BOOL, p.make_all)
+
+#define MCPR_SB_FIELDS_pl_player_digging(F, p) \
+  F(VARINT_ENUM, p.status, 7) \
+  F(POSITION, p.block_position) \
+  F(BYTE_ENUM, p.face, 6)
+
+#define MCPR_SB_FIELDS_pl_entity_action(F, p) \
+  F(VARINT, p.entity_id) \
+  F(VARINT_ENUM, p.action, 9) \
+  F(VARINT, p.jump_boost)
+
+#define MCPR_SB_FIELDS_pl_crafting_book_data(F, p) \
+  F(VARINT_ENUM, p.type, 2) \
+  F(OPTIONAL, p.type == MCPR_CRAFTING_BOOK_DATA_TYPE_DISPLAYED_RECIPE, INT, p.displayed_recipe_id) \
+  F(OPTIONAL, p.type == MCPR_CRAFTING_BOOK_DATA_TYPE_CRAFTING_BOOK_STATUS, BOOL, p.crafting_book_open) \
+  F(OPTIONAL, p.type == MCPR_CRAFTING_BOOK_DATA_TYPE_CRAFTING_BOOK_STATUS, BOOL, p.crafting_filter)
+
+#define MCPR_SB_FIELDS_pl_resource_pack_status(F, p) \
+  F(VARINT_ENUM, p.result, 4)
+
+#define MCPR_SB_FIELDS_pl_advancement_tab(F, p) \
+  F(VARINT_ENUM, p.action, 2) \
+  F(OPTIONAL, p.action == MCPR_ADVANCEMENT_TAB_ACTION_OPENED_TAB, STRING_VIEW, p.tab_id)
+
+#define MCPR_SB_FIELDS_pl_held_item_change(F, p) \
+  F(SHORT, p.slot)
+
+#define MCPR_SB_FIELDS_pl_creative_inventory_action(F, p) \
+  F(SHORT, p.slot) \
+  F(SLOT, p.clicked_item)
+
+#define MCPR_SB_FIELDS_pl_update_sign(F, p) \
+  F(POSITION, p.sign_location) \
+  F(STRING_VIEW, p.line_1) \
+  F(STRING_VIEW, p.line_2) \
+  F(STRING_VIEW, p.line_3) \
+  F(STRING_VIEW, p.line_4)
+
+#define MCPR_SB_FIELDS_pl_animation(F, p) \
+  F(VARINT_ENUM, p.hand, 2)
+
+#define MCPR_SB_FIELDS_pl_spectate(F, p) \
+  F(UUID, p.target_player)
+
+#define MCPR_SB_FIELDS_pl_player_block_placement(F, p) \
+  F(POSITION, p.block_position) \
+  F(VARINT_ENUM, p.face, 6) \
+  F(VARINT_ENUM, p.hand, 2) \
+  F(FLOAT, p.cursor_position_x) \
+  F(FLOAT, p.cursor_position_y) \
+  F(FLOAT, p.cursor_position_z)
+
+#define MCPR_SB_FIELDS_pl_use_item(F, p) \
+  F(VARINT_ENUM, p.hand, 2)
+
+
+#define MCPR_CB_FIELDS_st_pong(F, p) \
+  F(LONG, p.payload)
+
+#define MCPR_CB_FIELDS_lg_disconnect(F, p) \
+  F(STRING, p.reason)
+
+#define MCPR_CB_FIELDS_lg_encryption_request(F, p) \
+  F(STRING, p.server_id) \
+  F(BYTES, p.public_key, p.public_key_length) \
+  F(BYTES, p.verify_token, p.verify_token_length)
+
+#define MCPR_CB_FIELDS_lg_login_success(F, p) \
+  F(UUID_STRING, p.uuid) \
+  F(STRING, p.username)
+
+#define MCPR_CB_FIELDS_lg_set_compression(F, p) \
+  F(VARINT, p.threshold)
+
+#define MCPR_CB_FIELDS_pl_spawn_experience_orb(F, p) \
+  F(VARINT, p.entity_id) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.y) \
+  F(DOUBLE, p.z) \
+  F(SHORT, p.count)
+
+#define MCPR_CB_FIELDS_pl_spawn_global_entity(F, p) \
+  F(VARINT, p.entity_id) \
+  F(BYTE, p.type) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.y) \
+  F(DOUBLE, p.z)
+
+#define MCPR_CB_FIELDS_pl_animation(F, p) \
+  F(VARINT, p.entity_id) \
+  F(BYTE_ENUM, p.animation, 6)
+
+#define MCPR_CB_FIELDS_pl_block_break_animation(F, p) \
+  F(VARINT, p.entity_id) \
+  F(POSITION, p.location) \
+  F(BYTE, p.destroy_stage)
+
+#define MCPR_CB_FIELDS_pl_block_change(F, p) \
+  F(POSITION, p.location) \
+  F(VARINT, p.block_id)
+
+#define MCPR_CB_FIELDS_pl_server_difficulty(F, p) \
+  F(BYTE_ENUM, p.difficulty, 4)
+
+#define MCPR_CB_FIELDS_pl_tab_complete(F, p) \
+  F(VARINT, p.count) \
+  F(STRINGS, p.matches, p.count)
+
+#define MCPR_CB_FIELDS_pl_chat_message(F, p) \
+  F(STRING, p.json_data) \
+  F(BYTE_ENUM, p.position, 3)
+
+#define MCPR_CB_FIELDS_pl_confirm_transaction(F, p) \
+  F(UBYTE, p.window_id) \
+  F(USHORT, p.action_number) \
+  F(BOOL, p.accepted)
+
+#define MCPR_CB_FIELDS_pl_close_window(F, p) \
+  F(UBYTE, p.window_id)
+
+#define MCPR_CB_FIELDS_pl_window_items(F, p) \
+  F(UBYTE, p.window_id) \
+  F(SHORT, p.count) \
+  F(SLOTS, p.slots, p.count)
+
+#define MCPR_CB_FIELDS_pl_set_slot(F, p) \
+  F(UBYTE, p.window_id) \
+  F(SHORT, p.slot) \
+  F(SLOT, p.slot_data)
+
+#define MCPR_CB_FIELDS_pl_set_cooldown(F, p) \
+  F(VARINT, p.item_id) \
+  F(VARINT, p.cooldown_ticks)
+
+#define MCPR_CB_FIELDS_pl_plugin_message(F, p) \
+  F(STRING, p.channel) \
+  F(REMAINING_BYTES, p.data, p.data_length)
+
+#define MCPR_CB_FIELDS_pl_named_sound_effect(F, p) \
+  F(STRING, p.sound_id) \
+  F(VARINT_ENUM, p.sound_category, 10) \
+  F(INT, p.effect_position_x) \
+  F(INT, p.effect_position_y) \
+  F(INT, p.effect_position_z) \
+  F(FLOAT, p.volume) \
+  F(FLOAT, p.pitch)
+
+#define MCPR_CB_FIELDS_pl_disconnect(F, p) \
+  F(STRING, p.reason)
+
+#define MCPR_CB_FIELDS_pl_entity_status(F, p) \
+  F(INT, p.entity_id) \
+  F(BYTE, p.entity_status)
+
+#define MCPR_CB_FIELDS_pl_unload_chunk(F, p) \
+  F(INT, p.chunk_x) \
+  F(INT, p.chunk_z)
+
+#define MCPR_CB_FIELDS_pl_keep_alive(F, p) \
+  F(VARINT, p.keep_alive_id)
+
+#define MCPR_CB_FIELDS_pl_entity(F, p) \
+  F(VARINT, p.entity_id)
+
+#define MCPR_CB_FIELDS_pl_entity_relative_move(F, p) \
+  F(VARINT, p.entity_id) \
+  F(SHORT, p.delta_x) \
+  F(SHORT, p.delta_y) \
+  F(SHORT, p.delta_z) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_CB_FIELDS_pl_entity_look_and_relative_move(F, p) \
+  F(VARINT, p.entity_id) \
+  F(SHORT, p.delta_x) \
+  F(SHORT, p.delta_y) \
+  F(SHORT, p.delta_z) \
+  F(BYTE, p.yaw) \
+  F(BYTE, p.pitch) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_CB_FIELDS_pl_entity_look(F, p) \
+  F(VARINT, p.entity_id) \
+  F(BYTE, p.yaw) \
+  F(BYTE, p.pitch) \
+  F(BOOL, p.on_ground)
+
+#define MCPR_CB_FIELDS_pl_vehicle_move(F, p) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.y) \
+  F(DOUBLE, p.z) \
+  F(FLOAT, p.yaw) \
+  F(FLOAT, p.pitch)
+
+#define MCPR_CB_FIELDS_pl_open_sign_editor(F, p) \
+  F(POSITION, p.location)
+
+#define MCPR_CB_FIELDS_pl_craft_recipe_response(F, p) \
+  F(BYTE, p.window_id) \
+  F(VARINT, p.recipe_id)
+
+#define MCPR_CB_FIELDS_pl_use_bed(F, p) \
+  F(VARINT, p.entity_id) \
+  F(POSITION, p.location)
+
+#define MCPR_CB_FIELDS_pl_unlock_recipes(F, p) \
+  F(VARINT_ENUM, p.action, 3) \
+  F(BOOL, p.crafting_book_open) \
+  F(BOOL, p.filtering_craftable) \
+  F(VARINT, p.array_size_1) \
+  F(VARINTS, p.recipe_ids, p.array_size_1) \
+  F(OPTIONAL, p.action == MCPR_UNLOCK_RECIPES_ACTION_INIT, VARINT, p.array_size_2) \
+  F(OPTIONAL, p.action == MCPR_UNLOCK_RECIPES_ACTION_INIT, VARINTS, p.recipe_ids_2, p.array_size_2)
+
+#define MCPR_CB_FIELDS_pl_destroy_entities(F, p) \
+  F(VARINT, p.count) \
+  F(VARINTS, p.entity_ids, p.count)
+
+#define MCPR_CB_FIELDS_pl_resource_pack_send(F, p) \
+  F(STRING, p.url) \
+  F(STRING, p.hash)
+
+#define MCPR_CB_FIELDS_pl_entity_head_look(F, p) \
+  F(VARINT, p.entity_id) \
+  F(BYTE, p.head_yaw)
+
+#define MCPR_CB_FIELDS_pl_camera(F, p) \
+  F(VARINT, p.camera_id)
+
+#define MCPR_CB_FIELDS_pl_held_item_change(F, p) \
+  F(BYTE, p.slot)
+
+#define MCPR_CB_FIELDS_pl_display_scoreboard(F, p) \
+  F(BYTE_ENUM, p.position, 3) \
+  F(STRING, p.score_name)
+
+#define MCPR_CB_FIELDS_pl_attach_entity(F, p) \
+  F(INT, p.attached_entity_id) \
+  F(INT, p.holding_entity_id)
+
+#define MCPR_CB_FIELDS_pl_entity_velocity(F, p) \
+  F(VARINT, p.entity_id) \
+  F(SHORT, p.velocity_x) \
+  F(SHORT, p.velocity_y) \
+  F(SHORT, p.velocity_z)
+
+#define MCPR_CB_FIELDS_pl_entity_equipment(F, p) \
+  F(VARINT, p.entity_id) \
+  F(VARINT_ENUM, p.slot, 6) \
+  F(SLOT, p.slot_data)
+
+#define MCPR_CB_FIELDS_pl_set_experience(F, p) \
+  F(FLOAT, p.experience_bar) \
+  F(VARINT, p.level) \
+  F(VARINT, p.total_experience)
+
+#define MCPR_CB_FIELDS_pl_update_health(F, p) \
+  F(FLOAT, p.health) \
+  F(VARINT, p.food) \
+  F(FLOAT, p.food_saturation)
+
+#define MCPR_CB_FIELDS_pl_scoreboard_objective(F, p) \
+  F(STRING, p.objective_name) \
+  F(BYTE_ENUM, p.mode, 3) \
+  F(OPTIONAL, p.mode != MCPR_SCOREBOARD_OBJECTIVE_MODE_REMOVE, STRING, p.objective_value) \
+  F(OPTIONAL, p.mode != MCPR_SCOREBOARD_OBJECTIVE_MODE_REMOVE, STRING, p.type)
+
+#define MCPR_CB_FIELDS_pl_set_passengers(F, p) \
+  F(VARINT, p.entity_id) \
+  F(VARINT, p.passenger_count) \
+  F(VARINTS, p.passengers, p.passenger_count)
+
+#define MCPR_CB_FIELDS_pl_update_score(F, p) \
+  F(STRING, p.score_name) \
+  F(BYTE_ENUM, p.action, 2) \
+  F(STRING, p.objective_name) \
+  F(OPTIONAL, p.action != MCPR_UPDATE_SCORE_ACTION_REMOVE, VARINT, p.value)
+
+#define MCPR_CB_FIELDS_pl_spawn_position(F, p) \
+  F(POSITION, p.location)
+
+#define MCPR_CB_FIELDS_pl_time_update(F, p) \
+  F(LONG, p.world_age) \
+  F(LONG, p.time_of_day)
+
+#define MCPR_CB_FIELDS_pl_title(F, p) \
+  F(VARINT_ENUM, p.action, 6) \
+  F(OPTIONAL, p.action == MCPR_TITLE_ACTION_SET_TITLE, STRING, p.action_set_title.title_text) \
+  F(OPTIONAL, p.action == MCPR_TITLE_ACTION_SET_SUBTITLE, STRING, p.action_set_subtitle.subtitle_text) \
+  F(OPTIONAL, p.action == MCPR_TITLE_ACTION_SET_ACTION_BAR, STRING, p.action_set_action_bar.action_bar_text) \
+  F(OPTIONAL, p.action == MCPR_TITLE_ACTION_SET_TIMES_AND_DISPLAY, INT, p.action_set_times_and_display.fade_in) \
+  F(OPTIONAL, p.action == MCPR_TITLE_ACTION_SET_TIMES_AND_DISPLAY, INT, p.action_set_times_and_display.stay) \
+  F(OPTIONAL, p.action == MCPR_TITLE_ACTION_SET_TIMES_AND_DISPLAY, INT, p.action_set_times_and_display.fade_out)
+
+#define MCPR_CB_FIELDS_pl_sound_effect(F, p) \
+  F(VARINT, p.sound_id) \
+  F(VARINT_ENUM, p.category, 10) \
+  F(INT, p.effect_position_x) \
+  F(INT, p.effect_position_y) \
+  F(INT, p.effect_position_z) \
+  F(FLOAT, p.volume) \
+  F(FLOAT, p.pitch)
+
+#define MCPR_CB_FIELDS_pl_collect_item(F, p) \
+  F(VARINT, p.collected_entity_id) \
+  F(VARINT, p.collector_entity_id) \
+  F(VARINT, p.pickup_item_count)
+
+#define MCPR_CB_FIELDS_pl_entity_teleport(F, p) \
+  F(VARINT, p.entity_id) \
+  F(DOUBLE, p.x) \
+  F(DOUBLE, p.y) \
+  F(DOUBLE, p.z) \
+  F(BYTE, p.yaw) \
+  F(BYTE, p.pitch) \
+  F(BOOL, p.on_ground)
+
+#endif // MCPR_PACKETSCHEMA_H
@@ -34,6 +34,24 @@
 #define END_IGNORE() \
   DO_GCC_PRAGMA(GCC diagnostic pop)
 
+#ifdef __GNUC__
+  #ifndef likely
+    #define likely(x)     __builtin_expect(!!(x), 1)
+  #endif
+
+  #ifndef unlikely
+    #define unlikely(x)   __builtin_expect(!!(x), 0)
+  #endif
+#else
+  #ifndef likely
+    #define likely(x) (x)
+  #endif
+
+  #ifndef unlikely
+    #define unlikely(x) (x)
+  #endif
+#endif
+
 
 
 #define htonll(x) ((1==htonl(1)) ? ((uint64_t) x) : ((uint64_t) htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
@@ -33,10 +33,18 @@
 #include <ninio/bstream.h>
 
 #include "player.h"
+#include "conntable.h"
+#include "packetqueue.h"
+#include "serverkey.h"
 
+struct mapi_request;
+
+
+struct io_thread;
 
 struct connection
 {
+  conn_id id; // Key in the connection table, reused by later connections once this one is removed.
   int fd;
   struct sockaddr_storage client_address;
   FILE *rawstream;
@@ -47,15 +55,26 @@ struct connection
   struct player *player; // may be NULL
   bool auth_required;
   time_t connected_at; // unix time
+  struct io_thread *io; // The network I/O thread which accepted this connection, and which reads it.
+  struct packet_queue inbound; // Filled by the network I/O thread, drained by the tick.
+  bool ready; // Guarded by the network handoff lock, set if this connection is already queued to be served by the tick.
+  psnip_atomic_int32 hangup; // Set if the peer hung up or the connection broke, the connection is closed after draining what is left.
+  psnip_atomic_int32 io_paused; // Set by the I/O thread if it stopped decoding packets for this connection until the tick caught up.
+  psnip_atomic_int32 closing; // Set by the tick once the connection is closed, the I/O thread leaves it alone from then on.
+  psnip_atomic_int32 awaiting_deadline; // Set whilst the connection is in the pre-login deadline queue of its I/O thread.
+  int64_t closed_at_generation; // Value of the I/O thread's generation counter at the time of closing.
+  char *disconnect_message; // Sent once the connection is actually closed, may be NULL.
+  time_t congested_since; // unix time, 0 if the outgoing queue of this connection is not congested.
 
   bool tmp_present;
   struct {
-    int32_t verify_token_length;
-    void *verify_token;
-    RSA *rsa;
+    uint8_t verify_token[16];
+    struct server_key *key; // The key sent in the encryption request, with a reference held.
+    struct mapi_request *session_request; // Non-NULL whilst waiting for the session server to verify the client.
     char *username;
   } tmp;
 };
 void connection_close(struct connection *conn, const char *disconnect_message);
+void connection_resume(struct connection *conn); // Hands a connection held back during login back to its I/O thread, only called from the tick thread.
 
 #endif
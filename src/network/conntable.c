@@ -0,0 +1,130 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <ninerr/ninerr.h>
+
+#include "conntable.h"
+
+#define SLOT_NONE UINT32_MAX
+
+static inline uint32_t id_slot(conn_id id) { return id - 1; }
+static inline conn_id make_id(uint32_t slot) { return slot + 1; }
+
+static bool grow(struct conntable *table, size_t new_capacity)
+{
+  if(new_capacity >= SLOT_NONE) { ninerr_set_err(ninerr_arithmetic_new()); return false; }
+
+  struct conntable_slot *slots = realloc(table->slots, new_capacity * sizeof(struct conntable_slot));
+  if(slots == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  table->slots = slots;
+
+  conn_id *ids = realloc(table->ids, new_capacity * sizeof(conn_id));
+  if(ids == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  table->ids = ids;
+
+  struct connection **conns = realloc(table->conns, new_capacity * sizeof(struct connection *));
+  if(conns == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  table->conns = conns;
+
+  // Push the new slots onto the free list, lowest index first.
+  for(size_t i = new_capacity; i > table->capacity; i--)
+  {
+    struct conntable_slot *slot = &(table->slots[i - 1]);
+    slot->in_use = false;
+    slot->index = table->free_head;
+    table->free_head = (uint32_t) (i - 1);
+  }
+  table->capacity = new_capacity;
+  return true;
+}
+
+bool conntable_init(struct conntable *table, size_t initial_capacity)
+{
+  table->slots = NULL;
+  table->ids = NULL;
+  table->conns = NULL;
+  table->count = 0;
+  table->capacity = 0;
+  table->free_head = SLOT_NONE;
+  if(initial_capacity == 0) initial_capacity = 16;
+  if(!grow(table, initial_capacity)) { conntable_destroy(table); return false; }
+  return true;
+}
+
+void conntable_destroy(struct conntable *table)
+{
+  free(table->slots);
+  free(table->ids);
+  free(table->conns);
+  table->slots = NULL;
+  table->ids = NULL;
+  table->conns = NULL;
+  table->count = 0;
+  table->capacity = 0;
+  table->free_head = SLOT_NONE;
+}
+
+conn_id conntable_insert(struct conntable *table, struct connection *conn)
+{
+  if(table->free_head == SLOT_NONE && !grow(table, table->capacity * 2)) return CONN_ID_INVALID;
+
+  uint32_t slot_index = table->free_head;
+  struct conntable_slot *slot = &(table->slots[slot_index]);
+  table->free_head = slot->index;
+
+  conn_id id = make_id(slot_index);
+  slot->in_use = true;
+  slot->index = (uint32_t) table->count;
+  table->conns[table->count] = conn;
+  table->ids[table->count] = id;
+  table->count++;
+  return id;
+}
+
+bool conntable_remove(struct conntable *table, conn_id id)
+{
+  uint32_t slot_index = id_slot(id);
+  if(slot_index >= table->capacity) return false;
+  struct conntable_slot *slot = &(table->slots[slot_index]);
+  if(!slot->in_use) return false;
+
+  // Move the last connection into the hole to keep the dense array contiguous.
+  uint32_t index = slot->index;
+  size_t last = table->count - 1;
+  if(index != last)
+  {
+    table->conns[index] = table->conns[last];
+    table->ids[index] = table->ids[last];
+    table->slots[id_slot(table->ids[index])].index = index;
+  }
+  table->count--;
+
+  slot->in_use = false;
+  slot->index = table->free_head;
+  table->free_head = slot_index;
+  return true;
+}
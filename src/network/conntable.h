@@ -0,0 +1,65 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_CONNTABLE_H
+#define STRONK_CONNTABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct connection;
+
+// Dense table of connections.
+// Connections are stored contiguously so they can be handed out in slices, removal swaps the last connection into the hole.
+// A connection id names a slot which keeps track of where the connection currently is in the dense array,
+// it is only valid until the connection is removed, after which the slot may be handed out again.
+// The table is not thread-safe.
+
+typedef uint32_t conn_id;
+#define CONN_ID_INVALID ((conn_id) 0) // Ids are slot indices plus one.
+
+struct conntable_slot
+{
+  uint32_t index; // Index into the dense array if in use, else the next free slot.
+  bool in_use;
+};
+
+struct conntable
+{
+  struct conntable_slot *slots;
+  conn_id *ids; // Parallel to conns.
+  struct connection **conns;
+  size_t count;
+  size_t capacity;
+  uint32_t free_head; // UINT32_MAX if there are no free slots.
+};
+
+bool conntable_init                       (struct conntable *table, size_t initial_capacity);
+void conntable_destroy                    (struct conntable *table);
+conn_id conntable_insert                  (struct conntable *table, struct connection *conn); // Returns CONN_ID_INVALID on error.
+bool conntable_remove                     (struct conntable *table, conn_id id); // Returns false if id isn't in use.
+
+static inline size_t conntable_count              (const struct conntable *table) { return table->count; }
+static inline struct connection **conntable_conns (const struct conntable *table) { return table->conns; }
+
+#endif
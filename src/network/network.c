@@ -31,17 +31,22 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <signal.h>
 #include <pthread.h>
 
-#include <thpool.h>
+#include <zlib.h>
+
+#include <psnip/atomic/atomic.h>
 
-#include <algo/slist.h>
 #include <algo/hash-table.h>
 #include <algo/hash-pointer.h>
 #include <algo/compare-pointer.h>
@@ -52,53 +57,140 @@
 
 #include <mcpr/mcpr.h>
 #include <mcpr/packet.h>
+#include <mcpr/packetschema.h>
 #include <mcpr/codec.h>
 #include <mcpr/connection.h>
 
+#include <mapi/mapi.h>
+
 #include <logging/logging.h>
 
 #include "network/network.h"
 #include <network/connection.h>
+#include <network/packetqueue.h>
+#include <network/ratelimit.h>
+#include <network/serverkey.h>
+#include <network/statusresponse.h>
 #include <network/packethandlers/packethandlers.h>
+#include <world/world.h>
+#include <scheduler/scheduler.h>
+#include <tickstats/tickstats.h>
 #include <server.h>
 #include "stronk.h"
 #include "util.h"
 
-static int server_socket;
-static size_t client_count = 0;
-static pthread_rwlock_t clients_lock;
-static SListEntry *clients = NULL; // List of clients.
-static char *motd;
-static struct addrinfo *addressinfo;
+#define EPOLL_MAX_EVENTS 256
+#define IO_POLL_TIMEOUT 50 // In milliseconds, the I/O thread wakes up at least this often.
+#define INBOUND_QUEUE_CAPACITY 128 // Maximum amount of decoded packets waiting for the tick, per connection.
+#define HOUSEKEEPING_INTERVAL_TICKS 20 // Keep alives and timeouts are checked once every second.
+#define CHUNKS_PER_TICK 8 // Maximum amount of chunks sent to a single player per tick.
+#define CHUNK_STREAM_GRAIN 4 // Connections per scheduler task when streaming chunks.
+#define MAX_IO_THREADS 16
+#define CONNECT_RATE 2 // Connections per second a single address may make on average..
+#define CONNECT_BURST 8 // ..and at once.
+#define CONNECT_RATELIMIT_ADDRESSES 16384 // Amount of addresses the rate limiter keeps track of.
+#define PRELOGIN_DEADLINE 10 // In seconds, connections which haven't finished logging in by then are closed.
+#define REJECTION_REPORT_INTERVAL 60 // In housekeeping runs.
+#define CONGESTION_TIMEOUT 30 // Connections which can't keep up with what is sent to them for this long (in seconds) are dropped.
+#define DEFAULT_MAX_PLAYERS 20
 
+/*
+  Sockets are read by dedicated I/O threads, which decode packets into the inbound queue of each connection.
+  Everything else, handling those packets included, happens on the tick thread, so game state is only ever mutated from the tick.
 
-static void accept_incoming_connections(void);
-static void serve_client_batch(void *arg);
-static void serve_clients(void);
+  Every I/O thread has its own listener socket, all bound to the same port with SO_REUSEPORT so that the kernel spreads
+  incoming connections over them, and its own epoll instance. A connection stays with the I/O thread which accepted it.
 
+  The connection table is owned by the tick. Connections accepted by an I/O thread are handed over through new_clients,
+  connections which have something for the tick to do through ready_clients. The tick hands connections back to their I/O thread
+  through its resumed_clients once it caught up with a connection the I/O thread stopped decoding for.
 
-int net_init(void) {
-  const char *service = "25565"; // TODO configuration of port.
-  nlog_info("Creating server socket..");
+  Closed connections are only freed once their I/O thread finished the batch of events it was working on when the connection was closed,
+  so that it never touches a freed connection. The generation of an I/O thread counts those batches.
+*/
 
-  struct addrinfo hints;
+struct connection_list
+{
+  struct connection **conns;
+  size_t count;
+  size_t max_size;
+};
 
-  // first, load up address structs with getaddrinfo():
-  memset(&hints, 0, sizeof hints);
-  hints.ai_family = AF_UNSPEC; // use IPv4 or IPv6, whichever
-  hints.ai_socktype = SOCK_STREAM;
-  hints.ai_flags = AI_PASSIVE; // fill in my IP for me
+struct prelogin_deadline
+{
+  struct connection *conn;
+  uint64_t expires_at; // Monotonic, in nanoseconds.
+};
 
-  int getaddrinfo_result = getaddrinfo(NULL, service, &hints, &addressinfo);
-  if(getaddrinfo_result != 0)
-  {
-    nlog_fatal("Could not set up inbound socket address, getaddrinfo() returned an error: %s", gai_strerror(getaddrinfo_result));
-    return -1;
-  }
+// Ring buffer. Every connection gets the same amount of time, so deadlines are pushed in the order in which they expire.
+struct deadline_queue
+{
+  struct prelogin_deadline *entries;
+  size_t head;
+  size_t count;
+  size_t capacity;
+};
+
+struct io_thread
+{
+  pthread_t thread;
+  bool started;
+  int listener;
+  int epoll_fd;
+  int wake_fd; // eventfd which wakes up the I/O thread.
+  int timer_fd; // timerfd which expires at the first deadline in deadlines.
+  struct deadline_queue deadlines; // Of the connections accepted by this I/O thread, only touched by the I/O thread itself.
+  psnip_atomic_int64 generation; // Incremented every time the I/O thread is done with a batch of events.
+  bool accept_retry; // Only touched by the I/O thread itself.
+  struct connection_list resumed_clients; // The I/O thread should continue decoding packets for these, guarded by handoff_lock.
+};
+
+static struct io_thread *io_threads = NULL;
+static unsigned int io_thread_count = 0;
+static psnip_atomic_int32 io_threads_running;
+static unsigned int listener_count_setting = 0; // 0 means one per four cores.
+static int accept_backlog = 1024; // Capped by the kernel to net.core.somaxconn.
+static int defer_accept_timeout = 5; // In seconds, 0 disables TCP_DEFER_ACCEPT.
+static unsigned int key_rotation_interval = 0; // In seconds, 0 disables rotation of the server key.
+static bool server_key_init_done = false;
+static struct ratelimiter connect_limiter;
+static bool connect_limiter_init_done = false;
+static psnip_atomic_int64 rejected_rate_limited;
+static psnip_atomic_int64 rejected_prelogin_timeout;
+static unsigned int housekeeping_since_report = 0; // Only touched by the tick thread.
+static struct net_rejection_counters last_reported_rejections; // Only touched by the tick thread.
+static struct mapi_cache_stats last_reported_cache_stats; // Only touched by the tick thread.
+static struct conntable clients; // Only touched by the tick thread.
+static psnip_atomic_int32 online_players = PSNIP_ATOMIC_VAR_INIT(0); // Connections with a player, counted from the tick and the workers.
+static psnip_atomic_int32 max_players = PSNIP_ATOMIC_VAR_INIT(DEFAULT_MAX_PLAYERS);
+static bool status_response_init_done = false;
+static int compression_threshold = 256; // Packets of at least this size are compressed, negative disables compression.
+static int compression_level = Z_DEFAULT_COMPRESSION;
+static struct addrinfo *addressinfo;
+static unsigned int ticks_since_housekeeping = 0;
+
+static pthread_mutex_t handoff_lock; // Guards new_clients, ready_clients, the resumed_clients of every I/O thread and the ready flag of every connection.
+static struct connection_list new_clients; // Accepted, but not yet in the connection table.
+static struct connection_list ready_clients; // Have packets waiting, or need to be looked at by the tick for another reason.
+static struct connection_list serving_clients; // ready_clients as taken by the tick, only touched by the tick thread.
+static struct connection_list closed_clients; // Waiting to be freed, only touched by the tick thread.
 
-  // make a socket:
-  server_socket = socket(addressinfo->ai_family, addressinfo->ai_socktype, addressinfo->ai_protocol);
-  if(server_socket == -1)
+
+static void accept_incoming_connections(struct io_thread *io);
+static void *io_thread_run(void *arg);
+static void read_client(struct connection *conn);
+static void serve_clients(void);
+static void reap_closed_clients(void);
+static void stream_chunks_range(size_t begin, size_t end, void *arg);
+static void stream_chunks(void);
+static void do_housekeeping(void);
+
+
+// Creates a listener socket bound to the server address, only logs the address if announce is set.
+static int create_listener(bool announce)
+{
+  int listener = socket(addressinfo->ai_family, addressinfo->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, addressinfo->ai_protocol);
+  if(listener == -1)
   {
     nlog_fatal("Could not create server socket. (%s)", strerror(errno));
     return -1;
@@ -108,18 +200,35 @@ int net_init(void) {
   //char yes='1'; // Solaris people use this
 
   // lose the pesky "Address already in use" error message
-  if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes) == -1) {
+  if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes) == -1) {
     nlog_fatal("Could not setsockopt");
+    close(listener);
     return -1;
   }
 
+  // Every I/O thread binds its own socket to the same port, the kernel balances incoming connections between them.
+  if(setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes) == -1)
+  {
+    nlog_fatal("Could not enable SO_REUSEPORT for server socket. (%s)", strerror(errno));
+    close(listener);
+    return -1;
+  }
+
+  // Connections are only handed to accept() once the client has actually sent something,
+  // so that idle connects are dealt with by the kernel instead.
+  if(defer_accept_timeout > 0 && setsockopt(listener, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept_timeout, sizeof defer_accept_timeout) == -1)
+  {
+    nlog_warn("Could not enable TCP_DEFER_ACCEPT for server socket. (%s)", strerror(errno));
+  }
+
   // bind it to the port we passed in to getaddrinfo():
-  if(bind(server_socket, addressinfo->ai_addr, addressinfo->ai_addrlen) == -1)
+  if(bind(listener, addressinfo->ai_addr, addressinfo->ai_addrlen) == -1)
   {
     nlog_fatal("Could not bind socket. (%s)", strerror(errno));
+    close(listener);
     return -1;
   }
-  if(addressinfo->ai_addr->sa_family == AF_INET6)
+  if(announce && addressinfo->ai_addr->sa_family == AF_INET6)
   {
     char buf[INET6_ADDRSTRLEN];
     const char *ip = inet_ntop(AF_INET6, addressinfo->ai_addr, buf, addressinfo->ai_addrlen);
@@ -128,7 +237,7 @@ int net_init(void) {
       nlog_info("Successfully bound socket to [%s]:%hu", ip, ntoh16(((struct sockaddr_in6 *) addressinfo->ai_addr)->sin6_port));
     }
   }
-  else if(addressinfo->ai_addr->sa_family == AF_INET)
+  else if(announce && addressinfo->ai_addr->sa_family == AF_INET)
   {
     char buf[INET_ADDRSTRLEN];
     const char *ip = inet_ntop(AF_INET, addressinfo->ai_addr, buf, addressinfo->ai_addrlen);
@@ -138,10 +247,115 @@ int net_init(void) {
     }
   }
 
+  if(listen(listener, accept_backlog) == -1)
+  {
+    nlog_fatal("Could not listen on server socket. (%s)", strerror(errno));
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+
+static bool init_io_thread(struct io_thread *io, bool announce)
+{
+  io->listener = create_listener(announce);
+  if(io->listener == -1) return false;
 
-  if(fcntl(server_socket, F_SETFL, O_NONBLOCK) == -1)
+  io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(io->epoll_fd == -1)
   {
-    nlog_fatal("Could not set O_NONBLOCK flag for server socket. (%s)", strerror(errno));
+    nlog_fatal("Could not create epoll instance. (%s)", strerror(errno));
+    return false;
+  }
+
+  // The listener and the wake up eventfd are registered with a pointer to their fd, client sockets with a pointer to their connection.
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = &(io->listener);
+  if(epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->listener, &ev) == -1)
+  {
+    nlog_fatal("Could not add server socket to epoll instance. (%s)", strerror(errno));
+    return false;
+  }
+
+  io->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(io->wake_fd == -1)
+  {
+    nlog_fatal("Could not create eventfd. (%s)", strerror(errno));
+    return false;
+  }
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = &(io->wake_fd);
+  if(epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->wake_fd, &ev) == -1)
+  {
+    nlog_fatal("Could not add eventfd to epoll instance. (%s)", strerror(errno));
+    return false;
+  }
+
+  io->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(io->timer_fd == -1)
+  {
+    nlog_fatal("Could not create timerfd. (%s)", strerror(errno));
+    return false;
+  }
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = &(io->timer_fd);
+  if(epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->timer_fd, &ev) == -1)
+  {
+    nlog_fatal("Could not add timerfd to epoll instance. (%s)", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static uint64_t monotonic_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static void wake_io_thread(struct io_thread *io)
+{
+  uint64_t one = 1;
+  if(write(io->wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) nlog_warn("Could not wake up network I/O thread. (%s)", strerror(errno));
+}
+
+void net_set_listener_count(unsigned int count)
+{
+  listener_count_setting = count;
+}
+
+void net_set_accept_backlog(int backlog)
+{
+  accept_backlog = backlog;
+}
+
+void net_set_defer_accept_timeout(int seconds)
+{
+  defer_accept_timeout = seconds;
+}
+
+void net_set_key_rotation_interval(unsigned int seconds)
+{
+  key_rotation_interval = seconds;
+}
+
+int net_init(void) {
+  const char *service = "25565"; // TODO configuration of port.
+
+  struct addrinfo hints;
+
+  // first, load up address structs with getaddrinfo():
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC; // use IPv4 or IPv6, whichever
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE; // fill in my IP for me
+
+  int getaddrinfo_result = getaddrinfo(NULL, service, &hints, &addressinfo);
+  if(getaddrinfo_result != 0)
+  {
+    nlog_fatal("Could not set up inbound socket address, getaddrinfo() returned an error: %s", gai_strerror(getaddrinfo_result));
     return -1;
   }
 
@@ -153,212 +367,492 @@ int net_init(void) {
   new_actn.sa_flags = 0;
   sigaction (SIGPIPE, &new_actn, &old_actn);
 
-  nlog_info("Listening on server socket with a backlog of 20..");
-  if(listen(server_socket, 20) == -1)
+  io_thread_count = listener_count_setting;
+  if(io_thread_count == 0) io_thread_count = (scheduler_get_worker_count() + 3) / 4;
+  if(io_thread_count > MAX_IO_THREADS) io_thread_count = MAX_IO_THREADS;
+  io_threads = malloc(io_thread_count * sizeof(struct io_thread));
+  if(io_threads == NULL)
   {
-    nlog_fatal("Could not listen on server socket. (%s)", strerror(errno));
+    nlog_fatal("Could not allocate memory. (%s)", strerror(errno));
+    io_thread_count = 0;
+    return -1;
+  }
+  for(unsigned int i = 0; i < io_thread_count; i++)
+  {
+    io_threads[i].started = false;
+    io_threads[i].listener = -1;
+    io_threads[i].epoll_fd = -1;
+    io_threads[i].wake_fd = -1;
+    io_threads[i].timer_fd = -1;
+    io_threads[i].deadlines.entries = NULL;
+    io_threads[i].deadlines.head = 0;
+    io_threads[i].deadlines.count = 0;
+    io_threads[i].deadlines.capacity = 0;
+    io_threads[i].accept_retry = false;
+    psnip_atomic_int64_store(&(io_threads[i].generation), 0);
+    io_threads[i].resumed_clients.conns = NULL;
+    io_threads[i].resumed_clients.count = 0;
+    io_threads[i].resumed_clients.max_size = 0;
+  }
+
+  if(!server_key_init(key_rotation_interval))
+  {
+    nlog_fatal("Could not initialize server key. (%s)", ninerr->message);
     return -1;
   }
+  server_key_init_done = true;
 
-  if(pthread_rwlock_init(&clients_lock, NULL) != 0)
+  if(!ratelimiter_init(&connect_limiter, CONNECT_RATELIMIT_ADDRESSES, CONNECT_RATE, CONNECT_BURST))
   {
-    nlog_fatal("Could not initialize clients delete lock.");
+    nlog_fatal("Could not initialize connection rate limiter. (%s)", ninerr->message);
     return -1;
   }
+  connect_limiter_init_done = true;
+  psnip_atomic_int64_store(&rejected_rate_limited, 0);
+  psnip_atomic_int64_store(&rejected_prelogin_timeout, 0);
 
-  motd = mcpr_as_chat("A bloody stronk server.");
+  nlog_info("Creating %u server sockets with a backlog of %i..", io_thread_count, accept_backlog);
+  for(unsigned int i = 0; i < io_thread_count; i++)
+  {
+    if(!init_io_thread(&(io_threads[i]), i == 0)) return -1;
+  }
+
+  if(pthread_mutex_init(&handoff_lock, NULL) != 0)
+  {
+    nlog_fatal("Could not initialize handoff lock.");
+    return -1;
+  }
+
+  if(!conntable_init(&clients, 64))
+  {
+    nlog_fatal("Could not initialize connection table. (%s)", ninerr->message);
+    return -1;
+  }
+
+  char *motd = mcpr_as_chat("A bloody stronk server.");
   if(motd == NULL)
   {
     nlog_fatal("Could not generate MOTD.");
     ninerr_print_g();
     return -1;
   }
+  bool status_ok = status_response_init(motd);
+  free(motd);
+  if(!status_ok)
+  {
+    nlog_fatal("Could not initialize status response. (%s)", ninerr->message);
+    return -1;
+  }
+  status_response_init_done = true;
+
+  nlog_info("Starting %u network I/O threads..", io_thread_count);
+  psnip_atomic_int32_store(&io_threads_running, 1);
+  for(unsigned int i = 0; i < io_thread_count; i++)
+  {
+    if(pthread_create(&(io_threads[i].thread), NULL, io_thread_run, &(io_threads[i])) != 0)
+    {
+      nlog_fatal("Could not start network I/O thread.");
+      return -1;
+    }
+    io_threads[i].started = true;
+  }
 
   return 1;
 }
 
 void net_cleanup(void)
 {
+  psnip_atomic_int32_store(&io_threads_running, 0);
+  for(unsigned int i = 0; i < io_thread_count; i++)
+  {
+    if(io_threads[i].started) { wake_io_thread(&(io_threads[i])); pthread_join(io_threads[i].thread, NULL); }
+  }
+  for(unsigned int i = 0; i < io_thread_count; i++)
+  {
+    if(io_threads[i].listener != -1) close(io_threads[i].listener);
+    if(io_threads[i].epoll_fd != -1) close(io_threads[i].epoll_fd);
+    if(io_threads[i].wake_fd != -1) close(io_threads[i].wake_fd);
+    if(io_threads[i].timer_fd != -1) close(io_threads[i].timer_fd);
+    free(io_threads[i].deadlines.entries);
+    free(io_threads[i].resumed_clients.conns);
+  }
+  free(io_threads);
+  if(connect_limiter_init_done) ratelimiter_destroy(&connect_limiter);
+  if(server_key_init_done) server_key_cleanup(); // Connections still logging in hold their own reference.
+  if(status_response_init_done) status_response_cleanup();
   freeaddrinfo(addressinfo);
+  free(new_clients.conns);
+  free(ready_clients.conns);
+  free(serving_clients.conns);
+  free(closed_clients.conns);
+  conntable_destroy(&clients);
   // TODO
 }
 
 void net_tick(void)
 {
-  accept_incoming_connections();
   serve_clients();
+
+  uint64_t t = tickstats_now();
+  mapi_async_perform(); // Resumes logins of which the session server has answered.
+  t = tickstats_record_phase(TICK_PHASE_SESSION, t);
+
+  stream_chunks();
+  t = tickstats_record_phase(TICK_PHASE_CHUNKS, t);
+
+  if(++ticks_since_housekeeping >= HOUSEKEEPING_INTERVAL_TICKS)
+  {
+    do_housekeeping();
+    tickstats_record_phase(TICK_PHASE_HOUSEKEEPING, t);
+    ticks_since_housekeeping = 0;
+  }
 }
 
-void connection_close(struct connection *conn, const char *disconnect_message)
+static bool connection_list_push(struct connection_list *list, struct connection *conn)
 {
-  // TODO should we free player here?
-  again: if(pthread_rwlock_wrlock(&clients_lock) != 0) { nlog_debug("Could not lock internal clock lock! Retrying.."); goto again; }
+  if(list->count == list->max_size)
+  {
+    size_t new_size = (list->max_size == 0) ? 64 : list->max_size * 2;
+    void *tmp = realloc(list->conns, new_size * sizeof(struct connection *));
+    if(tmp == NULL) { nlog_error("Could not allocate memory. (%s)", strerror(errno)); return false; }
+    list->conns = tmp;
+    list->max_size = new_size;
+  }
+  list->conns[list->count++] = conn;
+  return true;
+}
 
-  bool found = false;
-  int i = 0;
-  for(; i < slist_length(clients); i++) if(slist_nth_data(clients, i) == conn) { found = true; break; }
-  if(!found) { nlog_fatal("Fatal error! Could not find client which needs to be closed in client list!"); exit(EXIT_FAILURE); }
-  SListEntry *entry = slist_nth_entry(clients, i);
-  if(entry == SLIST_NULL) { nlog_error("Fatal error! Could not find client which needs to be closed in client list!"); exit(EXIT_FAILURE); }
+static void connection_list_remove(struct connection_list *list, struct connection *conn)
+{
+  for(size_t i = 0; i < list->count; i++)
+  {
+    if(list->conns[i] == conn) { list->conns[i] = list->conns[--list->count]; return; }
+  }
+}
 
+// Only called from the tick thread. The connection stays allocated until the I/O thread is guaranteed to be done with it.
+void connection_close(struct connection *conn, const char *disconnect_message)
+{
+  // TODO should we free player here?
+  if(conn->player != NULL) net_player_left();
+  if(conn->id != CONN_ID_INVALID && !conntable_remove(&clients, conn->id)) { nlog_fatal("Fatal error! Could not find client which needs to be closed in client list!"); exit(EXIT_FAILURE); }
+
+  pthread_mutex_lock(&handoff_lock);
+  psnip_atomic_int32_store(&(conn->closing), 1);
+  connection_list_remove(&ready_clients, conn);
+  connection_list_remove(&(conn->io->resumed_clients), conn);
+  pthread_mutex_unlock(&handoff_lock);
+
+  if(epoll_ctl(conn->io->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL) == -1) nlog_warn("Could not remove socket from epoll instance. (%s)", strerror(errno));
+  conn->disconnect_message = NULL;
+  if(disconnect_message != NULL)
+  {
+    conn->disconnect_message = strdup(disconnect_message);
+    if(conn->disconnect_message == NULL) nlog_warn("Could not allocate memory for disconnect message. (%s)", strerror(errno));
+  }
+  conn->closed_at_generation = psnip_atomic_int64_load(&(conn->io->generation));
+  if(!connection_list_push(&closed_clients, conn)) nlog_error("Leaking connection at address %p.", (void *) conn);
+}
 
-  if(slist_remove_entry(&clients, entry) == 0) { nlog_error("Could not remove entry from clients"); }
-  client_count--;
-  pthread_rwlock_unlock(&clients_lock);
-  mcpr_connection_close(conn->conn, disconnect_message);
-  fclose(conn->rawstream);
-  if(close(conn->fd) == -1) nlog_warn("Error whilst closing a socket: %s", strerror(errno));
-  free(conn->server_address_used);
-  free(conn);
+static void reap_closed_clients(void)
+{
+  for(size_t i = closed_clients.count; i > 0; i--)
+  {
+    struct connection *conn = closed_clients.conns[i - 1];
+    if(conn->closed_at_generation >= psnip_atomic_int64_load(&(conn->io->generation))) continue; // The I/O thread may still be working with it.
+    if(psnip_atomic_int32_load(&(conn->awaiting_deadline))) continue; // Still referenced by the deadline queue of its I/O thread.
+    closed_clients.conns[i - 1] = closed_clients.conns[--closed_clients.count];
+
+    mcpr_connection_close(conn->conn, conn->disconnect_message);
+    mcpr_connection_free(conn->conn);
+    if(fclose(conn->rawstream) == EOF) nlog_warn("Error whilst closing a socket: %s", strerror(errno)); // Also closes conn->fd
+    packet_queue_destroy(&(conn->inbound));
+    if(conn->tmp_present)
+    {
+      if(conn->tmp.session_request != NULL) mapi_request_cancel(conn->tmp.session_request);
+      server_key_release(conn->tmp.key);
+      free(conn->tmp.username);
+    }
+    free(conn->disconnect_message);
+    free(conn->server_address_used);
+    free(conn);
 
-  nlog_info("Connection at address %p closed.", (void *) conn);
+    nlog_info("Connection at address %p closed.", (void *) conn);
+  }
 }
 
+// Serverbound packets only ever get decoded for the connection's current state, so the packet type alone picks the handler.
+static struct hp_result (*const packet_handlers[MCPR_PACKET_TYPE_COUNT])(const struct mcpr_packet *pkt, struct connection *conn) =
+{
+  #define X(type, state, id, name, path, layout) [type] = handle_##name,
+  MCPR_SERVERBOUND_PACKETS(X)
+  #undef X
+};
+
 static bool packet_handler(const struct mcpr_packet *pkt, struct connection *conn2)
 {
   nlog_debug("Received a packet! at packet_handler");
-  mcpr_connection *conn = conn2->conn;
 
-  struct hp_result result;
-  IGNORE("-Wswitch")
-  switch(mcpr_connection_get_state(conn))
+  struct hp_result (*handler)(const struct mcpr_packet *pkt, struct connection *conn) = packet_handlers[pkt->id];
+  if(handler == NULL)
+  {
+    nlog_warn("No handler for packet with enum id (not packet id) %i, ignoring it.", pkt->id);
+    return true;
+  }
+  struct hp_result result = handler(pkt, conn2);
+
+  if(result.result == HP_RESULT_FATAL)
   {
-    case MCPR_STATE_HANDSHAKE:
+    nlog_error("Fatal error, closing connection");
+    connection_close(conn2, result.disconnect_message);
+    IGNORE("-Wdiscarded-qualifiers")
+    if(result.free_disconnect_message) free(result.disconnect_message);
+    END_IGNORE()
+    return false;
+  }
+  else if(result.result == HP_RESULT_CLOSED)
+  {
+    connection_close(conn2, result.disconnect_message);
+    IGNORE("-Wdiscarded-qualifiers")
+    if(result.free_disconnect_message) free(result.disconnect_message);
+    END_IGNORE()
+    return false;
+  }
+  else
+  {
+    IGNORE("-Wdiscarded-qualifiers")
+    if(result.free_disconnect_message) free(result.disconnect_message);
+    END_IGNORE()
+    return true;
+  }
+}
+
+// Queues a connection to be served by the tick, only called from the I/O thread.
+static void mark_ready(struct connection *conn)
+{
+  pthread_mutex_lock(&handoff_lock);
+  if(!conn->ready && !psnip_atomic_int32_load(&(conn->closing)) && connection_list_push(&ready_clients, conn)) conn->ready = true;
+  pthread_mutex_unlock(&handoff_lock);
+}
+
+// Hands a connection back to the I/O thread once the tick caught up with it, only called from the tick thread.
+static void resume_client(struct connection *conn)
+{
+  psnip_atomic_int32_store(&(conn->io_paused), 0);
+  pthread_mutex_lock(&handoff_lock);
+  bool pushed = connection_list_push(&(conn->io->resumed_clients), conn);
+  pthread_mutex_unlock(&handoff_lock);
+  if(!pushed) { psnip_atomic_int32_store(&(conn->hangup), 1); return; }
+  wake_io_thread(conn->io);
+}
+
+void connection_resume(struct connection *conn)
+{
+  if(psnip_atomic_int32_load(&(conn->io_paused)) && !psnip_atomic_int32_load(&(conn->closing))) resume_client(conn);
+}
+
+// Arms the timer of io for the first deadline in its queue, or disarms it if there is none.
+static void arm_deadline_timer(struct io_thread *io)
+{
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if(io->deadlines.count > 0)
+  {
+    uint64_t expires_at = io->deadlines.entries[io->deadlines.head].expires_at;
+    spec.it_value.tv_sec = expires_at / 1000000000;
+    spec.it_value.tv_nsec = expires_at % 1000000000;
+  }
+  if(timerfd_settime(io->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) nlog_error("Could not set timerfd. (%s)", strerror(errno));
+}
+
+static bool push_prelogin_deadline(struct io_thread *io, struct connection *conn)
+{
+  struct deadline_queue *queue = &(io->deadlines);
+  if(queue->count == queue->capacity)
+  {
+    size_t new_capacity = (queue->capacity == 0) ? 64 : queue->capacity * 2;
+    struct prelogin_deadline *entries = malloc(new_capacity * sizeof(struct prelogin_deadline));
+    if(entries == NULL) { nlog_error("Could not allocate memory. (%s)", strerror(errno)); return false; }
+    for(size_t i = 0; i < queue->count; i++) entries[i] = queue->entries[(queue->head + i) % queue->capacity];
+    free(queue->entries);
+    queue->entries = entries;
+    queue->head = 0;
+    queue->capacity = new_capacity;
+  }
+
+  psnip_atomic_int32_store(&(conn->awaiting_deadline), 1);
+  struct prelogin_deadline *deadline = &(queue->entries[(queue->head + queue->count) % queue->capacity]);
+  deadline->conn = conn;
+  deadline->expires_at = monotonic_ns() + (uint64_t) PRELOGIN_DEADLINE * 1000000000;
+  if(queue->count++ == 0) arm_deadline_timer(io);
+  return true;
+}
+
+// Hangs up on every connection whose deadline passed without it having logged in.
+static void expire_prelogin_deadlines(struct io_thread *io)
+{
+  uint64_t expirations;
+  if(read(io->timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) nlog_warn("Could not read timerfd. (%s)", strerror(errno));
+
+  struct deadline_queue *queue = &(io->deadlines);
+  uint64_t now = monotonic_ns();
+  while(queue->count > 0 && queue->entries[queue->head].expires_at <= now)
+  {
+    struct connection *conn = queue->entries[queue->head].conn;
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+
+    if(!psnip_atomic_int32_load(&(conn->closing)) && !psnip_atomic_int32_load(&(conn->hangup)) && mcpr_connection_get_state(conn->conn) != MCPR_STATE_PLAY)
     {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_HS_SB_HANDSHAKE: { result = handle_hs_handshake(pkt, conn2); goto finish; }
-      }
-      break;
+      nlog_info("Connection %p did not log in within %i seconds, closing it.", (void *) conn, PRELOGIN_DEADLINE);
+      psnip_atomic_int64_add(&rejected_prelogin_timeout, 1);
+      psnip_atomic_int32_store(&(conn->hangup), 1);
+      mark_ready(conn);
     }
+    psnip_atomic_int32_store(&(conn->awaiting_deadline), 0); // The tick may free it from here on.
+  }
+  arm_deadline_timer(io);
+}
+
+static void *io_thread_run(void *arg)
+{
+  struct io_thread *io = arg;
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  struct connection_list resumed = { NULL, 0, 0 };
 
-    case MCPR_STATE_STATUS:
+  while(psnip_atomic_int32_load(&io_threads_running))
+  {
+    int count = epoll_wait(io->epoll_fd, events, EPOLL_MAX_EVENTS, IO_POLL_TIMEOUT);
+    if(count == -1)
     {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_ST_SB_REQUEST:  { result = handle_st_request(pkt, conn2); goto finish; }
-        case MCPR_PKT_ST_SB_PING:     { result = handle_st_ping(pkt, conn2);    goto finish; }
-      }
-      break;
+      if(errno != EINTR) nlog_error("Could not poll for network events. (%s)", strerror(errno));
+      count = 0;
     }
 
-    case MCPR_STATE_LOGIN:
+    bool accept_pending = io->accept_retry;
+    for(int i = 0; i < count; i++)
     {
-      switch(pkt->id)
+      if(events[i].data.ptr == &(io->listener)) { accept_pending = true; continue; }
+      if(events[i].data.ptr == &(io->timer_fd)) { expire_prelogin_deadlines(io); continue; }
+      if(events[i].data.ptr == &(io->wake_fd))
       {
-        case MCPR_PKT_LG_SB_LOGIN_START:          { result = handle_lg_login_start(pkt, conn2);         goto finish; }
-        case MCPR_PKT_LG_SB_ENCRYPTION_RESPONSE:  { result = handle_lg_encryption_response(pkt, conn2); goto finish; }
+        uint64_t value;
+        if(read(io->wake_fd, &value, sizeof(value)) == -1 && errno != EAGAIN) nlog_warn("Could not read eventfd. (%s)", strerror(errno));
+        continue;
       }
-      break;
+
+      struct connection *conn = events[i].data.ptr;
+      if(psnip_atomic_int32_load(&(conn->closing))) continue;
+
+      if(events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) { psnip_atomic_int32_store(&(conn->hangup), 1); mark_ready(conn); }
+      if((events[i].events & EPOLLOUT) && !mcpr_connection_flush(conn->conn)) { psnip_atomic_int32_store(&(conn->hangup), 1); mark_ready(conn); }
+      if(events[i].events & EPOLLIN) read_client(conn);
     }
 
-    case MCPR_STATE_PLAY:
+    // Connections the tick caught up with, there may already be data buffered for those which won't trigger another event.
+    pthread_mutex_lock(&handoff_lock);
+    struct connection_list tmp = resumed;
+    resumed = io->resumed_clients;
+    io->resumed_clients = tmp;
+    pthread_mutex_unlock(&handoff_lock);
+    for(size_t i = 0; i < resumed.count; i++)
     {
-      switch(pkt->id)
-      {
-        case MCPR_PKT_PL_SB_TELEPORT_CONFIRM:           { result = handle_pl_teleport_confirm(pkt, conn2);          goto finish; }
-        case MCPR_PKT_PL_SB_TAB_COMPLETE:               { result = handle_pl_tab_complete(pkt, conn2);              goto finish; }
-        case MCPR_PKT_PL_SB_CHAT_MESSAGE:               { result = handle_pl_chat_message(pkt, conn2);              goto finish; }
-        case MCPR_PKT_PL_SB_CLIENT_STATUS:              { result = handle_pl_client_status(pkt, conn2);             goto finish; }
-        case MCPR_PKT_PL_SB_CLIENT_SETTINGS:            { result = handle_pl_client_settings(pkt, conn2);           goto finish; }
-        case MCPR_PKT_PL_SB_CONFIRM_TRANSACTION:        { result = handle_pl_confirm_transaction(pkt, conn2);       goto finish; }
-        case MCPR_PKT_PL_SB_ENCHANT_ITEM:               { result = handle_pl_enchant_item(pkt, conn2);              goto finish; }
-        case MCPR_PKT_PL_SB_CLICK_WINDOW:               { result = handle_pl_click_window(pkt, conn2);              goto finish; }
-        case MCPR_PKT_PL_SB_CLOSE_WINDOW:               { result = handle_pl_close_window(pkt, conn2);              goto finish; }
-        case MCPR_PKT_PL_SB_PLUGIN_MESSAGE:             { result = handle_pl_plugin_message(pkt, conn2);            goto finish; }
-        case MCPR_PKT_PL_SB_USE_ENTITY:                 { result = handle_pl_use_entity(pkt, conn2);                goto finish; }
-        case MCPR_PKT_PL_SB_KEEP_ALIVE:                 { result = handle_pl_keep_alive(pkt, conn2);                goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER_POSITION:            { result = handle_pl_player_position(pkt, conn2);           goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER_POSITION_AND_LOOK:   { result = handle_pl_player_position_and_look(pkt, conn2);  goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER_LOOK:                { result = handle_pl_player_look(pkt, conn2);               goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER:                     { result = handle_pl_player(pkt, conn2);                    goto finish; }
-        case MCPR_PKT_PL_SB_VEHICLE_MOVE:               { result = handle_pl_vehicle_move(pkt, conn2);              goto finish; }
-        case MCPR_PKT_PL_SB_STEER_BOAT:                 { result = handle_pl_steer_boat(pkt, conn2);                goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER_ABILITIES:           { result = handle_pl_player_abilities(pkt, conn2);          goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER_DIGGING:             { result = handle_pl_player_digging(pkt, conn2);            goto finish; }
-        case MCPR_PKT_PL_SB_ENTITY_ACTION:              { result = handle_pl_entity_action(pkt, conn2);             goto finish; }
-        case MCPR_PKT_PL_SB_STEER_VEHICLE:              { result = handle_pl_steer_vehicle(pkt, conn2);             goto finish; }
-        case MCPR_PKT_PL_SB_RESOURCE_PACK_STATUS:       { result = handle_pl_resource_pack_status(pkt, conn2);      goto finish; }
-        case MCPR_PKT_PL_SB_HELD_ITEM_CHANGE:           { result = handle_pl_held_item_change(pkt, conn2);          goto finish; }
-        case MCPR_PKT_PL_SB_CREATIVE_INVENTORY_ACTION:  { result = handle_pl_creative_inventory_action(pkt, conn2); goto finish; }
-        case MCPR_PKT_PL_SB_UPDATE_SIGN:                { result = handle_pl_update_sign(pkt, conn2);               goto finish; }
-        case MCPR_PKT_PL_SB_ANIMATION:                  { result = handle_pl_animation(pkt, conn2);                 goto finish; }
-        case MCPR_PKT_PL_SB_SPECTATE:                   { result = handle_pl_spectate(pkt, conn2);                  goto finish; }
-        case MCPR_PKT_PL_SB_PLAYER_BLOCK_PLACEMENT:     { result = handle_pl_player_block_placement(pkt, conn2);    goto finish; }
-        case MCPR_PKT_PL_SB_USE_ITEM:                   { result = handle_pl_use_item(pkt, conn2);                  goto finish; }
-      }
-      break;
+      if(!psnip_atomic_int32_load(&(resumed.conns[i]->closing))) read_client(resumed.conns[i]);
     }
+    resumed.count = 0;
+
+    if(accept_pending) accept_incoming_connections(io);
+    psnip_atomic_int64_add(&(io->generation), 1);
   }
-  END_IGNORE()
 
-  finish:
-    if(result.result == HP_RESULT_FATAL)
+  free(resumed.conns);
+  return NULL;
+}
+
+// Decodes everything which is available into the connection's inbound queue, only called from the I/O thread.
+static void read_client(struct connection *conn)
+{
+  if(psnip_atomic_int32_load(&(conn->io_paused))) return;
+
+  bool notify = false;
+  while(true)
+  {
+    struct ninio_buffer *storage;
+    struct mcpr_packet *slot = packet_queue_reserve(&(conn->inbound), &storage);
+    if(slot == NULL) // Full, reading continues once the tick has caught up.
     {
-      nlog_error("Fatal error, closing connection");
-      connection_close(conn2, result.disconnect_message);
-      IGNORE("-Wdiscarded-qualifiers")
-      if(result.free_disconnect_message) free(result.disconnect_message);
-      END_IGNORE()
-      return false;
+      psnip_atomic_int32_store(&(conn->io_paused), 1);
+      notify = true;
+      break;
     }
-    else if(result.result == HP_RESULT_CLOSED)
+
+    enum mcpr_state state = mcpr_connection_get_state(conn->conn);
+    if(!mcpr_connection_read_packet(conn->conn, slot, storage))
     {
-      connection_close(conn2, result.disconnect_message);
-      IGNORE("-Wdiscarded-qualifiers")
-      if(result.free_disconnect_message) free(result.disconnect_message);
-      END_IGNORE()
-      return false;
+      if(mcpr_connection_is_closed(conn->conn)) { psnip_atomic_int32_store(&(conn->hangup), 1); notify = true; }
+      break;
     }
-    else
+    packet_queue_commit(&(conn->inbound));
+    notify = true;
+
+    // Handling these packets may change how the rest of the stream has to be decoded (state, compression, encryption),
+    // so those are handed to the tick one at a time.
+    if(state == MCPR_STATE_HANDSHAKE || state == MCPR_STATE_LOGIN)
     {
-      IGNORE("-Wdiscarded-qualifiers")
-      if(result.free_disconnect_message) free(result.disconnect_message);
-      END_IGNORE()
-      return true;
+      psnip_atomic_int32_store(&(conn->io_paused), 1);
+      break;
     }
+  }
+  if(notify) mark_ready(conn);
 }
 
-static void accept_incoming_connections(void)
+static void accept_incoming_connections(struct io_thread *io)
 {
   char ip_str_buf[128];
+  io->accept_retry = false;
   while(true)
   {
     struct sockaddr_storage clientname;
     socklen_t clientname_size = (socklen_t) sizeof(clientname);
-    int newfd = accept(server_socket, (struct sockaddr *) &clientname, &clientname_size);
+    int newfd = accept4(io->listener, (struct sockaddr *) &clientname, &clientname_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if(newfd == -1)
     {
       if(errno == EAGAIN || errno == EWOULDBLOCK) // There are no incoming connections in the queue.
       {
         break;
       }
-      else if(errno == ECONNABORTED)
+      else if(errno == ECONNABORTED || errno == EINTR)
       {
         nlog_debug("An incoming connection was aborted.");
+        continue;
       }
       else
       {
+        // The listener is edge-triggered, so we have to retry next tick as we won't be notified about the remaining queue.
         nlog_error("Could not accept incoming connection. (%s)", strerror(errno));
-        continue;
+        io->accept_retry = true;
+        break;
       }
     }
+
+    // Before anything is allocated for it, so that a flood from a few addresses costs next to nothing.
+    if(!ratelimiter_allow(&connect_limiter, &clientname, monotonic_ns()))
+    {
+      psnip_atomic_int64_add(&rejected_rate_limited, 1);
+      nlog_debug("Refused connection from %s, it is connecting too often.", sockaddr_ip_str((struct sockaddr *) &clientname, ip_str_buf, 128));
+      if(close(newfd) == -1) nlog_error("Error closing refused socket. (%s)", strerror(errno));
+      continue;
+    }
+
     nlog_info("Accepted incoming connection from %s:%u (fd = %d)",
       sockaddr_ip_str((struct sockaddr *) &clientname, ip_str_buf, 128),
       (clientname.ss_family == AF_INET6) ?
         ntohs(((struct sockaddr_in *) &clientname)->sin_port) :
         ntohs(((struct sockaddr_in6 *) &clientname)->sin6_port), newfd);
 
-    if(fcntl(newfd, F_SETFL, O_NONBLOCK) == -1)
-    {
-      nlog_fatal("Could not set O_NONBLOCK flag for incoming connection. (%s)", strerror(errno));
-      if(close(newfd) == -1) nlog_error("Error closing socket after previous error. (%s)", strerror(errno));
-      continue;
-    }
-
     FILE *stream = fdopen(newfd, "r+");
-    if(stream == NULL) { nlog_error("fdopen() failed (%s)", strerror(errno)); continue; }
-    if(setvbuf(stream, NULL, _IONBF, 0) != 0) { nlog_error("setvbuf() failed (%s ?)", strerror(errno)); continue; }
+    if(stream == NULL) { nlog_error("fdopen() failed (%s)", strerror(errno)); close(newfd); continue; }
+    if(setvbuf(stream, NULL, _IONBF, 0) != 0) { nlog_error("setvbuf() failed (%s ?)", strerror(errno)); fclose(stream); continue; }
     mcpr_connection *conn = mcpr_connection_new(stream);
     if(conn == NULL)
     {
@@ -371,8 +865,7 @@ static void accept_incoming_connections(void)
     if(conn2 == NULL)
     {
       nlog_error("Could not allocate memory for connection. (%s)", strerror(errno));
-      if(close(newfd) == -1) nlog_error("Error closing socket after memory allocation failure. (%s)", strerror(errno));
-      //mcpr_connection_decref(conn);
+      mcpr_connection_free(conn);
       fclose(stream);
       continue;
     }
@@ -385,17 +878,51 @@ static void accept_incoming_connections(void)
     conn2->tmp_present = false;
     conn2->client_address = clientname;
     conn2->connected_at = time(NULL);
+    conn2->id = CONN_ID_INVALID; // Assigned by the tick once it adopts the connection.
+    conn2->io = io;
+    conn2->ready = false;
+    psnip_atomic_int32_store(&(conn2->hangup), 0);
+    psnip_atomic_int32_store(&(conn2->io_paused), 0);
+    psnip_atomic_int32_store(&(conn2->closing), 0);
+    psnip_atomic_int32_store(&(conn2->awaiting_deadline), 0);
+    conn2->disconnect_message = NULL;
+    conn2->congested_since = 0;
+    if(!packet_queue_init(&(conn2->inbound), INBOUND_QUEUE_CAPACITY))
+    {
+      nlog_error("Could not create inbound packet queue. (%s)", ninerr->message);
+      mcpr_connection_free(conn);
+      fclose(stream);
+      free(conn2);
+      continue;
+    }
 
-    if(slist_append(&clients, conn2) == NULL)
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; // Edge triggered EPOLLOUT only fires once a full socket has room again.
+    ev.data.ptr = conn2;
+    if(epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, newfd, &ev) == -1)
     {
-      nlog_error("Could not add incoming connection to connection storage.");
-      if(close(newfd) == -1) nlog_error("Error closing socket after previous error. (%s)", strerror(errno));
-      //mcpr_connection_decref(conn);
-      fclose(conn2->rawstream);
+      nlog_error("Could not add incoming connection to epoll instance. (%s)", strerror(errno));
+      mcpr_connection_free(conn);
+      packet_queue_destroy(&(conn2->inbound));
+      fclose(stream);
+      free(conn2);
+      continue;
+    }
+
+    pthread_mutex_lock(&handoff_lock);
+    bool pushed = connection_list_push(&new_clients, conn2);
+    pthread_mutex_unlock(&handoff_lock);
+    if(!pushed)
+    {
+      if(epoll_ctl(io->epoll_fd, EPOLL_CTL_DEL, newfd, NULL) == -1) nlog_warn("Could not remove socket from epoll instance. (%s)", strerror(errno));
+      mcpr_connection_free(conn);
+      packet_queue_destroy(&(conn2->inbound));
+      fclose(stream);
       free(conn2);
       continue;
     }
-    client_count++;
+    push_prelogin_deadline(io, conn2); // If this fails the connection is still timed out by the housekeeping, only later.
+    read_client(conn2); // The client may have sent data before it got registered.
     nlog_info("Client from %s:%u (fd = %d) connected successfully.", sockaddr_ip_str((struct sockaddr *) &clientname, ip_str_buf, 128),
     (clientname.ss_family == AF_INET6) ?
       ntohs(((struct sockaddr_in *) &clientname)->sin_port) :
@@ -422,8 +949,33 @@ static void do_timeout(struct connection *conn)
   free(reason);
 }
 
-static void update_client(struct connection *conn)
+// Sends keep alives and times out connections, returns false if the connection was closed.
+static bool check_client(struct connection *conn)
 {
+  if(psnip_atomic_int32_load(&(conn->hangup)))
+  {
+    connection_close(conn, NULL);
+    return false;
+  }
+
+  if(mcpr_connection_is_congested(conn->conn))
+  {
+    if(conn->congested_since == 0)
+    {
+      conn->congested_since = time(NULL);
+    }
+    else if(time(NULL) - conn->congested_since > CONGESTION_TIMEOUT)
+    {
+      nlog_warn("Connection %p can't keep up, %zu bytes are queued.", (void *) conn, mcpr_connection_get_outgoing_queue_size(conn->conn));
+      do_timeout(conn);
+      return false;
+    }
+  }
+  else
+  {
+    conn->congested_since = 0;
+  }
+
   struct player *player = conn->player; // Will be NULL if there is no player associated with this connection.
   if(player != NULL)
   {
@@ -431,8 +983,15 @@ static void update_client(struct connection *conn)
     server_get_internal_clock_time(&now);
 
     struct timespec diff;
-    timespec_diff(&diff, &(player->last_keepalive_sent), &now);
+    timespec_diff(&diff, &(player->last_keepalive_received), &now);
+
+    if(diff.tv_sec >= 30)
+    {
+      do_timeout(conn);
+      return false;
+    }
 
+    timespec_diff(&diff, &(player->last_keepalive_sent), &now);
     if(diff.tv_sec >= 10)
     {
       struct mcpr_packet keep_alive;
@@ -441,12 +1000,12 @@ static void update_client(struct connection *conn)
       keep_alive.data.play.clientbound.keep_alive.keep_alive_id = 0;
 
 
-      if(fwrite(&keep_alive, sizeof(keep_alive), 1, conn->pktstream) == 0)
+      if(!mcpr_connection_send_packet(conn->conn, &keep_alive))
       {
         if(strcmp(ninerr->type, "ninerr_closed") == 0)
         {
           connection_close(conn, NULL);
-          return;
+          return false;
         }
         else
         {
@@ -455,117 +1014,184 @@ static void update_client(struct connection *conn)
       }
       else
       {
-        server_get_internal_clock_time(&(player->last_keepalive_sent));
+        player->last_keepalive_sent = now;
       }
     }
   }
+  else if(time(NULL) - conn->connected_at > 60) // This occurs if the client has not
+  {                                             // completed the initial connection procedure within 60 seconds.
+    do_timeout(conn);
+    return false;
+  }
+  return true;
+}
 
-  struct mcpr_packet pkt;
-  //while(fread(&pkt, sizeof(pkt), 1, conn->pktstream) == 1) packet_handler(&pkt, conn);
-
-  while(true)
+// Handles all packets the I/O thread decoded for this connection, returns false if the connection was closed.
+static bool serve_client(struct connection *conn)
+{
+  struct mcpr_packet *pkt;
+  while((pkt = packet_queue_peek(&(conn->inbound))) != NULL)
   {
-    int result = fread(&pkt, sizeof(pkt), 1, conn->pktstream);
-    nlog_info("result: %i", result);
-    sleep(2);
-    if (result == 1)
-    {
-      packet_handler(&pkt, conn);
-      continue;
-    }
-    else if(ferror(conn->pktstream))
-    {
-      if(ninerr != NULL && ninerr_is(ninerr, "ninerr_wouldblock"))
-      {
-        ninerr_print_g();
-        ninerr_set_err(NULL);
-      }
-      clearerr(conn->pktstream);
-    }
-    break;
+    uint64_t start = tickstats_now();
+    enum mcpr_packet_type type = pkt->id;
+    enum mcpr_state state = pkt->state;
+    bool open = packet_handler(pkt, conn);
+    tickstats_record_handler(type, state, tickstats_now() - start);
+    packet_queue_release(&(conn->inbound)); // The connection is still allocated if it was just closed.
+    if(!open) return false;
   }
 
-  if(player != NULL)
+  if(psnip_atomic_int32_load(&(conn->hangup)) || mcpr_connection_is_closed(conn->conn))
   {
-    struct timespec now;
-    server_get_internal_clock_time(&now);
+    connection_close(conn, NULL);
+    return false;
+  }
 
-    struct timespec diff;
-    timespec_diff(&diff, &(player->last_keepalive_received), &now);
+  // The queue is empty now. Whilst the session server is verifying the client, the login isn't done changing
+  // how the stream is decoded, so the connection stays paused until on_session_verified() resumes it.
+  bool verifying = conn->tmp_present && conn->tmp.session_request != NULL;
+  if(psnip_atomic_int32_load(&(conn->io_paused)) && !verifying) resume_client(conn);
+  return true;
+}
 
-    if(diff.tv_sec >= 30)
+static void serve_clients(void)
+{
+  // Take everything the I/O thread has handed over since last tick.
+  uint64_t t = tickstats_now();
+  pthread_mutex_lock(&handoff_lock);
+  for(size_t i = 0; i < new_clients.count; i++)
+  {
+    struct connection *conn = new_clients.conns[i];
+    conn->id = conntable_insert(&clients, conn);
+    if(conn->id == CONN_ID_INVALID)
     {
-      do_timeout(conn);
+      // The I/O thread may already be reading from it, so it has to go through the regular close path.
+      nlog_error("Could not add incoming connection to connection storage. (%s)", ninerr->message);
+      psnip_atomic_int32_store(&(conn->hangup), 1);
+      if(!conn->ready && connection_list_push(&ready_clients, conn)) conn->ready = true;
     }
   }
-  else if(time(NULL) - conn->connected_at > 60) // This occurs if the client has not
-  {                                             // completed the initial connection procedure within 60 seconds.
-    do_timeout(conn);
+  new_clients.count = 0;
+  t = tickstats_record_phase(TICK_PHASE_ACCEPT, t);
+
+  struct connection_list tmp = serving_clients;
+  serving_clients = ready_clients;
+  ready_clients = tmp;
+  for(size_t i = 0; i < serving_clients.count; i++) serving_clients.conns[i]->ready = false;
+  pthread_mutex_unlock(&handoff_lock);
+
+  // Connections closed before this point can't be in serving_clients, nor be handed over anymore.
+  reap_closed_clients();
+
+  // Only the connections which have something to do are served, so the cost of a tick scales with the amount of active sockets.
+  for(size_t i = 0; i < serving_clients.count; i++) serve_client(serving_clients.conns[i]);
+  serving_clients.count = 0;
+  tickstats_record_phase(TICK_PHASE_SERVE, t);
+}
+
+static void stream_chunks_range(size_t begin, size_t end, void *arg)
+{
+  struct connection **conns = arg;
+  for(size_t i = begin; i < end; i++)
+  {
+    struct connection *conn = conns[i];
+    if(conn->player == NULL || conn->player->chunk_queue.next >= conn->player->chunk_queue.total) continue;
+    if(mcpr_connection_is_congested(conn->conn)) continue; // Let the client catch up first.
+    if(!world_send_queued_chunks(conn->player, CHUNKS_PER_TICK)) psnip_atomic_int32_store(&(conn->hangup), 1);
   }
 }
 
-static void serve_client_batch(void *arg)
+static void stream_chunks(void)
 {
-  again: if(pthread_rwlock_rdlock(&clients_lock) != 0) { nlog_warn("Could not lock clients lock. Retrying.."); goto again; }
+  // Connections can't be closed whilst the workers walk the table, so that is left for after they're done.
+  size_t count = conntable_count(&clients);
+  if(count == 0) return;
+  struct connection **conns = conntable_conns(&clients);
 
-  SListEntry *first = *(SListEntry **) arg;
-  unsigned int amount = *((unsigned int *) (arg + sizeof(SListEntry *)));
+  // Small ranges, a player with a full chunk queue costs a lot more than an idle one, the scheduler balances the rest.
+  sched_parallel_for(count, CHUNK_STREAM_GRAIN, stream_chunks_range, conns);
 
-  struct connection *clients[amount];
-  for(unsigned int i = 0; i < amount; i++)
+  for(size_t i = conntable_count(&clients); i > 0; i--)
   {
-    clients[i] = slist_nth_data(first, i);
-    if(clients[i] == SLIST_NULL) // Shouldn't happen
-    {
-      nlog_error("Bad slist index %i. (amount: %u)", i, amount);
-      break;
-    }
+    struct connection *conn = conns[i - 1];
+    if(psnip_atomic_int32_load(&(conn->hangup)) || mcpr_connection_is_closed(conn->conn)) connection_close(conn, NULL);
   }
-  pthread_rwlock_unlock(&clients_lock);
-  free(arg);
-
-  for(unsigned int i = 0; i < amount; i++) update_client(clients[i]);
 }
 
-static void serve_clients(void)
+static void do_housekeeping(void)
 {
-  again: if(pthread_rwlock_rdlock(&clients_lock) != 0) { nlog_warn("Could not lock clients lock. Retrying.."); goto again; }
-  unsigned int conns_per_thread = client_count / main_threadpool_threadcount;
-  unsigned int rest = client_count % main_threadpool_threadcount;
+  // The workers are idle at this point in the tick. Iterating backwards is safe with respect to connections being closed,
+  // since closing a connection only moves the last connection of the table into its place.
+  struct connection **conns = conntable_conns(&clients);
+  for(size_t i = conntable_count(&clients); i > 0; i--) check_client(conns[i - 1]);
 
-  unsigned int index = 0;
-
-  for(unsigned int i = 0; i < main_threadpool_threadcount; i++)
+  if(++housekeeping_since_report >= REJECTION_REPORT_INTERVAL)
   {
-    unsigned int amount = conns_per_thread;
-    if(i == (main_threadpool_threadcount - 1)) amount += rest;
-
-    SListEntry *arg1 = slist_nth_entry(clients, index);
-    if(arg1 == NULL) continue;
-    unsigned int arg2 = amount;
-    void *args = malloc(sizeof(SListEntry *) + sizeof(unsigned int));
-    if(args == NULL)
+    struct net_rejection_counters counters;
+    net_get_rejection_counters(&counters);
+    uint64_t rate_limited = counters.rate_limited - last_reported_rejections.rate_limited;
+    uint64_t prelogin_timeouts = counters.prelogin_timeouts - last_reported_rejections.prelogin_timeouts;
+    if(rate_limited > 0 || prelogin_timeouts > 0)
     {
-      nlog_error("Could not serve client. Could not allocate memory. (%s)", strerror(errno));
-      free(args);
-      continue;
+      nlog_info("Refused %llu connections from addresses which connected too often, and closed %llu which did not log in in time, over the last minute.",
+        (unsigned long long) rate_limited, (unsigned long long) prelogin_timeouts);
+    }
+    last_reported_rejections = counters;
+
+    struct mapi_cache_stats cache_stats;
+    mapi_get_cache_stats(&cache_stats);
+    uint64_t name_hits = (cache_stats.names.hits + cache_stats.names.negative_hits) - (last_reported_cache_stats.names.hits + last_reported_cache_stats.names.negative_hits);
+    uint64_t name_misses = cache_stats.names.misses - last_reported_cache_stats.names.misses;
+    uint64_t profile_hits = (cache_stats.profiles.hits + cache_stats.profiles.negative_hits) - (last_reported_cache_stats.profiles.hits + last_reported_cache_stats.profiles.negative_hits);
+    uint64_t profile_misses = cache_stats.profiles.misses - last_reported_cache_stats.profiles.misses;
+    if(name_hits > 0 || name_misses > 0 || profile_hits > 0 || profile_misses > 0)
+    {
+      nlog_info("Mojang API cache answered %llu of %llu name lookups and %llu of %llu profile lookups over the last minute.",
+        (unsigned long long) name_hits, (unsigned long long) (name_hits + name_misses),
+        (unsigned long long) profile_hits, (unsigned long long) (profile_hits + profile_misses));
     }
-    memcpy(args, &arg1, sizeof(arg1));
-    memcpy(args + sizeof(arg1), &arg2, sizeof(arg2));
-    thpool_add_work(main_threadpool, serve_client_batch, args);
-    index += amount;
+    last_reported_cache_stats = cache_stats;
+    housekeeping_since_report = 0;
   }
-  pthread_rwlock_unlock(&clients_lock);
+}
+
+void net_get_rejection_counters(struct net_rejection_counters *out)
+{
+  out->rate_limited = (uint64_t) psnip_atomic_int64_load(&rejected_rate_limited);
+  out->prelogin_timeouts = (uint64_t) psnip_atomic_int64_load(&rejected_prelogin_timeout);
+}
 
-  thpool_wait(main_threadpool);
+void net_set_max_players(unsigned int count)
+{
+  psnip_atomic_int32_store(&max_players, (int32_t) ((count > INT32_MAX) ? INT32_MAX : count));
 }
 
 unsigned int net_get_max_players(void)
 {
-  return 999; // TODO
+  return (unsigned int) psnip_atomic_int32_load(&max_players);
+}
+
+void net_player_joined(void)
+{
+  psnip_atomic_int32_add(&online_players, 1);
+}
+
+void net_player_left(void)
+{
+  psnip_atomic_int32_sub(&online_players, 1);
+}
+
+unsigned int net_get_online_players(void)
+{
+  return (unsigned int) psnip_atomic_int32_load(&online_players);
+}
+
+int net_get_compression_threshold(void)
+{
+  return compression_threshold;
 }
 
-const char *net_get_motd(void)
+int net_get_compression_level(void)
 {
-  return motd;
+  return compression_level;
 }
@@ -23,10 +23,31 @@
 #ifndef STRONK_NETWORK_H
 #define STRONK_NETWORK_H
 
+#include <stdint.h>
+
+struct net_rejection_counters
+{
+  uint64_t rate_limited; // Connections refused because their address connected too often.
+  uint64_t prelogin_timeouts; // Connections closed because they didn't finish logging in in time.
+};
+
 void net_tick(void);
 int net_init(void);
+
+// These only have an effect if called before net_init().
+void net_set_listener_count(unsigned int count); // Amount of listener sockets, each with their own I/O thread. 0 means one per four cores.
+void net_set_accept_backlog(int backlog);
+void net_set_defer_accept_timeout(int seconds); // 0 disables TCP_DEFER_ACCEPT.
+void net_set_key_rotation_interval(unsigned int seconds); // 0, the default, keeps the same server key for as long as the server runs.
+
 void net_cleanup(void);
+void net_set_max_players(unsigned int count); // May be called at any time, as may the other getters and counters below.
 unsigned int net_get_max_players(void);
-const char *net_get_motd(void); // returns chat JSON
+unsigned int net_get_online_players(void);
+void net_player_joined(void); // Called once a connection has a player, net_player_left() is called when it closes.
+void net_player_left(void);
+int net_get_compression_threshold(void); // Negative if compression is disabled.
+int net_get_compression_level(void);
+void net_get_rejection_counters(struct net_rejection_counters *out); // Totals since startup, may be called from any thread.
 
 #endif
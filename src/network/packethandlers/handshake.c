@@ -33,8 +33,9 @@
 
 struct hp_result handle_hs_handshake(const struct mcpr_packet *pkt, struct connection *conn)\
 {
-  nlog_info("Received a handshake packet. (protocol version: %i, server address: %s, server port: %i, next state: %s)",
-    pkt->data.handshake.serverbound.handshake.protocol_version, pkt->data.handshake.serverbound.handshake.server_address,
+  struct mcpr_string_view server_address = pkt->data.handshake.serverbound.handshake.server_address;
+  nlog_info("Received a handshake packet. (protocol version: %i, server address: %.*s, server port: %i, next state: %s)",
+    pkt->data.handshake.serverbound.handshake.protocol_version, (int) server_address.len, server_address.str,
     pkt->data.handshake.serverbound.handshake.server_port, (pkt->data.handshake.serverbound.handshake.next_state == MCPR_STATE_LOGIN) ? "login" : "status");
   int32_t protocol_version = pkt->data.handshake.serverbound.handshake.protocol_version;
   mcpr_connection_set_state(conn->conn, pkt->data.handshake.serverbound.handshake.next_state);
@@ -49,8 +50,7 @@ struct hp_result handle_hs_handshake(const struct mcpr_packet *pkt, struct conne
     hp_result.free_disconnect_message = true;
     return hp_result;
   }
-  size_t server_address_len = strlen(pkt->data.handshake.serverbound.handshake.server_address);
-  conn->server_address_used = malloc(server_address_len + 1);
+  conn->server_address_used = mcpr_string_view_dup(server_address);
   if(conn->server_address_used == NULL)
   {
     nlog_error("Could not allocate memory for conn->server_address (%s)", strerror(errno));
@@ -68,7 +68,6 @@ struct hp_result handle_hs_handshake(const struct mcpr_packet *pkt, struct conne
     }
     return hp_result;
   }
-  memcpy(conn->server_address_used, pkt->data.handshake.serverbound.handshake.server_address, server_address_len + 1);
   conn->port_used = pkt->data.handshake.serverbound.handshake.server_port;
 
   struct hp_result hp_result;
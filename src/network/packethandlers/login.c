@@ -43,20 +43,42 @@
 #include <mcpr/packet.h>
 #include <mcpr/crypto.h>
 #include <mcpr/codec.h>
+#include <mcpr/connection.h>
 
 #include <mapi/mapi.h>
 
 #include <logging/logging.h>
 #include <network/packethandlers/packethandlers.h>
+#include <network/network.h>
+#include <network/serverkey.h>
 #include <world/entity.h>
 #include "../../util.h"
 #include "../../server.h"
 
-static bool is_auth_required(const char *username)
+static bool is_auth_required(struct mcpr_string_view username)
 {
   return true;
 }
 
+// Sends the set compression packet and enables compression for conn, unless it's disabled server-wide.
+static bool enable_compression(struct connection *conn)
+{
+  int threshold = net_get_compression_threshold();
+  if(threshold < 0) return true;
+
+  struct mcpr_packet pkt;
+  pkt.id = MCPR_PKT_LG_CB_SET_COMPRESSION;
+  pkt.state = MCPR_STATE_LOGIN;
+  pkt.data.login.clientbound.set_compression.threshold = threshold;
+  if(!mcpr_connection_send_packet(conn->conn, &pkt)) return false; // This packet itself has to go out uncompressed.
+
+  if(!mcpr_connection_set_compression_level(conn->conn, net_get_compression_level()))
+  {
+    nlog_warn("Could not set compression level. (%s)", ninerr->message);
+  }
+  return mcpr_connection_set_compression(conn->conn, true, (unsigned long) threshold);
+}
+
 static struct player *create_player(struct connection *conn, struct ninuuid uuid)
 {
   struct player *player = malloc(sizeof(struct player));
@@ -75,6 +97,8 @@ static struct player *create_player(struct connection *conn, struct ninuuid uuid
   player->flying_speed = 1.0;
   player->gamemode = MCPR_GAMEMODE_SURVIVAL;
   player->client_settings_known = false;
+  player->chunk_queue.next = 0;
+  player->chunk_queue.total = 0;
   player->compass_target.x = 0;
   player->compass_target.y = 70;
   player->compass_target.z = 0;
@@ -88,6 +112,7 @@ static struct player *create_player(struct connection *conn, struct ninuuid uuid
   server_get_internal_clock_time(&(player->last_keepalive_sent));
   server_get_internal_clock_time(&(player->last_keepalive_received));
   conn->player = player;
+  net_player_joined();
   return player;
 }
 
@@ -105,12 +130,13 @@ static struct hp_result send_post_login_sequence(struct connection *conn)
   pkt_.hardcore = false;
   pkt_.dimension = MCPR_DIMENSION_OVERWORLD;
   pkt_.difficulty = MCPR_DIFFICULTY_PEACEFUL;
-  pkt_.max_players = 255;
+  unsigned int max_players = net_get_max_players();
+  pkt_.max_players = (max_players > 255) ? 255 : max_players; // Only a byte, and unused by the client anyway.
   pkt_.level_type = MCPR_LEVEL_DEFAULT;
   pkt_.reduced_debug_info = false;
   #undef pkt_
 
-  if(fwrite(&join_game_pkt, sizeof(join_game_pkt), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &join_game_pkt))
   {
     if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
     {
@@ -161,7 +187,7 @@ static struct hp_result send_post_login_sequence(struct connection *conn)
   pkt_.data = server_brand_buf;
   #undef pkt_
 
-  if(fwrite(&pm_brand, sizeof(pm_brand), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &pm_brand))
   {
     if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
     {
@@ -194,7 +220,7 @@ static struct hp_result send_post_login_sequence(struct connection *conn)
   spawn_position_pkt.state = MCPR_STATE_PLAY;
   spawn_position_pkt.data.play.clientbound.spawn_position.location = player->compass_target;
 
-  if(fwrite(&spawn_position_pkt, sizeof(spawn_position_pkt), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &spawn_position_pkt))
   {
     if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
     {
@@ -232,7 +258,7 @@ static struct hp_result send_post_login_sequence(struct connection *conn)
   player_abilities_pkt.data.play.clientbound.player_abilities.field_of_view_modifier = 1.0;
   player_abilities_pkt.data.play.clientbound.player_abilities.creative_mode = false;
 
-  if(fwrite(&player_abilities_pkt, sizeof(player_abilities_pkt), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &player_abilities_pkt))
   {
     if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
     {
@@ -269,62 +295,158 @@ static struct hp_result send_post_login_sequence(struct connection *conn)
 }
 
 
-struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct connection *conn)
+// Frees what login start set up for the encryption handshake, the username is kept if it's still needed.
+static void release_login_state(struct connection *conn, bool free_username)
 {
-  nlog_debug("in handle_lg_login_start");
-  conn->tmp.username = pkt->data.login.serverbound.login_start.name;
+  server_key_release(conn->tmp.key);
+  conn->tmp.key = NULL;
+  if(free_username) { free(conn->tmp.username); conn->tmp.username = NULL; }
+  conn->tmp_present = false;
+}
+
+// Everything after the client has been authenticated (or didn't have to be), conn->tmp.username is handed over to the player.
+static struct hp_result complete_login(struct connection *conn, struct ninuuid uuid)
+{
+  struct hp_result result;
+  result.result = HP_RESULT_FATAL;
+  result.disconnect_message = mcpr_as_chat("A fatal error occurred whilst logging in.");
+  result.free_disconnect_message = (result.disconnect_message != NULL);
 
-  if(is_auth_required(pkt->data.login.serverbound.login_start.name))
+  if(!enable_compression(conn))
   {
-    nlog_info("Connection at %p is required to do authentication.", (void *) conn);
-    RSA *rsa = RSA_generate_key(1024, 3, 0, 0); // TODO this is deprecated in OpenSSL 1.0.2? But the alternative is not there in 1.0.1
+    if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0) goto closed;
+    nlog_error("Could not enable compression for connection. (%s)", (ninerr != NULL && ninerr->message != NULL) ? ninerr->message : "unknown error");
+    goto err;
+  }
 
-    unsigned char *buf = NULL; // TODO should this be freed afterwards?
-    int buflen = i2d_RSA_PUBKEY(rsa, &buf);
-    if(buflen < 0)
-    {
-      // Error occured.
-      nlog_error("Ermg ze openssl errorz!!"); // TODO proper error handling.
+  struct mcpr_packet response;
+  response.id = MCPR_PKT_LG_CB_LOGIN_SUCCESS;
+  response.state = MCPR_STATE_LOGIN;
+  response.data.login.clientbound.login_success.uuid = uuid;
+  response.data.login.clientbound.login_success.username = conn->tmp.username;
 
-      char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
-      struct hp_result result;
-      result.result = HP_RESULT_FATAL;
-      result.disconnect_message = reason;
-      result.free_disconnect_message = true;
-      return result;
+  if(!mcpr_connection_send_packet(conn->conn, &response))
+  {
+    if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0) goto closed;
+    if(ninerr != NULL && ninerr->message != NULL)
+    {
+      nlog_error("Could not send login success packet to connection. (%s ?)", ninerr->message);
     }
-    if(buflen > INT32_MAX || buflen < INT32_MIN)
+    else
     {
-      nlog_error("Integer overflow.");
-      RSA_free(rsa);
-
-      char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
-      struct hp_result result;
-      result.result = HP_RESULT_FATAL;
-      result.disconnect_message = reason;
-      result.free_disconnect_message = true;
-      return result;
+      nlog_error("Could not send login success packet to connection.");
     }
+    goto err;
+  }
 
-    int32_t verify_token_length = 16;
-    uint8_t *verify_token = malloc(verify_token_length * sizeof(uint8_t)); // 128 bit verify token.
-    if(verify_token == NULL)
-    {
-      nlog_error("Could not allocate memory. (%s)", strerror(errno));
-      RSA_free(rsa);
+  mcpr_connection_set_state(conn->conn, MCPR_STATE_PLAY);
 
-      char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
-      struct hp_result result;
-      result.result = HP_RESULT_FATAL;
-      result.disconnect_message = reason;
-      result.free_disconnect_message = true;
-      return result;
+  struct player *player = create_player(conn, uuid);
+  if(player == NULL) goto err;
+  conn->tmp.username = NULL; // Owned by the player now.
+
+  nlog_debug("State for connection at %p (username: %s) switched to PLAY", conn, player->username);
+
+  IGNORE("-Wdiscarded-qualifiers")
+  if(result.free_disconnect_message) free(result.disconnect_message);
+  END_IGNORE()
+  result = send_post_login_sequence(conn);
+  if(result.result != HP_RESULT_OK)
+  {
+    conn->player = NULL; // Closing the connection won't count this player as leaving, so that happens here.
+    net_player_left();
+    free(player->username);
+    free(player);
+  }
+  return result;
+
+closed:
+  IGNORE("-Wdiscarded-qualifiers")
+  if(result.free_disconnect_message) free(result.disconnect_message);
+  END_IGNORE()
+  result.result = HP_RESULT_CLOSED;
+  result.disconnect_message = NULL;
+  result.free_disconnect_message = false;
+err:
+  free(conn->tmp.username);
+  conn->tmp.username = NULL;
+  return result;
+}
+
+// Handlers report back through their hp_result, but the session server answers outside of any handler.
+static void apply_result(struct connection *conn, struct hp_result result)
+{
+  if(result.result == HP_RESULT_FATAL || result.result == HP_RESULT_CLOSED) connection_close(conn, result.disconnect_message);
+  IGNORE("-Wdiscarded-qualifiers")
+  if(result.free_disconnect_message) free(result.disconnect_message);
+  END_IGNORE()
+}
+
+// Called by mapi_async_perform() from the tick, so it may do anything a packet handler may.
+static void on_session_verified(enum mapi_has_joined_result verify_result, struct mapi_minecraft_has_joined_response *response, void *arg)
+{
+  struct connection *conn = arg;
+  conn->tmp.session_request = NULL;
+
+  if(psnip_atomic_int32_load(&(conn->closing)))
+  {
+    if(response != NULL) mapi_minecraft_has_joined_response_destroy(response);
+    release_login_state(conn, true);
+    return;
+  }
+
+  if(verify_result != MAPI_HAS_JOINED_RESULT_SUCCESS)
+  {
+    struct hp_result result;
+    result.result = HP_RESULT_FATAL;
+    if(verify_result == MAPI_HAS_JOINED_RESULT_FAILED)
+    {
+      nlog_info("Session of %s could not be verified, the client is not who it claims to be.", conn->tmp.username);
+      result.disconnect_message = mcpr_as_chat("Failed to verify username!");
+    }
+    else
+    {
+      nlog_error("Could not verify session of %s. (%s)", conn->tmp.username, (ninerr != NULL && ninerr->message != NULL) ? ninerr->message : "unknown error");
+      result.disconnect_message = mcpr_as_chat("A fatal error occurred whilst logging in.");
     }
+    result.free_disconnect_message = (result.disconnect_message != NULL);
+    release_login_state(conn, true);
+    apply_result(conn, result);
+    return;
+  }
+
+  struct ninuuid uuid = response->id;
+  mapi_minecraft_has_joined_response_destroy(response);
+  release_login_state(conn, false);
+  struct hp_result result = complete_login(conn, uuid);
+  bool open = (result.result != HP_RESULT_FATAL && result.result != HP_RESULT_CLOSED);
+  apply_result(conn, result);
+  if(open) connection_resume(conn); // The state and compression are final now, the I/O thread may carry on decoding.
+}
 
-    if(secure_random(verify_token, verify_token_length) < 0)
+
+struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct connection *conn)
+{
+  nlog_debug("in handle_lg_login_start");
+  struct mcpr_string_view name = pkt->data.login.serverbound.login_start.name;
+
+  if(conn->tmp_present)
+  {
+    nlog_error("Received a login start whilst already logging in.");
+    struct hp_result result;
+    result.result = HP_RESULT_FATAL;
+    result.disconnect_message = mcpr_as_chat("A fatal error occurred whilst logging in.");
+    result.free_disconnect_message = (result.disconnect_message != NULL);
+    return result;
+  }
+
+  if(is_auth_required(name))
+  {
+    nlog_info("Connection at %p is required to do authentication.", (void *) conn);
+    uint8_t verify_token[sizeof(conn->tmp.verify_token)]; // 128 bit verify token.
+    if(secure_random(verify_token, sizeof(verify_token)) < 0)
     {
       nlog_error("Could not get random data.");
-      RSA_free(rsa);
 
       char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
       struct hp_result result;
@@ -334,23 +456,23 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
       return result;
     }
 
+    struct server_key *key = server_key_acquire();
 
     struct mcpr_packet response;
     response.id = MCPR_PKT_LG_CB_ENCRYPTION_REQUEST;
     response.state = MCPR_STATE_LOGIN;
     response.data.login.clientbound.encryption_request.server_id = ""; // Yes, that's supposed to be an empty string.
-    response.data.login.clientbound.encryption_request.public_key_length = (int32_t) buflen;
-    response.data.login.clientbound.encryption_request.public_key = buf;
-    response.data.login.clientbound.encryption_request.verify_token_length = verify_token_length;
+    response.data.login.clientbound.encryption_request.public_key_length = key->public_key_length;
+    response.data.login.clientbound.encryption_request.public_key = key->public_key;
+    response.data.login.clientbound.encryption_request.verify_token_length = (int32_t) sizeof(verify_token);
     response.data.login.clientbound.encryption_request.verify_token = verify_token;
 
 
-    if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
+    if(!mcpr_connection_send_packet(conn->conn, &response))
     {
+      server_key_release(key);
       if(ninerr != NULL && ninerr->message != NULL && strcmp(ninerr->message, "ninerr_closed") == 0)
       {
-        RSA_free(rsa);
-
         struct hp_result result;
         result.result = HP_RESULT_CLOSED;
         result.disconnect_message = NULL;
@@ -368,8 +490,6 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
           nlog_error("Could not write packet to connection");
         }
 
-        RSA_free(rsa);
-
         char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
         struct hp_result result;
         result.result = HP_RESULT_FATAL;
@@ -379,12 +499,11 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
       }
     }
 
-    size_t username_len = strlen(pkt->data.login.serverbound.login_start.name);
-    char *username = malloc(username_len + 1);
+    char *username = mcpr_string_view_dup(name); // The packet's name only lives as long as the packet.
     if(username == NULL)
     {
       nlog_error("Could not allocate memory. (%s)", strerror(errno));
-      RSA_free(rsa);
+      server_key_release(key);
 
       char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
       struct hp_result result;
@@ -393,12 +512,11 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
       result.free_disconnect_message = true;
       return result;
     }
-    memcpy(username, pkt->data.login.serverbound.login_start.name, username_len + 1);
 
     conn->tmp_present = true;
-    conn->tmp.rsa = rsa;
-    conn->tmp.verify_token_length = verify_token_length;
-    conn->tmp.verify_token = verify_token;
+    conn->tmp.key = key;
+    conn->tmp.session_request = NULL;
+    memcpy(conn->tmp.verify_token, verify_token, sizeof(verify_token));
     conn->tmp.username = username;
 
     struct hp_result result;
@@ -410,10 +528,10 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
   else
   {
     nlog_info("Connection at %p is not required to do authentication.", (void *) conn);
-    struct ninuuid uuid;
-    if(!ninuuid_generate(&uuid, 4)) // TODO should not actually be version 4 but version 3
+    conn->tmp.username = mcpr_string_view_dup(name);
+    if(conn->tmp.username == NULL)
     {
-      nlog_error("Could not generate new UUID for player.");
+      nlog_error("Could not allocate memory. (%s)", strerror(errno));
       struct hp_result result;
       result.result = HP_RESULT_FATAL;
       result.disconnect_message = NULL;
@@ -421,45 +539,10 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
       return result;
     }
 
-    struct mcpr_packet response;
-    response.id = MCPR_PKT_LG_CB_LOGIN_SUCCESS;
-    response.state = MCPR_STATE_LOGIN;
-    response.data.login.clientbound.login_success.uuid = uuid;
-    response.data.login.clientbound.login_success.username = conn->tmp.username;
-
-    if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
-    {
-      if(strcmp(ninerr->type, "ninerr_closed") == 0)
-      {
-        struct hp_result result;
-        result.result = HP_RESULT_CLOSED;
-        result.disconnect_message = NULL;
-        result.free_disconnect_message = false;
-        return result;
-      }
-      else
-      {
-        if(ninerr != NULL && ninerr->message != NULL)
-        {
-          nlog_error("Could not send login success packet to connection. (%s ?)", ninerr->message);
-        }
-        else
-        {
-          nlog_error("Could not send login success packet to connection.");
-        }
-        struct hp_result result;
-        result.result = HP_RESULT_FATAL;
-        result.disconnect_message = NULL;
-        result.free_disconnect_message = false;
-        return result;
-      }
-    }
-
-    mcpr_connection_set_state(conn->conn, MCPR_STATE_PLAY);
-
-    struct player *player = create_player(conn, uuid);
-    if(player == NULL)
+    struct ninuuid uuid;
+    if(!ninuuid_generate(&uuid, 4)) // TODO should not actually be version 4 but version 3
     {
+      nlog_error("Could not generate new UUID for player.");
       struct hp_result result;
       result.result = HP_RESULT_FATAL;
       result.disconnect_message = NULL;
@@ -467,11 +550,7 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
       return result;
     }
 
-    nlog_debug("State for connection at %p (username: %s) switched to PLAY", conn, player->username);
-
-    struct hp_result result = send_post_login_sequence(conn);
-    if(result.result != HP_RESULT_OK) free(player);
-    return result;
+    return complete_login(conn, uuid);
   }
 }
 
@@ -485,188 +564,133 @@ struct hp_result handle_lg_login_start(const struct mcpr_packet *pkt, struct con
 
 
 
-  struct hp_result handle_lg_encryption_response(const struct mcpr_packet *pkt, struct connection *conn)
+struct hp_result handle_lg_encryption_response(const struct mcpr_packet *pkt, struct connection *conn)
+{
+  nlog_debug("in handle_lg_encryption_response(pkt = %p, conn = %p)", (void *) pkt, (void *) conn);
+  if(!conn->tmp_present || conn->tmp.session_request != NULL)
   {
-    nlog_debug("in handle_lg_encryption_response(pkt = %p, conn = %p)", (void *) pkt, (void *) conn);
-    if(!conn->tmp_present)
-    {
-      nlog_error("Could not handle login start packet, tmp_present was false.");
-      char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
-      struct hp_result result;
-      result.result = HP_RESULT_FATAL;
-      result.disconnect_message = reason;
-      result.free_disconnect_message = true;
-      return result;
-    }
-
-    void *decrypted_shared_secret = NULL;
-    uint8_t server_id_hash[SHA_DIGEST_LENGTH];
-    char stringified_server_id_hash[SHA_DIGEST_LENGTH * 2 + 2];
-    struct player *player;
-    bool player_init = false;
-
-    int32_t shared_secret_length = pkt->data.login.serverbound.encryption_response.shared_secret_length;
-    void *shared_secret = pkt->data.login.serverbound.encryption_response.shared_secret;
-
-    if(shared_secret_length > INT_MAX || shared_secret_length < INT_MIN)
-    {
-      nlog_error("Integer overflow.");
-      goto err;
-    }
-
-    decrypted_shared_secret = malloc(RSA_size(conn->tmp.rsa));
-    if(decrypted_shared_secret == NULL)
-    {
-      nlog_error("Could not allocate memory. (%s)", strerror(errno));
-      goto err;
-    }
-
-    nlog_debug("Attempting to decrypt shared secret of (encrypted) length %lld", (long long) shared_secret_length);
-    nlog_debug("RSA_size(rsa) is %d", RSA_size(conn->tmp.rsa));
-    if(shared_secret_length > RSA_size(conn->tmp.rsa))
-    {
-      nlog_error("Shared secret length is greater than RSA_size(rsa)");
-      goto err;
-    }
-    int decrypted_shared_secret_length = RSA_private_decrypt((int) shared_secret_length, (unsigned char *) shared_secret, (unsigned char *) decrypted_shared_secret, conn->tmp.rsa, RSA_PKCS1_PADDING);
-    if(decrypted_shared_secret_length < 0)
-    {
-      nlog_error("Could not decrypt shared secret.");
-      ERR_print_errors_fp(fp_error);
-      goto err;
-    }
-
-    EVP_CIPHER_CTX *ctx_encrypt = EVP_CIPHER_CTX_new();
-    if(ctx_encrypt == NULL)
-    {
-      nlog_error("Could not create ctx_encrypt.");
-      goto err;
-    }
-    EVP_CIPHER_CTX_init(ctx_encrypt);
-    if(EVP_EncryptInit_ex(ctx_encrypt, EVP_aes_128_cfb8(), NULL, (unsigned char *) decrypted_shared_secret, (unsigned char *) decrypted_shared_secret) == 0) // TODO Should those 2 pointers be seperate buffers of shared secret?
-     {
-      nlog_error("Error upon EVP_EncryptInit_ex().");
-      ERR_print_errors_fp(fp_error);
-      goto err;
-    }
-
-    EVP_CIPHER_CTX *ctx_decrypt = EVP_CIPHER_CTX_new();
-    if(ctx_decrypt == NULL)
-    {
-      nlog_error("Could not create ctx_decrypt.");
-      goto err;
-    }
-    EVP_CIPHER_CTX_init(ctx_decrypt);
-    if(EVP_DecryptInit_ex(ctx_decrypt, EVP_aes_128_cfb8(), NULL, (unsigned char *) decrypted_shared_secret, (unsigned char *) decrypted_shared_secret) == 0) // TODO Should those 2 pointers be seperate buffers of shared secret?
-     {
-      nlog_error("Error upon EVP_DecryptInit_ex().");
-      ERR_print_errors_fp(fp_error);
-      goto err;
-    }
-    mcpr_connection_set_crypto(conn->conn, ctx_encrypt, ctx_decrypt);
-
-    unsigned char *encoded_public_key = NULL; // TODO should this be freed afterwards?
-    int encoded_public_key_len = i2d_RSA_PUBKEY(conn->tmp.rsa, &encoded_public_key);
-    if(encoded_public_key_len < 0)
-    {
-      // Error occured.
-      nlog_error("Ermg ze openssl errorz!!");
-      ERR_print_errors_fp(fp_error);
-      goto err;
-    }
-
-
-
-    SHA_CTX sha_ctx;
-    if(unlikely(SHA1_Init(&sha_ctx) == 0)) { nlog_error("Could not initialize SHA-1 hash."); goto err; }
-    if(SHA1_Update(&sha_ctx, decrypted_shared_secret, decrypted_shared_secret_length) == 0) { nlog_error("Could not update SHA-1 hash."); uint8_t ignored_tmpbuf[SHA_DIGEST_LENGTH]; /* needed for cleanup */ SHA1_Final(ignored_tmpbuf, &sha_ctx); goto err; }
-    if(SHA1_Update(&sha_ctx, encoded_public_key, encoded_public_key_len) == 0) { nlog_error("Could not update SHA-1 hash."); uint8_t ignored_tmpbuf[SHA_DIGEST_LENGTH]; /* needed for cleanup */ SHA1_Final(ignored_tmpbuf, &sha_ctx); goto err; }
-    if(unlikely(SHA1_Final(server_id_hash, &sha_ctx) == 0)) { nlog_error("Could not finalize SHA-1 hash."); goto err; }
-    mcpr_crypto_stringify_sha1(stringified_server_id_hash, server_id_hash);
-    nlog_debug("Server id hash: %s", stringified_server_id_hash);
-    struct mapi_minecraft_has_joined_response *mapi_result = mapi_minecraft_has_joined(conn->tmp.username, stringified_server_id_hash, conn->server_address_used);
-    if(mapi_result == NULL)
-    {
-      // TODO handle legit non error case where a failure happened.
-      ninerr_print(ninerr);
-      goto err;
-    }
+    nlog_error("Received an encryption response whilst not expecting one.");
+    char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
+    struct hp_result result;
+    result.result = HP_RESULT_FATAL;
+    result.disconnect_message = reason;
+    result.free_disconnect_message = true;
+    return result;
+  }
 
+  void *decrypted_shared_secret = NULL;
+  uint8_t server_id_hash[SHA_DIGEST_LENGTH];
+  char stringified_server_id_hash[SHA_DIGEST_LENGTH * 2 + 2];
 
-    struct mcpr_packet response;
-    response.id = MCPR_PKT_LG_CB_LOGIN_SUCCESS;
-    response.state = MCPR_STATE_LOGIN;
-    response.data.login.clientbound.login_success.uuid = mapi_result->id;
-    response.data.login.clientbound.login_success.username = conn->tmp.username; // eh i think we should get the username from another source?
+  int32_t shared_secret_length = pkt->data.login.serverbound.encryption_response.shared_secret_length;
+  const void *shared_secret = pkt->data.login.serverbound.encryption_response.shared_secret;
 
-    if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
-    {
-      if(strcmp(ninerr->type, "ninerr_closed") == 0)
-      {
-        goto closed;
-      }
-      else
-      {
-        if(ninerr != NULL && ninerr->message != NULL)
-        {
-          nlog_error("Could not send login success packet to connection. (%s ?)", ninerr->message);
-        }
-        else
-        {
-          nlog_error("Could not send login success packet to connection.");
-        }
-        goto err;
-      }
-    }
+  if(shared_secret_length > INT_MAX || shared_secret_length < INT_MIN)
+  {
+    nlog_error("Integer overflow.");
+    goto err;
+  }
 
-    mcpr_connection_set_state(conn->conn, MCPR_STATE_PLAY);
+  RSA *rsa = conn->tmp.key->rsa;
+  decrypted_shared_secret = malloc(RSA_size(rsa));
+  if(decrypted_shared_secret == NULL)
+  {
+    nlog_error("Could not allocate memory. (%s)", strerror(errno));
+    goto err;
+  }
 
+  nlog_debug("Attempting to decrypt shared secret of (encrypted) length %lld", (long long) shared_secret_length);
+  nlog_debug("RSA_size(rsa) is %d", RSA_size(rsa));
+  if(shared_secret_length > RSA_size(rsa))
+  {
+    nlog_error("Shared secret length is greater than RSA_size(rsa)");
+    goto err;
+  }
+  int decrypted_shared_secret_length = RSA_private_decrypt((int) shared_secret_length, (const unsigned char *) shared_secret, (unsigned char *) decrypted_shared_secret, rsa, RSA_PKCS1_PADDING);
+  if(decrypted_shared_secret_length < 0)
+  {
+    nlog_error("Could not decrypt shared secret.");
+    ERR_print_errors_fp(fp_error);
+    goto err;
+  }
 
-    player = create_player(conn, mapi_result->id);
-    if(player == NULL) goto err;
-    player_init = true;
+  // Proves that the client encrypted with the key this connection was sent, rather than replaying someone else's response.
+  int32_t verify_token_length = pkt->data.login.serverbound.encryption_response.verify_token_length;
+  unsigned char decrypted_verify_token[SERVER_KEY_BITS / 8];
+  if(verify_token_length > RSA_size(rsa) || RSA_size(rsa) > (int) sizeof(decrypted_verify_token))
+  {
+    nlog_error("Verify token length is greater than RSA_size(rsa)");
+    goto err;
+  }
+  int decrypted_verify_token_length = RSA_private_decrypt((int) verify_token_length, (const unsigned char *) pkt->data.login.serverbound.encryption_response.verify_token, decrypted_verify_token, rsa, RSA_PKCS1_PADDING);
+  if(decrypted_verify_token_length != (int) sizeof(conn->tmp.verify_token) ||
+    memcmp(decrypted_verify_token, conn->tmp.verify_token, sizeof(conn->tmp.verify_token)) != 0)
+  {
+    nlog_error("Verify token sent by client does not match.");
+    goto err;
+  }
 
-    struct hp_result send_post_login_sequence_result = send_post_login_sequence(conn);
-    if(send_post_login_sequence_result.result == HP_RESULT_FATAL) goto err;
-    else if(send_post_login_sequence_result.result == HP_RESULT_CLOSED) goto closed;
-    else goto cleanup_only;
+  EVP_CIPHER_CTX *ctx_encrypt = EVP_CIPHER_CTX_new();
+  if(ctx_encrypt == NULL)
+  {
+    nlog_error("Could not create ctx_encrypt.");
+    goto err;
+  }
+  EVP_CIPHER_CTX_init(ctx_encrypt);
+  if(EVP_EncryptInit_ex(ctx_encrypt, EVP_aes_128_cfb8(), NULL, (unsigned char *) decrypted_shared_secret, (unsigned char *) decrypted_shared_secret) == 0) // TODO Should those 2 pointers be seperate buffers of shared secret?
+  {
+    nlog_error("Error upon EVP_EncryptInit_ex().");
+    ERR_print_errors_fp(fp_error);
+    goto err;
+  }
 
-  err:
-    nlog_debug("Last address of conn: %p", (void *) conn);
-    RSA_free(conn->tmp.rsa);
-    free(conn->tmp.verify_token);
-    free(conn->tmp.username);
-    conn->tmp_present = false;
-    free(decrypted_shared_secret);
-    if(player_init) free(player);
-    char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
-    struct hp_result result1;
-    result1.result = HP_RESULT_FATAL;
-    result1.disconnect_message = reason;
-    result1.free_disconnect_message = true;
-    return result1;
-
-  cleanup_only:
-    RSA_free(conn->tmp.rsa);
-    free(conn->tmp.verify_token);
-    conn->tmp_present = false;
-    free(decrypted_shared_secret);
-    struct hp_result result2;
-    result2.result = HP_RESULT_OK;
-    result2.disconnect_message = NULL;
-    result2.free_disconnect_message = false;
-    return result2;
-
-  closed:
-    RSA_free(conn->tmp.rsa);
-    free(conn->tmp.verify_token);
-    free(conn->tmp.username);
-    conn->tmp_present = false;
-    free(decrypted_shared_secret);
-    if(player_init) free(player);
-    struct hp_result result3;
-    result3.result = HP_RESULT_CLOSED;
-    result3.disconnect_message = NULL;
-    result3.free_disconnect_message = false;
-    return result3;
+  EVP_CIPHER_CTX *ctx_decrypt = EVP_CIPHER_CTX_new();
+  if(ctx_decrypt == NULL)
+  {
+    nlog_error("Could not create ctx_decrypt.");
+    goto err;
+  }
+  EVP_CIPHER_CTX_init(ctx_decrypt);
+  if(EVP_DecryptInit_ex(ctx_decrypt, EVP_aes_128_cfb8(), NULL, (unsigned char *) decrypted_shared_secret, (unsigned char *) decrypted_shared_secret) == 0) // TODO Should those 2 pointers be seperate buffers of shared secret?
+  {
+    nlog_error("Error upon EVP_DecryptInit_ex().");
+    ERR_print_errors_fp(fp_error);
+    goto err;
+  }
+  mcpr_connection_set_crypto(conn->conn, ctx_encrypt, ctx_decrypt);
+  mcpr_connection_set_use_encryption(conn->conn, true);
+
+  SHA_CTX sha_ctx;
+  if(unlikely(SHA1_Init(&sha_ctx) == 0)) { nlog_error("Could not initialize SHA-1 hash."); goto err; }
+  if(SHA1_Update(&sha_ctx, decrypted_shared_secret, decrypted_shared_secret_length) == 0) { nlog_error("Could not update SHA-1 hash."); uint8_t ignored_tmpbuf[SHA_DIGEST_LENGTH]; /* needed for cleanup */ SHA1_Final(ignored_tmpbuf, &sha_ctx); goto err; }
+  if(SHA1_Update(&sha_ctx, conn->tmp.key->public_key, conn->tmp.key->public_key_length) == 0) { nlog_error("Could not update SHA-1 hash."); uint8_t ignored_tmpbuf[SHA_DIGEST_LENGTH]; /* needed for cleanup */ SHA1_Final(ignored_tmpbuf, &sha_ctx); goto err; }
+  if(unlikely(SHA1_Final(server_id_hash, &sha_ctx) == 0)) { nlog_error("Could not finalize SHA-1 hash."); goto err; }
+  mcpr_crypto_stringify_sha1(stringified_server_id_hash, server_id_hash);
+  nlog_debug("Server id hash: %s", stringified_server_id_hash);
+
+  // The rest of the login continues in on_session_verified(), once the session server has answered.
+  conn->tmp.session_request = mapi_minecraft_has_joined_async(conn->tmp.username, stringified_server_id_hash, conn->server_address_used, on_session_verified, conn);
+  if(conn->tmp.session_request == NULL)
+  {
+    nlog_error("Could not start session verification. (%s)", (ninerr != NULL && ninerr->message != NULL) ? ninerr->message : "unknown error");
+    goto err;
+  }
+  free(decrypted_shared_secret);
+
+  struct hp_result result1;
+  result1.result = HP_RESULT_OK;
+  result1.disconnect_message = NULL;
+  result1.free_disconnect_message = false;
+  return result1;
+
+err:
+  nlog_debug("Last address of conn: %p", (void *) conn);
+  release_login_state(conn, true);
+  free(decrypted_shared_secret);
+  char *reason = mcpr_as_chat("A fatal error occurred whilst logging in.");
+  struct hp_result result2;
+  result2.result = HP_RESULT_FATAL;
+  result2.disconnect_message = reason;
+  result2.free_disconnect_message = true;
+  return result2;
 }
@@ -80,5 +80,8 @@ struct hp_result handle_pl_animation          (const struct mcpr_packet *pkt, st
 struct hp_result handle_pl_spectate           (const struct mcpr_packet *pkt, struct connection *conn);
 struct hp_result handle_pl_player_block_placement     (const struct mcpr_packet *pkt, struct connection *conn);
 struct hp_result handle_pl_use_item           (const struct mcpr_packet *pkt, struct connection *conn);
+struct hp_result handle_pl_craft_recipe_request     (const struct mcpr_packet *pkt, struct connection *conn);
+struct hp_result handle_pl_crafting_book_data       (const struct mcpr_packet *pkt, struct connection *conn);
+struct hp_result handle_pl_advancement_tab        (const struct mcpr_packet *pkt, struct connection *conn);
 
 #endif
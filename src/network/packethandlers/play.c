@@ -51,20 +51,17 @@ struct hp_result handle_pl_keep_alive(const struct mcpr_packet *pkt, struct conn
 
 struct hp_result handle_pl_plugin_message(const struct mcpr_packet *pkt, struct connection *conn)
 {
-  if(strcmp(pkt->data.play.serverbound.plugin_message.channel, "MC|BRAND") == 0)
+  if(mcpr_string_view_equals(pkt->data.play.serverbound.plugin_message.channel, "MC|BRAND"))
   {
-    int32_t data_length = pkt->data.play.serverbound.plugin_message.data_length;
-    if(data_length < 0) goto err;
-    IGNORE("-Wtype-limits")
-    if((uint32_t) data_length > SIZE_MAX) goto err;
-    END_IGNORE();
-    void *data = pkt->data.play.serverbound.plugin_message.data;
-
-    char *client_brand;
-    ssize_t result = mcpr_decode_string(&client_brand, data, (size_t) data_length);
+    size_t data_length = pkt->data.play.serverbound.plugin_message.data_length;
+    const void *data = pkt->data.play.serverbound.plugin_message.data;
+
+    struct mcpr_string_view client_brand;
+    ssize_t result = mcpr_decode_string_view(&client_brand, data, data_length);
     if(result < 0) goto err;
 
-    conn->player->client_brand = client_brand;
+    conn->player->client_brand = mcpr_string_view_dup(client_brand);
+    if(conn->player->client_brand == NULL) goto err;
   }
 
   struct hp_result hp_result;
@@ -85,18 +82,12 @@ struct hp_result handle_pl_plugin_message(const struct mcpr_packet *pkt, struct
 struct hp_result handle_pl_client_settings(const struct mcpr_packet *pkt, struct connection *conn)
 {
   struct player *player = conn->player;
-  // We don't know how the locale in the packet is allocated, so we need to copy the string to ensure
-  // that it is allocated via malloc()
-  char *locale = pkt->data.play.serverbound.client_settings.locale;
-  player->client_settings.locale = malloc(strlen(locale) + 1);
+  // The locale in the packet only lives as long as the packet does.
+  player->client_settings.locale = mcpr_string_view_dup(pkt->data.play.serverbound.client_settings.locale);
   if(player->client_settings.locale == NULL)
   {
     nlog_error("Could not allocate memory. (%s)", strerror(errno));
   }
-  else
-  {
-    strcpy(player->client_settings.locale, locale);
-  }
 
   player->client_settings.view_distance = pkt->data.play.serverbound.client_settings.view_distance;
   player->client_settings.chat_mode = pkt->data.play.serverbound.client_settings.chat_mode;
@@ -113,12 +104,8 @@ struct hp_result handle_pl_client_settings(const struct mcpr_packet *pkt, struct
 
   player->client_settings_known = true;
 
-
-  if(world_send_chunk_data1(player) < 0)
-  {
-    nlog_error("Could not send chunk data to player. (%s ?)", strerror(errno));
-    goto fatal_err;
-  }
+  // The chunks themselves are streamed over the next ticks.
+  world_queue_chunks(player);
 
   struct mcpr_packet response;
   response.id = MCPR_PKT_PL_CB_PLAYER_POSITION_AND_LOOK;
@@ -137,7 +124,7 @@ struct hp_result handle_pl_client_settings(const struct mcpr_packet *pkt, struct
 
   response.data.play.clientbound.player_position_and_look.teleport_id = 0;
 
-  if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &response))
   {
     if(ninerr != NULL && strcmp(ninerr->message, "ninerr_closed") == 0)
     {
@@ -204,7 +191,7 @@ struct hp_result handle_pl_teleport_confirm(const struct mcpr_packet *pkt, struc
 
     response.data.play.clientbound.player_position_and_look.teleport_id = 0;
 
-    if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
+    if(!mcpr_connection_send_packet(conn->conn, &response))
     {
       if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
       {
@@ -257,15 +244,23 @@ struct hp_result handle_pl_tab_complete(const struct mcpr_packet *pkt, struct co
 
 struct hp_result handle_pl_chat_message(const struct mcpr_packet *pkt, struct connection *conn)
 {
-  const char *msg = pkt->data.play.serverbound.chat_message.message;
-  if(msg[0] != '/') // check if it isn't a command
+  struct mcpr_string_view message = pkt->data.play.serverbound.chat_message.message;
+  if(message.len == 0 || message.str[0] != '/') // check if it isn't a command
   {
+    char *msg = mcpr_string_view_dup(message);
+    if(msg == NULL)
+    {
+      nlog_error("Could not allocate memory. (%s)", strerror(errno));
+      struct hp_result result = { .result = HP_RESULT_ERR, .disconnect_message = NULL, .free_disconnect_message = false };
+      return result;
+    }
     char *chat_json = mcpr_as_chat("%s", msg);
     struct chat_entry entry;
     entry.msg = msg;
     entry.position = MCPR_CHAT_POSITION_CHAT;
     chat_broadcast(entry, CHAT_TYPE_CHAT);
     free(chat_json);
+    free(msg);
   }
 
   struct hp_result result = { .result = HP_RESULT_OK, .disconnect_message = NULL, .free_disconnect_message = false };
@@ -416,4 +411,22 @@ struct hp_result handle_pl_use_item(const struct mcpr_packet *pkt, struct connec
   struct hp_result result = { .result = HP_RESULT_OK, .disconnect_message = NULL, .free_disconnect_message = false };
   return result;
 }
+
+struct hp_result handle_pl_craft_recipe_request(const struct mcpr_packet *pkt, struct connection *conn)
+{
+  struct hp_result result = { .result = HP_RESULT_OK, .disconnect_message = NULL, .free_disconnect_message = false };
+  return result;
+}
+
+struct hp_result handle_pl_crafting_book_data(const struct mcpr_packet *pkt, struct connection *conn)
+{
+  struct hp_result result = { .result = HP_RESULT_OK, .disconnect_message = NULL, .free_disconnect_message = false };
+  return result;
+}
+
+struct hp_result handle_pl_advancement_tab(const struct mcpr_packet *pkt, struct connection *conn)
+{
+  struct hp_result result = { .result = HP_RESULT_OK, .disconnect_message = NULL, .free_disconnect_message = false };
+  return result;
+}
 END_IGNORE()
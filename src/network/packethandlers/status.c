@@ -25,35 +25,31 @@
 #include <ninerr/ninerr.h>
 
 #include <network/network.h>
+#include <network/statusresponse.h>
 #include <logging/logging.h>
 #include <mcpr/packet.h>
+#include <mcpr/connection.h>
 #include <network/packethandlers/packethandlers.h>
 
 struct hp_result handle_st_request(const struct mcpr_packet *pkt, struct connection *conn)
 {
   nlog_debug("in handle_st_request");
 
-  struct mcpr_packet response;
-  response.id = MCPR_PKT_ST_CB_RESPONSE;
-  response.state = MCPR_STATE_STATUS;
-  response.data.status.clientbound.response.version_name = MCPR_MINECRAFT_VERSION;
-  response.data.status.clientbound.response.protocol_version = MCPR_PROTOCOL_VERSION;
-  response.data.status.clientbound.response.max_players = net_get_max_players();
-  response.data.status.clientbound.response.online_players_size = 0;
-  #ifdef __GNUC__
-    #pragma GCC diagnostic push
-    #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-  #endif
-    response.data.status.clientbound.response.description = net_get_motd();
-  #ifdef __GNUC__
-    #pragma GCC diagnostic pop
-  #endif
-  response.data.status.clientbound.response.online_players = 999;
-  response.data.status.clientbound.response.player_sample = NULL;
-  response.data.status.clientbound.response.favicon = NULL;
-  nlog_info("Motd: %s", net_get_motd());
+  // Encoded once and shared by every ping, until something it shows changes.
+  struct status_response *response = status_response_acquire();
+  if(response == NULL)
+  {
+    nlog_error("Could not get status response. (%s)", ninerr->message);
+    struct hp_result hp_result;
+    hp_result.result = HP_RESULT_ERR;
+    hp_result.disconnect_message = NULL;
+    hp_result.free_disconnect_message = false;
+    return hp_result;
+  }
 
-  if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
+  bool sent = mcpr_connection_write_encoded_packet(conn->conn, response->data, response->size, NULL, 0);
+  status_response_release(response);
+  if(!sent)
   {
     if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
     {
@@ -92,7 +88,7 @@ struct hp_result handle_st_ping(const struct mcpr_packet *pkt, struct connection
   response.state = MCPR_STATE_STATUS;
   response.data.status.clientbound.pong.payload = pkt->data.status.serverbound.ping.payload;
 
-  if(fwrite(&response, sizeof(response), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &response))
   {
     if(ninerr != NULL && strcmp(ninerr->type, "ninerr_closed") == 0)
     {
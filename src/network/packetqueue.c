@@ -0,0 +1,93 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <ninerr/ninerr.h>
+
+#include "packetqueue.h"
+
+// Storage which grew larger than this for a big packet is given back on release, so idle connections stay small.
+#define SLOT_STORAGE_KEEP_SIZE 4096
+
+bool packet_queue_init(struct packet_queue *queue, size_t capacity)
+{
+  size_t rounded = 1;
+  while(rounded < capacity) rounded *= 2;
+
+  queue->packets = malloc(rounded * sizeof(struct mcpr_packet));
+  if(queue->packets == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  queue->storage = calloc(rounded, sizeof(struct ninio_buffer)); // Allocated lazily by the first packet decoded into each slot.
+  if(queue->storage == NULL) { ninerr_set_err(ninerr_from_errno()); free(queue->packets); return false; }
+  queue->capacity = rounded;
+  psnip_atomic_int64_store(&(queue->head), 0);
+  psnip_atomic_int64_store(&(queue->tail), 0);
+  return true;
+}
+
+void packet_queue_destroy(struct packet_queue *queue)
+{
+  for(size_t i = 0; i < queue->capacity; i++) free(queue->storage[i].content);
+  free(queue->storage);
+  queue->storage = NULL;
+  free(queue->packets);
+  queue->packets = NULL;
+}
+
+struct mcpr_packet *packet_queue_reserve(struct packet_queue *queue, struct ninio_buffer **storage)
+{
+  int64_t tail = psnip_atomic_int64_load(&(queue->tail));
+  int64_t head = psnip_atomic_int64_load(&(queue->head));
+  if((size_t) (tail - head) >= queue->capacity) return NULL;
+  size_t index = (size_t) tail & (queue->capacity - 1);
+  *storage = &(queue->storage[index]);
+  return &(queue->packets[index]);
+}
+
+void packet_queue_commit(struct packet_queue *queue)
+{
+  psnip_atomic_int64_add(&(queue->tail), 1);
+}
+
+struct mcpr_packet *packet_queue_peek(struct packet_queue *queue)
+{
+  int64_t head = psnip_atomic_int64_load(&(queue->head));
+  int64_t tail = psnip_atomic_int64_load(&(queue->tail));
+  if(head == tail) return NULL;
+  return &(queue->packets[(size_t) head & (queue->capacity - 1)]);
+}
+
+void packet_queue_release(struct packet_queue *queue)
+{
+  int64_t head = psnip_atomic_int64_load(&(queue->head));
+  struct ninio_buffer *storage = &(queue->storage[(size_t) head & (queue->capacity - 1)]);
+  if(storage->max_size > SLOT_STORAGE_KEEP_SIZE)
+  {
+    free(storage->content);
+    storage->content = NULL;
+    storage->max_size = 0;
+  }
+  storage->size = 0;
+  psnip_atomic_int64_add(&(queue->head), 1);
+}
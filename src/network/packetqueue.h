@@ -0,0 +1,58 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_PACKETQUEUE_H
+#define STRONK_PACKETQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <psnip/atomic/atomic.h>
+#include <mcpr/packet.h>
+#include <ninio/ninio.h>
+
+// Bounded single-producer/single-consumer queue of decoded packets.
+// The producer decodes straight into a reserved slot and commits it, the consumer peeks at the oldest packet and releases it
+// once it is done with it, so packets are never copied. No locks are taken, the producer only ever writes tail and the consumer head.
+// Every slot has its own storage buffer which the packet's strings and byte arrays point into, it stays valid until the slot is released.
+
+struct packet_queue
+{
+  struct mcpr_packet *packets;
+  struct ninio_buffer *storage; // One per slot.
+  size_t capacity; // Always a power of two.
+  psnip_atomic_int64 head; // Index of the next packet to be consumed, only written by the consumer.
+  psnip_atomic_int64 tail; // Index of the next slot to be produced, only written by the producer.
+};
+
+bool packet_queue_init                    (struct packet_queue *queue, size_t capacity); // capacity is rounded up to a power of two.
+void packet_queue_destroy                 (struct packet_queue *queue);
+
+// Producer side.
+struct mcpr_packet *packet_queue_reserve  (struct packet_queue *queue, struct ninio_buffer **storage); // Returns NULL if the queue is full.
+void packet_queue_commit                  (struct packet_queue *queue); // Publishes the slot returned by the last reserve.
+
+// Consumer side.
+struct mcpr_packet *packet_queue_peek     (struct packet_queue *queue); // Returns NULL if the queue is empty.
+void packet_queue_release                 (struct packet_queue *queue); // Frees the slot returned by the last peek.
+
+#endif
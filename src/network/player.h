@@ -75,6 +75,15 @@ struct player {
 
   uint8_t selected_slot;
 
+  // Chunks around center are sent a few per tick, closest first. See world_queue_chunks().
+  struct
+  {
+    long center_x, center_z;
+    unsigned int radius;
+    size_t next; // Index of the next chunk to send in the distance ordered list of offsets.
+    size_t total; // 0 if nothing was queued yet.
+  } chunk_queue;
+
   long last_teleport_id;
   struct timespec last_keepalive_received; // Based on server_get_internal_clock_time()
   struct timespec last_keepalive_sent; // Based on server_get_internal_clock_time()
@@ -0,0 +1,129 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include <ninerr/ninerr.h>
+
+#include "ratelimit.h"
+
+#define PROBE_LENGTH 8 // Buckets looked at for a single address, before the least recently used of them is taken.
+
+bool ratelimiter_init(struct ratelimiter *limiter, size_t capacity, unsigned int rate, unsigned int burst)
+{
+  size_t rounded = PROBE_LENGTH;
+  while(rounded < capacity) rounded *= 2;
+
+  limiter->buckets = calloc(rounded, sizeof(struct ratelimit_bucket));
+  if(limiter->buckets == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  if(pthread_mutex_init(&(limiter->lock), NULL) != 0)
+  {
+    free(limiter->buckets);
+    ninerr_set_err(ninerr_new("Could not initialize rate limiter lock."));
+    return false;
+  }
+  limiter->capacity = rounded;
+  limiter->rate = rate;
+  limiter->burst = burst;
+  return true;
+}
+
+void ratelimiter_destroy(struct ratelimiter *limiter)
+{
+  pthread_mutex_destroy(&(limiter->lock));
+  free(limiter->buckets);
+}
+
+// IPv4 addresses are stored the same way as IPv4-mapped IPv6 addresses, so both forms share a bucket.
+static void make_key(uint8_t key[16], const struct sockaddr_storage *address)
+{
+  memset(key, 0, 16);
+  if(address->ss_family == AF_INET6)
+  {
+    const uint8_t *ip = ((const struct sockaddr_in6 *) address)->sin6_addr.s6_addr;
+    if(IN6_IS_ADDR_V4MAPPED(&(((const struct sockaddr_in6 *) address)->sin6_addr))) memcpy(key, ip, 16);
+    else memcpy(key, ip, 8);
+  }
+  else if(address->ss_family == AF_INET)
+  {
+    key[10] = 0xFF;
+    key[11] = 0xFF;
+    memcpy(key + 12, &(((const struct sockaddr_in *) address)->sin_addr.s_addr), 4);
+  }
+}
+
+static size_t hash_key(const uint8_t key[16])
+{
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  for(int i = 0; i < 16; i++)
+  {
+    hash ^= key[i];
+    hash *= 1099511628211ULL;
+  }
+  return (size_t) hash;
+}
+
+bool ratelimiter_allow(struct ratelimiter *limiter, const struct sockaddr_storage *address, uint64_t now_ns)
+{
+  uint8_t key[16];
+  make_key(key, address);
+  size_t start = hash_key(key) & (limiter->capacity - 1);
+  uint64_t full = (uint64_t) limiter->burst * 1000;
+
+  pthread_mutex_lock(&(limiter->lock));
+  struct ratelimit_bucket *bucket = NULL;
+  struct ratelimit_bucket *oldest = NULL;
+  for(size_t i = 0; i < PROBE_LENGTH; i++)
+  {
+    struct ratelimit_bucket *candidate = &(limiter->buckets[(start + i) & (limiter->capacity - 1)]);
+    if(candidate->used && memcmp(candidate->key, key, 16) == 0) { bucket = candidate; break; }
+    if(oldest == NULL || !candidate->used || (oldest->used && candidate->updated_at < oldest->updated_at)) oldest = candidate;
+  }
+
+  if(bucket == NULL)
+  {
+    bucket = oldest;
+    memcpy(bucket->key, key, 16);
+    bucket->used = true;
+    bucket->tokens = full;
+    bucket->updated_at = now_ns;
+  }
+  else if(now_ns > bucket->updated_at)
+  {
+    // Elapsed milliseconds times rate is in thousandths of a token. The remainder of a millisecond is kept for next time.
+    uint64_t elapsed_ms = (now_ns - bucket->updated_at) / 1000000;
+    uint64_t refill = elapsed_ms * limiter->rate;
+    bucket->tokens = (refill >= full || bucket->tokens + refill >= full) ? full : bucket->tokens + refill;
+    bucket->updated_at += elapsed_ms * 1000000;
+  }
+
+  bool allowed = bucket->tokens >= 1000;
+  if(allowed) bucket->tokens -= 1000;
+  pthread_mutex_unlock(&(limiter->lock));
+  return allowed;
+}
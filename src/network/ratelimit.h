@@ -0,0 +1,61 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_RATELIMIT_H
+#define STRONK_RATELIMIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+// Token buckets keyed by client address, in a fixed size table so that a flood of addresses can't make it grow.
+// IPv6 addresses are keyed by their /64 prefix, as that is what a single host usually gets.
+// Every address starts out with burst tokens, gets rate tokens back per second, and every connection costs one.
+// When the table is full, the bucket which was used least recently is forgotten, which it would have been refilled by then anyway.
+
+struct ratelimit_bucket
+{
+  uint8_t key[16];
+  bool used;
+  uint64_t updated_at; // Monotonic, in nanoseconds.
+  uint64_t tokens; // In thousandths of a token.
+};
+
+struct ratelimiter
+{
+  pthread_mutex_t lock; // Shared by all network I/O threads.
+  struct ratelimit_bucket *buckets;
+  size_t capacity; // Always a power of two.
+  unsigned int rate; // Tokens per second.
+  unsigned int burst;
+};
+
+bool ratelimiter_init     (struct ratelimiter *limiter, size_t capacity, unsigned int rate, unsigned int burst); // capacity is rounded up to a power of two.
+void ratelimiter_destroy  (struct ratelimiter *limiter);
+
+// Takes a token from the bucket of address, returns false if there was none left.
+bool ratelimiter_allow    (struct ratelimiter *limiter, const struct sockaddr_storage *address, uint64_t now_ns);
+
+#endif
@@ -0,0 +1,195 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include <openssl/rsa.h>
+#include <openssl/bn.h>
+#include <openssl/x509.h>
+#include <openssl/err.h>
+
+#include <psnip/atomic/atomic.h>
+
+#include <ninerr/ninerr.h>
+
+#include <logging/logging.h>
+#include <network/serverkey.h>
+#include "../util.h"
+
+static struct server_key *current_key = NULL; // Guarded by key_lock.
+static pthread_mutex_t key_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int rotation_interval_setting = 0;
+static pthread_t rotation_thread;
+static bool rotation_thread_started = false;
+static pthread_mutex_t rotation_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rotation_cond;
+static bool rotation_stop = false; // Guarded by rotation_lock.
+
+IGNORE("-Wdeprecated-declarations")
+static void free_key(struct server_key *key)
+{
+  RSA_free(key->rsa);
+  OPENSSL_free(key->public_key);
+  free(key);
+}
+
+static struct server_key *generate_key(void)
+{
+  struct server_key *key = malloc(sizeof(struct server_key));
+  if(key == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
+  key->rsa = NULL;
+  key->public_key = NULL;
+
+  BIGNUM *exponent = BN_new();
+  if(exponent == NULL || BN_set_word(exponent, RSA_F4) == 0) goto err;
+  key->rsa = RSA_new();
+  if(key->rsa == NULL || RSA_generate_key_ex(key->rsa, SERVER_KEY_BITS, exponent, NULL) == 0) goto err;
+  BN_free(exponent);
+  exponent = NULL;
+
+  int public_key_length = i2d_RSA_PUBKEY(key->rsa, &(key->public_key));
+  if(public_key_length < 0) goto err;
+  key->public_key_length = (int32_t) public_key_length;
+
+  psnip_atomic_int32_store(&(key->refcount), 1); // The reference held as current_key.
+  return key;
+
+err:
+  {
+    char openssl_error[256];
+    ERR_error_string_n(ERR_get_error(), openssl_error, sizeof(openssl_error));
+    ninerr_set_err(ninerr_new("Could not generate RSA keypair. (%s)", openssl_error));
+  }
+  BN_free(exponent);
+  RSA_free(key->rsa);
+  free(key);
+  return NULL;
+}
+END_IGNORE()
+
+struct server_key *server_key_acquire(void)
+{
+  pthread_mutex_lock(&key_lock);
+  struct server_key *key = current_key;
+  psnip_atomic_int32_add(&(key->refcount), 1);
+  pthread_mutex_unlock(&key_lock);
+  return key;
+}
+
+void server_key_release(struct server_key *key)
+{
+  if(key != NULL && psnip_atomic_int32_sub(&(key->refcount), 1) == 0) free_key(key);
+}
+
+static void *rotation_thread_main(void *arg)
+{
+  pthread_mutex_lock(&rotation_lock);
+  while(!rotation_stop)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += rotation_interval_setting;
+    while(!rotation_stop && pthread_cond_timedwait(&rotation_cond, &rotation_lock, &deadline) != ETIMEDOUT);
+    if(rotation_stop) break;
+
+    // Generating takes a while, logins carry on with the old key in the meantime.
+    pthread_mutex_unlock(&rotation_lock);
+    struct server_key *key = generate_key();
+    if(key == NULL)
+    {
+      nlog_error("Could not rotate the server key, keeping the old one. (%s)", ninerr->message);
+    }
+    else
+    {
+      pthread_mutex_lock(&key_lock);
+      struct server_key *old_key = current_key;
+      current_key = key;
+      pthread_mutex_unlock(&key_lock);
+      server_key_release(old_key); // Logins which received the old key still hold a reference to it.
+      nlog_info("Rotated the server key.");
+    }
+    pthread_mutex_lock(&rotation_lock);
+  }
+  pthread_mutex_unlock(&rotation_lock);
+  return NULL;
+}
+
+bool server_key_init(unsigned int rotation_interval)
+{
+  nlog_info("Generating server key..");
+  current_key = generate_key();
+  if(current_key == NULL) return false;
+
+  rotation_interval_setting = rotation_interval;
+  if(rotation_interval == 0) return true;
+
+  pthread_condattr_t condattr;
+  if(pthread_condattr_init(&condattr) != 0 ||
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC) != 0 ||
+    pthread_cond_init(&rotation_cond, &condattr) != 0)
+  {
+    ninerr_set_err(ninerr_new("Could not initialize condition variable for server key rotation."));
+    server_key_cleanup();
+    return false;
+  }
+  pthread_condattr_destroy(&condattr);
+
+  rotation_stop = false;
+  int result = pthread_create(&rotation_thread, NULL, rotation_thread_main, NULL);
+  if(result != 0)
+  {
+    ninerr_set_err(ninerr_new("Could not start server key rotation thread. (%s)", strerror(result)));
+    pthread_cond_destroy(&rotation_cond);
+    server_key_cleanup();
+    return false;
+  }
+  rotation_thread_started = true;
+  return true;
+}
+
+void server_key_cleanup(void)
+{
+  if(rotation_thread_started)
+  {
+    pthread_mutex_lock(&rotation_lock);
+    rotation_stop = true;
+    pthread_cond_signal(&rotation_cond);
+    pthread_mutex_unlock(&rotation_lock);
+    pthread_join(rotation_thread, NULL);
+    pthread_cond_destroy(&rotation_cond);
+    rotation_thread_started = false;
+  }
+
+  pthread_mutex_lock(&key_lock);
+  struct server_key *key = current_key;
+  current_key = NULL;
+  pthread_mutex_unlock(&key_lock);
+  server_key_release(key);
+}
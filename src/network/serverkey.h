@@ -0,0 +1,54 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_SERVERKEY_H
+#define STRONK_SERVERKEY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <openssl/rsa.h>
+
+#include <psnip/atomic/atomic.h>
+
+// The RSA keypair used for the encryption handshake, shared by all logins.
+// It is generated once at startup, and optionally replaced every rotation interval by a background thread.
+// A login holds on to the key it sent out until the encryption response arrives, so rotation never breaks a login in progress.
+
+#define SERVER_KEY_BITS 1024 // What the vanilla server uses, clients expect it.
+
+struct server_key
+{
+  RSA *rsa;
+  unsigned char *public_key; // DER encoded, as sent in the encryption request and hashed into the server id.
+  int32_t public_key_length;
+  psnip_atomic_int32 refcount;
+};
+
+bool server_key_init      (unsigned int rotation_interval); // In seconds, 0 disables rotation.
+void server_key_cleanup   (void);
+
+// Returns the current key with a reference taken, never NULL after server_key_init() succeeded. May be called from any thread.
+struct server_key *server_key_acquire (void);
+void server_key_release   (struct server_key *key);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include <psnip/atomic/atomic.h>
+
+#include <ninerr/ninerr.h>
+
+#include <mcpr/mcpr.h>
+#include <mcpr/packet.h>
+#include <network/network.h>
+#include <network/statusresponse.h>
+
+static pthread_mutex_t status_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct status_response *current_response = NULL; // Guarded by status_lock, NULL until the next ping if it has to be encoded again.
+static char *motd = NULL; // Guarded by status_lock.
+static char *favicon = NULL; // Guarded by status_lock, NULL if there is none.
+
+void status_response_release(struct status_response *response)
+{
+  if(response != NULL && psnip_atomic_int32_sub(&(response->refcount), 1) == 0) free(response);
+}
+
+// Called with status_lock held.
+static struct status_response *encode_response(int32_t online_players, int32_t max_players)
+{
+  struct mcpr_packet pkt;
+  pkt.id = MCPR_PKT_ST_CB_RESPONSE;
+  pkt.state = MCPR_STATE_STATUS;
+  #define pkt_ (pkt.data.status.clientbound.response)
+  pkt_.version_name = MCPR_MINECRAFT_VERSION;
+  pkt_.protocol_version = MCPR_PROTOCOL_VERSION;
+  pkt_.max_players = (unsigned int) max_players;
+  pkt_.online_players = (unsigned int) online_players;
+  pkt_.online_players_size = 0;
+  pkt_.player_sample = NULL;
+  pkt_.description = motd;
+  pkt_.favicon = favicon;
+  #undef pkt_
+
+  size_t bounds = mcpr_encode_packet_bounds(&pkt);
+  if(bounds == 0) return NULL;
+  struct status_response *response = malloc(sizeof(struct status_response) + bounds);
+  if(response == NULL) { ninerr_set_err(ninerr_from_errno()); return NULL; }
+  response->size = mcpr_encode_packet(response->data, &pkt);
+  if(response->size == 0)
+  {
+    free(response);
+    if(ninerr == NULL) ninerr_set_err(ninerr_new("Could not encode status response."));
+    return NULL;
+  }
+  response->online_players = online_players;
+  response->max_players = max_players;
+  psnip_atomic_int32_store(&(response->refcount), 1); // The reference of current_response.
+  return response;
+}
+
+// Called with status_lock held.
+static void invalidate(void)
+{
+  status_response_release(current_response);
+  current_response = NULL;
+}
+
+struct status_response *status_response_acquire(void)
+{
+  int32_t online_players = (int32_t) net_get_online_players();
+  int32_t max_players = (int32_t) net_get_max_players();
+
+  pthread_mutex_lock(&status_lock);
+  if(current_response == NULL || current_response->online_players != online_players || current_response->max_players != max_players)
+  {
+    struct status_response *response = encode_response(online_players, max_players);
+    if(response == NULL) { pthread_mutex_unlock(&status_lock); return NULL; }
+    invalidate();
+    current_response = response;
+  }
+  struct status_response *response = current_response;
+  psnip_atomic_int32_add(&(response->refcount), 1);
+  pthread_mutex_unlock(&status_lock);
+  return response;
+}
+
+// Replaces *field with a copy of value, value may be NULL.
+static bool set_string(char **field, const char *value)
+{
+  char *copy = NULL;
+  if(value != NULL)
+  {
+    copy = strdup(value);
+    if(copy == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+  }
+
+  pthread_mutex_lock(&status_lock);
+  free(*field);
+  *field = copy;
+  invalidate();
+  pthread_mutex_unlock(&status_lock);
+  return true;
+}
+
+bool status_response_set_motd(const char *new_motd)
+{
+  return set_string(&motd, new_motd);
+}
+
+bool status_response_set_favicon(const char *new_favicon)
+{
+  return set_string(&favicon, new_favicon);
+}
+
+bool status_response_init(const char *initial_motd)
+{
+  return status_response_set_motd(initial_motd);
+}
+
+void status_response_cleanup(void)
+{
+  pthread_mutex_lock(&status_lock);
+  invalidate(); // Clients which are still being sent it hold their own reference.
+  free(motd);
+  motd = NULL;
+  free(favicon);
+  favicon = NULL;
+  pthread_mutex_unlock(&status_lock);
+}
@@ -0,0 +1,56 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_STATUSRESPONSE_H
+#define STRONK_STATUSRESPONSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <psnip/atomic/atomic.h>
+
+// The server list status response, encoded once and sent as is to every client which pings.
+// It is only encoded again once something it shows has changed: the MOTD, the favicon, or the player counts.
+// A client being sent the old response holds on to it, so replacing it never pulls the data from under a write.
+
+struct status_response
+{
+  int32_t online_players; // The counts it was encoded with.
+  int32_t max_players;
+  psnip_atomic_int32 refcount;
+  size_t size;
+  unsigned char data[]; // Packet id and payload, as taken by mcpr_connection_write_encoded_packet().
+};
+
+bool status_response_init    (const char *motd); // MOTD as chat JSON.
+void status_response_cleanup (void);
+
+// These may be called from any thread, the next ping gets the new response.
+bool status_response_set_motd   (const char *motd);    // Chat JSON.
+bool status_response_set_favicon(const char *favicon); // A data URI of a 64x64 PNG, "data:image/png;base64,...", or NULL for none.
+
+// Returns the current response with a reference taken, or NULL upon error, in which case ninerr will be set. May be called from any thread.
+struct status_response *status_response_acquire(void);
+void status_response_release(struct status_response *response);
+
+#endif
@@ -0,0 +1,393 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <ninerr/ninerr.h>
+
+#include "scheduler/scheduler.h"
+
+#define DEQUE_CAPACITY 4096 // Per worker, tasks spawned whilst the deque is full are executed right away.
+#define IDLE_SPINS 64 // Amount of failed attempts at finding work before an idle worker goes to sleep.
+#define RANGE_MAX_SPLITS 64
+
+// Chase-Lev deque. The owner pushes and pops at the bottom, thieves steal from the top.
+struct deque
+{
+  psnip_atomic_int64 top;
+  psnip_atomic_int64 bottom;
+  psnip_atomic_int64 tasks[DEQUE_CAPACITY]; // struct sched_task pointers.
+};
+
+struct worker
+{
+  unsigned int index;
+  pthread_t thread;
+  struct deque deque;
+  struct sched_task *current; // The task which is running on this worker, NULL if none.
+  unsigned int next_victim;
+};
+
+struct range_task
+{
+  struct sched_task task;
+  size_t begin;
+  size_t end;
+  size_t grain;
+  sched_range_func func;
+  void *arg;
+};
+
+static struct worker *workers = NULL;
+static unsigned int worker_count = 0;
+static psnip_atomic_int32 running;
+static psnip_atomic_int32 sleepers;
+static psnip_atomic_int32 waiters; // Sleepers which are waiting for a task to complete, counted in sleepers as well.
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+static thread_local struct worker *current_worker = NULL;
+
+static bool deque_push(struct deque *deque, struct sched_task *task)
+{
+  int64_t bottom = psnip_atomic_int64_load(&(deque->bottom));
+  int64_t top = psnip_atomic_int64_load(&(deque->top));
+  if(bottom - top >= DEQUE_CAPACITY) return false;
+  psnip_atomic_int64_store(&(deque->tasks[bottom & (DEQUE_CAPACITY - 1)]), (int64_t) (intptr_t) task);
+  psnip_atomic_int64_store(&(deque->bottom), bottom + 1);
+  return true;
+}
+
+static struct sched_task *deque_pop(struct deque *deque)
+{
+  int64_t bottom = psnip_atomic_int64_load(&(deque->bottom)) - 1;
+  psnip_atomic_int64_store(&(deque->bottom), bottom);
+  int64_t top = psnip_atomic_int64_load(&(deque->top));
+  if(top > bottom)
+  {
+    psnip_atomic_int64_store(&(deque->bottom), bottom + 1);
+    return NULL;
+  }
+
+  struct sched_task *task = (struct sched_task *) (intptr_t) psnip_atomic_int64_load(&(deque->tasks[bottom & (DEQUE_CAPACITY - 1)]));
+  if(top == bottom)
+  {
+    // Last task, race the thieves for it.
+    psnip_int64_t expected = top;
+    if(!psnip_atomic_int64_compare_exchange(&(deque->top), &expected, top + 1)) task = NULL;
+    psnip_atomic_int64_store(&(deque->bottom), bottom + 1);
+  }
+  return task;
+}
+
+static struct sched_task *deque_steal(struct deque *deque)
+{
+  int64_t top = psnip_atomic_int64_load(&(deque->top));
+  int64_t bottom = psnip_atomic_int64_load(&(deque->bottom));
+  if(top >= bottom) return NULL;
+
+  struct sched_task *task = (struct sched_task *) (intptr_t) psnip_atomic_int64_load(&(deque->tasks[top & (DEQUE_CAPACITY - 1)]));
+  psnip_int64_t expected = top;
+  if(!psnip_atomic_int64_compare_exchange(&(deque->top), &expected, top + 1)) return NULL; // Lost the race, the caller just tries again later.
+  return task;
+}
+
+static bool work_available(void)
+{
+  for(unsigned int i = 0; i < worker_count; i++)
+  {
+    struct deque *deque = &(workers[i].deque);
+    if(psnip_atomic_int64_load(&(deque->top)) < psnip_atomic_int64_load(&(deque->bottom))) return true;
+  }
+  return false;
+}
+
+static struct sched_task *find_task(struct worker *worker)
+{
+  struct sched_task *task = deque_pop(&(worker->deque));
+  if(task != NULL) return task;
+
+  for(unsigned int i = 1; i < worker_count; i++)
+  {
+    worker->next_victim = (worker->next_victim + 1) % worker_count;
+    if(worker->next_victim == worker->index) continue;
+    task = deque_steal(&(workers[worker->next_victim].deque));
+    if(task != NULL) return task;
+  }
+  return NULL;
+}
+
+static void wake_sleepers(void)
+{
+  if(psnip_atomic_int32_load(&sleepers) == 0) return;
+  pthread_mutex_lock(&sleep_lock);
+  pthread_cond_signal(&sleep_cond);
+  pthread_mutex_unlock(&sleep_lock);
+}
+
+static void wake_waiters(void)
+{
+  if(psnip_atomic_int32_load(&waiters) == 0) return;
+  pthread_mutex_lock(&sleep_lock);
+  pthread_cond_broadcast(&sleep_cond);
+  pthread_mutex_unlock(&sleep_lock);
+}
+
+// Marks one reference to task as done, completing its ancestors as well if this was the last thing they were waiting for.
+static void complete(struct sched_task *task)
+{
+  while(task != NULL)
+  {
+    struct sched_task *parent = task->parent; // task may be gone as soon as its pending count drops to zero.
+    int32_t pending = psnip_atomic_int32_sub(&(task->pending), 1);
+    if(pending <= 1) wake_waiters(); // help_until() waits for either 1 or 0.
+    if(pending != 0) return;
+    task = parent;
+  }
+}
+
+static void run_task(struct worker *worker, struct sched_task *task)
+{
+  struct sched_task *previous = worker->current;
+  worker->current = task;
+  task->func(task->arg);
+  worker->current = previous;
+  complete(task);
+}
+
+static void *worker_run(void *arg)
+{
+  struct worker *worker = arg;
+  current_worker = worker;
+
+  unsigned int idle = 0;
+  while(psnip_atomic_int32_load(&running))
+  {
+    struct sched_task *task = find_task(worker);
+    if(task != NULL)
+    {
+      run_task(worker, task);
+      idle = 0;
+      continue;
+    }
+
+    if(++idle < IDLE_SPINS) { sched_yield(); continue; }
+
+    // Whoever pushes a task checks for sleepers after publishing it, and sleepers check for work after announcing themselves,
+    // so at least one of both notices the other. That rules out lost wake-ups, so sleeping needs no timeout.
+    pthread_mutex_lock(&sleep_lock);
+    psnip_atomic_int32_add(&sleepers, 1);
+    if(psnip_atomic_int32_load(&running) && !work_available())
+    {
+      pthread_cond_wait(&sleep_cond, &sleep_lock);
+    }
+    psnip_atomic_int32_sub(&sleepers, 1);
+    pthread_mutex_unlock(&sleep_lock);
+    idle = 0;
+  }
+  return NULL;
+}
+
+bool scheduler_init(unsigned int count)
+{
+  if(count == 0) count = 1;
+  workers = malloc(count * sizeof(struct worker));
+  if(workers == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+
+  for(unsigned int i = 0; i < count; i++)
+  {
+    workers[i].index = i;
+    workers[i].current = NULL;
+    workers[i].next_victim = i;
+    psnip_atomic_int64_store(&(workers[i].deque.top), 0);
+    psnip_atomic_int64_store(&(workers[i].deque.bottom), 0);
+  }
+  worker_count = count;
+  psnip_atomic_int32_store(&running, 1);
+  psnip_atomic_int32_store(&sleepers, 0);
+  psnip_atomic_int32_store(&waiters, 0);
+  current_worker = &(workers[0]);
+
+  for(unsigned int i = 1; i < count; i++)
+  {
+    int result = pthread_create(&(workers[i].thread), NULL, worker_run, &(workers[i]));
+    if(result != 0)
+    {
+      ninerr_set_err(ninerr_new("Could not create worker thread. (%s)", strerror(result)));
+      worker_count = i; // Only join the threads which were actually started.
+      scheduler_cleanup();
+      return false;
+    }
+  }
+  return true;
+}
+
+void scheduler_cleanup(void)
+{
+  if(workers == NULL) return;
+  psnip_atomic_int32_store(&running, 0);
+  pthread_mutex_lock(&sleep_lock);
+  pthread_cond_broadcast(&sleep_cond);
+  pthread_mutex_unlock(&sleep_lock);
+
+  for(unsigned int i = 1; i < worker_count; i++) pthread_join(workers[i].thread, NULL);
+  free(workers);
+  workers = NULL;
+  worker_count = 0;
+  current_worker = NULL;
+}
+
+unsigned int scheduler_get_worker_count(void)
+{
+  return worker_count;
+}
+
+void sched_task_init(struct sched_task *task, sched_func func, void *arg)
+{
+  task->func = func;
+  task->arg = arg;
+  task->parent = NULL;
+  psnip_atomic_int32_store(&(task->pending), 1);
+}
+
+// Executes other tasks until task's pending count drops to target.
+static void help_until(struct worker *worker, struct sched_task *task, int32_t target)
+{
+  unsigned int idle = 0;
+  while(psnip_atomic_int32_load(&(task->pending)) > target)
+  {
+    struct sched_task *other = find_task(worker);
+    if(other != NULL)
+    {
+      run_task(worker, other);
+      idle = 0;
+      continue;
+    }
+
+    if(++idle < IDLE_SPINS) { sched_yield(); continue; }
+
+    // What's left has been stolen and may take a while, so sleep like an idle worker does.
+    // The same handshake applies, with complete() checking for waiters after lowering the pending count.
+    pthread_mutex_lock(&sleep_lock);
+    psnip_atomic_int32_add(&sleepers, 1);
+    psnip_atomic_int32_add(&waiters, 1);
+    if(psnip_atomic_int32_load(&(task->pending)) > target && !work_available())
+    {
+      pthread_cond_wait(&sleep_cond, &sleep_lock);
+    }
+    psnip_atomic_int32_sub(&waiters, 1);
+    psnip_atomic_int32_sub(&sleepers, 1);
+    pthread_mutex_unlock(&sleep_lock);
+    idle = 0;
+  }
+}
+
+void sched_run(struct sched_task *root)
+{
+  struct worker *worker = current_worker;
+  root->parent = NULL;
+  psnip_atomic_int32_store(&(root->pending), 1);
+  run_task(worker, root);
+  help_until(worker, root, 0);
+}
+
+void sched_spawn(struct sched_task *child)
+{
+  struct worker *worker = current_worker;
+  struct sched_task *parent = worker->current;
+  child->parent = parent;
+  psnip_atomic_int32_store(&(child->pending), 1);
+  psnip_atomic_int32_add(&(parent->pending), 1);
+
+  if(!deque_push(&(worker->deque), child))
+  {
+    run_task(worker, child);
+    return;
+  }
+  wake_sleepers();
+}
+
+void sched_wait(void)
+{
+  struct worker *worker = current_worker;
+  help_until(worker, worker->current, 1); // Only the reference of the task itself left.
+}
+
+static void run_range(void *arg)
+{
+  struct range_task *range = arg;
+  struct range_task children[RANGE_MAX_SPLITS];
+  size_t split_count = 0;
+
+  // Keep halving the range, handing the upper halves to whoever wants them.
+  size_t begin = range->begin;
+  size_t end = range->end;
+  while(end - begin > range->grain && split_count < RANGE_MAX_SPLITS)
+  {
+    size_t middle = begin + (end - begin) / 2;
+    struct range_task *child = &(children[split_count++]);
+    child->begin = middle;
+    child->end = end;
+    child->grain = range->grain;
+    child->func = range->func;
+    child->arg = range->arg;
+    sched_task_init(&(child->task), run_range, child);
+    sched_spawn(&(child->task));
+    end = middle;
+  }
+
+  range->func(begin, end, range->arg);
+  sched_wait();
+}
+
+void sched_parallel_for(size_t count, size_t grain, sched_range_func func, void *arg)
+{
+  if(count == 0) return;
+  if(grain == 0) grain = 1;
+
+  struct range_task range;
+  range.begin = 0;
+  range.end = count;
+  range.grain = grain;
+  range.func = func;
+  range.arg = arg;
+  sched_task_init(&(range.task), run_range, &range);
+
+  struct worker *worker = current_worker;
+  if(worker->current == NULL)
+  {
+    sched_run(&(range.task));
+  }
+  else
+  {
+    // Run it as a child of the current task, but right here, run_range() only returns once everything it spawned is done.
+    range.task.parent = worker->current;
+    psnip_atomic_int32_add(&(worker->current->pending), 1);
+    run_task(worker, &(range.task));
+  }
+}
@@ -0,0 +1,75 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_SCHEDULER_H
+#define STRONK_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <psnip/atomic/atomic.h>
+
+/*
+  Work-stealing task scheduler.
+
+  Every worker has its own deque of tasks. A worker pushes and pops tasks at the bottom of its own deque,
+  idle workers steal from the top of the deques of others, so work spreads over all cores without a shared queue.
+  The thread which calls scheduler_init() (the main thread, which runs the tick) is worker 0,
+  it only executes tasks from within sched_run() and sched_wait().
+
+  Tasks form a tree. A task spawned from within another task is a child of that task, a task is only complete
+  once its function has returned and all of its children are complete. Task structs are owned by the caller,
+  and have to stay valid until the task is complete, which is easiest to guarantee by calling sched_wait()
+  before the frame holding the children goes out of scope.
+*/
+
+typedef void (*sched_func)(void *arg);
+typedef void (*sched_range_func)(size_t begin, size_t end, void *arg);
+
+struct sched_task
+{
+  sched_func func;
+  void *arg;
+  struct sched_task *parent; // NULL for a root task.
+  psnip_atomic_int32 pending; // 1 for the task itself plus 1 for every child which isn't complete yet.
+};
+
+bool scheduler_init                       (unsigned int worker_count); // worker_count includes the calling thread.
+void scheduler_cleanup                    (void);
+unsigned int scheduler_get_worker_count   (void);
+
+void sched_task_init                      (struct sched_task *task, sched_func func, void *arg);
+
+// Runs root and everything it spawns, returns once root is complete. May only be called from outside a task, by worker 0.
+void sched_run                            (struct sched_task *root);
+
+// Spawns a child of the task which is currently running on this worker. May only be called from within a task.
+void sched_spawn                          (struct sched_task *child);
+
+// Waits for all children of the task which is currently running on this worker, executing other tasks in the meantime.
+void sched_wait                           (void);
+
+// Calls func for consecutive ranges of [0, count) in parallel, with ranges of at most grain elements. Returns once all are done.
+// May be called from within a task as well as from outside a task by worker 0.
+void sched_parallel_for                   (size_t count, size_t grain, sched_range_func func, void *arg);
+
+#endif
@@ -47,6 +47,8 @@
 
 #include <jansson/jansson.h>
 
+#include <psnip/atomic/atomic.h>
+
 #include <openssl/ssl.h>
 #include <openssl/opensslv.h>
 
@@ -64,6 +66,8 @@
 #include <logging/logging.h>
 #include <network/network.h>
 #include <world/world.h>
+#include <scheduler/scheduler.h>
+#include <tickstats/tickstats.h>
 
 #include "server.h"
 #include "stronk.h"
@@ -92,15 +96,9 @@
   }
 #endif
 
-// Why the hell isn't this nanosleep defined anyway in Ubuntu/WSL?
-// Oh well this hack works for now, even though it's terrible. TODO find out!
-#if !defined(__USE_POSIX199309) && defined(NANOSLEEP_HACKY_FIX)
-  extern int nanosleep (const struct timespec *__requested_time, struct timespec *__remaining);
-#endif
-
 // Function prototypes.
-static void init_thread_pooling(void);
-static void cleanup_thread_pooling(void);
+static void start_scheduler(void);
+static void stop_scheduler(void);
 static void cleanup(void);
 static void *secure_malloc(size_t size);
 static void secure_free(void *ptr);
@@ -112,17 +110,14 @@ static void init(void);
 static const long tick_duration_ns = 50000000; // Delay in nanoseconds, equivalent to 50 milliseconds
 static bool world_manager_init_done = false;
 static bool logging_init_done = false;
-static bool thread_pooling_init_done = false;
+static bool scheduler_init_done = false;
 static bool networking_init_done = false;
 static bool curl_init_done = false;
+static bool mapi_init_done = false;
+static bool mapi_async_init_done = false;
 static bool openssl_init_done = false;
 
-static bool internal_clock_init_done = false;
-pthread_rwlock_t internal_clock_lock;
-static struct timespec internal_clock; // Every time the clock ticks 50ms is added
-
-unsigned int main_threadpool_threadcount;
-threadpool main_threadpool;
+static psnip_atomic_int64 internal_clock; // Monotonic time in nanoseconds, sampled once at the start of every tick.
 
 unsigned int async_threadpool_threadcount;
 threadpool async_threadpool;
@@ -219,9 +214,9 @@ void server_crash(void)
   server_shutdown(EXIT_FAILURE);
 }
 
-static void init_thread_pooling(void)
+static void start_scheduler(void)
 {
-  nlog_info("Setting up thread pools..");
+  nlog_info("Setting up scheduler..");
 
   int cpu_core_count = count_cores(); // Set up thread pool.
   if(cpu_core_count <= 0)
@@ -233,34 +228,34 @@ static void init_thread_pooling(void)
   {
     nlog_info("Detected %i CPU cores", cpu_core_count);
   }
-  int planned_thread_count = cpu_core_count;
-  nlog_info("Creating thread pool with %i threads..", planned_thread_count);
-  main_threadpool = thpool_init(planned_thread_count);
+  int planned_worker_count = cpu_core_count;
+  nlog_info("Starting scheduler with %i workers..", planned_worker_count); // The main thread is one of them.
 
-  if(main_threadpool == NULL)
+  if(!scheduler_init(planned_worker_count))
   {
-    nlog_fatal("Failed to create thread pool. (%s)?", strerror(errno));
+    nlog_fatal("Failed to start scheduler. (%s)", ninerr->message);
     cleanup();
     exit(EXIT_FAILURE);
   }
-  main_threadpool_threadcount = planned_thread_count;
 
-  thread_pooling_init_done = true;
+  scheduler_init_done = true;
 }
 
-void cleanup_thread_pooling(void)
+void stop_scheduler(void)
 {
-  nlog_info("Destroying thread pool..");
-  thpool_destroy(main_threadpool);
+  nlog_info("Stopping scheduler..");
+  scheduler_cleanup();
 }
 
 void cleanup(void)
 {
   if(networking_init_done) net_cleanup();
-  if(thread_pooling_init_done) cleanup_thread_pooling();
+  if(scheduler_init_done) stop_scheduler();
   if(world_manager_init_done) world_manager_cleanup();
 
-  if(internal_clock_init_done) pthread_rwlock_destroy(&internal_clock_lock);
+  if(mapi_async_init_done) mapi_async_cleanup();
+  mapi_cache_clear();
+  if(mapi_init_done) mapi_cleanup();
   if(curl_init_done) { nlog_info("Cleaning up CURL.."); curl_global_cleanup(); }
   if(openssl_init_done) { nlog_info("Cleaning up OpenSSL.."); EVP_cleanup(); } // make sure to do this after CURL cleanup.
 
@@ -295,16 +290,38 @@ static void init(void)
   }
   curl_init_done = true;
 
-  nlog_info("Initializing some synchronization locks..");
-  if(pthread_rwlock_init(&internal_clock_lock, NULL) != 0)
+  if(!mapi_init())
+  {
+    nlog_fatal("Could not initialize Mojang API requests. (%s)", ninerr->message);
+    exit(EXIT_FAILURE);
+  }
+  mapi_init_done = true;
+
+  if(!mapi_async_init())
+  {
+    nlog_fatal("Could not initialize asynchronous Mojang API requests. (%s)", ninerr->message);
+    exit(EXIT_FAILURE);
+  }
+  mapi_async_init_done = true;
+
+  // Mostly useful for pointing the server at a stand-in for testing.
+  const char *session_server = getenv("STRONK_SESSION_SERVER");
+  if(session_server != NULL)
   {
-    nlog_fatal("Could not initialize internal clock lock.");
+    nlog_info("Using session server at %s", session_server);
+    if(!mapi_set_session_server(session_server)) { nlog_fatal("Could not set session server. (%s)", ninerr->message); exit(EXIT_FAILURE); }
+  }
+
+  struct timespec now;
+  if(clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+  {
+    nlog_fatal("Could not read the monotonic clock. (%s)", strerror(errno));
     cleanup();
     exit(EXIT_FAILURE);
   }
-  internal_clock_init_done = true;
+  psnip_atomic_int64_store(&internal_clock, (int64_t) now.tv_sec * 1000000000 + now.tv_nsec);
 
-  init_thread_pooling();
+  start_scheduler();
   if(net_init() < 0)        { exit(EXIT_FAILURE); } networking_init_done = true;
   if(world_manager_init() < 0)  { exit(EXIT_FAILURE); } world_manager_init_done = true;
 
@@ -321,66 +338,46 @@ void server_start(void)
    // Main thread loop.
    while(true)
    {
-     struct timespec start; // TODO C11 timespec_get() isn't implemented anywhere but in glibc.
-     if(!timespec_get(&start, TIME_UTC))
+     struct timespec start;
+     if(clock_gettime(CLOCK_MONOTONIC, &start) == -1)
      {
-       nlog_error("Could not get current time in main game loop!");
+       nlog_error("Could not get current time in main game loop! (%s)", strerror(errno));
        server_crash();
      }
+     psnip_atomic_int64_store(&internal_clock, (int64_t) start.tv_sec * 1000000000 + start.tv_nsec);
 
 
      // Execute main game loop logic.
+     tickstats_tick_begin();
      server_tick();
+     tickstats_tick_end();
 
 
 
+     // Sleeping until an absolute deadline, so that time spent in the tick doesn't have to be subtracted,
+     // and a deadline which has already passed just returns right away.
      struct timespec should_stop_at;
      timespec_addraw(&should_stop_at, &start, 0, tick_duration_ns);
 
-     struct timespec stop;
-     if(!timespec_get(&stop, TIME_UTC))
+     int result;
+     while((result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &should_stop_at, NULL)) == EINTR);
+     if(result != 0)
      {
-       nlog_error("Could not get current time in main game loop!");
-       server_crash();
-     }
-
-     if(timespec_cmp(&should_stop_at, &stop) > 0)
-     {
-       struct timespec diff;
-       timespec_diff(&diff, &stop, &should_stop_at);
-       //nlog_debug("Sleeping for %lld.%.9ld", (long long) diff.tv_sec, diff.tv_nsec);
-       if(nanosleep(&diff, NULL) == -1)
-       {
-         nlog_error("Sleeping in main game loop failed. (%s)", strerror(errno));
-       }
+       nlog_error("Sleeping in main game loop failed. (%s)", strerror(result));
      }
    }
 }
 
 static void server_tick(void)
 {
-  //nlog_debug("Current internal clock: %lu : %lu", internal_clock.tv_sec, internal_clock.tv_nsec);
   net_tick();
-
-
-  // Do this last.
-  struct timespec addend;
-  addend.tv_sec = 0;
-  addend.tv_nsec = tick_duration_ns;
-  timespec_add(&internal_clock, &internal_clock, &addend);
 }
 
 void server_get_internal_clock_time(struct timespec *out)
 {
-  int result;
-  again:
-  result = pthread_rwlock_rdlock(&internal_clock_lock);
-  if(result != 0) { nlog_debug("Could not lock internal clock lock! Retrying.."); goto again; }
-
-  out->tv_sec = internal_clock.tv_sec;
-  out->tv_nsec = internal_clock.tv_nsec;
-
-  pthread_rwlock_unlock(&internal_clock_lock);
+  int64_t now = psnip_atomic_int64_load(&internal_clock);
+  out->tv_sec = now / 1000000000;
+  out->tv_nsec = now % 1000000000;
 }
 
 
@@ -38,6 +38,7 @@ void server_get_players(struct player ***out_players, size_t *out_players_count)
 pthread_rwlock_t *server_get_players_lock(void);
 
 
+// Monotonic, the same for the whole duration of a tick. Doesn't lock, so it may be called from any thread.
 void server_get_internal_clock_time(struct timespec *out);
 
 #endif
@@ -29,9 +29,6 @@
 
 #include <logging/logging.h>
 
-extern unsigned int main_threadpool_threadcount;
-extern threadpool main_threadpool;
-
 extern unsigned int async_threadpool_threadcount;
 extern threadpool async_threadpool;
 
@@ -0,0 +1,279 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <mcpr/mcpr.h>
+#include <mcpr/packet.h>
+#include <logging/logging.h>
+
+#include "tickstats/tickstats.h"
+
+#define TICK_DURATION_NS 50000000
+#define BUCKET_WIDTH_US 100 // Histograms have a resolution of 0.1 ms..
+#define BUCKET_COUNT 1001 // ..up to 100 ms, the last bucket holds everything longer than that.
+#define REPORT_INTERVAL TICKSTATS_WINDOW // Ticks between two summaries in the debug log.
+#define OVERRUN_LOG_INTERVAL_NS 1000000000 // Overruns are logged at most once every second.
+#define OVERRUN_TOP_HANDLERS 3
+
+// Durations of the last TICKSTATS_WINDOW ticks, both as a ring buffer and as a histogram.
+struct series
+{
+  uint32_t samples[TICKSTATS_WINDOW]; // In microseconds.
+  uint32_t buckets[BUCKET_COUNT];
+  uint64_t sum_us;
+};
+
+static struct series ticks;
+static struct series phases[TICK_PHASE_COUNT];
+static uint64_t tick_starts[TICKSTATS_WINDOW];
+static size_t window_next = 0;
+static size_t window_count = 0;
+static unsigned long ticks_since_report = 0;
+
+// The tick which is currently running.
+static uint64_t tick_start;
+static uint64_t phase_ns[TICK_PHASE_COUNT];
+static uint64_t handler_ns[MCPR_PACKET_TYPE_COUNT];
+static uint32_t handler_count[MCPR_PACKET_TYPE_COUNT];
+static enum mcpr_state handler_state[MCPR_PACKET_TYPE_COUNT];
+static enum mcpr_packet_type handlers_used[MCPR_PACKET_TYPE_COUNT]; // So that only these have to be reset.
+static size_t handlers_used_count = 0;
+
+static uint64_t last_overrun_log = 0;
+static unsigned long overruns_not_logged = 0;
+
+static const char *phase_names[TICK_PHASE_COUNT] =
+{
+  [TICK_PHASE_ACCEPT] = "accept",
+  [TICK_PHASE_SERVE] = "serve",
+  [TICK_PHASE_HANDLERS] = "handlers",
+  [TICK_PHASE_SESSION] = "session",
+  [TICK_PHASE_CHUNKS] = "chunks",
+  [TICK_PHASE_HOUSEKEEPING] = "housekeeping",
+};
+
+const char *tickstats_phase_name(enum tick_phase phase)
+{
+  return phase_names[phase];
+}
+
+uint64_t tickstats_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static size_t bucket_of(uint32_t us)
+{
+  size_t bucket = us / BUCKET_WIDTH_US;
+  return (bucket < BUCKET_COUNT) ? bucket : BUCKET_COUNT - 1;
+}
+
+// Has to be called before window_next and window_count are advanced.
+static void series_push(struct series *series, uint64_t duration_ns)
+{
+  if(window_count == TICKSTATS_WINDOW)
+  {
+    uint32_t evicted = series->samples[window_next];
+    series->buckets[bucket_of(evicted)]--;
+    series->sum_us -= evicted;
+  }
+
+  uint64_t us64 = duration_ns / 1000;
+  uint32_t us = (us64 > UINT32_MAX) ? UINT32_MAX : (uint32_t) us64;
+  series->samples[window_next] = us;
+  series->buckets[bucket_of(us)]++;
+  series->sum_us += us;
+}
+
+static double series_max_ms(const struct series *series)
+{
+  uint32_t max = 0;
+  for(size_t i = 0; i < window_count; i++) if(series->samples[i] > max) max = series->samples[i];
+  return max / 1000.0;
+}
+
+static double series_percentile_ms(const struct series *series, double max_ms, unsigned int percent)
+{
+  size_t target = (window_count * percent + 99) / 100;
+  if(target == 0) return 0.0;
+
+  size_t seen = 0;
+  for(size_t i = 0; i < BUCKET_COUNT - 1; i++)
+  {
+    seen += series->buckets[i];
+    if(seen >= target)
+    {
+      double upper_ms = (i + 1) * BUCKET_WIDTH_US / 1000.0;
+      return (upper_ms < max_ms) ? upper_ms : max_ms;
+    }
+  }
+  return max_ms;
+}
+
+static void series_summarize(const struct series *series, struct tickstats_summary *out)
+{
+  out->mean_ms = (window_count == 0) ? 0.0 : (double) series->sum_us / window_count / 1000.0;
+  out->max_ms = series_max_ms(series);
+  out->p50_ms = series_percentile_ms(series, out->max_ms, 50);
+  out->p99_ms = series_percentile_ms(series, out->max_ms, 99);
+}
+
+void tickstats_get_summary(struct tickstats_summary *out)
+{
+  series_summarize(&ticks, out);
+}
+
+void tickstats_get_phase_summary(enum tick_phase phase, struct tickstats_summary *out)
+{
+  series_summarize(&(phases[phase]), out);
+}
+
+double tickstats_get_mspt(void)
+{
+  return (window_count == 0) ? 0.0 : (double) ticks.sum_us / window_count / 1000.0;
+}
+
+double tickstats_get_tps(void)
+{
+  if(window_count < 2) return 20.0;
+  size_t oldest = (window_count < TICKSTATS_WINDOW) ? 0 : window_next;
+  size_t newest = (window_next + TICKSTATS_WINDOW - 1) % TICKSTATS_WINDOW;
+  double tps = (window_count - 1) * 1000000000.0 / (double) (tick_starts[newest] - tick_starts[oldest]);
+  return (tps > 20.0) ? 20.0 : tps;
+}
+
+void tickstats_tick_begin(void)
+{
+  tick_start = tickstats_now();
+}
+
+uint64_t tickstats_record_phase(enum tick_phase phase, uint64_t since)
+{
+  uint64_t now = tickstats_now();
+  phase_ns[phase] += now - since;
+  return now;
+}
+
+void tickstats_record_handler(enum mcpr_packet_type type, enum mcpr_state state, uint64_t duration_ns)
+{
+  if(handler_count[type] == 0) handlers_used[handlers_used_count++] = type;
+  handler_ns[type] += duration_ns;
+  handler_count[type]++;
+  handler_state[type] = state;
+  phase_ns[TICK_PHASE_HANDLERS] += duration_ns;
+}
+
+static void log_overrun(uint64_t duration_ns)
+{
+  char message[1024];
+  size_t len = 0;
+  #define APPEND(...) do { int written = snprintf(message + len, sizeof(message) - len, __VA_ARGS__); \
+    if(written > 0) len = ((size_t) written < sizeof(message) - len) ? len + written : sizeof(message) - 1; } while(0)
+
+  APPEND("Tick took %.2f ms, which is %.2f ms longer than it should!", duration_ns / 1000000.0, (duration_ns - TICK_DURATION_NS) / 1000000.0);
+
+  uint64_t accounted_ns = 0;
+  for(int i = 0; i < TICK_PHASE_COUNT; i++)
+  {
+    if(i == TICK_PHASE_HANDLERS) continue; // Part of TICK_PHASE_SERVE.
+    APPEND(" %s %.2f ms", phase_names[i], phase_ns[i] / 1000000.0);
+    accounted_ns += phase_ns[i];
+
+    if(i == TICK_PHASE_SERVE && handlers_used_count > 0)
+    {
+      APPEND(" (handlers %.2f ms, slowest:", phase_ns[TICK_PHASE_HANDLERS] / 1000000.0);
+
+      // Selection of the slowest few, destroys the order of handlers_used but that is reset afterwards anyway.
+      size_t top = (handlers_used_count < OVERRUN_TOP_HANDLERS) ? handlers_used_count : OVERRUN_TOP_HANDLERS;
+      for(size_t j = 0; j < top; j++)
+      {
+        size_t slowest = j;
+        for(size_t k = j + 1; k < handlers_used_count; k++) if(handler_ns[handlers_used[k]] > handler_ns[handlers_used[slowest]]) slowest = k;
+        enum mcpr_packet_type type = handlers_used[slowest];
+        handlers_used[slowest] = handlers_used[j];
+        handlers_used[j] = type;
+        uint8_t id = 0;
+        mcpr_packet_type_to_byte(&id, type); // Always succeeds, these types come from decoded packets.
+
+        APPEND("%s %s 0x%02X %.2f ms for %lu packets", (j == 0) ? "" : ",", mcpr_state_to_string(handler_state[type]),
+          (unsigned int) id, handler_ns[type] / 1000000.0, (unsigned long) handler_count[type]);
+      }
+      APPEND(")");
+    }
+    APPEND(",");
+  }
+  APPEND(" unaccounted %.2f ms.", ((duration_ns > accounted_ns) ? duration_ns - accounted_ns : 0) / 1000000.0);
+  if(overruns_not_logged > 0) APPEND(" %lu more ticks ran over since the last report.", overruns_not_logged);
+  #undef APPEND
+
+  nlog_warn("%s", message);
+}
+
+void tickstats_tick_end(void)
+{
+  uint64_t now = tickstats_now();
+  uint64_t duration_ns = now - tick_start;
+
+  series_push(&ticks, duration_ns);
+  for(int i = 0; i < TICK_PHASE_COUNT; i++) series_push(&(phases[i]), phase_ns[i]);
+  tick_starts[window_next] = tick_start;
+  window_next = (window_next + 1) % TICKSTATS_WINDOW;
+  if(window_count < TICKSTATS_WINDOW) window_count++;
+
+  if(duration_ns > TICK_DURATION_NS)
+  {
+    if(now - last_overrun_log >= OVERRUN_LOG_INTERVAL_NS)
+    {
+      log_overrun(duration_ns);
+      last_overrun_log = now;
+      overruns_not_logged = 0;
+    }
+    else
+    {
+      overruns_not_logged++;
+    }
+  }
+
+  if(++ticks_since_report >= REPORT_INTERVAL)
+  {
+    struct tickstats_summary summary;
+    tickstats_get_summary(&summary);
+    nlog_debug("MSPT %.2f (p50 %.2f, p99 %.2f, max %.2f), TPS %.2f over the last %lu ticks.",
+      summary.mean_ms, summary.p50_ms, summary.p99_ms, summary.max_ms, tickstats_get_tps(), (unsigned long) window_count);
+    ticks_since_report = 0;
+  }
+
+  for(int i = 0; i < TICK_PHASE_COUNT; i++) phase_ns[i] = 0;
+  for(size_t i = 0; i < handlers_used_count; i++)
+  {
+    handler_ns[handlers_used[i]] = 0;
+    handler_count[handlers_used[i]] = 0;
+  }
+  handlers_used_count = 0;
+}
@@ -0,0 +1,82 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_TICKSTATS_H
+#define STRONK_TICKSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mcpr/mcpr.h>
+#include <mcpr/packet.h>
+
+/*
+  Tick time instrumentation.
+
+  The tick loop brackets every tick with tickstats_tick_begin() and tickstats_tick_end(), subsystems report how long
+  their part of the tick took in between. Durations of the last TICKSTATS_WINDOW ticks are kept, per phase and in total,
+  for rolling averages and percentiles. A tick which takes longer than its 50 ms is logged with a per-phase breakdown.
+
+  Everything in here may only be used from the tick thread.
+*/
+
+#define TICKSTATS_WINDOW 1200 // Ticks, one minute at 20 TPS.
+
+enum tick_phase
+{
+  TICK_PHASE_ACCEPT, // Adopting newly accepted connections.
+  TICK_PHASE_SERVE, // Draining the inbound packet queues, handlers included.
+  TICK_PHASE_HANDLERS, // Packet handlers only, part of TICK_PHASE_SERVE.
+  TICK_PHASE_SESSION, // Session server transfers and the logins they complete.
+  TICK_PHASE_CHUNKS, // Streaming queued chunks to players.
+  TICK_PHASE_HOUSEKEEPING, // Keep alives and timeouts.
+
+  TICK_PHASE_COUNT
+};
+
+struct tickstats_summary
+{
+  double mean_ms;
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+};
+
+uint64_t tickstats_now(void); // Monotonic, in nanoseconds.
+
+void tickstats_tick_begin(void);
+void tickstats_tick_end(void);
+
+// Adds the time elapsed since `since` to phase, returns the current time so that consecutive phases can be chained.
+uint64_t tickstats_record_phase(enum tick_phase phase, uint64_t since);
+
+// Adds duration_ns to the handler of type and to TICK_PHASE_HANDLERS.
+void tickstats_record_handler(enum mcpr_packet_type type, enum mcpr_state state, uint64_t duration_ns);
+
+double tickstats_get_mspt(void); // Average over the window.
+double tickstats_get_tps(void); // Average over the window, at most 20.
+void tickstats_get_summary(struct tickstats_summary *out); // For whole ticks.
+void tickstats_get_phase_summary(enum tick_phase phase, struct tickstats_summary *out);
+
+const char *tickstats_phase_name(enum tick_phase phase);
+
+#endif
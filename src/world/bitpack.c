@@ -0,0 +1,172 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#include <psnip/cpu/cpu.h>
+
+#include "world/bitpack.h"
+#include "../util.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  #define BITPACK_X86
+  #include <immintrin.h>
+#endif
+
+/*
+  The vector kernels work on groups of 64 values, which always pack into exactly bits words.
+  Pairs of 16-bit values are first merged into 32-bit lanes with a multiply-add (v0 + v1 * 2^bits),
+  pairs of those lanes are then merged into 64-bit units of 4 values each.
+  The 16 units of a group are finally stitched into words, which is the only serial part left.
+*/
+
+static void (*pack_impl)(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits);
+static pthread_once_t pack_impl_once = PTHREAD_ONCE_INIT;
+
+static void pack_scalar(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits)
+{
+  uint64_t current = 0;
+  unsigned int used = 0;
+  for(size_t i = 0; i < count; i++)
+  {
+    uint64_t value = values[i] & ((((uint64_t) 1) << bits) - 1);
+    current |= value << used;
+    used += bits;
+    if(used >= 64)
+    {
+      *(out++) = hton64(current);
+      used -= 64;
+      current = (used > 0) ? value >> (bits - used) : 0;
+    }
+  }
+}
+
+// Stitches 16 units of 4 * bits wide into bits words.
+static inline void stitch_units(uint64_t *out, const uint64_t *units, unsigned int bits)
+{
+  unsigned int unit_bits = bits * 4;
+  uint64_t current = 0;
+  unsigned int used = 0;
+  for(unsigned int i = 0; i < 16; i++)
+  {
+    current |= units[i] << used;
+    used += unit_bits;
+    if(used >= 64)
+    {
+      *(out++) = hton64(current);
+      used -= 64;
+      current = (used > 0) ? units[i] >> (unit_bits - used) : 0;
+    }
+  }
+}
+
+#ifdef BITPACK_X86
+__attribute__((target("sse2")))
+static void pack_sse2(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits)
+{
+  const __m128i mask = _mm_set1_epi16((short) ((1 << bits) - 1));
+  const __m128i multipliers = _mm_set1_epi32((int) ((((uint32_t) 1 << bits) << 16) | 1));
+  const __m128i low_mask = _mm_set1_epi64x(0xFFFFFFFF);
+  const __m128i pair_shift = _mm_cvtsi32_si128((int) (bits * 2));
+  uint64_t units[16] __attribute__((aligned(16)));
+
+  for(size_t group = 0; group < count; group += 64)
+  {
+    for(unsigned int i = 0; i < 8; i++)
+    {
+      __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (values + group + i * 8)), mask);
+      __m128i pairs = _mm_madd_epi16(v, multipliers);
+      __m128i quads = _mm_or_si128(_mm_and_si128(pairs, low_mask), _mm_sll_epi64(_mm_srli_epi64(pairs, 32), pair_shift));
+      _mm_store_si128((__m128i *) (units + i * 2), quads);
+    }
+    stitch_units(out, units, bits);
+    out += bits;
+  }
+}
+
+__attribute__((target("avx2")))
+static void pack_avx2(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits)
+{
+  const __m256i mask = _mm256_set1_epi16((short) ((1 << bits) - 1));
+  const __m256i multipliers = _mm256_set1_epi32((int) ((((uint32_t) 1 << bits) << 16) | 1));
+  const __m256i low_mask = _mm256_set1_epi64x(0xFFFFFFFF);
+  const __m128i pair_shift = _mm_cvtsi32_si128((int) (bits * 2));
+  uint64_t units[16] __attribute__((aligned(32)));
+
+  for(size_t group = 0; group < count; group += 64)
+  {
+    for(unsigned int i = 0; i < 4; i++)
+    {
+      __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (values + group + i * 16)), mask);
+      __m256i pairs = _mm256_madd_epi16(v, multipliers);
+      __m256i quads = _mm256_or_si256(_mm256_and_si256(pairs, low_mask), _mm256_sll_epi64(_mm256_srli_epi64(pairs, 32), pair_shift));
+      _mm256_store_si256((__m256i *) (units + i * 4), quads);
+    }
+    stitch_units(out, units, bits);
+    out += bits;
+  }
+}
+#endif
+
+static void choose_pack_impl(void)
+{
+  pack_impl = pack_scalar;
+#ifdef BITPACK_X86
+  if(psnip_cpu_feature_check(PSNIP_CPU_FEATURE_X86_AVX2)) pack_impl = pack_avx2;
+  else if(psnip_cpu_feature_check(PSNIP_CPU_FEATURE_X86_SSE2)) pack_impl = pack_sse2;
+#endif
+}
+
+bool bitpack_force_impl(enum bitpack_impl impl)
+{
+  pthread_once(&pack_impl_once, choose_pack_impl);
+  switch(impl)
+  {
+    case BITPACK_IMPL_AUTO: choose_pack_impl(); return true;
+    case BITPACK_IMPL_SCALAR: pack_impl = pack_scalar; return true;
+#ifdef BITPACK_X86
+    case BITPACK_IMPL_SSE2:
+      if(!psnip_cpu_feature_check(PSNIP_CPU_FEATURE_X86_SSE2)) return false;
+      pack_impl = pack_sse2;
+      return true;
+    case BITPACK_IMPL_AVX2:
+      if(!psnip_cpu_feature_check(PSNIP_CPU_FEATURE_X86_AVX2)) return false;
+      pack_impl = pack_avx2;
+      return true;
+#endif
+    default: return false;
+  }
+}
+
+void bitpack_pack_be(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits)
+{
+  assert(bits >= BITPACK_MIN_BITS && bits <= BITPACK_MAX_BITS);
+  assert(count % 64 == 0);
+  pthread_once(&pack_impl_once, choose_pack_impl);
+  pack_impl(out, values, count, bits);
+}
@@ -0,0 +1,55 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_WORLD_BITPACK_H
+#define STRONK_WORLD_BITPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BITPACK_MIN_BITS 1
+#define BITPACK_MAX_BITS 14
+
+/*
+  Packs count values of bits wide into 64-bit words the way the protocol expects block arrays:
+  value i starts at bit i * bits, values may span two words, and each word is stored big endian.
+  count must be a multiple of 64, out must hold count * bits / 64 words.
+  The implementation is picked at runtime based on what the CPU supports.
+*/
+void bitpack_pack_be(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits);
+
+enum bitpack_impl
+{
+  BITPACK_IMPL_AUTO, // The best one the CPU supports.
+  BITPACK_IMPL_SCALAR,
+  BITPACK_IMPL_SSE2,
+  BITPACK_IMPL_AVX2
+};
+
+/*
+  Makes bitpack_pack_be() use impl from now on, so tests and benchmarks can reach every implementation.
+  Returns false if this build or the CPU doesn't support impl. Not thread-safe.
+*/
+bool bitpack_force_impl(enum bitpack_impl impl);
+
+#endif
@@ -0,0 +1,291 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <ninerr/ninerr.h>
+
+#include "world/chunksection.h"
+
+#define MIN_BITS_PER_BLOCK 4
+#define MAX_BITS_PER_BLOCK 12 // Enough to index every block of a section.
+#define COMPACT_MIN_BITS_PER_BLOCK 8 // Wider sections are sent using the global palette, at 13 bits per block.
+
+static inline size_t data_length(uint8_t bits_per_block) { return (BLOCKS_PER_CHUNK_SECTION * bits_per_block + 63) / 64; }
+
+static inline uint_fast16_t get_index(const uint64_t *data, uint8_t bits, uint_fast16_t i)
+{
+  size_t bit = (size_t) i * bits;
+  size_t word = bit >> 6;
+  unsigned int offset = bit & 63;
+  uint64_t value = data[word] >> offset;
+  if(offset + bits > 64) value |= data[word + 1] << (64 - offset);
+  return (uint_fast16_t) (value & ((((uint64_t) 1) << bits) - 1));
+}
+
+static inline void set_index(uint64_t *data, uint8_t bits, uint_fast16_t i, uint_fast16_t value)
+{
+  uint64_t mask = (((uint64_t) 1) << bits) - 1;
+  size_t bit = (size_t) i * bits;
+  size_t word = bit >> 6;
+  unsigned int offset = bit & 63;
+  data[word] = (data[word] & ~(mask << offset)) | (((uint64_t) value) << offset);
+  if(offset + bits > 64)
+  {
+    unsigned int spilled = offset + bits - 64;
+    uint64_t high_mask = (((uint64_t) 1) << spilled) - 1;
+    data[word + 1] = (data[word + 1] & ~high_mask) | (((uint64_t) value) >> (bits - spilled));
+  }
+}
+
+void chunk_section_init(struct chunk_section *section, block_state fill)
+{
+  section->bits_per_block = 0;
+  section->single_value = fill;
+  section->palette = &(section->single_value);
+  section->palette_length = 1;
+  section->palette_capacity = 1;
+  section->data = NULL;
+  section->non_air_count = (fill == BLOCK_STATE_AIR) ? 0 : BLOCKS_PER_CHUNK_SECTION;
+  section->extra_data_length = 0;
+  section->extra_data_capacity = 0;
+  section->extra_data = NULL;
+}
+
+void chunk_section_free(struct chunk_section *section)
+{
+  if(section->bits_per_block != 0) free(section->palette);
+  free(section->data);
+  free(section->extra_data);
+  chunk_section_init(section, BLOCK_STATE_AIR);
+}
+
+block_state chunk_section_get(const struct chunk_section *section, uint_fast16_t index)
+{
+  assert(index < BLOCKS_PER_CHUNK_SECTION);
+  if(section->bits_per_block == 0) return section->single_value;
+  return section->palette[get_index(section->data, section->bits_per_block, index)];
+}
+
+void chunk_section_get_states(const struct chunk_section *section, block_state *out)
+{
+  if(section->bits_per_block == 0)
+  {
+    for(uint_fast16_t i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++) out[i] = section->single_value;
+    return;
+  }
+
+  // Walk the words sequentially instead of recomputing the position of every value.
+  uint8_t bits = section->bits_per_block;
+  uint64_t mask = (((uint64_t) 1) << bits) - 1;
+  const uint64_t *word = section->data;
+  uint64_t current = *word;
+  unsigned int offset = 0;
+  for(uint_fast16_t i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
+  {
+    uint64_t value = current >> offset;
+    offset += bits;
+    if(offset >= 64)
+    {
+      offset -= 64;
+      if(i != BLOCKS_PER_CHUNK_SECTION - 1) current = *(++word);
+      if(offset > 0) value |= current << (bits - offset);
+    }
+    out[i] = section->palette[value & mask];
+  }
+}
+
+// Repacks the section with a larger index width.
+static bool grow(struct chunk_section *section, uint8_t new_bits)
+{
+  uint64_t *new_data = calloc(data_length(new_bits), sizeof(uint64_t));
+  if(new_data == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+
+  if(section->bits_per_block != 0)
+  {
+    for(uint_fast16_t i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
+    {
+      set_index(new_data, new_bits, i, get_index(section->data, section->bits_per_block, i));
+    }
+  }
+  // A single-valued section is all zeroes, which already points at palette[0].
+
+  free(section->data);
+  section->data = new_data;
+  section->bits_per_block = new_bits;
+  return true;
+}
+
+/*
+  Drops the palette entries which no block refers to anymore, returns the amount of entries dropped.
+  The block at skip is about to be overwritten, so its entry doesn't count as used; it's left pointing at palette[0].
+*/
+static uint_fast16_t compact_palette(struct chunk_section *section, uint_fast16_t skip)
+{
+  uint8_t bits = section->bits_per_block;
+  uint64_t used[(1U << MAX_BITS_PER_BLOCK) / 64] = { 0 };
+  for(uint_fast16_t i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
+  {
+    if(i == skip) continue;
+    uint_fast16_t p = get_index(section->data, bits, i);
+    used[p >> 6] |= ((uint64_t) 1) << (p & 63);
+  }
+
+  uint16_t remap[1U << MAX_BITS_PER_BLOCK];
+  uint_fast16_t length = 0;
+  for(uint_fast16_t p = 0; p < section->palette_length; p++)
+  {
+    if(!(used[p >> 6] & (((uint64_t) 1) << (p & 63)))) continue;
+    remap[p] = (uint16_t) length;
+    section->palette[length++] = section->palette[p];
+  }
+
+  uint_fast16_t dropped = section->palette_length - length;
+  if(dropped == 0) return 0;
+  for(uint_fast16_t i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
+  {
+    set_index(section->data, bits, i, (i == skip) ? 0 : remap[get_index(section->data, bits, i)]);
+  }
+  section->palette_length = (uint16_t) length;
+  return dropped;
+}
+
+static bool palette_add(struct chunk_section *section, block_state state, uint_fast16_t skip, uint_fast16_t *out_index)
+{
+  if(section->bits_per_block == 0 || section->palette_length == (1U << section->bits_per_block))
+  {
+    // Overwritten blocks leave their states behind in the palette, so reclaim those before widening the indices any further.
+    // Widening costs about as much as compacting, so the width only stays the same if compacting freed a fair share of the palette.
+    uint_fast16_t full_length = section->palette_length;
+    uint_fast16_t dropped = 0;
+    if(section->bits_per_block >= COMPACT_MIN_BITS_PER_BLOCK) dropped = compact_palette(section, skip);
+
+    // A full palette at the maximum width means every block has a state of its own, including the one at skip.
+    if(section->bits_per_block == MAX_BITS_PER_BLOCK) assert(dropped > 0);
+    else if(section->bits_per_block == 0 || dropped < full_length / 4)
+    {
+      uint8_t new_bits = (section->bits_per_block == 0) ? MIN_BITS_PER_BLOCK : section->bits_per_block + 1;
+      if(!grow(section, new_bits)) return false;
+    }
+  }
+
+  if(section->palette_length == section->palette_capacity)
+  {
+    uint16_t new_capacity = (uint16_t) (1U << section->bits_per_block);
+    block_state *new_palette = malloc(new_capacity * sizeof(block_state));
+    if(new_palette == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+    memcpy(new_palette, section->palette, section->palette_length * sizeof(block_state));
+    if(section->palette != &(section->single_value)) free(section->palette);
+    section->palette = new_palette;
+    section->palette_capacity = new_capacity;
+  }
+
+  section->palette[section->palette_length] = state;
+  *out_index = section->palette_length++;
+  return true;
+}
+
+bool chunk_section_set(struct chunk_section *section, uint_fast16_t index, block_state state)
+{
+  assert(index < BLOCKS_PER_CHUNK_SECTION);
+  block_state old = chunk_section_get(section, index);
+  if(old == state) return true;
+
+  uint_fast16_t palette_index = 0;
+  bool found = false;
+  for(uint_fast16_t i = 0; i < section->palette_length; i++)
+  {
+    if(section->palette[i] == state) { palette_index = i; found = true; break; }
+  }
+  if(!found && !palette_add(section, state, index, &palette_index)) return false;
+
+  set_index(section->data, section->bits_per_block, index, palette_index);
+  if(old == BLOCK_STATE_AIR) section->non_air_count++;
+  else if(state == BLOCK_STATE_AIR) section->non_air_count--;
+  return true;
+}
+
+static size_t find_extra_data(const struct chunk_section *section, uint_fast16_t index, bool *found)
+{
+  size_t low = 0;
+  size_t high = section->extra_data_length;
+  while(low < high)
+  {
+    size_t mid = (low + high) / 2;
+    if(section->extra_data[mid].index < index) low = mid + 1;
+    else high = mid;
+  }
+  *found = low < section->extra_data_length && section->extra_data[low].index == index;
+  return low;
+}
+
+void *chunk_section_get_extra_data(const struct chunk_section *section, uint_fast16_t index)
+{
+  bool found;
+  size_t i = find_extra_data(section, index, &found);
+  return found ? section->extra_data[i].data : NULL;
+}
+
+bool chunk_section_set_extra_data(struct chunk_section *section, uint_fast16_t index, void *data)
+{
+  bool found;
+  size_t i = find_extra_data(section, index, &found);
+  struct chunk_section_extra_data *entries = section->extra_data;
+
+  if(found)
+  {
+    if(data != NULL) { entries[i].data = data; return true; }
+    memmove(entries + i, entries + i + 1, (section->extra_data_length - i - 1) * sizeof(struct chunk_section_extra_data));
+    section->extra_data_length--;
+    return true;
+  }
+  if(data == NULL) return true;
+
+  if(section->extra_data_length == section->extra_data_capacity)
+  {
+    uint16_t new_capacity = (section->extra_data_capacity == 0) ? 4 : section->extra_data_capacity * 2;
+    void *tmp = realloc(entries, new_capacity * sizeof(struct chunk_section_extra_data));
+    if(tmp == NULL) { ninerr_set_err(ninerr_from_errno()); return false; }
+    entries = section->extra_data = tmp;
+    section->extra_data_capacity = new_capacity;
+  }
+  memmove(entries + i + 1, entries + i, (section->extra_data_length - i) * sizeof(struct chunk_section_extra_data));
+  entries[i].index = (uint16_t) index;
+  entries[i].data = data;
+  section->extra_data_length++;
+  return true;
+}
+
+size_t chunk_section_memory_usage(const struct chunk_section *section)
+{
+  size_t size = section->extra_data_capacity * sizeof(struct chunk_section_extra_data);
+  if(section->bits_per_block != 0)
+  {
+    size += section->palette_capacity * sizeof(block_state);
+    size += data_length(section->bits_per_block) * sizeof(uint64_t);
+  }
+  return size;
+}
@@ -0,0 +1,79 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STRONK_WORLD_CHUNKSECTION_H
+#define STRONK_WORLD_CHUNKSECTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BLOCKS_PER_CHUNK_SECTION 4096
+
+// A block state as used by the protocol, the block type id in the upper 12 bits and its data in the lower 4 bits.
+typedef uint16_t block_state;
+#define BLOCK_STATE(type_id, data) ((block_state) ((((uint16_t) (type_id)) << 4) | (((uint16_t) (data)) & 0x0F)))
+#define BLOCK_STATE_TYPE_ID(state) ((uint16_t) ((state) >> 4))
+#define BLOCK_STATE_DATA(state) ((uint8_t) ((state) & 0x0F))
+#define BLOCK_STATE_AIR ((block_state) 0)
+
+struct chunk_section_extra_data
+{
+  uint16_t index;
+  void *data;
+};
+
+/*
+  A 16x16x16 section of blocks, stored as indices into a palette of block states.
+  Indices are bit-packed into 64-bit words the same way the protocol does it, a value may span two words.
+  A section consisting of only a single block state uses no index storage at all (bits_per_block is 0).
+  Blocks are indexed as y * 256 + z * 16 + x.
+*/
+struct chunk_section
+{
+  uint8_t bits_per_block; // 0, or 4 to 12 inclusive.
+  uint16_t palette_length;
+  uint16_t palette_capacity;
+  block_state *palette; // Points to single_value if bits_per_block is 0.
+  block_state single_value;
+  uint64_t *data; // NULL if bits_per_block is 0.
+  uint16_t non_air_count;
+
+  // Extra data (i.e. for tile entities) is rare, so it's kept in a small array sorted by index.
+  uint16_t extra_data_length;
+  uint16_t extra_data_capacity;
+  struct chunk_section_extra_data *extra_data;
+};
+
+void chunk_section_init                 (struct chunk_section *section, block_state fill);
+void chunk_section_free                 (struct chunk_section *section);
+block_state chunk_section_get           (const struct chunk_section *section, uint_fast16_t index);
+bool chunk_section_set                  (struct chunk_section *section, uint_fast16_t index, block_state state); // Returns false on memory allocation failure.
+void chunk_section_get_states           (const struct chunk_section *section, block_state *out); // out must hold BLOCKS_PER_CHUNK_SECTION states.
+void *chunk_section_get_extra_data      (const struct chunk_section *section, uint_fast16_t index); // Returns NULL if there is none.
+bool chunk_section_set_extra_data       (struct chunk_section *section, uint_fast16_t index, void *data); // NULL removes the extra data.
+size_t chunk_section_memory_usage       (const struct chunk_section *section); // Heap memory used, excluding the struct itself.
+
+static inline bool chunk_section_is_empty(const struct chunk_section *section) { return section->non_air_count == 0; }
+static inline uint_fast16_t chunk_section_index(unsigned int x, unsigned int y, unsigned int z) { return (y << 8) | (z << 4) | x; }
+
+#endif
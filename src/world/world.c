@@ -43,13 +43,17 @@
 #include <mcpr/mcpr.h>
 #include <mcpr/packet.h>
 #include <mcpr/connection.h>
+#include <mcpr/codec.h>
 
 #include <logging/logging.h>
 #include <network/connection.h>
 #include <network/player.h>
+#include <network/network.h>
 
 #include "world/world.h"
 #include "world/block.h"
+#include "world/chunksection.h"
+#include "world/bitpack.h"
 #include "../util.h"
 
 int32_t entity_id_counter = INT32_MIN;
@@ -120,31 +124,45 @@ West to east, north to south block changing is the fastest (as they are indexed
 
 //#define xz_to_index(x, z)
 
-#define BLOCKS_PER_CHUNK_SECTION 4096
 #define CHUNK_SECTIONS_PER_CHUNK 16
 #define BLOCKS_PER_CHUNK (BLOCKS_PER_CHUNK_SECTION * CHUNK_SECTIONS_PER_CHUNK)
 
 static struct chunk *load_chunk(world *world, long x, long z);
-static bool send_chunk_data(const struct player *p, const struct chunk *chunk, long x, long z, bool send_sky_light);
+static bool send_chunk_data(const struct player *p, struct chunk *chunk, long x, long z, bool send_sky_light);
 
-struct chunk_section {
-  pthread_rwlock_t lock;
+#define GLOBAL_PALETTE_BITS_PER_BLOCK 13
+#define MAX_SECTION_PALETTE_BITS_PER_BLOCK 8 // The client only accepts section palettes with up to 8 bits per block.
+#define MIN_SECTION_PALETTE_BITS_PER_BLOCK 4
+#define MAX_BLOCK_ARRAY_LENGTH (BLOCKS_PER_CHUNK_SECTION * GLOBAL_PALETTE_BITS_PER_BLOCK / 64)
+static void encode_chunk_section_blocks(uint64_t *out, const struct chunk_section *section);
+static void encode_chunk_section(struct mcpr_chunk_section *out, const struct chunk_section *section);
 
-  struct block blocks[4096]; // 16x16x16
+// A fully encoded chunk data packet, shared by everyone who is sent the same version of a chunk.
+struct chunk_packet
+{
+  unsigned int reference_count; // Protected by the lock of the chunk's packet cache.
+  unsigned long long version; // last_update of the chunk at the time of encoding.
+  size_t size;
+  size_t compressed_size;
+  void *compressed; // May be NULL if the packet was encoded whilst compression was disabled.
+  unsigned char data[];
 };
-static void encode_chunk_section_blocks(uint64_t *out, const struct chunk_section *section);
 
 struct chunk
 {
-  unsigned long long last_update;
+  unsigned long long last_update; // Bumped on every block change, protected by packet_cache_lock.
   struct chunk_section sections[CHUNK_SECTIONS_PER_CHUNK]; // 16 high indexed bottom to top.
   uint8_t biomes[256];
+
+  pthread_mutex_t packet_cache_lock;
+  struct chunk_packet *packet_cache; // NULL if nothing is cached yet.
 };
 
 #define get_chunk_key(x, z) ((unsigned long long) (((unsigned long long) x) << 32 | ((unsigned long long) z)))
 struct world
 {
   HashTable *chunks;
+  pthread_mutex_t chunks_lock;
   enum mcpr_dimension dimension;
 };
 
@@ -159,6 +177,13 @@ int world_manager_init(void)
 
   default_world->chunks = hash_table_new(ull_hash, ull_equal);
   if(default_world->chunks == NULL) { nlog_fatal("Could not create hash table. (%s ?)", strerror(errno)); free(default_world); return -1; }
+  if(pthread_mutex_init(&(default_world->chunks_lock), NULL) != 0)
+  {
+    nlog_fatal("Could not initialize chunks lock.");
+    hash_table_free(default_world->chunks);
+    free(default_world);
+    return -1;
+  }
   default_world->dimension = MCPR_DIMENSION_OVERWORLD;
   return 1;
 }
@@ -170,9 +195,36 @@ void world_manager_cleanup(void)
 
 static struct chunk *get_chunk(world *w, long x, long z)
 {
+  struct world *world = (struct world *) w;
   unsigned long long key = get_chunk_key(x, z);
-  struct chunk *chunk = hash_table_lookup(default_world->chunks, &key);
-  return (chunk != HASH_TABLE_NULL) ? chunk : load_chunk(w, x, z);
+  pthread_mutex_lock(&(world->chunks_lock));
+  struct chunk *chunk = hash_table_lookup(world->chunks, &key);
+  if(chunk == HASH_TABLE_NULL) chunk = load_chunk(w, x, z);
+  pthread_mutex_unlock(&(world->chunks_lock));
+  return chunk;
+}
+
+bool world_set_block(const struct blockpos *pos, block_state state)
+{
+  if(pos->y < 0 || pos->y >= CHUNK_SECTIONS_PER_CHUNK * 16)
+  {
+    ninerr_set_err(ninerr_new("Block Y coordinate %lld is out of bounds.", pos->y));
+    return false;
+  }
+
+  struct chunk *chunk = get_chunk(pos->world, (long) (pos->x >> 4), (long) (pos->z >> 4));
+  if(chunk == NULL) { ninerr_set_err(ninerr_new("Could not load chunk.")); return false; }
+
+  struct chunk_section *section = &(chunk->sections[pos->y >> 4]);
+  uint_fast16_t index = chunk_section_index(pos->x & 15, pos->y & 15, pos->z & 15);
+  if(chunk_section_get(section, index) == state) return true;
+  if(!chunk_section_set(section, index, state)) return false;
+
+  // Anyone sent this chunk from now on needs a freshly encoded packet.
+  pthread_mutex_lock(&(chunk->packet_cache_lock));
+  chunk->last_update++;
+  pthread_mutex_unlock(&(chunk->packet_cache_lock));
+  return true;
 }
 
 IGNORE("-Wunused-parameter")
@@ -182,102 +234,175 @@ static struct chunk *load_chunk(world *world, long x, long z)
   struct chunk *chunk = malloc(sizeof(struct chunk));
   if(chunk == NULL) return NULL;
 
-  chunk->last_update = 0; // TODO
+  chunk->last_update = 0;
+  chunk->packet_cache = NULL;
+  if(pthread_mutex_init(&(chunk->packet_cache_lock), NULL) != 0) { free(chunk); return NULL; }
 
   // Fill the bottom 8 chunk sections with solid stone.
-  for(size_t i = 0; i < 8; i++)
-  {
-    struct chunk_section *chunk_section = &(chunk->sections[i]);
-
-    for(int i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
-    {
-      chunk_section->blocks[i].type_id = 1;
-      chunk_section->blocks[i].data = 0;
-    }
-  }
+  for(size_t i = 0; i < 8; i++) chunk_section_init(&(chunk->sections[i]), BLOCK_STATE(STONE, 0));
 
   // Fill the top 8 chunk sections with air.
-  for(size_t i = 8; i < 16; i++)
-  {
-    struct chunk_section *chunk_section = &(chunk->sections[i]);
-
-    for(int i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
-    {
-      chunk_section->blocks[i].type_id = 0;
-      chunk_section->blocks[i].data = 0;
-    }
-  }
+  for(size_t i = 8; i < 16; i++) chunk_section_init(&(chunk->sections[i]), BLOCK_STATE_AIR);
 
   // Fill in biome data.
   memset(chunk->biomes, 0, 256);
 
-  unsigned long long key = get_chunk_key(x, z);
-  int result = hash_table_insert(((struct world *) world)->chunks, &key, chunk);
-  if(result == 0){ nlog_error("Could not put new chunk in chunk map. (%s ?)", strerror(errno)); free(chunk); return NULL; }
+  unsigned long long *key = malloc(sizeof(unsigned long long)); // The hash table keeps a pointer to the key.
+  if(key == NULL) { pthread_mutex_destroy(&(chunk->packet_cache_lock)); free(chunk); return NULL; }
+  *key = get_chunk_key(x, z);
+  int result = hash_table_insert(((struct world *) world)->chunks, key, chunk);
+  if(result == 0){ nlog_error("Could not put new chunk in chunk map. (%s ?)", strerror(errno)); pthread_mutex_destroy(&(chunk->packet_cache_lock)); free(key); free(chunk); return NULL; }
 
   return chunk;
 }
 END_IGNORE()
 
-bool world_send_chunk_data1(const struct player *p) // TODO
+#define MAX_VIEW_DISTANCE 32
+#define CHUNK_OFFSET_COUNT ((2 * MAX_VIEW_DISTANCE + 1) * (2 * MAX_VIEW_DISTANCE + 1))
+
+struct chunk_offset
+{
+  int8_t x;
+  int8_t z;
+};
+
+// All chunk offsets within MAX_VIEW_DISTANCE, sorted in rings around the center so that for every
+// view distance r the first (2r + 1)^2 entries form exactly the square the client expects.
+// Within a ring, chunks closest to the center come first.
+static struct chunk_offset chunk_offsets[CHUNK_OFFSET_COUNT];
+static pthread_once_t chunk_offsets_once = PTHREAD_ONCE_INIT;
+
+static long chebyshev_distance(const struct chunk_offset *o)
+{
+  long ax = labs(o->x);
+  long az = labs(o->z);
+  return (ax > az) ? ax : az;
+}
+
+static int compare_chunk_offsets(const void *a, const void *b)
+{
+  const struct chunk_offset *o1 = a;
+  const struct chunk_offset *o2 = b;
+
+  long ring1 = chebyshev_distance(o1);
+  long ring2 = chebyshev_distance(o2);
+  if(ring1 != ring2) return (ring1 < ring2) ? -1 : 1;
+
+  long dist1 = o1->x * o1->x + o1->z * o1->z;
+  long dist2 = o2->x * o2->x + o2->z * o2->z;
+  if(dist1 != dist2) return (dist1 < dist2) ? -1 : 1;
+
+  if(o1->z != o2->z) return (o1->z < o2->z) ? -1 : 1;
+  if(o1->x != o2->x) return (o1->x < o2->x) ? -1 : 1;
+  return 0;
+}
+
+static void init_chunk_offsets(void)
 {
-  unsigned short view_distance = 10; // TODO proper view distance
-  long base_x = p->pos.x / 16;
-  long base_z = p->pos.z / 16;
-  for(int mod_x = -view_distance; mod_x <= view_distance; mod_x++)
+  size_t i = 0;
+  for(int z = -MAX_VIEW_DISTANCE; z <= MAX_VIEW_DISTANCE; z++)
   {
-    for(int mod_z = -view_distance; mod_z <= view_distance; mod_z++)
+    for(int x = -MAX_VIEW_DISTANCE; x <= MAX_VIEW_DISTANCE; x++)
     {
-      long x = base_x + mod_x;
-      long z = base_z + mod_z;
-
-      send_chunk_data(p, get_chunk(default_world, x, z), x, z, default_world->dimension == MCPR_DIMENSION_OVERWORLD);
+      chunk_offsets[i].x = x;
+      chunk_offsets[i].z = z;
+      i++;
     }
   }
+  qsort(chunk_offsets, CHUNK_OFFSET_COUNT, sizeof(struct chunk_offset), compare_chunk_offsets);
+}
 
-  return true;
+// Floor division, a plain cast rounds towards zero which is wrong for negative coordinates.
+static long block_to_chunk_coord(double block)
+{
+  long b = (long) block;
+  if(block < b) b--;
+  return (b >= 0) ? b / 16 : -((-b + 15) / 16);
 }
 
-static bool send_chunk_data(const struct player *p, const struct chunk *chunk, long x, long z, bool send_sky_light)
+void world_queue_chunks(struct player *p)
 {
-  nlog_debug("In send_chunk_data(player = %s, chunkX = %ld, chunkZ = %ld)", p->username, x, z);
+  pthread_once(&chunk_offsets_once, init_chunk_offsets);
+
+  unsigned int radius = server_view_distance;
+  if(p->client_settings_known && p->client_settings.view_distance < radius) radius = p->client_settings.view_distance;
+  if(radius > MAX_VIEW_DISTANCE) radius = MAX_VIEW_DISTANCE;
 
+  long center_x = block_to_chunk_coord(p->pos.x);
+  long center_z = block_to_chunk_coord(p->pos.z);
+
+  // Don't start over if nothing changed, the client already has the chunks we sent.
+  if(p->chunk_queue.total != 0 && p->chunk_queue.center_x == center_x && p->chunk_queue.center_z == center_z && p->chunk_queue.radius == radius) return;
+
+  p->chunk_queue.center_x = center_x;
+  p->chunk_queue.center_z = center_z;
+  p->chunk_queue.radius = radius;
+  p->chunk_queue.next = 0;
+  p->chunk_queue.total = (2 * radius + 1) * (2 * radius + 1);
+}
+
+bool world_send_queued_chunks(struct player *p, unsigned int max_chunks)
+{
+  bool send_sky_light = default_world->dimension == MCPR_DIMENSION_OVERWORLD;
+  for(unsigned int i = 0; i < max_chunks && p->chunk_queue.next < p->chunk_queue.total; i++)
+  {
+    const struct chunk_offset *offset = &(chunk_offsets[p->chunk_queue.next]);
+    long x = p->chunk_queue.center_x + offset->x;
+    long z = p->chunk_queue.center_z + offset->z;
+
+    if(!send_chunk_data(p, get_chunk(default_world, x, z), x, z, send_sky_light)) return false;
+    p->chunk_queue.next++;
+  }
+  return true;
+}
+
+static struct chunk_packet *encode_chunk_packet(const struct chunk *chunk, unsigned long long version, long x, long z, bool send_sky_light)
+{
   struct mcpr_packet pkt;
   pkt.id = MCPR_PKT_PL_CB_CHUNK_DATA;
   pkt.state = MCPR_STATE_PLAY;
   pkt.data.play.clientbound.chunk_data.chunk_x = x;
   pkt.data.play.clientbound.chunk_data.chunk_z = z;
   pkt.data.play.clientbound.chunk_data.ground_up_continuous = true;
-  pkt.data.play.clientbound.chunk_data.primary_bit_mask = 0xFFFF;
-  pkt.data.play.clientbound.chunk_data.size = CHUNK_SECTIONS_PER_CHUNK;
   pkt.data.play.clientbound.chunk_data.block_entities = NULL;
   pkt.data.play.clientbound.chunk_data.block_entity_count = 0;
-  void *membuf = malloc(CHUNK_SECTIONS_PER_CHUNK * sizeof(struct mcpr_chunk_section));
+  pkt.data.play.clientbound.chunk_data.biomes = (uint8_t *) chunk->biomes;
+
+  // Empty sections are left out entirely, the client treats them as air.
+  int32_t primary_bit_mask = 0;
+  int32_t section_count = 0;
+  for(size_t i = 0; i < CHUNK_SECTIONS_PER_CHUNK; i++)
+  {
+    if(chunk_section_is_empty(&(chunk->sections[i]))) continue;
+    primary_bit_mask |= 1 << i;
+    section_count++;
+  }
+  pkt.data.play.clientbound.chunk_data.primary_bit_mask = primary_bit_mask;
+  pkt.data.play.clientbound.chunk_data.size = section_count;
+
+  // All light, palette and block arrays are allocated in one go.
+  size_t light_size = (send_sky_light) ? BLOCKS_PER_CHUNK_SECTION / 2 * 2 : BLOCKS_PER_CHUNK_SECTION / 2;
+  size_t palette_size = (1 << MAX_SECTION_PALETTE_BITS_PER_BLOCK) * sizeof(int32_t);
+  size_t section_size = light_size + palette_size + MAX_BLOCK_ARRAY_LENGTH * sizeof(uint64_t);
+  void *membuf = malloc(CHUNK_SECTIONS_PER_CHUNK * (sizeof(struct mcpr_chunk_section) + section_size));
   if(membuf == NULL)
   {
     nlog_error("Could not allocate memory. (%s)", strerror(errno));
-    return false;
+    return NULL;
   }
-
   pkt.data.play.clientbound.chunk_data.chunk_sections = membuf;
-  pkt.data.play.clientbound.chunk_data.biomes = chunk->biomes;
-
+  void *section_data = membuf + CHUNK_SECTIONS_PER_CHUNK * sizeof(struct mcpr_chunk_section);
 
+  size_t j = 0;
   for(size_t i = 0; i < CHUNK_SECTIONS_PER_CHUNK; i++)
   {
     const struct chunk_section *section = &(chunk->sections[i]);
+    if(chunk_section_is_empty(section)) continue;
+    void *membuf2 = section_data + j * section_size;
 
-    struct mcpr_chunk_section *mcpr_chunk_section = pkt.data.play.clientbound.chunk_data.chunk_sections + i;
-    mcpr_chunk_section->bits_per_block = 13;
-    mcpr_chunk_section->palette_length = 0;
-    mcpr_chunk_section->palette = NULL;
+    struct mcpr_chunk_section *mcpr_chunk_section = pkt.data.play.clientbound.chunk_data.chunk_sections + j;
+    j++;
 
-    void *membuf2 = (send_sky_light) ? malloc(BLOCKS_PER_CHUNK_SECTION / 2 * 2 + 832 * sizeof(uint64_t)) : malloc(BLOCKS_PER_CHUNK_SECTION / 2 + 832 * sizeof(uint64_t));
-    if(membuf2 == NULL)
-    {
-      nlog_error("Could not allocate memory. (%s)", strerror(errno));
-      return false;
-    }
     mcpr_chunk_section->block_light = membuf2;
     memset(mcpr_chunk_section->block_light, 0, BLOCKS_PER_CHUNK_SECTION / 2); // TODO block light.
 
@@ -291,28 +416,130 @@ static bool send_chunk_data(const struct player *p, const struct chunk *chunk, l
       mcpr_chunk_section->sky_light = NULL;
     }
 
+    mcpr_chunk_section->palette = membuf2 + light_size;
+    mcpr_chunk_section->blocks = membuf2 + light_size + palette_size;
+    encode_chunk_section(mcpr_chunk_section, section);
+  }
+
+  size_t bounds = mcpr_encode_packet_bounds(&pkt);
+  if(bounds == 0)
+  {
+    nlog_error("Could not encode chunk data packet.");
+    free(membuf);
+    return NULL;
+  }
+  struct chunk_packet *cp = malloc(sizeof(struct chunk_packet) + bounds);
+  if(cp == NULL)
+  {
+    nlog_error("Could not allocate memory. (%s)", strerror(errno));
+    free(membuf);
+    return NULL;
+  }
+
+  cp->size = mcpr_encode_packet(cp->data, &pkt);
+  free(membuf);
+  if(cp->size == 0)
+  {
+    nlog_error("Could not encode chunk data packet.");
+    free(cp);
+    return NULL;
+  }
+  cp->reference_count = 1;
+  cp->version = version;
+  cp->compressed = NULL;
+  cp->compressed_size = 0;
+
+  // Compress once here, so that connections don't each have to compress their own copy.
+  int threshold = net_get_compression_threshold();
+  if(threshold >= 0 && cp->size >= (size_t) threshold)
+  {
+    void *compressed = malloc(mcpr_compress_bounds(cp->size));
+    if(compressed != NULL)
+    {
+      ssize_t compressed_size = mcpr_compress(compressed, cp->data, cp->size);
+      if(compressed_size >= 0)
+      {
+        void *tmp = realloc(compressed, compressed_size);
+        cp->compressed = (tmp != NULL) ? tmp : compressed;
+        cp->compressed_size = compressed_size;
+      }
+      else
+      {
+        free(compressed);
+      }
+    }
+  }
+  return cp;
+}
+
+static void chunk_packet_unref(struct chunk *chunk, struct chunk_packet *cp)
+{
+  pthread_mutex_lock(&(chunk->packet_cache_lock));
+  bool do_free = --cp->reference_count == 0;
+  pthread_mutex_unlock(&(chunk->packet_cache_lock));
+  if(do_free)
+  {
+    free(cp->compressed);
+    free(cp);
+  }
+}
+
+// Returns the cached packet for the current version of chunk, encoding it if needed. Release it with chunk_packet_unref().
+static struct chunk_packet *get_chunk_packet(struct chunk *chunk, long x, long z, bool send_sky_light)
+{
+  pthread_mutex_lock(&(chunk->packet_cache_lock));
+  struct chunk_packet *cp = chunk->packet_cache;
+  if(cp != NULL && cp->version == chunk->last_update)
+  {
+    cp->reference_count++;
+    pthread_mutex_unlock(&(chunk->packet_cache_lock));
+    return cp;
+  }
+  unsigned long long version = chunk->last_update; // Taken before encoding, so a change made meanwhile is never hidden by the cache.
+  pthread_mutex_unlock(&(chunk->packet_cache_lock));
 
-    mcpr_chunk_section->blocks = (send_sky_light) ? membuf2 + BLOCKS_PER_CHUNK_SECTION / 2 * 2 : membuf2 + BLOCKS_PER_CHUNK_SECTION / 2;
-    mcpr_chunk_section->block_array_length = 832;
+  // Encode without holding the lock, if another thread beats us to it we simply use theirs.
+  struct chunk_packet *new_cp = encode_chunk_packet(chunk, version, x, z, send_sky_light);
+  if(new_cp == NULL) return NULL;
 
-    encode_chunk_section_blocks(mcpr_chunk_section->blocks, section);
-	  //memset(mcpr_chunk_section->blocks, 0, 832 * sizeof(uint64_t));
+  struct chunk_packet *old = NULL;
+  pthread_mutex_lock(&(chunk->packet_cache_lock));
+  cp = chunk->packet_cache;
+  if(cp != NULL && cp->version == new_cp->version)
+  {
+    cp->reference_count++;
+    old = new_cp; // Lost the race.
+  }
+  else
+  {
+    old = cp;
+    new_cp->reference_count++; // One reference for the cache, one for the caller.
+    chunk->packet_cache = new_cp;
+    cp = new_cp;
   }
+  pthread_mutex_unlock(&(chunk->packet_cache_lock));
+
+  if(old != NULL) chunk_packet_unref(chunk, old);
+  return cp;
+}
+
+static bool send_chunk_data(const struct player *p, struct chunk *chunk, long x, long z, bool send_sky_light)
+{
+  nlog_debug("In send_chunk_data(player = %s, chunkX = %ld, chunkZ = %ld)", p->username, x, z);
+  if(chunk == NULL) return false;
+
+  struct chunk_packet *cp = get_chunk_packet(chunk, x, z, send_sky_light);
+  if(cp == NULL) return false;
 
   const struct connection *conn = player_get_connection(p);
-  if(fwrite(&pkt, sizeof(pkt), 1, conn->pktstream) == 0)
+  bool result = mcpr_connection_write_encoded_packet(conn->conn, cp->data, cp->size, cp->compressed, cp->compressed_size);
+  chunk_packet_unref(chunk, cp);
+  if(!result)
   {
     nlog_error("Could not send chunk data packet.");
     ninerr_print(ninerr);
     return false;
   }
-
-  // Clean up..
-  for(int i = 0; i < CHUNK_SECTIONS_PER_CHUNK; i++)
-  {
-    free(pkt.data.play.clientbound.chunk_data.chunk_sections[i].block_light);
-  }
-  free(pkt.data.play.clientbound.chunk_data.chunk_sections);
   return true;
 }
 
@@ -356,7 +583,7 @@ static bool send_chunk_section_data(const struct player *p, const struct chunk_s
   pkt.data.play.clientbound.chunk_data.chunk_sections[section_y] = mcpr_chunk_section;
 
   struct connection *conn = p->conn;
-  if(fwrite(&pkt, sizeof(pkt), 1, conn->pktstream) == 0)
+  if(!mcpr_connection_send_packet(conn->conn, &pkt))
   {
     nlog_error("Could not send chunk data packet.");
     ninerr_print(ninerr);
@@ -377,34 +604,39 @@ int32_t generate_new_entity_id(void)
   return tmp;
 }
 
-static void encode_chunk_section_blocks(uint64_t *out, const struct chunk_section *section)
+// Fills in the palette and block array of out, which should already point to buffers large enough for any section.
+static void encode_chunk_section(struct mcpr_chunk_section *out, const struct chunk_section *section)
 {
-  uint_fast8_t bits_used = 0;
-  uint64_t tmp_result = 0;
-  size_t block_data_index = 0;
-  for(unsigned int i = 0; i < BLOCKS_PER_CHUNK_SECTION; i++)
+  if(section->bits_per_block > MAX_SECTION_PALETTE_BITS_PER_BLOCK)
   {
-    const struct block *block = &(section->blocks[i]);
-    uint64_t current_block_data = ((((uint64_t) block->type_id) << 4) | ((uint64_t) block->data)); // This line has been tested, it works.
-    tmp_result |= (current_block_data << bits_used);
-    bits_used += 13;
+    out->bits_per_block = GLOBAL_PALETTE_BITS_PER_BLOCK;
+    out->palette_length = 0;
+    out->block_array_length = BLOCKS_PER_CHUNK_SECTION * GLOBAL_PALETTE_BITS_PER_BLOCK / 64;
+    encode_chunk_section_blocks(out->blocks, section);
+    return;
+  }
 
-    if(bits_used >= 64 || i == BLOCKS_PER_CHUNK_SECTION - 1)
-    {
-      out[block_data_index] = hton64(tmp_result);
-      block_data_index++;
+  // The section's own palette and packing can be sent as-is, as they follow the protocol's layout.
+  out->palette_length = section->palette_length;
+  for(uint_fast16_t i = 0; i < section->palette_length; i++) out->palette[i] = section->palette[i];
 
-      if(bits_used > 64) // It overflowed, we need to continue the last block in the next long.
-      {
-        uint_fast8_t overflowed_bits = bits_used - 64;
-        tmp_result = current_block_data >> (13 - overflowed_bits);
-        bits_used = overflowed_bits;
-      }
-      else
-      {
-        bits_used = 0;
-        tmp_result = 0;
-      }
-    }
+  if(section->bits_per_block == 0)
+  {
+    // Single valued, every index points at the only palette entry.
+    out->bits_per_block = MIN_SECTION_PALETTE_BITS_PER_BLOCK;
+    out->block_array_length = BLOCKS_PER_CHUNK_SECTION * MIN_SECTION_PALETTE_BITS_PER_BLOCK / 64;
+    memset(out->blocks, 0, out->block_array_length * sizeof(uint64_t));
+    return;
   }
+
+  out->bits_per_block = section->bits_per_block;
+  out->block_array_length = BLOCKS_PER_CHUNK_SECTION * section->bits_per_block / 64;
+  for(int32_t i = 0; i < out->block_array_length; i++) out->blocks[i] = hton64(section->data[i]);
+}
+
+static void encode_chunk_section_blocks(uint64_t *out, const struct chunk_section *section)
+{
+  block_state states[BLOCKS_PER_CHUNK_SECTION];
+  chunk_section_get_states(section, states);
+  bitpack_pack_be(out, states, BLOCKS_PER_CHUNK_SECTION, GLOBAL_PALETTE_BITS_PER_BLOCK);
 }
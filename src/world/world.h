@@ -30,9 +30,11 @@ typedef void block;
 #include <stdbool.h>
 
 #include <world/positions.h>
+#include <world/chunksection.h>
 #include "../network/player.h"
 
 struct player; // TODO.. what the hell? super strange bug, why is this required??
+struct blockpos; // world/positions.h includes this header before declaring it.
 
 int world_manager_init(void);
 void world_manager_cleanup(void);
@@ -40,7 +42,12 @@ void world_do_tick(world *world);
 size_t world_manager_get_world_count();
 world **world_manager_get_worlds();
 struct entitypos world_manager_get_init_spawn_pos(void);
-bool world_send_chunk_data1(const struct player *p);
+void world_queue_chunks(struct player *p); // (Re)starts sending chunks around the player's position.
+bool world_send_queued_chunks(struct player *p, unsigned int max_chunks); // Returns false on error.
+
+// Changes a single block, all block changes have to go through here so that chunks get re-encoded. Returns false on error.
+// Chunk sections aren't locked, so this must not run concurrently with sending chunks, e.g. call it from the tick thread.
+bool world_set_block(const struct blockpos *pos, block_state state);
 //void testerino(struct testerino *t);
 
 
@@ -0,0 +1,135 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+  Checks that every bit-packing implementation this build and CPU support produces exactly the same words,
+  for every width from BITPACK_MIN_BITS to BITPACK_MAX_BITS. Exits with EXIT_FAILURE on the first mismatch.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <world/bitpack.h>
+
+#define MAX_COUNT 4096
+#define GUARD_WORDS 4
+#define GUARD 0xA5A5A5A5A5A5A5A5ULL
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+static uint64_t rng(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static const struct { enum bitpack_impl impl; const char *name; } impls[] =
+{
+  { BITPACK_IMPL_SCALAR, "scalar" },
+  { BITPACK_IMPL_SSE2, "sse2" },
+  { BITPACK_IMPL_AVX2, "avx2" }
+};
+
+// Bit by bit, straight from the description of the format: value i starts at bit i * bits, words are stored big endian.
+static void reference_pack(uint64_t *out, const uint16_t *values, size_t count, unsigned int bits)
+{
+  size_t words = count * bits / 64;
+  memset(out, 0, words * sizeof(uint64_t));
+  for(size_t i = 0; i < count; i++)
+  {
+    for(unsigned int b = 0; b < bits; b++)
+    {
+      if(!(values[i] & (1U << b))) continue;
+      size_t bit = i * bits + b;
+      out[bit / 64] |= ((uint64_t) 1) << (bit % 64);
+    }
+  }
+
+  // Store each word big endian, independently of the host byte order.
+  for(size_t w = 0; w < words; w++)
+  {
+    unsigned char bytes[8];
+    for(unsigned int k = 0; k < 8; k++) bytes[k] = (unsigned char) (out[w] >> (56 - 8 * k));
+    memcpy(&(out[w]), bytes, 8);
+  }
+}
+
+int main(void)
+{
+  static uint16_t values[MAX_COUNT];
+  static uint64_t expected[MAX_COUNT * BITPACK_MAX_BITS / 64];
+  static uint64_t actual[MAX_COUNT * BITPACK_MAX_BITS / 64 + GUARD_WORDS];
+  static const size_t counts[] = { 64, 128, 192, 4096 };
+  unsigned int tested = 0;
+
+  for(size_t n = 0; n < sizeof(impls) / sizeof(impls[0]); n++)
+  {
+    if(!bitpack_force_impl(impls[n].impl)) { printf("bitpack_test: %s not supported here, skipped\n", impls[n].name); continue; }
+    tested++;
+
+    for(unsigned int bits = BITPACK_MIN_BITS; bits <= BITPACK_MAX_BITS; bits++)
+    {
+      for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+      {
+        size_t count = counts[c];
+        size_t words = count * bits / 64;
+        for(unsigned int round = 0; round < 16; round++)
+        {
+          // Bits above the width have to be ignored, so half of the rounds set them.
+          uint16_t mask = (round % 2 == 0) ? (uint16_t) ((1U << bits) - 1) : UINT16_MAX;
+          for(size_t i = 0; i < count; i++) values[i] = (uint16_t) rng() & mask;
+          if(round == 2) for(size_t i = 0; i < count; i++) values[i] = (uint16_t) ((1U << bits) - 1);
+          if(round == 4) memset(values, 0, count * sizeof(uint16_t));
+
+          uint16_t masked[MAX_COUNT];
+          for(size_t i = 0; i < count; i++) masked[i] = values[i] & (uint16_t) ((1U << bits) - 1);
+          reference_pack(expected, masked, count, bits);
+
+          for(size_t w = 0; w < words + GUARD_WORDS; w++) actual[w] = GUARD;
+          bitpack_pack_be(actual, values, count, bits);
+
+          if(memcmp(actual, expected, words * sizeof(uint64_t)) != 0)
+          {
+            fprintf(stderr, "bitpack_test: %s differs from the reference at %u bits, %zu values\n", impls[n].name, bits, count);
+            return EXIT_FAILURE;
+          }
+          for(size_t w = words; w < words + GUARD_WORDS; w++)
+          {
+            if(actual[w] != GUARD)
+            {
+              fprintf(stderr, "bitpack_test: %s wrote past the end at %u bits, %zu values\n", impls[n].name, bits, count);
+              return EXIT_FAILURE;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  bitpack_force_impl(BITPACK_IMPL_AUTO);
+  printf("bitpack_test: %u implementations identical for %u to %u bits\n", tested, BITPACK_MIN_BITS, BITPACK_MAX_BITS);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+/*
+  MIT License
+
+  Copyright (c) 2016-2020 Martijn Heil
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+/*
+  Checks the VarInt/VarLong codec against the byte-at-a-time implementation it replaced.
+  Exits with EXIT_FAILURE on the first mismatch.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mcpr/codec.h>
+
+#define RANDOM_ITERATIONS 20000
+#define BULK_COUNT 4096
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+static uint64_t rng(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// Random values with an even spread of encoded lengths, instead of nearly all of them taking the maximum.
+static int64_t random_value(unsigned int max_bits)
+{
+  unsigned int bits = (unsigned int) (rng() % (max_bits + 1));
+  if(bits == 0) return 0;
+  uint64_t value = rng();
+  if(bits < 64) value &= (((uint64_t) 1) << bits) - 1;
+  return (int64_t) value;
+}
+
+#define FAIL(...) do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); exit(EXIT_FAILURE); } while(0)
+
+// The previous encoder.
+static size_t old_encode_varlong(void *output, int64_t value)
+{
+  unsigned char *out = output;
+  uint64_t v = (uint64_t) value;
+  size_t i = 0;
+  do
+  {
+    uint8_t tmp = (uint8_t) (v & 0x7F);
+    v >>= 7;
+    if(v != 0) tmp |= 0x80;
+    out[i++] = tmp;
+  } while(v != 0);
+  return i;
+}
+
+static size_t old_encode_varint(void *output, int32_t value)
+{
+  return old_encode_varlong(output, (int64_t) (uint32_t) value);
+}
+
+// The previous decoder, with the two bugs the rewrite fixed taken out: it shifted a uint8_t, and it read a byte before checking maxlen.
+static ssize_t old_decode(uint64_t *out, const void *input, size_t max_len, size_t max_size)
+{
+  const unsigned char *in = input;
+  uint64_t result = 0;
+  size_t i = 0;
+  uint8_t tmp;
+  do
+  {
+    if(i >= max_size || i >= max_len) return -1;
+    tmp = in[i];
+    result |= ((uint64_t) (tmp & 0x7F)) << (7 * i);
+    i++;
+  } while(tmp & 0x80);
+  *out = result;
+  return i;
+}
+
+static void check_varint(int32_t value)
+{
+  unsigned char expected[MCPR_VARLONG_SIZE_MAX];
+  unsigned char actual[MCPR_VARLONG_SIZE_MAX];
+  size_t expected_size = old_encode_varint(expected, value);
+  size_t actual_size = mcpr_encode_varint(actual, value);
+  if(actual_size != expected_size || memcmp(actual, expected, expected_size) != 0) FAIL("mcpr_encode_varint(%d) differs", value);
+  if(mcpr_varint_bounds(value) != expected_size) FAIL("mcpr_varint_bounds(%d) is %zu, not %zu", value, mcpr_varint_bounds(value), expected_size);
+
+  // Every maxlen short of the full size has to fail, decoding from a buffer of exactly maxlen bytes.
+  for(size_t max_len = 0; max_len <= MCPR_VARINT_SIZE_MAX; max_len++)
+  {
+    unsigned char *buf = malloc(max_len + 1);
+    if(buf == NULL) FAIL("Out of memory");
+    memcpy(buf, expected, (max_len < expected_size) ? max_len : expected_size);
+    int32_t decoded = 0;
+    ssize_t result = mcpr_decode_varint(&decoded, buf, max_len);
+    if(max_len < expected_size && result != -1) FAIL("mcpr_decode_varint(%d) with maxlen %zu returned %zd instead of failing", value, max_len, result);
+    if(max_len >= expected_size && (result != (ssize_t) expected_size || decoded != value))
+    {
+      FAIL("mcpr_decode_varint(%d) with maxlen %zu returned %zd and %d", value, max_len, result, decoded);
+    }
+    free(buf);
+  }
+}
+
+static void check_varlong(int64_t value)
+{
+  unsigned char expected[MCPR_VARLONG_SIZE_MAX];
+  unsigned char actual[MCPR_VARLONG_SIZE_MAX];
+  size_t expected_size = old_encode_varlong(expected, value);
+  size_t actual_size = mcpr_encode_varlong(actual, value);
+  if(actual_size != expected_size || memcmp(actual, expected, expected_size) != 0) FAIL("mcpr_encode_varlong(%lld) differs", (long long) value);
+  if(mcpr_varlong_bounds(value) != expected_size) FAIL("mcpr_varlong_bounds(%lld) is %zu, not %zu", (long long) value, mcpr_varlong_bounds(value), expected_size);
+
+  for(size_t max_len = 0; max_len <= MCPR_VARLONG_SIZE_MAX; max_len++)
+  {
+    unsigned char *buf = malloc(max_len + 1);
+    if(buf == NULL) FAIL("Out of memory");
+    memcpy(buf, expected, (max_len < expected_size) ? max_len : expected_size);
+    int64_t decoded = 0;
+    ssize_t result = mcpr_decode_varlong(&decoded, buf, max_len);
+    if(max_len < expected_size && result != -1) FAIL("mcpr_decode_varlong(%lld) with maxlen %zu returned %zd instead of failing", (long long) value, max_len, result);
+    if(max_len >= expected_size && (result != (ssize_t) expected_size || decoded != value))
+    {
+      FAIL("mcpr_decode_varlong(%lld) with maxlen %zu returned %zd and %lld", (long long) value, max_len, result, (long long) decoded);
+    }
+    free(buf);
+  }
+}
+
+// Arbitrary bytes, including overlong and unterminated encodings, have to decode the same way as before.
+static void check_random_bytes(void)
+{
+  unsigned char buf[MCPR_VARLONG_SIZE_MAX + 1];
+  for(unsigned int n = 0; n < RANDOM_ITERATIONS; n++)
+  {
+    for(size_t i = 0; i < sizeof(buf); i++)
+    {
+      buf[i] = (unsigned char) rng();
+      if(rng() % 4 == 0) buf[i] |= 0x80; // Make long runs of continuation bits likelier.
+    }
+
+    size_t max_len = (size_t) (rng() % sizeof(buf));
+    uint64_t expected;
+    int32_t varint;
+    ssize_t expected_result = old_decode(&expected, buf, max_len, MCPR_VARINT_SIZE_MAX);
+    ssize_t result = mcpr_decode_varint(&varint, buf, max_len);
+    if(result != expected_result || (result > 0 && varint != (int32_t) (uint32_t) expected)) FAIL("mcpr_decode_varint() differs on random bytes");
+
+    int64_t varlong;
+    expected_result = old_decode(&expected, buf, max_len, MCPR_VARLONG_SIZE_MAX);
+    result = mcpr_decode_varlong(&varlong, buf, max_len);
+    if(result != expected_result || (result > 0 && varlong != (int64_t) expected)) FAIL("mcpr_decode_varlong() differs on random bytes");
+  }
+}
+
+static void check_bulk(void)
+{
+  static int32_t values[BULK_COUNT];
+  static int32_t decoded[BULK_COUNT];
+  static unsigned char expected[BULK_COUNT * 5];
+  static unsigned char actual[BULK_COUNT * 5];
+
+  for(unsigned int round = 0; round < 64; round++)
+  {
+    size_t expected_size = 0;
+    for(size_t i = 0; i < BULK_COUNT; i++)
+    {
+      values[i] = (int32_t) random_value(32);
+      expected_size += old_encode_varint(expected + expected_size, values[i]);
+    }
+
+    if(mcpr_varints_bounds(values, BULK_COUNT) != expected_size) FAIL("mcpr_varints_bounds() differs");
+    size_t actual_size = mcpr_encode_varints(actual, values, BULK_COUNT);
+    if(actual_size != expected_size || memcmp(actual, expected, expected_size) != 0) FAIL("mcpr_encode_varints() differs");
+
+    ssize_t result = mcpr_decode_varints(decoded, BULK_COUNT, expected, expected_size);
+    if(result != (ssize_t) expected_size || memcmp(decoded, values, sizeof(values)) != 0) FAIL("mcpr_decode_varints() differs");
+
+    // Cutting anything off the end has to fail, without reading past maxlen.
+    size_t cut = 1 + (size_t) (rng() % 5);
+    unsigned char *buf = malloc(expected_size - cut);
+    if(buf == NULL) FAIL("Out of memory");
+    memcpy(buf, expected, expected_size - cut);
+    if(mcpr_decode_varints(decoded, BULK_COUNT, buf, expected_size - cut) != -1) FAIL("mcpr_decode_varints() accepted a truncated buffer");
+    free(buf);
+  }
+}
+
+static void check_floats(void)
+{
+  static const unsigned char one_float[4] = { 0x3F, 0x80, 0x00, 0x00 };
+  static const unsigned char one_double[8] = { 0x3F, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+  unsigned char buf[8];
+
+  mcpr_encode_float(buf, 1.0f);
+  if(memcmp(buf, one_float, 4) != 0) FAIL("mcpr_encode_float(1.0) isn't big endian IEEE 754");
+  mcpr_encode_double(buf, 1.0);
+  if(memcmp(buf, one_double, 8) != 0) FAIL("mcpr_encode_double(1.0) isn't big endian IEEE 754");
+
+  float f;
+  double d;
+  mcpr_decode_float(&f, one_float);
+  if(f != 1.0f) FAIL("mcpr_decode_float() of 1.0 returned %f", f);
+  mcpr_decode_double(&d, one_double);
+  if(d != 1.0) FAIL("mcpr_decode_double() of 1.0 returned %f", d);
+
+  static const double values[] = { 0.0, -0.5, 3.25, -1234.0625, 1e30, -1e-30 };
+  for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+  {
+    mcpr_encode_float(buf, (float) values[i]);
+    mcpr_decode_float(&f, buf);
+    if(f != (float) values[i]) FAIL("Float %f didn't survive a round trip", values[i]);
+    mcpr_encode_double(buf, values[i]);
+    mcpr_decode_double(&d, buf);
+    if(d != values[i]) FAIL("Double %f didn't survive a round trip", values[i]);
+  }
+}
+
+int main(void)
+{
+  static const int32_t varint_edges[] = { 0, 1, 127, 128, 255, 16383, 16384, 2097151, 2097152, 268435455, 268435456, INT32_MAX, -1, -2, INT32_MIN };
+  static const int64_t varlong_edges[] = { 0, 1, 127, 128, (1LL << 28) - 1, 1LL << 28, (1LL << 35) - 1, 1LL << 35, (1LL << 56) - 1, 1LL << 56, INT64_MAX, -1, -2, INT64_MIN };
+
+  for(size_t i = 0; i < sizeof(varint_edges) / sizeof(varint_edges[0]); i++) check_varint(varint_edges[i]);
+  for(size_t i = 0; i < sizeof(varlong_edges) / sizeof(varlong_edges[0]); i++) check_varlong(varlong_edges[i]);
+  for(unsigned int i = 0; i < RANDOM_ITERATIONS; i++)
+  {
+    check_varint((int32_t) random_value(32));
+    check_varlong(random_value(64));
+  }
+  check_random_bytes();
+  check_bulk();
+  check_floats();
+
+  printf("varint_test: all checks passed\n");
+  return EXIT_SUCCESS;
+}